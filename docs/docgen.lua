@@ -824,6 +824,10 @@ do -- meta
           assert(func.params, func.name)
           local name = func.method_form:match('^[%w_]+%:([%w_]+)%(')
           local class = func.params[1].type
+          -- an optional first parameter is the object of the method form
+          if type(class) == 'table' and class.kind == 'union' and #class[1] == 2 and class[1][2] == 'nil' then
+            class = class[1][1]
+          end
           assert(type(class) == 'string')
           if write_type(out, class, types[class], true) then
             out:write('local ', class, ' = {}\n\n')
@@ -348,6 +348,7 @@ local types = {
   uv_check_t = cls('uv_handle_t'),
   uv_fs_event_t = cls('uv_handle_t'),
   uv_fs_poll_t = cls('uv_handle_t'),
+  uv_fs_poll_set_t = cls('uv_handle_t'),
   uv_idle_t = cls('uv_handle_t'),
   uv_poll_t = cls('uv_handle_t'),
   uv_prepare_t = cls('uv_handle_t'),
@@ -364,12 +365,24 @@ local types = {
 
   luv_dir_t = cls('userdata'),
   luv_work_ctx_t = cls('userdata'),
+  luv_work_pool_t = cls('userdata'),
+  luv_work_t = cls('userdata'),
   luv_thread_t = cls('userdata'),
   luv_sem_t = cls('userdata'),
+  luv_shared_buffer_t = cls('userdata'),
+  luv_channel_t = cls('userdata'),
+  luv_tcp_token_t = cls('userdata'),
+  luv_listen_group_t = cls('userdata'),
+  luv_atomic_t = cls('userdata'),
+  luv_shared_map_t = cls('userdata'),
+  luv_mutex_t = cls('userdata'),
+  luv_rwlock_t = cls('userdata'),
+  luv_cond_t = cls('userdata'),
+  luv_barrier_t = cls('userdata'),
 
-  threadargs = union('number', 'boolean', 'string', 'userdata'),
+  threadargs = union('number', 'boolean', 'string', 'userdata', 'table'),
 
-  buffer = union('string', 'string[]'),
+  buffer = union('string', 'luv_shared_buffer_t', '(string|luv_shared_buffer_t)[]'),
 
   address = table({
     { 'addr', 'string' },
@@ -534,9 +547,13 @@ local doc = {
             - `fail`: an assertable `nil, string, string` tuple (see [Error Handling][])
             - `callable`: a `function`; or a `table` or `userdata` with a `__call`
               metamethod
-            - `buffer`: a `string` or a sequential `table` of `string`s
+            - `buffer`: a `string`, a `luv_shared_buffer_t`, or a sequential `table` of
+              them
             - `threadargs`: variable arguments (`...`) of type `nil`, `boolean`, `number`,
-              `string`, or `userdata`, numbers of argument limited to 9.
+              `string`, `userdata`, or `table`. Tables are copied with their nested
+              tables, keeping shared and cyclic references within one argument;
+              their keys and values must be of the other types, and metatables are
+              not copied.
           ]],
         },
       },
@@ -570,6 +587,7 @@ local doc = {
           - [`uv_udp_t`][] — UDP handle
           - [`uv_fs_event_t`][] — FS Event handle
           - [`uv_fs_poll_t`][] — FS Poll handle
+          - [`uv_fs_poll_set_t`][] — FS Poll set handle
         - [File system operations][]
         - [Thread pool work scheduling][]
         - [DNS utility functions][]
@@ -881,7 +899,8 @@ local doc = {
           desc = [[
             Cancel a pending request. Fails if the request is executing or has finished
             executing. Only cancellation of `uv_fs_t`, `uv_getaddrinfo_t`,
-            `uv_getnameinfo_t` and `uv_work_t` requests is currently supported.
+            `uv_getnameinfo_t` and `uv_work_t` requests is currently supported, and
+            `luv_work_t` requests from `uv.queue_work()` are accepted too.
           ]],
           params = {
             { name = 'req', type = 'uv_req_t' },
@@ -1429,6 +1448,12 @@ local doc = {
             Unlike other handle initialization functions, this immediately starts
             the handle.
             ]],
+            [[
+            The callback is called once for every `uv.async_send()`, in the order of
+            the sends. With `options.batch`, it is instead called once per wakeup with
+            an array of all the pending messages, each one an array of the values that
+            were sent with their count in `n`.
+            ]],
           },
           params = {
             {
@@ -1437,6 +1462,12 @@ local doc = {
                 { '...', 'threadargs', 'passed to/from `uv.async_send(async, ...)`' },
               }),
             },
+            {
+              name = 'options',
+              type = opt(table({
+                { 'batch', opt_bool },
+              })),
+            },
           },
           returns = ret_or_fail('uv_async_t', 'async'),
         },
@@ -1449,14 +1480,10 @@ local doc = {
               It's safe to call this function from any thread. The callback will be
               called on the loop thread.
             ]],
-          },
-          warnings = {
             [[
-              libuv will coalesce calls to `uv.async_send(async)`, that is, not
-              every call to it will yield an execution of the callback. For example: if
-              `uv.async_send()` is called 5 times in a row before the callback is called, the
-              callback will only be called once. If `uv.async_send()` is called again after
-              the callback was called, it will be called again.
+              libuv will coalesce calls to `uv.async_send(async)` into one wakeup of
+              the loop. The values of every call are queued, so the callback still runs
+              once for each of them, or once with all of them in batch mode.
             ]],
           },
           params = {
@@ -1989,11 +2016,16 @@ local doc = {
         },
         {
           name = 'read_start',
-          method_form = 'stream:read_start(callback)',
+          method_form = 'stream:read_start(callback, [buffer])',
           desc = [[
             Read data from an incoming stream. The callback will be made several times until
             there is no more data to read or `uv.read_stop()` is called. When we've reached
             EOF, `data` will be `nil`.
+
+            With a `buffer`, every read lands at the start of that shared buffer instead of
+            in a new string, and `data` is the number of bytes read. The bytes are only
+            valid until the callback returns, as the next read overwrites them. Calling
+            `uv.read_start()` again without a buffer goes back to strings.
           ]],
           params = {
             { name = 'stream', type = 'uv_stream_t' },
@@ -2001,9 +2033,10 @@ local doc = {
               name = 'callback',
               type = fun({
                 { 'err', opt_str },
-                { 'data', opt_str },
+                { 'data', opt(union('string', 'integer')) },
               }),
             },
+            { name = 'buffer', type = opt('luv_shared_buffer_t') },
           },
           returns = success_ret,
           example = [[
@@ -2196,6 +2229,138 @@ local doc = {
             ]],
           },
         },
+        {
+          name = 'tcp_detach',
+          method_form = 'tcp:detach()',
+          desc = [[
+            Moves the socket of `tcp` into a token and closes the handle. The token can
+            be passed to other threads like a shared buffer, for example from a loop
+            accepting connections to `uv.new_loop_thread()` loops serving them, where
+            `tcp:adopt()` opens it in a new handle. A socket that is never adopted is
+            closed with the token.
+          ]],
+          params = {
+            { name = 'tcp', type = 'uv_tcp_t' },
+          },
+          returns = ret_or_fail('luv_tcp_token_t', 'token'),
+          notes = {
+            [[
+              Data already read by libuv but not yet delivered is lost, so detach
+              before reading. Not supported on Windows.
+            ]],
+          },
+        },
+        {
+          name = 'tcp_adopt',
+          method_form = 'tcp:adopt(token)',
+          desc = [[
+            Opens the socket of a token from `tcp:detach()` in `tcp`, which must be a new
+            handle, and returns `tcp`. A token can only be adopted once, it fails with
+            `EBADF` afterwards.
+          ]],
+          params = {
+            { name = 'tcp', type = 'uv_tcp_t' },
+            { name = 'token', type = 'luv_tcp_token_t' },
+          },
+          returns = ret_or_fail('uv_tcp_t', 'tcp'),
+        },
+        {
+          name = 'tcp_listen_group',
+          desc = [[
+            Starts `count` threads, each running its own loop like `uv.new_loop_thread()`
+            and listening on `host` and `port` with its own socket, bound with the
+            `reuseport` flag of `uv.tcp_bind()`. The kernel spreads the connections
+            between the sockets, so every thread accepts and serves its share without
+            going through the calling loop.
+
+            `init` is called in each thread with the 1-based index of the thread and must
+            return the function to call with each accepted `uv_tcp_t`. Like in
+            `uv.new_loop_thread()`, `thread:post()` calls globals of the threads, which
+            `group:threads()` returns.
+
+            A port of `0` is resolved once, all threads listen on the same port, see
+            `group:getsockname()`.
+          ]],
+          params = {
+            { name = 'host', type = 'string' },
+            { name = 'port', type = 'integer' },
+            { name = 'count', type = 'integer' },
+            { name = 'init', type = 'function|string' },
+            {
+              name = 'options',
+              type = opt(table({
+                { 'backlog', opt_int, '128' },
+              })),
+            },
+          },
+          returns = ret_or_fail('luv_listen_group_t', 'group'),
+          notes = {
+            [[
+              Needs `SO_REUSEPORT`, so it fails with `ENOTSUP` on Windows. The threads
+              start listening shortly after this returns, see `listening` in
+              `group:metrics()`. Keep a reference to the group, collecting it stops it.
+            ]],
+          },
+        },
+        {
+          name = 'listen_group_stop',
+          method_form = 'group:stop([timeout])',
+          desc = [[
+            Stops the group gracefully: each thread stops accepting and its loop ends
+            once the connections it accepted are closed, or after `timeout` milliseconds,
+            5000 by default. A `timeout` of `0` waits for the connections however long
+            they stay open. The address is released right away.
+
+            Collecting the group stops it the same way with the default timeout, and
+            `thread:stop()` on one of its threads ends that thread right away.
+          ]],
+          params = {
+            { name = 'group', type = 'luv_listen_group_t' },
+            { name = 'timeout', type = opt_int },
+          },
+        },
+        {
+          name = 'listen_group_metrics',
+          method_form = 'group:metrics()',
+          desc = [[
+            Returns the connections accepted by all threads, the failed accepts, how many
+            threads are listening and how many are still running, along with the same
+            counts for each thread in `shards`.
+          ]],
+          params = {
+            { name = 'group', type = 'luv_listen_group_t' },
+          },
+          returns = {
+            {
+              table({
+                { 'accepted', 'integer' },
+                { 'errors', 'integer' },
+                { 'listening', 'integer' },
+                { 'running', 'integer' },
+                { 'shards', 'table[]' },
+              }),
+              'metrics',
+            },
+          },
+        },
+        {
+          name = 'listen_group_threads',
+          method_form = 'group:threads()',
+          desc = 'Returns the threads of the group, in the order of their index.',
+          params = {
+            { name = 'group', type = 'luv_listen_group_t' },
+          },
+          returns = { { 'luv_thread_t[]', 'threads' } },
+        },
+        {
+          name = 'listen_group_getsockname',
+          method_form = 'group:getsockname()',
+          desc = 'Get the address the group listens on.',
+          params = {
+            { name = 'group', type = 'luv_listen_group_t' },
+          },
+          returns = { { 'socketinfo', 'address' } },
+        },
         {
           name = 'tcp_nodelay',
           method_form = 'tcp:nodelay(enable)',
@@ -2250,8 +2415,11 @@ local doc = {
           method_form = 'tcp:bind(host, port, [flags])',
           desc = [[
             Bind the handle to an host and port. `host` should be an IP address and
-            not a domain name. Any `flags` are set with a table with field `ipv6only`
-            equal to `true` or `false`.
+            not a domain name. Any `flags` are set with a table with fields `ipv6only`
+            and `reuseport` equal to `true` or `false`. With `reuseport`, sockets of any
+            process or thread that also set it can bind the same address, and the kernel
+            spreads the incoming connections between those listening. Before libuv
+            1.49.0 the handle must have been created with a family, see `uv.new_tcp()`.
 
             When the port is already taken, you can expect to see an `EADDRINUSE` error
             from either `uv.tcp_bind()`, `uv.listen()` or `uv.tcp_connect()`. That is, a
@@ -2269,6 +2437,7 @@ local doc = {
               name = 'flags',
               type = opt(table({
                 { 'ipv6only', 'boolean' },
+                { 'reuseport', 'boolean' },
               })),
             },
           },
@@ -3207,6 +3376,19 @@ local doc = {
           desc = [[
             Start the handle with the given callback, which will watch the specified path
             for changes.
+
+            If `debounce_ms` or `coalesce` is set, events are collected per filename and
+            delivered once per window of `debounce_ms` milliseconds (default `0`, i.e. on
+            the next loop iteration) instead of once per event. With `coalesce` the
+            callback is called once per window as `callback(err, batch)`, where `batch`
+            maps each filename to its merged `events` table. Without it, the callback is
+            called once per distinct filename. Events still pending when the handle is
+            stopped are dropped.
+
+            With `recursive`, the whole directory tree below `path` is watched and
+            `filename` is relative to `path`. On Linux, where libuv only watches the top
+            level directory, luv uses a single inotify instance with a watch per directory
+            and starts watching new subdirectories as they are created.
           ]],
           params = {
             { name = 'fs_event', type = 'uv_fs_event_t' },
@@ -3217,6 +3399,8 @@ local doc = {
                 { 'watch_entry', opt_bool, 'false' },
                 { 'stat', opt_bool, 'false' },
                 { 'recursive', opt_bool, 'false' },
+                { 'debounce_ms', opt_int },
+                { 'coalesce', opt_bool, 'false' },
               }),
             },
             cb_err({
@@ -3306,6 +3490,106 @@ local doc = {
         },
       },
     },
+    {
+      title = '`uv_fs_poll_set_t` - FS Poll set handle',
+      id = 'uv_fs_poll_set_t--fs-poll-set-handle',
+      class = 'uv_fs_poll_set_t',
+      desc = [[
+        > [`uv_handle_t`][] functions also apply.
+
+        FS Poll set handles monitor many paths with `stat` like [`uv_fs_poll_t`][],
+        but with a single timer for all of them. Every `interval` milliseconds the
+        paths are stat'ed in batches on the threadpool and the paths that changed
+        since the previous round are reported together in one callback.
+      ]],
+      funcs = {
+        {
+          name = 'new_fs_poll_set',
+          desc = [[
+            Creates and initializes a new `uv_fs_poll_set_t` that checks its paths every
+            `interval` milliseconds. Returns the Lua userdata wrapping it.
+          ]],
+          params = {
+            { name = 'interval', type = 'integer' },
+          },
+          returns = ret_or_fail('uv_fs_poll_set_t', 'fs_poll_set'),
+        },
+        {
+          name = 'fs_poll_set_add',
+          method_form = 'fs_poll_set:add(path)',
+          desc = [[
+            Add `path` to the set. It is checked from the next round on; like
+            `uv.fs_poll_start()`, the first check is only reported if it fails. Adding
+            a path that is already in the set fails with `EEXIST`.
+          ]],
+          params = {
+            { name = 'fs_poll_set', type = 'uv_fs_poll_set_t' },
+            { name = 'path', type = 'string' },
+          },
+          returns = success_ret,
+        },
+        {
+          name = 'fs_poll_set_remove',
+          method_form = 'fs_poll_set:remove(path)',
+          desc = [[
+            Remove `path` from the set. Removing a path that is not in the set fails with
+            `ENOENT`.
+          ]],
+          params = {
+            { name = 'fs_poll_set', type = 'uv_fs_poll_set_t' },
+            { name = 'path', type = 'string' },
+          },
+          returns = success_ret,
+        },
+        {
+          name = 'fs_poll_set_start',
+          method_form = 'fs_poll_set:start(callback)',
+          desc = [[
+            Start checking the paths in the set. The callback is called once per round
+            in which at least one path changed, with a list of the changes. Each entry
+            has the `path`, and the `prev` and `curr` stat tables (see `uv.fs_stat`) when
+            the path could be stat'ed before and now. `err` is set instead of `curr` when
+            the path can no longer be stat'ed.
+          ]],
+          params = {
+            { name = 'fs_poll_set', type = 'uv_fs_poll_set_t' },
+            cb({
+              {
+                'changes',
+                dict(
+                  'integer',
+                  table({
+                    { 'path', 'string' },
+                    { 'prev', opt('table') },
+                    { 'curr', opt('table') },
+                    { 'err', opt_str },
+                  })
+                ),
+              },
+            }),
+          },
+          returns = success_ret,
+        },
+        {
+          name = 'fs_poll_set_stop',
+          method_form = 'fs_poll_set:stop()',
+          desc = 'Stop the handle, the callback will no longer be called.',
+          params = {
+            { name = 'fs_poll_set', type = 'uv_fs_poll_set_t' },
+          },
+          returns = success_ret,
+        },
+        {
+          name = 'fs_poll_set_getpaths',
+          method_form = 'fs_poll_set:getpaths()',
+          desc = 'Get the paths in the set, in sorted order.',
+          params = {
+            { name = 'fs_poll_set', type = 'uv_fs_poll_set_t' },
+          },
+          returns = 'string[]',
+        },
+      },
+    },
     {
       title = 'File system operations',
       id = 'file-system-operations',
@@ -3370,6 +3654,8 @@ local doc = {
               Equivalent to `open(2)`. Access `flags` may be an integer or one of: `"r"`,
               `"rs"`, `"sr"`, `"r+"`, `"rs+"`, `"sr+"`, `"w"`, `"wx"`, `"xw"`, `"w+"`,
               `"wx+"`, `"xw+"`, `"a"`, `"ax"`, `"xa"`, `"a+"`, `"ax+"`, or "`xa+`".
+              Any of these may be suffixed with `"d"` (e.g. `"rd"` or `"w+d"`) to open
+              the file for direct I/O (`O_DIRECT`), bypassing the page cache.
             ]],
           params = {
             { name = 'path', type = 'string' },
@@ -3389,6 +3675,12 @@ local doc = {
                 opened in binary mode. Because of this, the `O_BINARY` and `O_TEXT` flags are
                 not supported.
               ]],
+            [[
+                Direct I/O requires reads and writes to be a multiple of the device
+                block size. On descriptors opened this way, `uv.fs_read()` aligns its
+                buffer when `size` is a multiple of 512, and `uv.fs_write()` copies such
+                writes into an aligned buffer.
+              ]],
           },
         },
         {
@@ -3396,17 +3688,20 @@ local doc = {
           desc = [[
               Equivalent to `preadv(2)`. Returns any data. An empty string indicates EOF.
 
+              If a shared buffer or a slice of one is given instead of `size`, the data is
+              read into it in place and the number of bytes read is returned, 0 at EOF.
+
               If `offset` is nil or omitted, it will default to `-1`, which indicates 'use and update the current file offset.'
 
               **Note:** When `offset` is >= 0, the current file offset will not be updated by the read.
             ]],
           params = {
             { name = 'fd', type = 'integer' },
-            { name = 'size', type = 'integer' },
+            { name = 'size', type = union('integer', 'luv_shared_buffer_t') },
             { name = 'offset', type = opt_int },
-            async_cb({ { 'data', opt_str } }),
+            async_cb({ { 'data', opt(union('string', 'integer')) } }),
           },
-          returns_sync = ret_or_fail('string', 'data'),
+          returns_sync = ret_or_fail(union('string', 'integer'), 'data'),
           returns_async = 'uv_fs_t',
         },
         {
@@ -3599,6 +3894,41 @@ local doc = {
           returns_sync = ret_or_fail('boolean', 'success'),
           returns_async = 'uv_fs_t',
         },
+        {
+          name = 'fs_fallocate',
+          desc = [[
+              Equivalent to `posix_fallocate(3)`. Ensures disk space is allocated for
+              the byte range `offset` to `offset + length`, growing the file if needed.
+              Fails with `ENOSYS` on platforms that do not support it.
+            ]],
+          params = {
+            { name = 'fd', type = 'integer' },
+            { name = 'offset', type = 'integer' },
+            { name = 'length', type = 'integer' },
+            async_cb(),
+          },
+          returns_sync = ret_or_fail('boolean', 'success'),
+          returns_async = 'uv_work_t',
+        },
+        {
+          name = 'fs_fadvise',
+          desc = [[
+              Equivalent to `posix_fadvise(2)`. Announces the intended access pattern
+              for the byte range `offset` to `offset + length`; a `length` of 0 means
+              until the end of the file. `advice` may be an integer or one of:
+              `"normal"`, `"sequential"`, `"random"`, `"willneed"`, `"dontneed"`, or
+              `"noreuse"`. Fails with `ENOSYS` on platforms that do not support it.
+            ]],
+          params = {
+            { name = 'fd', type = 'integer' },
+            { name = 'offset', type = 'integer' },
+            { name = 'length', type = 'integer' },
+            { name = 'advice', type = 'string|integer' },
+            async_cb(),
+          },
+          returns_sync = ret_or_fail('boolean', 'success'),
+          returns_async = 'uv_work_t',
+        },
         {
           name = 'fs_sendfile',
           desc = [[
@@ -3840,6 +4170,81 @@ local doc = {
           returns_sync = ret_or_fail('boolean', 'success'),
           returns_async = 'uv_fs_t',
         },
+        {
+          name = 'fs_copy_range',
+          desc = [[
+              Copies `length` bytes from `in_fd` starting at `offset` to `out_fd`, using
+              `copy_file_range(2)` where available and a read/write loop otherwise. Neither
+              file position is changed. The copy is split into chunks of `chunk_size`
+              bytes, each of which runs as its own threadpool job, and `on_progress` is
+              called with the bytes copied so far after each chunk. The data is written
+              at `offset` in `out_fd` unless `out_offset` is given. Returns the number of
+              bytes copied, which is less than `length` if the end of `in_fd` is reached.
+              If the `options` parameter is omitted, then the 5th parameter will be
+              treated as the `callback`.
+            ]],
+          params = {
+            { name = 'in_fd', type = 'integer' },
+            { name = 'out_fd', type = 'integer' },
+            { name = 'offset', type = 'integer' },
+            { name = 'length', type = 'integer' },
+            {
+              name = 'options',
+              type = opt(table({
+                { 'out_offset', opt_int },
+                { 'chunk_size', opt_int, '8 MiB' },
+                { 'on_progress', opt(fun({ { 'copied', 'integer' }, { 'total', 'integer' } })) },
+              })),
+            },
+            async_cb({ { 'bytes', opt_int } }),
+          },
+          returns_sync = ret_or_fail('integer', 'bytes'),
+          returns_async = 'uv_work_t',
+        },
+        {
+          name = 'fs_copy_tree',
+          desc = [[
+              Recursively copies the file or directory `src` to `dst`. Directories are
+              created and symlinks recreated while scanning the source on the threadpool,
+              then regular files are copied with at most `concurrency` files in flight,
+              one `chunk_size` chunk per threadpool job so that large copies don't starve
+              other threadpool users. File and directory modes are preserved, directory
+              modes are applied once all files are copied. A `dst` inside `src` fails
+              with `EINVAL`.
+
+              `reflink` selects whether files are cloned (e.g. with `FICLONE` on Linux or
+              `clonefile` on macOS) instead of copied: `"auto"` tries a clone and falls
+              back to copying, `"always"` fails if the clone fails and `"never"` always
+              copies.
+
+              `on_progress` is called with the total bytes copied so far and the total
+              size of all files after each chunk. `callback` is called once the copy is
+              done, or after the first error once in-flight chunks have finished.
+            ]],
+          params = {
+            { name = 'src', type = 'string' },
+            { name = 'dst', type = 'string' },
+            {
+              name = 'options',
+              type = opt(table({
+                { 'concurrency', opt_int, '4' },
+                { 'reflink', opt(union('string', 'boolean')), '"auto"' },
+                { 'chunk_size', opt_int, '8 MiB' },
+                { 'on_progress', opt(fun({ { 'copied', 'integer' }, { 'total', 'integer' } })) },
+              })),
+            },
+            cb_err({
+              {
+                'result',
+                opt(table({
+                  { 'files', 'integer' },
+                  { 'bytes', 'integer' },
+                })),
+              },
+            }),
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
         {
           name = 'fs_opendir',
           desc = [[
@@ -3934,6 +4339,13 @@ local doc = {
             Creates and initializes a new `luv_work_ctx_t` (not `uv_work_t`).
             `work_callback` is a Lua function or a string containing Lua code or bytecode dumped from a function.
             Returns the Lua userdata wrapping it.
+
+            If `options.pool` is a pool from `uv.new_work_pool()`, work queued with the
+            context runs on the threads of that pool instead of the libuv threadpool.
+
+            If `options.on_progress` is given, it is called in the main loop thread with
+            the values that `work_callback` passes to `uv.work_report()`, in order and
+            before `after_work_callback` of the same request.
           ]],
           params = {
             {
@@ -3951,6 +4363,18 @@ local doc = {
                 { '...', 'threadargs', 'returned from `work_callback`' },
               }),
             },
+            {
+              name = 'options',
+              type = opt(table({
+                { 'pool', opt('luv_work_pool_t') },
+                {
+                  'on_progress',
+                  opt(fun({
+                    { '...', 'threadargs', 'passed to `uv.work_report()`' },
+                  })),
+                },
+              })),
+            },
           },
           returns = 'luv_work_ctx_t',
         },
@@ -3962,59 +4386,340 @@ local doc = {
             thread from the threadpool with any additional arguments from `...`. Values
             returned from `work_callback` are passed to `after_work_callback`, which is
             called in the main loop thread.
+
+            Returns a `luv_work_t` that can cancel the request while it is still queued.
+            A cancelled request calls `after_work_callback` with `nil, err, name`
+            (`ECANCELED`) instead of the values returned from `work_callback`.
           ]],
           params = {
             { name = 'work_ctx', type = 'luv_work_ctx_t' },
             { name = '...', type = 'threadargs' },
           },
-          returns = ret_or_fail('boolean', 'success'),
+          returns = ret_or_fail('luv_work_t', 'work'),
         },
-      },
-    },
-    {
-      title = 'DNS utility functions',
-      id = 'dns-utility-functions',
-      funcs = {
         {
-          name = 'getaddrinfo',
+          name = 'work_report',
           desc = [[
-            Equivalent to `getaddrinfo(3)`. Either `node` or `service` may be `nil` but not
-            both.
-
-            See [Constants][] for supported address `family` input and output values.
+            Sends `...` to `options.on_progress` of the context of the running request.
+            It must be called from `work_callback`, returns immediately, and does nothing
+            if the context has no `on_progress`.
+          ]],
+          params = {
+            { name = '...', type = 'threadargs' },
+          },
+        },
+        {
+          name = 'parallel_map',
+          desc = [[
+            Calls `fn` on every element of the array `items` on the threadpool and calls
+            `callback` with the array of results, in the order of `items`.
 
-            See [Constants][] for supported `socktype` input and output values.
+            The elements are sent in chunks of `options.chunk` elements, each chunk as
+            one work request, so they are copied once per chunk rather than one by one.
+            By default there are about four chunks per thread. `options.pool` runs the
+            chunks on a pool from `uv.new_work_pool()`, and `options.on_progress` is
+            passed to `uv.new_work()`.
 
-            When `protocol` is set to 0 or nil, it will be automatically chosen based on the
-            socket's domain and type. When `protocol` is specified as a string, it will be
-            looked up using the `getprotobyname(3)` function. Examples: `"ip"`, `"icmp"`,
-            `"tcp"`, `"udp"`, etc.
+            If `fn` raises an error, `callback` is called with the error message instead.
           ]],
           params = {
-            { name = 'host', type = opt_str },
-            { name = 'service', type = opt_str },
             {
-              name = 'hints',
+              name = 'fn',
+              type = union(
+                'string',
+                fun({
+                  { 'item', 'any' },
+                })
+              ),
+            },
+            { name = 'items', type = 'table' },
+            {
+              name = 'options',
               type = opt(table({
-                { 'family', opt(union('string', 'integer')) },
-                { 'socktype', opt(union('string', 'integer')) },
-                { 'protocol', opt(union('string', 'integer')) },
-                { 'addrconfig', opt_bool },
-                { 'v4mapped', opt_bool },
-                { 'all', opt_bool },
-                { 'numerichost', opt_bool },
-                { 'passive', opt_bool },
-                { 'numericserv', opt_bool },
-                { 'canonname', opt_bool },
+                { 'chunk', opt_int },
+                { 'pool', opt('luv_work_pool_t') },
               })),
             },
-            async_cb({ { 'addresses', opt(dict('integer', 'address')) } }),
+            {
+              name = 'callback',
+              type = fun({
+                { 'err', opt_str },
+                { 'results', opt('table') },
+              }),
+            },
           },
-          returns_sync = ret_or_fail(dict('integer', 'address'), 'addresses'),
-          returns_async = ret_or_fail('uv_getaddrinfo_t', 'addrinfo'),
+          returns = ret_or_fail('boolean', 'success'),
         },
         {
-          name = 'getnameinfo',
+          name = 'parallel_reduce',
+          desc = [[
+            Like `uv.parallel_map()` with `map_fn`, then folds the results in order with
+            `reduce_fn` in the main loop thread, starting from the first result, and
+            calls `callback` with the final value.
+          ]],
+          params = {
+            {
+              name = 'map_fn',
+              type = union(
+                'string',
+                fun({
+                  { 'item', 'any' },
+                })
+              ),
+            },
+            {
+              name = 'reduce_fn',
+              type = fun({
+                { 'accumulator', 'any' },
+                { 'value', 'any' },
+              }),
+            },
+            { name = 'items', type = 'table' },
+            {
+              name = 'options',
+              type = opt(table({
+                { 'chunk', opt_int },
+                { 'pool', opt('luv_work_pool_t') },
+              })),
+            },
+            {
+              name = 'callback',
+              type = fun({
+                { 'err', opt_str },
+                { 'result', 'any' },
+              }),
+            },
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'work_metrics',
+          desc = [[
+            Returns counters of the requests queued with `work_ctx`, or of all requests
+            in the process when it is omitted.
+
+            `queued`, `running` and `cancelled` count requests. Finished requests are
+            counted in `errors` if `work_callback` raised an error, else in `completed`.
+            `wait_total` and `run_total` are the total time spent waiting in the queue and
+            running, in milliseconds. `wait_hist` and `run_hist` are histograms of the
+            same times: entry `i` counts the durations under `2^(i-1)` microseconds that
+            are not counted in an earlier entry, and the last entry also counts longer
+            durations.
+
+            `vms` is the number of worker Lua states that run the requests (of the
+            threadpool of this state, or of the pool of `work_ctx`), `heaps` the Lua heap
+            size of each of them in bytes after its last request, and `heap` their sum.
+          ]],
+          params = {
+            { name = 'work_ctx', type = opt('luv_work_ctx_t') },
+          },
+          returns = {
+            {
+              table({
+                { 'queued', 'integer' },
+                { 'running', 'integer' },
+                { 'completed', 'integer' },
+                { 'errors', 'integer' },
+                { 'cancelled', 'integer' },
+                { 'wait_total', 'number' },
+                { 'run_total', 'number' },
+                { 'wait_hist', 'integer[]' },
+                { 'run_hist', 'integer[]' },
+                { 'vms', 'integer' },
+                { 'heap', 'integer' },
+                { 'heaps', 'integer[]' },
+              }),
+              'metrics',
+            },
+          },
+        },
+        {
+          name = 'cancel_work',
+          method_form = 'work:cancel()',
+          desc = [[
+            Cancels a request from `uv.queue_work()` that has not started running. Fails
+            with `EBUSY` if it is running or has completed. `uv.cancel(work)` is the
+            same.
+          ]],
+          params = {
+            { name = 'work', type = 'luv_work_t' },
+          },
+          returns = success_ret,
+        },
+        {
+          name = 'queue_work_many',
+          method_form = 'work_ctx:queue_many(args_list, [on_each], [on_done])',
+          desc = [[
+            Queues one work request per element of `args_list`, passing the element as
+            the only argument of `work_callback`. This is cheaper than calling
+            `work_ctx:queue()` for each element: the requests share one allocation and
+            the arguments are not referenced one by one.
+
+            `on_each` is called with the index of the element and the values returned
+            for it, in completion order, instead of `after_work_callback`. `on_done` is
+            called once all requests have completed, with an array holding the first
+            value returned for each element, in the order of `args_list`.
+
+            If a request can't be queued the whole call fails: the requests queued so
+            far are cancelled, those that already started run to completion, and
+            neither `on_each` nor `on_done` is called.
+          ]],
+          params = {
+            { name = 'work_ctx', type = 'luv_work_ctx_t' },
+            { name = 'args_list', type = 'table' },
+            {
+              name = 'on_each',
+              type = opt(fun({
+                { 'index', 'integer' },
+                { '...', 'threadargs', 'returned from `work_callback`' },
+              })),
+            },
+            {
+              name = 'on_done',
+              type = opt(fun({
+                { 'results', 'table' },
+              })),
+            },
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'new_work_pool',
+          desc = [[
+            Creates a pool of `threads` worker threads, separate from the libuv
+            threadpool, so that CPU heavy Lua work does not delay file system and DNS
+            requests. Each thread keeps its own Lua state for the lifetime of the pool.
+            `threads` defaults to `uv.available_parallelism()`, `name` is used as the
+            thread name and `priority` as the thread priority (see
+            `uv.thread_setpriority()`) where supported. Use the pool with the `pool`
+            option of `uv.new_work()`.
+
+            The threads are joined when the pool is garbage collected; jobs already
+            queued are run first.
+          ]],
+          params = {
+            {
+              name = 'options',
+              type = opt(table({
+                { 'threads', opt_int },
+                { 'name', opt_str },
+                { 'priority', opt_int },
+              })),
+            },
+          },
+          returns = ret_or_fail('luv_work_pool_t', 'pool'),
+        },
+        {
+          name = 'work_pool_stats',
+          method_form = 'pool:stats()',
+          desc = [[
+            Returns the number of threads, the number of queued and running jobs, the
+            number of completed jobs, and the average and maximum time completed jobs
+            waited in the queue and ran, in milliseconds.
+          ]],
+          params = {
+            { name = 'pool', type = 'luv_work_pool_t' },
+          },
+          returns = {
+            {
+              table({
+                { 'threads', 'integer' },
+                { 'queued', 'integer' },
+                { 'running', 'integer' },
+                { 'completed', 'integer' },
+                { 'wait_avg', 'number' },
+                { 'wait_max', 'number' },
+                { 'run_avg', 'number' },
+                { 'run_max', 'number' },
+              }),
+              'stats',
+            },
+          },
+        },
+        {
+          name = 'set_work_init',
+          desc = [[
+            Sets a function that runs once in every worker Lua state before its next job,
+            both in the libuv threadpool and in pools from `uv.new_work_pool()`. Use it
+            to `require` modules or build lookup tables once per state instead of on
+            every job. `init_callback` is a Lua function or a string containing Lua code
+            or bytecode dumped from a function. Setting a new function runs it again in
+            every state; `nil` removes it.
+          ]],
+          params = {
+            { name = 'init_callback', type = opt(union('string', fun({}))) },
+          },
+          returns = success_ret,
+        },
+        {
+          name = 'warm_work_pool',
+          method_form = 'pool:warm([callback])',
+          desc = [[
+            Creates the Lua state of every thread in the libuv threadpool and runs the
+            function set with `uv.set_work_init()` in it now instead of on the first job.
+            `callback` is called once all states are ready. Only one warm up of the
+            threadpool can run at a time, otherwise this fails with `EBUSY`.
+
+            With `pool`, warms up the threads of a pool from `uv.new_work_pool()`
+            instead, whose Lua states already exist.
+
+            **Note:** The warm up occupies every thread of the threadpool until all of
+            them have picked up their part, so other requests wait until then. The
+            number of threads is taken from `UV_THREADPOOL_SIZE` when luv is first
+            loaded, as libuv reads it only once.
+          ]],
+          params = {
+            { name = 'pool', type = opt('luv_work_pool_t') },
+            cb(nil, true),
+          },
+          returns = success_ret,
+        },
+      },
+    },
+    {
+      title = 'DNS utility functions',
+      id = 'dns-utility-functions',
+      funcs = {
+        {
+          name = 'getaddrinfo',
+          desc = [[
+            Equivalent to `getaddrinfo(3)`. Either `node` or `service` may be `nil` but not
+            both.
+
+            See [Constants][] for supported address `family` input and output values.
+
+            See [Constants][] for supported `socktype` input and output values.
+
+            When `protocol` is set to 0 or nil, it will be automatically chosen based on the
+            socket's domain and type. When `protocol` is specified as a string, it will be
+            looked up using the `getprotobyname(3)` function. Examples: `"ip"`, `"icmp"`,
+            `"tcp"`, `"udp"`, etc.
+          ]],
+          params = {
+            { name = 'host', type = opt_str },
+            { name = 'service', type = opt_str },
+            {
+              name = 'hints',
+              type = opt(table({
+                { 'family', opt(union('string', 'integer')) },
+                { 'socktype', opt(union('string', 'integer')) },
+                { 'protocol', opt(union('string', 'integer')) },
+                { 'addrconfig', opt_bool },
+                { 'v4mapped', opt_bool },
+                { 'all', opt_bool },
+                { 'numerichost', opt_bool },
+                { 'passive', opt_bool },
+                { 'numericserv', opt_bool },
+                { 'canonname', opt_bool },
+              })),
+            },
+            async_cb({ { 'addresses', opt(dict('integer', 'address')) } }),
+          },
+          returns_sync = ret_or_fail(dict('integer', 'address'), 'addresses'),
+          returns_async = ret_or_fail('uv_getaddrinfo_t', 'addrinfo'),
+        },
+        {
+          name = 'getnameinfo',
           desc = [[
             Equivalent to `getnameinfo(3)`.
 
@@ -4196,6 +4901,152 @@ local doc = {
           },
           returns = ret_or_fail('boolean', 'success'),
         },
+        {
+          name = 'new_loop_thread',
+          desc = [[
+            Starts a thread with its own Lua state and event loop, for running one loop
+            per core. `init` is called in the thread with the arguments `...`, like the
+            entry of `uv.new_thread()`. It can set up handles in the thread loop, and
+            returns a table of functions that `thread:post()` calls by name, or nothing
+            to make `thread:post()` call globals. The loop then runs until
+            `thread:stop()` is called or it stops by itself.
+
+            When `options.cpu` is set, the thread is pinned to that CPU, numbered from 1
+            like `uv.thread_getcpu()` does. The result is the same as `thread:setaffinity()`
+            with only that CPU set.
+
+            A running loop thread keeps the calling loop alive.
+          ]],
+          params = {
+            { name = 'init', type = 'function|string' },
+            {
+              name = 'options',
+              type = opt(table({
+                { 'cpu', opt_int },
+              })),
+            },
+            { name = '...', type = 'threadargs', desc = 'passed to `init`' },
+          },
+          returns = ret_or_fail('luv_thread_t', 'thread'),
+        },
+        {
+          name = 'thread_post',
+          method_form = 'thread:post(name, ..., [callback])',
+          desc = [[
+            Calls the function `name` of a thread from `uv.new_loop_thread()` with the
+            arguments `...`, inside its loop. Posts run in the order they were made.
+
+            If `callback` is given, it is called in the calling loop with the values
+            returned by the function, or with the error it raised. Callbacks of posts
+            that never ran because the thread stopped receive an `ECANCELED` error.
+
+            Fails with `EPIPE` once the thread is stopping.
+          ]],
+          params = {
+            { name = 'thread', type = 'luv_thread_t' },
+            { name = 'name', type = 'string' },
+            {
+              name = '...',
+              type = 'threadargs',
+              desc = 'optionally followed by `callback(err, ...)`',
+            },
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'thread_stop',
+          method_form = 'thread:stop()',
+          desc = [[
+            Stops the loop of a thread from `uv.new_loop_thread()` once the posts
+            already made have run, even if a graceful stop is already waiting for its
+            handles. Handles left in the loop are closed when the thread closes its Lua
+            state, then the thread ends.
+          ]],
+          params = {
+            { name = 'thread', type = 'luv_thread_t' },
+          },
+        },
+        {
+          name = 'thread_vm_pool',
+          desc = [[
+            Keeps up to `max` Lua states of finished threads for the next
+            `uv.new_thread()` and `uv.new_loop_thread()`, instead of creating a new
+            state for each thread. `0`, the default, disables the pool and releases the
+            states it holds. The pool is shared by the whole process.
+
+            A state is reused with the globals and loaded modules it was created with,
+            changes made inside them (like new fields of `string`) are kept. States that
+            leave handles in their loop are not reused.
+          ]],
+          params = {
+            { name = 'max', type = 'integer' },
+          },
+          returns = success_ret,
+          notes = {
+            [[
+              Embedders can enable it with `luv_set_thread_vm_pool()`. States still come
+              from the callbacks given to `luv_set_thread_cb()`.
+            ]],
+          },
+        },
+        {
+          name = 'thread_vm_stats',
+          desc = [[
+            Returns how many Lua states threads created and reused, with the number of
+            states waiting in the pool and its `max`, see `uv.thread_vm_pool()`.
+          ]],
+          returns = {
+            {
+              table({
+                { 'created', 'integer' },
+                { 'reused', 'integer' },
+                { 'idle', 'integer' },
+                { 'max', 'integer' },
+              }),
+              'stats',
+            },
+          },
+        },
+        {
+          name = 'thread_vm_alloc',
+          desc = [[
+            Makes luv create the Lua states of later threads and work with their own
+            allocator. Freed blocks of up to 256 bytes are kept per size class for the
+            next allocation of the state, without locking, instead of going through a
+            `malloc` shared by every thread. Larger blocks still use `malloc`. Returns the
+            previous setting.
+          ]],
+          params = {
+            { name = 'enabled', type = 'boolean' },
+          },
+          returns = 'boolean',
+          notes = {
+            [[
+              Embedders can enable it with `luv_set_thread_vm_alloc()`. It only applies to
+              the states made by the default `luv_set_thread_cb()` callbacks. Threads of
+              `uv.new_work()` keep their state, so set it before queuing any work. LuaJIT
+              builds without GC64 keep their own allocator on 64-bit.
+            ]],
+          },
+        },
+        {
+          name = 'thread_vm_alloc_stats',
+          desc = [[
+            Returns the bytes the calling Lua state uses, the most it used at once, and
+            the bytes its allocator holds for small blocks. Returns `nil` for states not
+            using the allocator of `uv.thread_vm_alloc()`.
+          ]],
+          returns = {
+            {
+              opt(table({
+                { 'bytes', 'integer' },
+                { 'peak', 'integer' },
+                { 'reserved', 'integer' },
+              })),
+              'stats',
+            },
+          },
+        },
         {
           name = 'thread_detach',
           method_form = 'thread:detach()',
@@ -4296,6 +5147,605 @@ local doc = {
           },
           returns = 'boolean',
         },
+        {
+          name = 'new_atomic',
+          desc = [[
+            Creates an integer that threads update with atomic operations instead of a
+            lock, for counters and flags. Like a shared buffer, it is passed by reference
+            to `uv.new_thread()`, `uv.queue_work()` and `uv.async_send()`.
+          ]],
+          params = {
+            { name = 'initial', type = opt_int, default = '0' },
+          },
+          returns = 'luv_atomic_t',
+        },
+        {
+          name = 'atomic_load',
+          method_form = 'atomic:load()',
+          desc = 'Returns the value.',
+          params = {
+            { name = 'atomic', type = 'luv_atomic_t' },
+          },
+          returns = 'integer',
+        },
+        {
+          name = 'atomic_store',
+          method_form = 'atomic:store(value)',
+          desc = 'Sets the value.',
+          params = {
+            { name = 'atomic', type = 'luv_atomic_t' },
+            { name = 'value', type = 'integer' },
+          },
+        },
+        {
+          name = 'atomic_add',
+          method_form = 'atomic:add([n])',
+          desc = 'Adds `n` to the value and returns the result.',
+          params = {
+            { name = 'atomic', type = 'luv_atomic_t' },
+            { name = 'n', type = opt_int, default = '1' },
+          },
+          returns = 'integer',
+        },
+        {
+          name = 'atomic_sub',
+          method_form = 'atomic:sub([n])',
+          desc = 'Subtracts `n` from the value and returns the result.',
+          params = {
+            { name = 'atomic', type = 'luv_atomic_t' },
+            { name = 'n', type = opt_int, default = '1' },
+          },
+          returns = 'integer',
+        },
+        {
+          name = 'atomic_cas',
+          method_form = 'atomic:cas(expected, desired)',
+          desc = [[
+            Sets the value to `desired` only if it is `expected`. Returns whether it did,
+            and the value found, which can be used as `expected` of the next attempt.
+          ]],
+          params = {
+            { name = 'atomic', type = 'luv_atomic_t' },
+            { name = 'expected', type = 'integer' },
+            { name = 'desired', type = 'integer' },
+          },
+          returns = {
+            { 'boolean', 'swapped' },
+            { 'integer', 'found' },
+          },
+        },
+        {
+          name = 'new_mutex',
+          desc = [[
+            Creates a mutex that can be passed by reference to `uv.new_thread()`,
+            `uv.queue_work()` and `uv.async_send()`. Unlike an OS mutex it is not owned by
+            the thread that locked it: it can be locked in one callback and unlocked in a
+            later one, or by another thread.
+
+            Waiters are served in the order they came. Besides the blocking
+            `mutex:lock()`, which stalls every handle of the loop when called from a
+            loop thread, `mutex:lock_async()` waits without blocking the thread.
+          ]],
+          returns = ret_or_fail('luv_mutex_t', 'mutex'),
+        },
+        {
+          name = 'mutex_lock',
+          method_form = 'mutex:lock()',
+          desc = 'Locks the mutex, blocking the calling thread until it is available.',
+          params = {
+            { name = 'mutex', type = 'luv_mutex_t' },
+          },
+        },
+        {
+          name = 'mutex_trylock',
+          method_form = 'mutex:trylock()',
+          desc = 'Locks the mutex if it is available and nobody is waiting for it, and returns whether it did.',
+          params = {
+            { name = 'mutex', type = 'luv_mutex_t' },
+          },
+          returns = 'boolean',
+        },
+        {
+          name = 'mutex_lock_async',
+          method_form = 'mutex:lock_async(callback)',
+          desc = [[
+            Queues the loop of the calling thread for the mutex and returns at once.
+            `callback` is called from the loop once the mutex is locked for it, and
+            should unlock it when done, there or in a later callback. The pending wait
+            keeps the loop alive.
+          ]],
+          params = {
+            { name = 'mutex', type = 'luv_mutex_t' },
+            cb(),
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'mutex_unlock',
+          method_form = 'mutex:unlock()',
+          desc = 'Unlocks the mutex, handing it to the next waiter. It is an error to unlock a mutex that is not locked.',
+          params = {
+            { name = 'mutex', type = 'luv_mutex_t' },
+          },
+        },
+        {
+          name = 'new_rwlock',
+          desc = [[
+            Creates a read-write lock, shared between threads like `uv.new_mutex()`.
+            Many readers or a single writer can hold it. Waiters are served in order, so a
+            waiting writer is not starved by readers arriving after it.
+          ]],
+          returns = ret_or_fail('luv_rwlock_t', 'rwlock'),
+        },
+        {
+          name = 'rwlock_rdlock',
+          method_form = 'rwlock:rdlock()',
+          desc = 'Locks for reading, blocking the calling thread until it is available.',
+          params = {
+            { name = 'rwlock', type = 'luv_rwlock_t' },
+          },
+        },
+        {
+          name = 'rwlock_tryrdlock',
+          method_form = 'rwlock:tryrdlock()',
+          desc = 'Locks for reading if it can be done without waiting, and returns whether it did.',
+          params = {
+            { name = 'rwlock', type = 'luv_rwlock_t' },
+          },
+          returns = 'boolean',
+        },
+        {
+          name = 'rwlock_rdlock_async',
+          method_form = 'rwlock:rdlock_async(callback)',
+          desc = [[
+            Like `mutex:lock_async()`, `callback` is called from the loop once the lock is
+            held for reading.
+          ]],
+          params = {
+            { name = 'rwlock', type = 'luv_rwlock_t' },
+            cb(),
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'rwlock_rdunlock',
+          method_form = 'rwlock:rdunlock()',
+          desc = 'Releases a read lock.',
+          params = {
+            { name = 'rwlock', type = 'luv_rwlock_t' },
+          },
+        },
+        {
+          name = 'rwlock_wrlock',
+          method_form = 'rwlock:wrlock()',
+          desc = 'Locks for writing, blocking the calling thread until it is available.',
+          params = {
+            { name = 'rwlock', type = 'luv_rwlock_t' },
+          },
+        },
+        {
+          name = 'rwlock_trywrlock',
+          method_form = 'rwlock:trywrlock()',
+          desc = 'Locks for writing if it can be done without waiting, and returns whether it did.',
+          params = {
+            { name = 'rwlock', type = 'luv_rwlock_t' },
+          },
+          returns = 'boolean',
+        },
+        {
+          name = 'rwlock_wrlock_async',
+          method_form = 'rwlock:wrlock_async(callback)',
+          desc = [[
+            Like `mutex:lock_async()`, `callback` is called from the loop once the lock is
+            held for writing.
+          ]],
+          params = {
+            { name = 'rwlock', type = 'luv_rwlock_t' },
+            cb(),
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'rwlock_wrunlock',
+          method_form = 'rwlock:wrunlock()',
+          desc = 'Releases the write lock.',
+          params = {
+            { name = 'rwlock', type = 'luv_rwlock_t' },
+          },
+        },
+        {
+          name = 'new_cond',
+          desc = [[
+            Creates a condition variable to use with a mutex from `uv.new_mutex()`, shared
+            between threads like it.
+          ]],
+          returns = ret_or_fail('luv_cond_t', 'cond'),
+        },
+        {
+          name = 'cond_wait',
+          method_form = 'cond:wait(mutex, [timeout])',
+          desc = [[
+            Unlocks `mutex`, which must be locked, and blocks the calling thread until the
+            condition is signalled or `timeout` milliseconds pass. The mutex is locked again
+            before returning. Returns `true` if signalled and `false` on timeout.
+          ]],
+          params = {
+            { name = 'cond', type = 'luv_cond_t' },
+            { name = 'mutex', type = 'luv_mutex_t' },
+            { name = 'timeout', type = opt_int },
+          },
+          returns = ret_or_fail('boolean', 'signalled'),
+        },
+        {
+          name = 'cond_wait_async',
+          method_form = 'cond:wait_async(mutex, callback)',
+          desc = [[
+            Unlocks `mutex`, which must be locked, and queues the loop of the calling thread
+            on the condition. Once signalled it waits for the mutex, and `callback` is
+            called from the loop with the mutex locked again.
+          ]],
+          params = {
+            { name = 'cond', type = 'luv_cond_t' },
+            { name = 'mutex', type = 'luv_mutex_t' },
+            cb(),
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'cond_signal',
+          method_form = 'cond:signal()',
+          desc = 'Wakes the first waiter, if any.',
+          params = {
+            { name = 'cond', type = 'luv_cond_t' },
+          },
+        },
+        {
+          name = 'cond_broadcast',
+          method_form = 'cond:broadcast()',
+          desc = 'Wakes all waiters.',
+          params = {
+            { name = 'cond', type = 'luv_cond_t' },
+          },
+        },
+        {
+          name = 'new_barrier',
+          desc = [[
+            Creates a barrier that opens once `count` waiters arrived, shared between threads
+            like `uv.new_mutex()`. It can be used again once open.
+          ]],
+          params = {
+            { name = 'count', type = 'integer' },
+          },
+          returns = ret_or_fail('luv_barrier_t', 'barrier'),
+        },
+        {
+          name = 'barrier_wait',
+          method_form = 'barrier:wait()',
+          desc = [[
+            Blocks the calling thread until the barrier opens. Returns `true` for the last
+            to arrive only, like `uv_barrier_wait()`.
+          ]],
+          params = {
+            { name = 'barrier', type = 'luv_barrier_t' },
+          },
+          returns = ret_or_fail('boolean', 'serial'),
+        },
+        {
+          name = 'barrier_wait_async',
+          method_form = 'barrier:wait_async(callback)',
+          desc = [[
+            Arrives at the barrier without blocking. `callback` is called from the loop of the
+            calling thread once it opens, with `true` for the last to arrive.
+          ]],
+          params = {
+            { name = 'barrier', type = 'luv_barrier_t' },
+            cb({ { 'serial', 'boolean' } }),
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'new_shared_buffer',
+          desc = [[
+            Creates a fixed size byte buffer that lives outside of any Lua state. It is
+            zero-filled when `size` is given, or holds a copy of `data`.
+
+            Passing the buffer to `uv.new_thread()`, `uv.queue_work()` or
+            `uv.async_send()` (or returning it from a work callback) passes a reference
+            to the same memory instead of copying it. The memory is freed once every
+            state has collected its reference. Accesses are not synchronized, so threads
+            must agree on who writes which bytes and when.
+
+            Buffers and their slices can be passed wherever a `buffer` is accepted, such
+            as `uv.write()` and `uv.fs_write()`, and are used in place.
+          ]],
+          params = {
+            { name = 'size', type = union('integer', 'string'), desc = 'size in bytes, or the initial data' },
+          },
+          returns = 'luv_shared_buffer_t',
+        },
+        {
+          name = 'shared_buffer_size',
+          method_form = 'buffer:size()',
+          desc = [[
+            Returns the size of the buffer in bytes. `#buffer` is the same.
+          ]],
+          params = {
+            { name = 'buffer', type = 'luv_shared_buffer_t' },
+          },
+          returns = 'integer',
+        },
+        {
+          name = 'shared_buffer_read',
+          method_form = 'buffer:read([offset], [length])',
+          desc = [[
+            Returns a copy of `length` bytes starting at the 0-based `offset` as a
+            string. By default the whole buffer is read.
+          ]],
+          params = {
+            { name = 'buffer', type = 'luv_shared_buffer_t' },
+            { name = 'offset', type = opt_int, default = '0' },
+            { name = 'length', type = opt_int },
+          },
+          returns = 'string',
+        },
+        {
+          name = 'shared_buffer_write',
+          method_form = 'buffer:write(data, [offset])',
+          desc = [[
+            Copies `data` into the buffer at the 0-based `offset` and returns the number
+            of bytes written. It is an error if `data` does not fit.
+          ]],
+          params = {
+            { name = 'buffer', type = 'luv_shared_buffer_t' },
+            { name = 'data', type = union('string', 'luv_shared_buffer_t') },
+            { name = 'offset', type = opt_int, default = '0' },
+          },
+          returns = 'integer',
+        },
+        {
+          name = 'shared_buffer_slice',
+          method_form = 'buffer:slice([offset], [length])',
+          desc = [[
+            Returns a new `luv_shared_buffer_t` for `length` bytes of `buffer` starting
+            at the 0-based `offset`, sharing its memory. The slice keeps the memory
+            alive on its own.
+          ]],
+          params = {
+            { name = 'buffer', type = 'luv_shared_buffer_t' },
+            { name = 'offset', type = opt_int, default = '0' },
+            { name = 'length', type = opt_int },
+          },
+          returns = 'luv_shared_buffer_t',
+        },
+        {
+          name = 'new_shared_map',
+          desc = [[
+            Creates a map of string keys to values kept in C memory, which any thread can
+            read and update without going through messages. Like a shared buffer, the map
+            is passed by reference to `uv.new_thread()`, `uv.queue_work()` and
+            `uv.async_send()`.
+
+            Values are booleans, numbers, strings and tables of those, copied like thread
+            arguments: `map:get()` returns a new copy of one value. Every update of a key
+            gives it a new version, larger than any version given before in the map,
+            which allows updates conditional on the version read.
+
+            The keys are spread over 16 parts with their own read/write lock, so threads
+            updating different keys rarely wait for each other.
+          ]],
+          returns = 'luv_shared_map_t',
+        },
+        {
+          name = 'shared_map_get',
+          method_form = 'map:get(key)',
+          desc = 'Returns a copy of the value of `key` and its version, or `nil`.',
+          params = {
+            { name = 'map', type = 'luv_shared_map_t' },
+            { name = 'key', type = 'string' },
+          },
+          returns = {
+            { 'any', 'value' },
+            { opt_int, 'version' },
+          },
+        },
+        {
+          name = 'shared_map_set',
+          method_form = 'map:set(key, value, [version])',
+          desc = [[
+            Sets the value of `key`, or removes it when `value` is `nil`. With `version`,
+            only does so if the key still has that version, `0` meaning absent. Returns
+            `true` and the new version (`0` once removed), or `false` and the current
+            version when it didn't match.
+          ]],
+          params = {
+            { name = 'map', type = 'luv_shared_map_t' },
+            { name = 'key', type = 'string' },
+            { name = 'value', type = 'any' },
+            { name = 'version', type = opt_int },
+          },
+          returns = {
+            { 'boolean', 'updated' },
+            { 'integer', 'version' },
+          },
+        },
+        {
+          name = 'shared_map_version',
+          method_form = 'map:version(key)',
+          desc = [[
+            Returns the version of `key`, `0` if absent, without copying its value. A
+            cheap way to check whether a value changed since it was read.
+          ]],
+          params = {
+            { name = 'map', type = 'luv_shared_map_t' },
+            { name = 'key', type = 'string' },
+          },
+          returns = 'integer',
+        },
+        {
+          name = 'shared_map_count',
+          method_form = 'map:count()',
+          desc = 'Returns the number of keys, also available as `#map`.',
+          params = {
+            { name = 'map', type = 'luv_shared_map_t' },
+          },
+          returns = 'integer',
+        },
+        {
+          name = 'shared_map_snapshot',
+          method_form = 'map:snapshot()',
+          desc = [[
+            Copies the whole map as it is at one point in time, with all its parts locked
+            for reading meanwhile. Returns a table of the values by key and a table of
+            their versions by key.
+          ]],
+          params = {
+            { name = 'map', type = 'luv_shared_map_t' },
+          },
+          returns = {
+            { 'table<string, any>', 'values' },
+            { 'table<string, integer>', 'versions' },
+          },
+        },
+        {
+          name = 'shared_map_pairs',
+          method_form = 'map:pairs()',
+          desc = [[
+            Returns an iterator over a snapshot of the map, giving the key, value and
+            version of each entry: `for key, value, version in map:pairs() do ... end`.
+            Updates made during the loop are not seen.
+          ]],
+          params = {
+            { name = 'map', type = 'luv_shared_map_t' },
+          },
+          returns = { { 'function', 'iterator' } },
+        },
+        {
+          name = 'new_channel',
+          desc = [[
+            Creates a queue of at most `options.capacity` messages (64 by default) that
+            any thread can send to and receive from. Like a shared buffer, the channel
+            is passed by reference to `uv.new_thread()`, `uv.queue_work()` and
+            `uv.async_send()`.
+
+            A message is the values given to `channel:send()`, copied like thread
+            arguments. Messages are received in the order they were sent, each one by a
+            single receiver.
+          ]],
+          params = {
+            {
+              name = 'options',
+              type = opt(table({
+                { 'capacity', opt_int },
+              })),
+            },
+          },
+          returns = ret_or_fail('luv_channel_t', 'channel'),
+        },
+        {
+          name = 'channel_send',
+          method_form = 'channel:send(...)',
+          desc = [[
+            Queues the values as one message, waiting for room while the channel is
+            full. Fails with `EPIPE` once the channel is closed.
+          ]],
+          warnings = {
+            [[
+            Waiting blocks the whole thread. In a thread that receives with
+            `channel:recv_start()`, use `channel:try_send()` instead.
+            ]],
+          },
+          params = {
+            { name = 'channel', type = 'luv_channel_t' },
+            { name = '...', type = 'threadargs' },
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'channel_try_send',
+          method_form = 'channel:try_send(...)',
+          desc = [[
+            Like `channel:send()`, but returns `false` without waiting when the channel
+            is full.
+          ]],
+          params = {
+            { name = 'channel', type = 'luv_channel_t' },
+            { name = '...', type = 'threadargs' },
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'channel_recv',
+          method_form = 'channel:recv()',
+          desc = [[
+            Waits for the next message and returns its values. Fails with `EOF` once the
+            channel is closed and every message has been received.
+
+            This blocks the calling thread, it is meant for threads and work callbacks
+            rather than loops.
+          ]],
+          params = {
+            { name = 'channel', type = 'luv_channel_t' },
+          },
+          returns = { { 'threadargs', '...' } },
+        },
+        {
+          name = 'channel_recv_start',
+          method_form = 'channel:recv_start(callback)',
+          desc = [[
+            Receives messages in the loop of the calling thread: `callback` is called
+            with the values of each message, in order. Sends wake the loop through an
+            internal async handle, which keeps the loop alive until
+            `channel:recv_stop()` is called or the channel is closed and drained.
+
+            Only one loop can receive from a channel at a time, it fails with `EBUSY`
+            otherwise. Blocking `channel:recv()` calls in other threads can still take
+            messages.
+          ]],
+          params = {
+            { name = 'channel', type = 'luv_channel_t' },
+            {
+              name = 'callback',
+              type = fun({
+                { '...', 'threadargs', 'passed to `channel:send(...)`' },
+              }),
+            },
+          },
+          returns = ret_or_fail('boolean', 'success'),
+        },
+        {
+          name = 'channel_recv_stop',
+          method_form = 'channel:recv_stop()',
+          desc = [[
+            Stops receiving with `channel:recv_start()`. It must be called from the
+            thread of the receiving loop, it fails with `EINVAL` otherwise.
+          ]],
+          params = {
+            { name = 'channel', type = 'luv_channel_t' },
+          },
+          returns = ret_or_fail('0', 'success'),
+        },
+        {
+          name = 'channel_close',
+          method_form = 'channel:close()',
+          desc = [[
+            Closes the channel. Later sends fail and waiting senders are woken up.
+            Messages already queued can still be received.
+          ]],
+          params = {
+            { name = 'channel', type = 'luv_channel_t' },
+          },
+        },
+        {
+          name = 'channel_count',
+          method_form = 'channel:count()',
+          desc = [[
+            Returns the number of queued messages. `#channel` is the same.
+          ]],
+          params = {
+            { name = 'channel', type = 'luv_channel_t' },
+          },
+          returns = 'integer',
+        },
       },
     },
     {
@@ -77,9 +77,13 @@ uv.constants = {}
 --- - `fail`: an assertable `nil, string, string` tuple (see [Error Handling][])
 --- - `callable`: a `function`; or a `table` or `userdata` with a `__call`
 ---   metamethod
---- - `buffer`: a `string` or a sequential `table` of `string`s
+--- - `buffer`: a `string`, a `luv_shared_buffer_t`, or a sequential `table` of
+---   them
 --- - `threadargs`: variable arguments (`...`) of type `nil`, `boolean`, `number`,
----   `string`, or `userdata`, numbers of argument limited to 9.
+---   `string`, `userdata`, or `table`. Tables are copied with their nested
+---   tables, keeping shared and cyclic references within one argument;
+---   their keys and values must be of the other types, and metatables are
+---   not copied.
 
 
 --- # Contents
@@ -110,6 +114,7 @@ uv.constants = {}
 ---   - [`uv_udp_t`][] — UDP handle
 ---   - [`uv_fs_event_t`][] — FS Event handle
 ---   - [`uv_fs_poll_t`][] — FS Poll handle
+---   - [`uv_fs_poll_set_t`][] — FS Poll set handle
 --- - [File system operations][]
 --- - [Thread pool work scheduling][]
 --- - [DNS utility functions][]
@@ -478,7 +483,8 @@ local uv_req_t = {}
 
 --- Cancel a pending request. Fails if the request is executing or has finished
 --- executing. Only cancellation of `uv_fs_t`, `uv_getaddrinfo_t`,
---- `uv_getnameinfo_t` and `uv_work_t` requests is currently supported.
+--- `uv_getnameinfo_t` and `uv_work_t` requests is currently supported, and
+--- `luv_work_t` requests from `uv.queue_work()` are accepted too.
 --- @param req uv.uv_req_t
 --- @return 0? success
 --- @return string? err
@@ -487,7 +493,8 @@ function uv.cancel(req) end
 
 --- Cancel a pending request. Fails if the request is executing or has finished
 --- executing. Only cancellation of `uv_fs_t`, `uv_getaddrinfo_t`,
---- `uv_getnameinfo_t` and `uv_work_t` requests is currently supported.
+--- `uv_getnameinfo_t` and `uv_work_t` requests is currently supported, and
+--- `luv_work_t` requests from `uv.queue_work()` are accepted too.
 --- @return 0? success
 --- @return string? err
 --- @return uv.error_name? err_name
@@ -1075,22 +1082,26 @@ local uv_async_t = {}
 --- **Note**:
 --- Unlike other handle initialization functions, this immediately starts
 --- the handle.
+--- **Note**:
+--- The callback is called once for every `uv.async_send()`, in the order of
+--- the sends. With `options.batch`, it is instead called once per wakeup with
+--- an array of all the pending messages, each one an array of the values that
+--- were sent with their count in `n`.
 --- @param callback fun(...: uv.threadargs)
+--- @param options { batch: boolean? }?
 --- @return uv.uv_async_t? async
 --- @return string? err
 --- @return uv.error_name? err_name
-function uv.new_async(callback) end
+function uv.new_async(callback, options) end
 
 --- Wakeup the event loop and call the async handle's callback.
 --- **Note**:
 --- It's safe to call this function from any thread. The callback will be
 --- called on the loop thread.
---- **Warning**:
---- libuv will coalesce calls to `uv.async_send(async)`, that is, not
---- every call to it will yield an execution of the callback. For example: if
---- `uv.async_send()` is called 5 times in a row before the callback is called, the
---- callback will only be called once. If `uv.async_send()` is called again after
---- the callback was called, it will be called again.
+--- **Note**:
+--- libuv will coalesce calls to `uv.async_send(async)` into one wakeup of
+--- the loop. The values of every call are queued, so the callback still runs
+--- once for each of them, or once with all of them in batch mode.
 --- @param async uv.uv_async_t
 --- @param ... uv.threadargs
 --- @return 0? success
@@ -1102,12 +1113,10 @@ function uv.async_send(async, ...) end
 --- **Note**:
 --- It's safe to call this function from any thread. The callback will be
 --- called on the loop thread.
---- **Warning**:
---- libuv will coalesce calls to `uv.async_send(async)`, that is, not
---- every call to it will yield an execution of the callback. For example: if
---- `uv.async_send()` is called 5 times in a row before the callback is called, the
---- callback will only be called once. If `uv.async_send()` is called again after
---- the callback was called, it will be called again.
+--- **Note**:
+--- libuv will coalesce calls to `uv.async_send(async)` into one wakeup of
+--- the loop. The values of every call are queued, so the callback still runs
+--- once for each of them, or once with all of them in batch mode.
 --- @param ... uv.threadargs
 --- @return 0? success
 --- @return string? err
@@ -1543,6 +1552,13 @@ function uv.shutdown(stream, callback) end
 --- @return uv.error_name? err_name
 function uv_stream_t:shutdown(callback) end
 
+--- @class uv.listen_group_metrics.metrics
+--- @field accepted integer
+--- @field errors integer
+--- @field listening integer
+--- @field running integer
+--- @field shards table[]
+
 --- Start listening for incoming connections. `backlog` indicates the number of
 --- connections the kernel might queue, same as `listen(2)`. When a new incoming
 --- connection is received the callback is called.
@@ -1610,6 +1626,11 @@ function uv_stream_t:accept(client_stream) end
 --- Read data from an incoming stream. The callback will be made several times until
 --- there is no more data to read or `uv.read_stop()` is called. When we've reached
 --- EOF, `data` will be `nil`.
+---
+--- With a `buffer`, every read lands at the start of that shared buffer instead of
+--- in a new string, and `data` is the number of bytes read. The bytes are only
+--- valid until the callback returns, as the next read overwrites them. Calling
+--- `uv.read_start()` again without a buffer goes back to strings.
 --- Example
 --- ```lua
 --- stream:read_start(function (err, chunk)
@@ -1623,15 +1644,21 @@ function uv_stream_t:accept(client_stream) end
 --- end)
 --- ```
 --- @param stream uv.uv_stream_t
---- @param callback fun(err: string?, data: string?)
+--- @param callback fun(err: string?, data: string|integer?)
+--- @param buffer uv.luv_shared_buffer_t?
 --- @return 0? success
 --- @return string? err
 --- @return uv.error_name? err_name
-function uv.read_start(stream, callback) end
+function uv.read_start(stream, callback, buffer) end
 
 --- Read data from an incoming stream. The callback will be made several times until
 --- there is no more data to read or `uv.read_stop()` is called. When we've reached
 --- EOF, `data` will be `nil`.
+---
+--- With a `buffer`, every read lands at the start of that shared buffer instead of
+--- in a new string, and `data` is the number of bytes read. The bytes are only
+--- valid until the callback returns, as the next read overwrites them. Calling
+--- `uv.read_start()` again without a buffer goes back to strings.
 --- Example
 --- ```lua
 --- stream:read_start(function (err, chunk)
@@ -1644,11 +1671,12 @@ function uv.read_start(stream, callback) end
 ---   end
 --- end)
 --- ```
---- @param callback fun(err: string?, data: string?)
+--- @param callback fun(err: string?, data: string|integer?)
+--- @param buffer uv.luv_shared_buffer_t?
 --- @return 0? success
 --- @return string? err
 --- @return uv.error_name? err_name
-function uv_stream_t:read_start(callback) end
+function uv_stream_t:read_start(callback, buffer) end
 
 --- Stop reading data from the stream. The read callback will no longer be called.
 ---
@@ -1867,6 +1895,134 @@ function uv.tcp_open(tcp, sock) end
 --- @return uv.error_name? err_name
 function uv_tcp_t:open(sock) end
 
+--- Moves the socket of `tcp` into a token and closes the handle. The token can
+--- be passed to other threads like a shared buffer, for example from a loop
+--- accepting connections to `uv.new_loop_thread()` loops serving them, where
+--- `tcp:adopt()` opens it in a new handle. A socket that is never adopted is
+--- closed with the token.
+--- **Note**:
+--- Data already read by libuv but not yet delivered is lost, so detach
+--- before reading. Not supported on Windows.
+--- @param tcp uv.uv_tcp_t
+--- @return uv.luv_tcp_token_t? token
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.tcp_detach(tcp) end
+
+--- Moves the socket of `tcp` into a token and closes the handle. The token can
+--- be passed to other threads like a shared buffer, for example from a loop
+--- accepting connections to `uv.new_loop_thread()` loops serving them, where
+--- `tcp:adopt()` opens it in a new handle. A socket that is never adopted is
+--- closed with the token.
+--- **Note**:
+--- Data already read by libuv but not yet delivered is lost, so detach
+--- before reading. Not supported on Windows.
+--- @return uv.luv_tcp_token_t? token
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv_tcp_t:detach() end
+
+--- Opens the socket of a token from `tcp:detach()` in `tcp`, which must be a new
+--- handle, and returns `tcp`. A token can only be adopted once, it fails with
+--- `EBADF` afterwards.
+--- @param tcp uv.uv_tcp_t
+--- @param token uv.luv_tcp_token_t
+--- @return uv.uv_tcp_t? tcp
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.tcp_adopt(tcp, token) end
+
+--- Opens the socket of a token from `tcp:detach()` in `tcp`, which must be a new
+--- handle, and returns `tcp`. A token can only be adopted once, it fails with
+--- `EBADF` afterwards.
+--- @param token uv.luv_tcp_token_t
+--- @return uv.uv_tcp_t? tcp
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv_tcp_t:adopt(token) end
+
+--- Starts `count` threads, each running its own loop like `uv.new_loop_thread()`
+--- and listening on `host` and `port` with its own socket, bound with the
+--- `reuseport` flag of `uv.tcp_bind()`. The kernel spreads the connections
+--- between the sockets, so every thread accepts and serves its share without
+--- going through the calling loop.
+---
+--- `init` is called in each thread with the 1-based index of the thread and must
+--- return the function to call with each accepted `uv_tcp_t`. Like in
+--- `uv.new_loop_thread()`, `thread:post()` calls globals of the threads, which
+--- `group:threads()` returns.
+---
+--- A port of `0` is resolved once, all threads listen on the same port, see
+--- `group:getsockname()`.
+--- **Note**:
+--- Needs `SO_REUSEPORT`, so it fails with `ENOTSUP` on Windows. The threads
+--- start listening shortly after this returns, see `listening` in
+--- `group:metrics()`. Keep a reference to the group, collecting it stops it.
+--- @param host string
+--- @param port integer
+--- @param count integer
+--- @param init function|string
+--- @param options { backlog: integer? }?
+--- @return uv.luv_listen_group_t? group
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.tcp_listen_group(host, port, count, init, options) end
+
+--- Stops the group gracefully: each thread stops accepting and its loop ends
+--- once the connections it accepted are closed, or after `timeout` milliseconds,
+--- 5000 by default. A `timeout` of `0` waits for the connections however long
+--- they stay open. The address is released right away.
+---
+--- Collecting the group stops it the same way with the default timeout, and
+--- `thread:stop()` on one of its threads ends that thread right away.
+--- @param group uv.luv_listen_group_t
+--- @param timeout integer?
+function uv.listen_group_stop(group, timeout) end
+
+--- @class uv.luv_listen_group_t : userdata
+local luv_listen_group_t = {}
+
+--- Stops the group gracefully: each thread stops accepting and its loop ends
+--- once the connections it accepted are closed, or after `timeout` milliseconds,
+--- 5000 by default. A `timeout` of `0` waits for the connections however long
+--- they stay open. The address is released right away.
+---
+--- Collecting the group stops it the same way with the default timeout, and
+--- `thread:stop()` on one of its threads ends that thread right away.
+--- @param timeout integer?
+function luv_listen_group_t:stop(timeout) end
+
+--- Returns the connections accepted by all threads, the failed accepts, how many
+--- threads are listening and how many are still running, along with the same
+--- counts for each thread in `shards`.
+--- @param group uv.luv_listen_group_t
+--- @return uv.listen_group_metrics.metrics metrics
+function uv.listen_group_metrics(group) end
+
+--- Returns the connections accepted by all threads, the failed accepts, how many
+--- threads are listening and how many are still running, along with the same
+--- counts for each thread in `shards`.
+--- @return uv.listen_group_metrics.metrics metrics
+function luv_listen_group_t:metrics() end
+
+--- Returns the threads of the group, in the order of their index.
+--- @param group uv.luv_listen_group_t
+--- @return luv_thread_t[] threads
+function uv.listen_group_threads(group) end
+
+--- Returns the threads of the group, in the order of their index.
+--- @return luv_thread_t[] threads
+function luv_listen_group_t:threads() end
+
+--- Get the address the group listens on.
+--- @param group uv.luv_listen_group_t
+--- @return uv.socketinfo address
+function uv.listen_group_getsockname(group) end
+
+--- Get the address the group listens on.
+--- @return uv.socketinfo address
+function luv_listen_group_t:getsockname() end
+
 --- Enable / disable Nagle's algorithm.
 --- @param tcp uv.uv_tcp_t
 --- @param enable boolean
@@ -1937,8 +2093,11 @@ function uv.tcp_simultaneous_accepts(tcp, enable) end
 function uv_tcp_t:simultaneous_accepts(enable) end
 
 --- Bind the handle to an host and port. `host` should be an IP address and
---- not a domain name. Any `flags` are set with a table with field `ipv6only`
---- equal to `true` or `false`.
+--- not a domain name. Any `flags` are set with a table with fields `ipv6only`
+--- and `reuseport` equal to `true` or `false`. With `reuseport`, sockets of any
+--- process or thread that also set it can bind the same address, and the kernel
+--- spreads the incoming connections between those listening. Before libuv
+--- 1.49.0 the handle must have been created with a family, see `uv.new_tcp()`.
 ---
 --- When the port is already taken, you can expect to see an `EADDRINUSE` error
 --- from either `uv.tcp_bind()`, `uv.listen()` or `uv.tcp_connect()`. That is, a
@@ -1950,15 +2109,18 @@ function uv_tcp_t:simultaneous_accepts(enable) end
 --- @param tcp uv.uv_tcp_t
 --- @param host string
 --- @param port integer
---- @param flags { ipv6only: boolean }?
+--- @param flags { ipv6only: boolean, reuseport: boolean }?
 --- @return 0? success
 --- @return string? err
 --- @return uv.error_name? err_name
 function uv.tcp_bind(tcp, host, port, flags) end
 
 --- Bind the handle to an host and port. `host` should be an IP address and
---- not a domain name. Any `flags` are set with a table with field `ipv6only`
---- equal to `true` or `false`.
+--- not a domain name. Any `flags` are set with a table with fields `ipv6only`
+--- and `reuseport` equal to `true` or `false`. With `reuseport`, sockets of any
+--- process or thread that also set it can bind the same address, and the kernel
+--- spreads the incoming connections between those listening. Before libuv
+--- 1.49.0 the handle must have been created with a family, see `uv.new_tcp()`.
 ---
 --- When the port is already taken, you can expect to see an `EADDRINUSE` error
 --- from either `uv.tcp_bind()`, `uv.listen()` or `uv.tcp_connect()`. That is, a
@@ -1969,7 +2131,7 @@ function uv.tcp_bind(tcp, host, port, flags) end
 --- later using `uv.tcp_getsockname()`.
 --- @param host string
 --- @param port integer
---- @param flags { ipv6only: boolean }?
+--- @param flags { ipv6only: boolean, reuseport: boolean }?
 --- @return 0? success
 --- @return string? err
 --- @return uv.error_name? err_name
@@ -3067,9 +3229,24 @@ function uv.new_fs_event() end
 --- @field watch_entry boolean?
 --- @field stat boolean?
 --- @field recursive boolean?
+--- @field debounce_ms integer?
+--- @field coalesce boolean?
 
 --- Start the handle with the given callback, which will watch the specified path
 --- for changes.
+---
+--- If `debounce_ms` or `coalesce` is set, events are collected per filename and
+--- delivered once per window of `debounce_ms` milliseconds (default `0`, i.e. on
+--- the next loop iteration) instead of once per event. With `coalesce` the
+--- callback is called once per window as `callback(err, batch)`, where `batch`
+--- maps each filename to its merged `events` table. Without it, the callback is
+--- called once per distinct filename. Events still pending when the handle is
+--- stopped are dropped.
+---
+--- With `recursive`, the whole directory tree below `path` is watched and
+--- `filename` is relative to `path`. On Linux, where libuv only watches the top
+--- level directory, luv uses a single inotify instance with a watch per directory
+--- and starts watching new subdirectories as they are created.
 --- @param fs_event uv.uv_fs_event_t
 --- @param path string
 --- @param flags uv.fs_event_start.flags
@@ -3081,6 +3258,19 @@ function uv.fs_event_start(fs_event, path, flags, callback) end
 
 --- Start the handle with the given callback, which will watch the specified path
 --- for changes.
+---
+--- If `debounce_ms` or `coalesce` is set, events are collected per filename and
+--- delivered once per window of `debounce_ms` milliseconds (default `0`, i.e. on
+--- the next loop iteration) instead of once per event. With `coalesce` the
+--- callback is called once per window as `callback(err, batch)`, where `batch`
+--- maps each filename to its merged `events` table. Without it, the callback is
+--- called once per distinct filename. Events still pending when the handle is
+--- stopped are dropped.
+---
+--- With `recursive`, the whole directory tree below `path` is watched and
+--- `filename` is relative to `path`. On Linux, where libuv only watches the top
+--- level directory, luv uses a single inotify instance with a watch per directory
+--- and starts watching new subdirectories as they are created.
 --- @param path string
 --- @param flags uv.fs_event_start.flags
 --- @param callback uv.fs_event_start.callback
@@ -3188,6 +3378,113 @@ function uv.fs_poll_getpath(fs_poll) end
 function uv_fs_poll_t:getpath() end
 
 
+--- # `uv_fs_poll_set_t` - FS Poll set handle
+---
+--- > [`uv_handle_t`][] functions also apply.
+---
+--- FS Poll set handles monitor many paths with `stat` like [`uv_fs_poll_t`][],
+--- but with a single timer for all of them. Every `interval` milliseconds the
+--- paths are stat'ed in batches on the threadpool and the paths that changed
+--- since the previous round are reported together in one callback.
+--- @class uv.uv_fs_poll_set_t : uv.uv_handle_t
+local uv_fs_poll_set_t = {}
+
+--- Creates and initializes a new `uv_fs_poll_set_t` that checks its paths every
+--- `interval` milliseconds. Returns the Lua userdata wrapping it.
+--- @param interval integer
+--- @return uv.uv_fs_poll_set_t? fs_poll_set
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.new_fs_poll_set(interval) end
+
+--- Add `path` to the set. It is checked from the next round on; like
+--- `uv.fs_poll_start()`, the first check is only reported if it fails. Adding
+--- a path that is already in the set fails with `EEXIST`.
+--- @param fs_poll_set uv.uv_fs_poll_set_t
+--- @param path string
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.fs_poll_set_add(fs_poll_set, path) end
+
+--- Add `path` to the set. It is checked from the next round on; like
+--- `uv.fs_poll_start()`, the first check is only reported if it fails. Adding
+--- a path that is already in the set fails with `EEXIST`.
+--- @param path string
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv_fs_poll_set_t:add(path) end
+
+--- Remove `path` from the set. Removing a path that is not in the set fails with
+--- `ENOENT`.
+--- @param fs_poll_set uv.uv_fs_poll_set_t
+--- @param path string
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.fs_poll_set_remove(fs_poll_set, path) end
+
+--- Remove `path` from the set. Removing a path that is not in the set fails with
+--- `ENOENT`.
+--- @param path string
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv_fs_poll_set_t:remove(path) end
+
+--- @class uv.fs_poll_set_start.callback.changes
+--- @field path string
+--- @field prev table?
+--- @field curr table?
+--- @field err string?
+
+--- Start checking the paths in the set. The callback is called once per round
+--- in which at least one path changed, with a list of the changes. Each entry
+--- has the `path`, and the `prev` and `curr` stat tables (see `uv.fs_stat`) when
+--- the path could be stat'ed before and now. `err` is set instead of `curr` when
+--- the path can no longer be stat'ed.
+--- @param fs_poll_set uv.uv_fs_poll_set_t
+--- @param callback fun(changes: table<integer, uv.fs_poll_set_start.callback.changes>)
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.fs_poll_set_start(fs_poll_set, callback) end
+
+--- Start checking the paths in the set. The callback is called once per round
+--- in which at least one path changed, with a list of the changes. Each entry
+--- has the `path`, and the `prev` and `curr` stat tables (see `uv.fs_stat`) when
+--- the path could be stat'ed before and now. `err` is set instead of `curr` when
+--- the path can no longer be stat'ed.
+--- @param callback fun(changes: table<integer, uv.fs_poll_set_start.callback.changes>)
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv_fs_poll_set_t:start(callback) end
+
+--- Stop the handle, the callback will no longer be called.
+--- @param fs_poll_set uv.uv_fs_poll_set_t
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.fs_poll_set_stop(fs_poll_set) end
+
+--- Stop the handle, the callback will no longer be called.
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv_fs_poll_set_t:stop() end
+
+--- Get the paths in the set, in sorted order.
+--- @param fs_poll_set uv.uv_fs_poll_set_t
+--- @return string[]
+function uv.fs_poll_set_getpaths(fs_poll_set) end
+
+--- Get the paths in the set, in sorted order.
+--- @return string[]
+function uv_fs_poll_set_t:getpaths() end
+
+
 --- # File system operations
 ---
 --- Most file system functions can operate synchronously or asynchronously. When a synchronous version is called (by omitting a callback), the function will
@@ -3244,10 +3541,17 @@ function uv.fs_close(fd) end
 --- Equivalent to `open(2)`. Access `flags` may be an integer or one of: `"r"`,
 --- `"rs"`, `"sr"`, `"r+"`, `"rs+"`, `"sr+"`, `"w"`, `"wx"`, `"xw"`, `"w+"`,
 --- `"wx+"`, `"xw+"`, `"a"`, `"ax"`, `"xa"`, `"a+"`, `"ax+"`, or "`xa+`".
+--- Any of these may be suffixed with `"d"` (e.g. `"rd"` or `"w+d"`) to open
+--- the file for direct I/O (`O_DIRECT`), bypassing the page cache.
 --- **Note**:
 --- On Windows, libuv uses `CreateFileW` and thus the file is always
 --- opened in binary mode. Because of this, the `O_BINARY` and `O_TEXT` flags are
 --- not supported.
+--- **Note**:
+--- Direct I/O requires reads and writes to be a multiple of the device
+--- block size. On descriptors opened this way, `uv.fs_read()` aligns its
+--- buffer when `size` is a multiple of 512, and `uv.fs_write()` copies such
+--- writes into an aligned buffer.
 --- @param path string
 --- @param flags string|integer
 --- @param mode integer (octal `chmod(1)` mode, e.g. `tonumber('644', 8)`)
@@ -3259,16 +3563,19 @@ function uv.fs_open(path, flags, mode) end
 
 --- Equivalent to `preadv(2)`. Returns any data. An empty string indicates EOF.
 ---
+--- If a shared buffer or a slice of one is given instead of `size`, the data is
+--- read into it in place and the number of bytes read is returned, 0 at EOF.
+---
 --- If `offset` is nil or omitted, it will default to `-1`, which indicates 'use and update the current file offset.'
 ---
 --- **Note:** When `offset` is >= 0, the current file offset will not be updated by the read.
 --- @param fd integer
---- @param size integer
+--- @param size integer|uv.luv_shared_buffer_t
 --- @param offset integer?
---- @return string? data
+--- @return string|integer? data
 --- @return string? err
 --- @return uv.error_name? err_name
---- @overload fun(fd: integer, size: integer, offset: integer?, callback: fun(err: string?, data: string?)): uv.uv_fs_t
+--- @overload fun(fd: integer, size: integer|uv.luv_shared_buffer_t, offset: integer?, callback: fun(err: string?, data: string|integer?)): uv.uv_fs_t
 function uv.fs_read(fd, size, offset) end
 
 --- Equivalent to `unlink(2)`.
@@ -3445,6 +3752,33 @@ function uv.fs_fdatasync(fd) end
 --- @overload fun(fd: integer, offset: integer, callback: fun(err: string?, success: boolean?)): uv.uv_fs_t
 function uv.fs_ftruncate(fd, offset) end
 
+--- Equivalent to `posix_fallocate(3)`. Ensures disk space is allocated for
+--- the byte range `offset` to `offset + length`, growing the file if needed.
+--- Fails with `ENOSYS` on platforms that do not support it.
+--- @param fd integer
+--- @param offset integer
+--- @param length integer
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+--- @overload fun(fd: integer, offset: integer, length: integer, callback: fun(err: string?, success: boolean?)): uv.uv_work_t
+function uv.fs_fallocate(fd, offset, length) end
+
+--- Equivalent to `posix_fadvise(2)`. Announces the intended access pattern
+--- for the byte range `offset` to `offset + length`; a `length` of 0 means
+--- until the end of the file. `advice` may be an integer or one of:
+--- `"normal"`, `"sequential"`, `"random"`, `"willneed"`, `"dontneed"`, or
+--- `"noreuse"`. Fails with `ENOSYS` on platforms that do not support it.
+--- @param fd integer
+--- @param offset integer
+--- @param length integer
+--- @param advice string|integer
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+--- @overload fun(fd: integer, offset: integer, length: integer, advice: string|integer, callback: fun(err: string?, success: boolean?)): uv.uv_work_t
+function uv.fs_fadvise(fd, offset, length, advice) end
+
 --- Limited equivalent to `sendfile(2)`. Returns the number of bytes written.
 --- @param out_fd integer
 --- @param in_fd integer
@@ -3619,6 +3953,62 @@ function uv.fs_lchown(fd, uid, gid) end
 --- @overload fun(path: string, new_path: string, flags: integer|uv.fs_copyfile.flags?, callback: fun(err: string?, success: boolean?)): uv.uv_fs_t
 function uv.fs_copyfile(path, new_path, flags) end
 
+--- @class uv.fs_copy_range.options
+--- @field out_offset integer?
+--- @field chunk_size integer?
+--- @field on_progress fun(copied: integer, total: integer)?
+
+--- Copies `length` bytes from `in_fd` starting at `offset` to `out_fd`, using
+--- `copy_file_range(2)` where available and a read/write loop otherwise. Neither
+--- file position is changed. The copy is split into chunks of `chunk_size`
+--- bytes, each of which runs as its own threadpool job, and `on_progress` is
+--- called with the bytes copied so far after each chunk. The data is written
+--- at `offset` in `out_fd` unless `out_offset` is given. Returns the number of
+--- bytes copied, which is less than `length` if the end of `in_fd` is reached.
+--- If the `options` parameter is omitted, then the 5th parameter will be
+--- treated as the `callback`.
+--- @param in_fd integer
+--- @param out_fd integer
+--- @param offset integer
+--- @param length integer
+--- @param options uv.fs_copy_range.options?
+--- @return integer? bytes
+--- @return string? err
+--- @return uv.error_name? err_name
+--- @overload fun(in_fd: integer, out_fd: integer, offset: integer, length: integer, options: uv.fs_copy_range.options?, callback: fun(err: string?, bytes: integer?)): uv.uv_work_t
+function uv.fs_copy_range(in_fd, out_fd, offset, length, options) end
+
+--- @class uv.fs_copy_tree.options
+--- @field concurrency integer?
+--- @field reflink string|boolean?
+--- @field chunk_size integer?
+--- @field on_progress fun(copied: integer, total: integer)?
+
+--- Recursively copies the file or directory `src` to `dst`. Directories are
+--- created and symlinks recreated while scanning the source on the threadpool,
+--- then regular files are copied with at most `concurrency` files in flight,
+--- one `chunk_size` chunk per threadpool job so that large copies don't starve
+--- other threadpool users. File and directory modes are preserved, directory
+--- modes are applied once all files are copied. A `dst` inside `src` fails
+--- with `EINVAL`.
+---
+--- `reflink` selects whether files are cloned (e.g. with `FICLONE` on Linux or
+--- `clonefile` on macOS) instead of copied: `"auto"` tries a clone and falls
+--- back to copying, `"always"` fails if the clone fails and `"never"` always
+--- copies.
+---
+--- `on_progress` is called with the total bytes copied so far and the total
+--- size of all files after each chunk. `callback` is called once the copy is
+--- done, or after the first error once in-flight chunks have finished.
+--- @param src string
+--- @param dst string
+--- @param options uv.fs_copy_tree.options?
+--- @param callback fun(err: string?, result: { files: integer, bytes: integer }?)
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.fs_copy_tree(src, dst, options, callback) end
+
 --- Opens path as a directory stream. Returns a handle that the user can pass to
 --- `uv.fs_readdir()`. The `entries` parameter defines the maximum number of entries
 --- that should be returned by each call to `uv.fs_readdir()`.
@@ -3701,21 +4091,38 @@ function uv.fs_statfs(path) end
 --- -- output: "The result is: 3"
 --- ```
 
+--- @class uv.new_work_pool.options
+--- @field threads integer?
+--- @field name string?
+--- @field priority integer?
+
 --- Creates and initializes a new `luv_work_ctx_t` (not `uv_work_t`).
 --- `work_callback` is a Lua function or a string containing Lua code or bytecode dumped from a function.
 --- Returns the Lua userdata wrapping it.
+---
+--- If `options.pool` is a pool from `uv.new_work_pool()`, work queued with the
+--- context runs on the threads of that pool instead of the libuv threadpool.
+---
+--- If `options.on_progress` is given, it is called in the main loop thread with
+--- the values that `work_callback` passes to `uv.work_report()`, in order and
+--- before `after_work_callback` of the same request.
 --- @param work_callback string|fun(...: uv.threadargs)
 --- @param after_work_callback fun(...: uv.threadargs)
+--- @param options { pool: uv.luv_work_pool_t?, on_progress: fun(...: uv.threadargs)? }?
 --- @return uv.luv_work_ctx_t
-function uv.new_work(work_callback, after_work_callback) end
+function uv.new_work(work_callback, after_work_callback, options) end
 
 --- Queues a work request which will run `work_callback` in a new Lua state in a
 --- thread from the threadpool with any additional arguments from `...`. Values
 --- returned from `work_callback` are passed to `after_work_callback`, which is
 --- called in the main loop thread.
+---
+--- Returns a `luv_work_t` that can cancel the request while it is still queued.
+--- A cancelled request calls `after_work_callback` with `nil, err, name`
+--- (`ECANCELED`) instead of the values returned from `work_callback`.
 --- @param work_ctx uv.luv_work_ctx_t
 --- @param ... uv.threadargs
---- @return boolean? success
+--- @return uv.luv_work_t? work
 --- @return string? err
 --- @return uv.error_name? err_name
 function uv.queue_work(work_ctx, ...) end
@@ -3727,12 +4134,240 @@ local luv_work_ctx_t = {}
 --- thread from the threadpool with any additional arguments from `...`. Values
 --- returned from `work_callback` are passed to `after_work_callback`, which is
 --- called in the main loop thread.
+---
+--- Returns a `luv_work_t` that can cancel the request while it is still queued.
+--- A cancelled request calls `after_work_callback` with `nil, err, name`
+--- (`ECANCELED`) instead of the values returned from `work_callback`.
 --- @param ... uv.threadargs
---- @return boolean? success
+--- @return uv.luv_work_t? work
 --- @return string? err
 --- @return uv.error_name? err_name
 function luv_work_ctx_t:queue(...) end
 
+--- Sends `...` to `options.on_progress` of the context of the running request.
+--- It must be called from `work_callback`, returns immediately, and does nothing
+--- if the context has no `on_progress`.
+--- @param ... uv.threadargs
+function uv.work_report(...) end
+
+--- Calls `fn` on every element of the array `items` on the threadpool and calls
+--- `callback` with the array of results, in the order of `items`.
+---
+--- The elements are sent in chunks of `options.chunk` elements, each chunk as
+--- one work request, so they are copied once per chunk rather than one by one.
+--- By default there are about four chunks per thread. `options.pool` runs the
+--- chunks on a pool from `uv.new_work_pool()`, and `options.on_progress` is
+--- passed to `uv.new_work()`.
+---
+--- If `fn` raises an error, `callback` is called with the error message instead.
+--- @param fn string|fun(item: any)
+--- @param items table
+--- @param options { chunk: integer?, pool: uv.luv_work_pool_t? }?
+--- @param callback fun(err: string?, results: table?)
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.parallel_map(fn, items, options, callback) end
+
+--- Like `uv.parallel_map()` with `map_fn`, then folds the results in order with
+--- `reduce_fn` in the main loop thread, starting from the first result, and
+--- calls `callback` with the final value.
+--- @param map_fn string|fun(item: any)
+--- @param reduce_fn fun(accumulator: any, value: any)
+--- @param items table
+--- @param options { chunk: integer?, pool: uv.luv_work_pool_t? }?
+--- @param callback fun(err: string?, result: any)
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.parallel_reduce(map_fn, reduce_fn, items, options, callback) end
+
+--- @class uv.work_metrics.metrics
+--- @field queued integer
+--- @field running integer
+--- @field completed integer
+--- @field errors integer
+--- @field cancelled integer
+--- @field wait_total number
+--- @field run_total number
+--- @field wait_hist integer[]
+--- @field run_hist integer[]
+--- @field vms integer
+--- @field heap integer
+--- @field heaps integer[]
+
+--- Returns counters of the requests queued with `work_ctx`, or of all requests
+--- in the process when it is omitted.
+---
+--- `queued`, `running` and `cancelled` count requests. Finished requests are
+--- counted in `errors` if `work_callback` raised an error, else in `completed`.
+--- `wait_total` and `run_total` are the total time spent waiting in the queue and
+--- running, in milliseconds. `wait_hist` and `run_hist` are histograms of the
+--- same times: entry `i` counts the durations under `2^(i-1)` microseconds that
+--- are not counted in an earlier entry, and the last entry also counts longer
+--- durations.
+---
+--- `vms` is the number of worker Lua states that run the requests (of the
+--- threadpool of this state, or of the pool of `work_ctx`), `heaps` the Lua heap
+--- size of each of them in bytes after its last request, and `heap` their sum.
+--- @param work_ctx uv.luv_work_ctx_t?
+--- @return uv.work_metrics.metrics metrics
+function uv.work_metrics(work_ctx) end
+
+--- Cancels a request from `uv.queue_work()` that has not started running. Fails
+--- with `EBUSY` if it is running or has completed. `uv.cancel(work)` is the
+--- same.
+--- @param work uv.luv_work_t
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.cancel_work(work) end
+
+--- @class uv.luv_work_t : userdata
+local luv_work_t = {}
+
+--- Cancels a request from `uv.queue_work()` that has not started running. Fails
+--- with `EBUSY` if it is running or has completed. `uv.cancel(work)` is the
+--- same.
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_work_t:cancel() end
+
+--- Queues one work request per element of `args_list`, passing the element as
+--- the only argument of `work_callback`. This is cheaper than calling
+--- `work_ctx:queue()` for each element: the requests share one allocation and
+--- the arguments are not referenced one by one.
+---
+--- `on_each` is called with the index of the element and the values returned
+--- for it, in completion order, instead of `after_work_callback`. `on_done` is
+--- called once all requests have completed, with an array holding the first
+--- value returned for each element, in the order of `args_list`.
+---
+--- If a request can't be queued the whole call fails: the requests queued so
+--- far are cancelled, those that already started run to completion, and
+--- neither `on_each` nor `on_done` is called.
+--- @param work_ctx uv.luv_work_ctx_t
+--- @param args_list table
+--- @param on_each fun(index: integer, ...: uv.threadargs)?
+--- @param on_done fun(results: table)?
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.queue_work_many(work_ctx, args_list, on_each, on_done) end
+
+--- Queues one work request per element of `args_list`, passing the element as
+--- the only argument of `work_callback`. This is cheaper than calling
+--- `work_ctx:queue()` for each element: the requests share one allocation and
+--- the arguments are not referenced one by one.
+---
+--- `on_each` is called with the index of the element and the values returned
+--- for it, in completion order, instead of `after_work_callback`. `on_done` is
+--- called once all requests have completed, with an array holding the first
+--- value returned for each element, in the order of `args_list`.
+---
+--- If a request can't be queued the whole call fails: the requests queued so
+--- far are cancelled, those that already started run to completion, and
+--- neither `on_each` nor `on_done` is called.
+--- @param args_list table
+--- @param on_each fun(index: integer, ...: uv.threadargs)?
+--- @param on_done fun(results: table)?
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_work_ctx_t:queue_many(args_list, on_each, on_done) end
+
+--- Creates a pool of `threads` worker threads, separate from the libuv
+--- threadpool, so that CPU heavy Lua work does not delay file system and DNS
+--- requests. Each thread keeps its own Lua state for the lifetime of the pool.
+--- `threads` defaults to `uv.available_parallelism()`, `name` is used as the
+--- thread name and `priority` as the thread priority (see
+--- `uv.thread_setpriority()`) where supported. Use the pool with the `pool`
+--- option of `uv.new_work()`.
+---
+--- The threads are joined when the pool is garbage collected; jobs already
+--- queued are run first.
+--- @param options uv.new_work_pool.options?
+--- @return uv.luv_work_pool_t? pool
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.new_work_pool(options) end
+
+--- @class uv.work_pool_stats.stats
+--- @field threads integer
+--- @field queued integer
+--- @field running integer
+--- @field completed integer
+--- @field wait_avg number
+--- @field wait_max number
+--- @field run_avg number
+--- @field run_max number
+
+--- Returns the number of threads, the number of queued and running jobs, the
+--- number of completed jobs, and the average and maximum time completed jobs
+--- waited in the queue and ran, in milliseconds.
+--- @param pool uv.luv_work_pool_t
+--- @return uv.work_pool_stats.stats stats
+function uv.work_pool_stats(pool) end
+
+--- @class uv.luv_work_pool_t : userdata
+local luv_work_pool_t = {}
+
+--- Returns the number of threads, the number of queued and running jobs, the
+--- number of completed jobs, and the average and maximum time completed jobs
+--- waited in the queue and ran, in milliseconds.
+--- @return uv.work_pool_stats.stats stats
+function luv_work_pool_t:stats() end
+
+--- Sets a function that runs once in every worker Lua state before its next job,
+--- both in the libuv threadpool and in pools from `uv.new_work_pool()`. Use it
+--- to `require` modules or build lookup tables once per state instead of on
+--- every job. `init_callback` is a Lua function or a string containing Lua code
+--- or bytecode dumped from a function. Setting a new function runs it again in
+--- every state; `nil` removes it.
+--- @param init_callback string|fun()?
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.set_work_init(init_callback) end
+
+--- Creates the Lua state of every thread in the libuv threadpool and runs the
+--- function set with `uv.set_work_init()` in it now instead of on the first job.
+--- `callback` is called once all states are ready. Only one warm up of the
+--- threadpool can run at a time, otherwise this fails with `EBUSY`.
+---
+--- With `pool`, warms up the threads of a pool from `uv.new_work_pool()`
+--- instead, whose Lua states already exist.
+---
+--- **Note:** The warm up occupies every thread of the threadpool until all of
+--- them have picked up their part, so other requests wait until then. The
+--- number of threads is taken from `UV_THREADPOOL_SIZE` when luv is first
+--- loaded, as libuv reads it only once.
+--- @param pool uv.luv_work_pool_t?
+--- @param callback fun()?
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.warm_work_pool(pool, callback) end
+
+--- Creates the Lua state of every thread in the libuv threadpool and runs the
+--- function set with `uv.set_work_init()` in it now instead of on the first job.
+--- `callback` is called once all states are ready. Only one warm up of the
+--- threadpool can run at a time, otherwise this fails with `EBUSY`.
+---
+--- With `pool`, warms up the threads of a pool from `uv.new_work_pool()`
+--- instead, whose Lua states already exist.
+---
+--- **Note:** The warm up occupies every thread of the threadpool until all of
+--- them have picked up their part, so other requests wait until then. The
+--- number of threads is taken from `UV_THREADPOOL_SIZE` when luv is first
+--- loaded, as libuv reads it only once.
+--- @param callback fun()?
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_work_pool_t:warm(callback) end
+
 
 --- # DNS utility functions
 
@@ -3982,6 +4617,123 @@ function uv.thread_join(thread) end
 --- @return uv.error_name? err_name
 function luv_thread_t:join() end
 
+--- Starts a thread with its own Lua state and event loop, for running one loop
+--- per core. `init` is called in the thread with the arguments `...`, like the
+--- entry of `uv.new_thread()`. It can set up handles in the thread loop, and
+--- returns a table of functions that `thread:post()` calls by name, or nothing
+--- to make `thread:post()` call globals. The loop then runs until
+--- `thread:stop()` is called or it stops by itself.
+---
+--- When `options.cpu` is set, the thread is pinned to that CPU, numbered from 1
+--- like `uv.thread_getcpu()` does. The result is the same as `thread:setaffinity()`
+--- with only that CPU set.
+---
+--- A running loop thread keeps the calling loop alive.
+--- @param init function|string
+--- @param options { cpu: integer? }?
+--- @param ... uv.threadargs passed to `init`
+--- @return uv.luv_thread_t? thread
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.new_loop_thread(init, options, ...) end
+
+--- Calls the function `name` of a thread from `uv.new_loop_thread()` with the
+--- arguments `...`, inside its loop. Posts run in the order they were made.
+---
+--- If `callback` is given, it is called in the calling loop with the values
+--- returned by the function, or with the error it raised. Callbacks of posts
+--- that never ran because the thread stopped receive an `ECANCELED` error.
+---
+--- Fails with `EPIPE` once the thread is stopping.
+--- @param thread uv.luv_thread_t
+--- @param name string
+--- @param ... uv.threadargs optionally followed by `callback(err, ...)`
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.thread_post(thread, name, ...) end
+
+--- Calls the function `name` of a thread from `uv.new_loop_thread()` with the
+--- arguments `...`, inside its loop. Posts run in the order they were made.
+---
+--- If `callback` is given, it is called in the calling loop with the values
+--- returned by the function, or with the error it raised. Callbacks of posts
+--- that never ran because the thread stopped receive an `ECANCELED` error.
+---
+--- Fails with `EPIPE` once the thread is stopping.
+--- @param name string
+--- @param ... uv.threadargs optionally followed by `callback(err, ...)`
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_thread_t:post(name, ...) end
+
+--- Stops the loop of a thread from `uv.new_loop_thread()` once the posts
+--- already made have run, even if a graceful stop is already waiting for its
+--- handles. Handles left in the loop are closed when the thread closes its Lua
+--- state, then the thread ends.
+--- @param thread uv.luv_thread_t
+function uv.thread_stop(thread) end
+
+--- Stops the loop of a thread from `uv.new_loop_thread()` once the posts
+--- already made have run, even if a graceful stop is already waiting for its
+--- handles. Handles left in the loop are closed when the thread closes its Lua
+--- state, then the thread ends.
+function luv_thread_t:stop() end
+
+--- Keeps up to `max` Lua states of finished threads for the next
+--- `uv.new_thread()` and `uv.new_loop_thread()`, instead of creating a new
+--- state for each thread. `0`, the default, disables the pool and releases the
+--- states it holds. The pool is shared by the whole process.
+---
+--- A state is reused with the globals and loaded modules it was created with,
+--- changes made inside them (like new fields of `string`) are kept. States that
+--- leave handles in their loop are not reused.
+--- **Note**:
+--- Embedders can enable it with `luv_set_thread_vm_pool()`. States still come
+--- from the callbacks given to `luv_set_thread_cb()`.
+--- @param max integer
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.thread_vm_pool(max) end
+
+--- @class uv.thread_vm_stats.stats
+--- @field created integer
+--- @field reused integer
+--- @field idle integer
+--- @field max integer
+
+--- Returns how many Lua states threads created and reused, with the number of
+--- states waiting in the pool and its `max`, see `uv.thread_vm_pool()`.
+--- @return uv.thread_vm_stats.stats stats
+function uv.thread_vm_stats() end
+
+--- @class uv.thread_vm_alloc_stats.stats
+--- @field bytes integer
+--- @field peak integer
+--- @field reserved integer
+
+--- Makes luv create the Lua states of later threads and work with their own
+--- allocator. Freed blocks of up to 256 bytes are kept per size class for the
+--- next allocation of the state, without locking, instead of going through a
+--- `malloc` shared by every thread. Larger blocks still use `malloc`. Returns the
+--- previous setting.
+--- **Note**:
+--- Embedders can enable it with `luv_set_thread_vm_alloc()`. It only applies to
+--- the states made by the default `luv_set_thread_cb()` callbacks. Threads of
+--- `uv.new_work()` keep their state, so set it before queuing any work. LuaJIT
+--- builds without GC64 keep their own allocator on 64-bit.
+--- @param enabled boolean
+--- @return boolean
+function uv.thread_vm_alloc(enabled) end
+
+--- Returns the bytes the calling Lua state uses, the most it used at once, and
+--- the bytes its allocator holds for small blocks. Returns `nil` for states not
+--- using the allocator of `uv.thread_vm_alloc()`.
+--- @return uv.thread_vm_alloc_stats.stats? stats
+function uv.thread_vm_alloc_stats() end
+
 --- Detaches a thread. Detached threads automatically release their resources upon
 --- termination, eliminating the need for the application to call `uv.thread_join`.
 --- @param thread uv.luv_thread_t
@@ -4080,6 +4832,647 @@ function uv.sem_trywait(sem) end
 --- @return boolean
 function luv_sem_t:trywait() end
 
+--- Creates an integer that threads update with atomic operations instead of a
+--- lock, for counters and flags. Like a shared buffer, it is passed by reference
+--- to `uv.new_thread()`, `uv.queue_work()` and `uv.async_send()`.
+--- @param initial integer?
+--- @return uv.luv_atomic_t
+function uv.new_atomic(initial) end
+
+--- Returns the value.
+--- @param atomic uv.luv_atomic_t
+--- @return integer
+function uv.atomic_load(atomic) end
+
+--- @class uv.luv_atomic_t : userdata
+local luv_atomic_t = {}
+
+--- Returns the value.
+--- @return integer
+function luv_atomic_t:load() end
+
+--- Sets the value.
+--- @param atomic uv.luv_atomic_t
+--- @param value integer
+function uv.atomic_store(atomic, value) end
+
+--- Sets the value.
+--- @param value integer
+function luv_atomic_t:store(value) end
+
+--- Adds `n` to the value and returns the result.
+--- @param atomic uv.luv_atomic_t
+--- @param n integer?
+--- @return integer
+function uv.atomic_add(atomic, n) end
+
+--- Adds `n` to the value and returns the result.
+--- @param n integer?
+--- @return integer
+function luv_atomic_t:add(n) end
+
+--- Subtracts `n` from the value and returns the result.
+--- @param atomic uv.luv_atomic_t
+--- @param n integer?
+--- @return integer
+function uv.atomic_sub(atomic, n) end
+
+--- Subtracts `n` from the value and returns the result.
+--- @param n integer?
+--- @return integer
+function luv_atomic_t:sub(n) end
+
+--- Sets the value to `desired` only if it is `expected`. Returns whether it did,
+--- and the value found, which can be used as `expected` of the next attempt.
+--- @param atomic uv.luv_atomic_t
+--- @param expected integer
+--- @param desired integer
+--- @return boolean swapped
+--- @return integer found
+function uv.atomic_cas(atomic, expected, desired) end
+
+--- Sets the value to `desired` only if it is `expected`. Returns whether it did,
+--- and the value found, which can be used as `expected` of the next attempt.
+--- @param expected integer
+--- @param desired integer
+--- @return boolean swapped
+--- @return integer found
+function luv_atomic_t:cas(expected, desired) end
+
+--- Creates a mutex that can be passed by reference to `uv.new_thread()`,
+--- `uv.queue_work()` and `uv.async_send()`. Unlike an OS mutex it is not owned by
+--- the thread that locked it: it can be locked in one callback and unlocked in a
+--- later one, or by another thread.
+---
+--- Waiters are served in the order they came. Besides the blocking
+--- `mutex:lock()`, which stalls every handle of the loop when called from a
+--- loop thread, `mutex:lock_async()` waits without blocking the thread.
+--- @return uv.luv_mutex_t? mutex
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.new_mutex() end
+
+--- Locks the mutex, blocking the calling thread until it is available.
+--- @param mutex uv.luv_mutex_t
+function uv.mutex_lock(mutex) end
+
+--- @class uv.luv_mutex_t : userdata
+local luv_mutex_t = {}
+
+--- Locks the mutex, blocking the calling thread until it is available.
+function luv_mutex_t:lock() end
+
+--- Locks the mutex if it is available and nobody is waiting for it, and returns whether it did.
+--- @param mutex uv.luv_mutex_t
+--- @return boolean
+function uv.mutex_trylock(mutex) end
+
+--- Locks the mutex if it is available and nobody is waiting for it, and returns whether it did.
+--- @return boolean
+function luv_mutex_t:trylock() end
+
+--- Queues the loop of the calling thread for the mutex and returns at once.
+--- `callback` is called from the loop once the mutex is locked for it, and
+--- should unlock it when done, there or in a later callback. The pending wait
+--- keeps the loop alive.
+--- @param mutex uv.luv_mutex_t
+--- @param callback fun()
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.mutex_lock_async(mutex, callback) end
+
+--- Queues the loop of the calling thread for the mutex and returns at once.
+--- `callback` is called from the loop once the mutex is locked for it, and
+--- should unlock it when done, there or in a later callback. The pending wait
+--- keeps the loop alive.
+--- @param callback fun()
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_mutex_t:lock_async(callback) end
+
+--- Unlocks the mutex, handing it to the next waiter. It is an error to unlock a mutex that is not locked.
+--- @param mutex uv.luv_mutex_t
+function uv.mutex_unlock(mutex) end
+
+--- Unlocks the mutex, handing it to the next waiter. It is an error to unlock a mutex that is not locked.
+function luv_mutex_t:unlock() end
+
+--- Creates a read-write lock, shared between threads like `uv.new_mutex()`.
+--- Many readers or a single writer can hold it. Waiters are served in order, so a
+--- waiting writer is not starved by readers arriving after it.
+--- @return uv.luv_rwlock_t? rwlock
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.new_rwlock() end
+
+--- Locks for reading, blocking the calling thread until it is available.
+--- @param rwlock uv.luv_rwlock_t
+function uv.rwlock_rdlock(rwlock) end
+
+--- @class uv.luv_rwlock_t : userdata
+local luv_rwlock_t = {}
+
+--- Locks for reading, blocking the calling thread until it is available.
+function luv_rwlock_t:rdlock() end
+
+--- Locks for reading if it can be done without waiting, and returns whether it did.
+--- @param rwlock uv.luv_rwlock_t
+--- @return boolean
+function uv.rwlock_tryrdlock(rwlock) end
+
+--- Locks for reading if it can be done without waiting, and returns whether it did.
+--- @return boolean
+function luv_rwlock_t:tryrdlock() end
+
+--- Like `mutex:lock_async()`, `callback` is called from the loop once the lock is
+--- held for reading.
+--- @param rwlock uv.luv_rwlock_t
+--- @param callback fun()
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.rwlock_rdlock_async(rwlock, callback) end
+
+--- Like `mutex:lock_async()`, `callback` is called from the loop once the lock is
+--- held for reading.
+--- @param callback fun()
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_rwlock_t:rdlock_async(callback) end
+
+--- Releases a read lock.
+--- @param rwlock uv.luv_rwlock_t
+function uv.rwlock_rdunlock(rwlock) end
+
+--- Releases a read lock.
+function luv_rwlock_t:rdunlock() end
+
+--- Locks for writing, blocking the calling thread until it is available.
+--- @param rwlock uv.luv_rwlock_t
+function uv.rwlock_wrlock(rwlock) end
+
+--- Locks for writing, blocking the calling thread until it is available.
+function luv_rwlock_t:wrlock() end
+
+--- Locks for writing if it can be done without waiting, and returns whether it did.
+--- @param rwlock uv.luv_rwlock_t
+--- @return boolean
+function uv.rwlock_trywrlock(rwlock) end
+
+--- Locks for writing if it can be done without waiting, and returns whether it did.
+--- @return boolean
+function luv_rwlock_t:trywrlock() end
+
+--- Like `mutex:lock_async()`, `callback` is called from the loop once the lock is
+--- held for writing.
+--- @param rwlock uv.luv_rwlock_t
+--- @param callback fun()
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.rwlock_wrlock_async(rwlock, callback) end
+
+--- Like `mutex:lock_async()`, `callback` is called from the loop once the lock is
+--- held for writing.
+--- @param callback fun()
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_rwlock_t:wrlock_async(callback) end
+
+--- Releases the write lock.
+--- @param rwlock uv.luv_rwlock_t
+function uv.rwlock_wrunlock(rwlock) end
+
+--- Releases the write lock.
+function luv_rwlock_t:wrunlock() end
+
+--- Creates a condition variable to use with a mutex from `uv.new_mutex()`, shared
+--- between threads like it.
+--- @return uv.luv_cond_t? cond
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.new_cond() end
+
+--- Unlocks `mutex`, which must be locked, and blocks the calling thread until the
+--- condition is signalled or `timeout` milliseconds pass. The mutex is locked again
+--- before returning. Returns `true` if signalled and `false` on timeout.
+--- @param cond uv.luv_cond_t
+--- @param mutex uv.luv_mutex_t
+--- @param timeout integer?
+--- @return boolean? signalled
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.cond_wait(cond, mutex, timeout) end
+
+--- @class uv.luv_cond_t : userdata
+local luv_cond_t = {}
+
+--- Unlocks `mutex`, which must be locked, and blocks the calling thread until the
+--- condition is signalled or `timeout` milliseconds pass. The mutex is locked again
+--- before returning. Returns `true` if signalled and `false` on timeout.
+--- @param mutex uv.luv_mutex_t
+--- @param timeout integer?
+--- @return boolean? signalled
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_cond_t:wait(mutex, timeout) end
+
+--- Unlocks `mutex`, which must be locked, and queues the loop of the calling thread
+--- on the condition. Once signalled it waits for the mutex, and `callback` is
+--- called from the loop with the mutex locked again.
+--- @param cond uv.luv_cond_t
+--- @param mutex uv.luv_mutex_t
+--- @param callback fun()
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.cond_wait_async(cond, mutex, callback) end
+
+--- Unlocks `mutex`, which must be locked, and queues the loop of the calling thread
+--- on the condition. Once signalled it waits for the mutex, and `callback` is
+--- called from the loop with the mutex locked again.
+--- @param mutex uv.luv_mutex_t
+--- @param callback fun()
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_cond_t:wait_async(mutex, callback) end
+
+--- Wakes the first waiter, if any.
+--- @param cond uv.luv_cond_t
+function uv.cond_signal(cond) end
+
+--- Wakes the first waiter, if any.
+function luv_cond_t:signal() end
+
+--- Wakes all waiters.
+--- @param cond uv.luv_cond_t
+function uv.cond_broadcast(cond) end
+
+--- Wakes all waiters.
+function luv_cond_t:broadcast() end
+
+--- Creates a barrier that opens once `count` waiters arrived, shared between threads
+--- like `uv.new_mutex()`. It can be used again once open.
+--- @param count integer
+--- @return uv.luv_barrier_t? barrier
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.new_barrier(count) end
+
+--- Blocks the calling thread until the barrier opens. Returns `true` for the last
+--- to arrive only, like `uv_barrier_wait()`.
+--- @param barrier uv.luv_barrier_t
+--- @return boolean? serial
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.barrier_wait(barrier) end
+
+--- @class uv.luv_barrier_t : userdata
+local luv_barrier_t = {}
+
+--- Blocks the calling thread until the barrier opens. Returns `true` for the last
+--- to arrive only, like `uv_barrier_wait()`.
+--- @return boolean? serial
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_barrier_t:wait() end
+
+--- Arrives at the barrier without blocking. `callback` is called from the loop of the
+--- calling thread once it opens, with `true` for the last to arrive.
+--- @param barrier uv.luv_barrier_t
+--- @param callback fun(serial: boolean)
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.barrier_wait_async(barrier, callback) end
+
+--- Arrives at the barrier without blocking. `callback` is called from the loop of the
+--- calling thread once it opens, with `true` for the last to arrive.
+--- @param callback fun(serial: boolean)
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_barrier_t:wait_async(callback) end
+
+--- Creates a fixed size byte buffer that lives outside of any Lua state. It is
+--- zero-filled when `size` is given, or holds a copy of `data`.
+---
+--- Passing the buffer to `uv.new_thread()`, `uv.queue_work()` or
+--- `uv.async_send()` (or returning it from a work callback) passes a reference
+--- to the same memory instead of copying it. The memory is freed once every
+--- state has collected its reference. Accesses are not synchronized, so threads
+--- must agree on who writes which bytes and when.
+---
+--- Buffers and their slices can be passed wherever a `buffer` is accepted, such
+--- as `uv.write()` and `uv.fs_write()`, and are used in place.
+--- @param size integer|string size in bytes, or the initial data
+--- @return uv.luv_shared_buffer_t
+function uv.new_shared_buffer(size) end
+
+--- Returns the size of the buffer in bytes. `#buffer` is the same.
+--- @param buffer uv.luv_shared_buffer_t
+--- @return integer
+function uv.shared_buffer_size(buffer) end
+
+--- @class uv.luv_shared_buffer_t : userdata
+local luv_shared_buffer_t = {}
+
+--- Returns the size of the buffer in bytes. `#buffer` is the same.
+--- @return integer
+function luv_shared_buffer_t:size() end
+
+--- Returns a copy of `length` bytes starting at the 0-based `offset` as a
+--- string. By default the whole buffer is read.
+--- @param buffer uv.luv_shared_buffer_t
+--- @param offset integer?
+--- @param length integer?
+--- @return string
+function uv.shared_buffer_read(buffer, offset, length) end
+
+--- Returns a copy of `length` bytes starting at the 0-based `offset` as a
+--- string. By default the whole buffer is read.
+--- @param offset integer?
+--- @param length integer?
+--- @return string
+function luv_shared_buffer_t:read(offset, length) end
+
+--- Copies `data` into the buffer at the 0-based `offset` and returns the number
+--- of bytes written. It is an error if `data` does not fit.
+--- @param buffer uv.luv_shared_buffer_t
+--- @param data string|uv.luv_shared_buffer_t
+--- @param offset integer?
+--- @return integer
+function uv.shared_buffer_write(buffer, data, offset) end
+
+--- Copies `data` into the buffer at the 0-based `offset` and returns the number
+--- of bytes written. It is an error if `data` does not fit.
+--- @param data string|uv.luv_shared_buffer_t
+--- @param offset integer?
+--- @return integer
+function luv_shared_buffer_t:write(data, offset) end
+
+--- Returns a new `luv_shared_buffer_t` for `length` bytes of `buffer` starting
+--- at the 0-based `offset`, sharing its memory. The slice keeps the memory
+--- alive on its own.
+--- @param buffer uv.luv_shared_buffer_t
+--- @param offset integer?
+--- @param length integer?
+--- @return uv.luv_shared_buffer_t
+function uv.shared_buffer_slice(buffer, offset, length) end
+
+--- Returns a new `luv_shared_buffer_t` for `length` bytes of `buffer` starting
+--- at the 0-based `offset`, sharing its memory. The slice keeps the memory
+--- alive on its own.
+--- @param offset integer?
+--- @param length integer?
+--- @return uv.luv_shared_buffer_t
+function luv_shared_buffer_t:slice(offset, length) end
+
+--- Creates a map of string keys to values kept in C memory, which any thread can
+--- read and update without going through messages. Like a shared buffer, the map
+--- is passed by reference to `uv.new_thread()`, `uv.queue_work()` and
+--- `uv.async_send()`.
+---
+--- Values are booleans, numbers, strings and tables of those, copied like thread
+--- arguments: `map:get()` returns a new copy of one value. Every update of a key
+--- gives it a new version, larger than any version given before in the map,
+--- which allows updates conditional on the version read.
+---
+--- The keys are spread over 16 parts with their own read/write lock, so threads
+--- updating different keys rarely wait for each other.
+--- @return uv.luv_shared_map_t
+function uv.new_shared_map() end
+
+--- Returns a copy of the value of `key` and its version, or `nil`.
+--- @param map uv.luv_shared_map_t
+--- @param key string
+--- @return any value
+--- @return integer? version
+function uv.shared_map_get(map, key) end
+
+--- @class uv.luv_shared_map_t : userdata
+local luv_shared_map_t = {}
+
+--- Returns a copy of the value of `key` and its version, or `nil`.
+--- @param key string
+--- @return any value
+--- @return integer? version
+function luv_shared_map_t:get(key) end
+
+--- Sets the value of `key`, or removes it when `value` is `nil`. With `version`,
+--- only does so if the key still has that version, `0` meaning absent. Returns
+--- `true` and the new version (`0` once removed), or `false` and the current
+--- version when it didn't match.
+--- @param map uv.luv_shared_map_t
+--- @param key string
+--- @param value any
+--- @param version integer?
+--- @return boolean updated
+--- @return integer version
+function uv.shared_map_set(map, key, value, version) end
+
+--- Sets the value of `key`, or removes it when `value` is `nil`. With `version`,
+--- only does so if the key still has that version, `0` meaning absent. Returns
+--- `true` and the new version (`0` once removed), or `false` and the current
+--- version when it didn't match.
+--- @param key string
+--- @param value any
+--- @param version integer?
+--- @return boolean updated
+--- @return integer version
+function luv_shared_map_t:set(key, value, version) end
+
+--- Returns the version of `key`, `0` if absent, without copying its value. A
+--- cheap way to check whether a value changed since it was read.
+--- @param map uv.luv_shared_map_t
+--- @param key string
+--- @return integer
+function uv.shared_map_version(map, key) end
+
+--- Returns the version of `key`, `0` if absent, without copying its value. A
+--- cheap way to check whether a value changed since it was read.
+--- @param key string
+--- @return integer
+function luv_shared_map_t:version(key) end
+
+--- Returns the number of keys, also available as `#map`.
+--- @param map uv.luv_shared_map_t
+--- @return integer
+function uv.shared_map_count(map) end
+
+--- Returns the number of keys, also available as `#map`.
+--- @return integer
+function luv_shared_map_t:count() end
+
+--- Copies the whole map as it is at one point in time, with all its parts locked
+--- for reading meanwhile. Returns a table of the values by key and a table of
+--- their versions by key.
+--- @param map uv.luv_shared_map_t
+--- @return table<string, any> values
+--- @return table<string, integer> versions
+function uv.shared_map_snapshot(map) end
+
+--- Copies the whole map as it is at one point in time, with all its parts locked
+--- for reading meanwhile. Returns a table of the values by key and a table of
+--- their versions by key.
+--- @return table<string, any> values
+--- @return table<string, integer> versions
+function luv_shared_map_t:snapshot() end
+
+--- Returns an iterator over a snapshot of the map, giving the key, value and
+--- version of each entry: `for key, value, version in map:pairs() do ... end`.
+--- Updates made during the loop are not seen.
+--- @param map uv.luv_shared_map_t
+--- @return function iterator
+function uv.shared_map_pairs(map) end
+
+--- Returns an iterator over a snapshot of the map, giving the key, value and
+--- version of each entry: `for key, value, version in map:pairs() do ... end`.
+--- Updates made during the loop are not seen.
+--- @return function iterator
+function luv_shared_map_t:pairs() end
+
+--- Creates a queue of at most `options.capacity` messages (64 by default) that
+--- any thread can send to and receive from. Like a shared buffer, the channel
+--- is passed by reference to `uv.new_thread()`, `uv.queue_work()` and
+--- `uv.async_send()`.
+---
+--- A message is the values given to `channel:send()`, copied like thread
+--- arguments. Messages are received in the order they were sent, each one by a
+--- single receiver.
+--- @param options { capacity: integer? }?
+--- @return uv.luv_channel_t? channel
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.new_channel(options) end
+
+--- Queues the values as one message, waiting for room while the channel is
+--- full. Fails with `EPIPE` once the channel is closed.
+--- **Warning**:
+--- Waiting blocks the whole thread. In a thread that receives with
+--- `channel:recv_start()`, use `channel:try_send()` instead.
+--- @param channel uv.luv_channel_t
+--- @param ... uv.threadargs
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.channel_send(channel, ...) end
+
+--- @class uv.luv_channel_t : userdata
+local luv_channel_t = {}
+
+--- Queues the values as one message, waiting for room while the channel is
+--- full. Fails with `EPIPE` once the channel is closed.
+--- **Warning**:
+--- Waiting blocks the whole thread. In a thread that receives with
+--- `channel:recv_start()`, use `channel:try_send()` instead.
+--- @param ... uv.threadargs
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_channel_t:send(...) end
+
+--- Like `channel:send()`, but returns `false` without waiting when the channel
+--- is full.
+--- @param channel uv.luv_channel_t
+--- @param ... uv.threadargs
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.channel_try_send(channel, ...) end
+
+--- Like `channel:send()`, but returns `false` without waiting when the channel
+--- is full.
+--- @param ... uv.threadargs
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_channel_t:try_send(...) end
+
+--- Waits for the next message and returns its values. Fails with `EOF` once the
+--- channel is closed and every message has been received.
+---
+--- This blocks the calling thread, it is meant for threads and work callbacks
+--- rather than loops.
+--- @param channel uv.luv_channel_t
+--- @return uv.threadargs ...
+function uv.channel_recv(channel) end
+
+--- Waits for the next message and returns its values. Fails with `EOF` once the
+--- channel is closed and every message has been received.
+---
+--- This blocks the calling thread, it is meant for threads and work callbacks
+--- rather than loops.
+--- @return uv.threadargs ...
+function luv_channel_t:recv() end
+
+--- Receives messages in the loop of the calling thread: `callback` is called
+--- with the values of each message, in order. Sends wake the loop through an
+--- internal async handle, which keeps the loop alive until
+--- `channel:recv_stop()` is called or the channel is closed and drained.
+---
+--- Only one loop can receive from a channel at a time, it fails with `EBUSY`
+--- otherwise. Blocking `channel:recv()` calls in other threads can still take
+--- messages.
+--- @param channel uv.luv_channel_t
+--- @param callback fun(...: uv.threadargs)
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.channel_recv_start(channel, callback) end
+
+--- Receives messages in the loop of the calling thread: `callback` is called
+--- with the values of each message, in order. Sends wake the loop through an
+--- internal async handle, which keeps the loop alive until
+--- `channel:recv_stop()` is called or the channel is closed and drained.
+---
+--- Only one loop can receive from a channel at a time, it fails with `EBUSY`
+--- otherwise. Blocking `channel:recv()` calls in other threads can still take
+--- messages.
+--- @param callback fun(...: uv.threadargs)
+--- @return boolean? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_channel_t:recv_start(callback) end
+
+--- Stops receiving with `channel:recv_start()`. It must be called from the
+--- thread of the receiving loop, it fails with `EINVAL` otherwise.
+--- @param channel uv.luv_channel_t
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function uv.channel_recv_stop(channel) end
+
+--- Stops receiving with `channel:recv_start()`. It must be called from the
+--- thread of the receiving loop, it fails with `EINVAL` otherwise.
+--- @return 0? success
+--- @return string? err
+--- @return uv.error_name? err_name
+function luv_channel_t:recv_stop() end
+
+--- Closes the channel. Later sends fail and waiting senders are woken up.
+--- Messages already queued can still be received.
+--- @param channel uv.luv_channel_t
+function uv.channel_close(channel) end
+
+--- Closes the channel. Later sends fail and waiting senders are woken up.
+--- Messages already queued can still be received.
+function luv_channel_t:close() end
+
+--- Returns the number of queued messages. `#channel` is the same.
+--- @param channel uv.luv_channel_t
+--- @return integer
+function uv.channel_count(channel) end
+
+--- Returns the number of queued messages. `#channel` is the same.
+--- @return integer
+function luv_channel_t:count() end
+
 
 --- # Miscellaneous utilities
 
@@ -4591,7 +5984,10 @@ function uv.wtf8_to_utf16(wtf8) end
 
 --- @alias uv.buffer
 --- | string
---- | string[]
+--- | uv.luv_shared_buffer_t
+--- | (string|luv_shared_buffer_t)[]
+
+--- @class uv.luv_tcp_token_t : userdata
 
 --- @class uv.socketinfo
 --- @field ip string
@@ -4603,6 +5999,7 @@ function uv.wtf8_to_utf16(wtf8) end
 --- | boolean
 --- | string
 --- | userdata
+--- | table
 
 --- @class uv.uv_connect_t : uv.uv_req_t
 
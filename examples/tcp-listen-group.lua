@@ -0,0 +1,32 @@
+-- The same server as tcp-cluster.lua, with a loop thread per CPU core instead
+-- of child processes. Every thread listens on the port and the kernel spreads
+-- the connections between them.
+local p = require('lib/utils').prettyPrint
+local uv = require('luv')
+
+local cpu_count = uv.available_parallelism()
+
+local group = assert(uv.tcp_listen_group("::1", 1337, cpu_count, function (index)
+  return function (client)
+    client:write("BYE from thread " .. index .. "!\n")
+    client:shutdown(function ()
+      client:close()
+    end)
+  end
+end))
+print("Listening on TCP port 1337 on ::1 with " .. cpu_count .. " threads")
+
+-- Report every few seconds, stop on Ctrl-C
+local timer = uv.new_timer()
+timer:start(5000, 5000, function ()
+  p(group:metrics())
+end)
+
+local sigint = uv.new_signal()
+sigint:start("sigint", function ()
+  sigint:close()
+  timer:close()
+  group:stop(1000)
+end)
+
+uv.run()
@@ -0,0 +1,55 @@
+-- Measures the per job cost of large work functions. Worker states cache the
+-- compiled function of each work ctx, so after the first job on a thread a
+-- 50 KB function should cost about as much as a tiny one. A new ctx per job
+-- has nothing cached and shows the cost of compiling on every job, which is
+-- what every job paid before the cache.
+local uv = require('luv')
+
+local jobs = tonumber(arg and arg[1]) or 500
+local big = string.dump(load("local s = '" .. string.rep("x", 50 * 1024) .. "' return #s"))
+local small = string.dump(load("return 1"))
+
+local function report(name, code, start)
+  local per_job = (uv.hrtime() - start) / jobs / 1000
+  print(string.format("%-22s %6d bytes  %8.1f us per job", name, #code, per_job))
+end
+
+-- Runs the jobs one after another on the same ctx
+local function cached(name, code, nxt)
+  local done, start = 0, uv.hrtime()
+  local ctx
+  ctx = uv.new_work(code, function ()
+    done = done + 1
+    if done < jobs then
+      return ctx:queue()
+    end
+    report(name, code, start)
+    nxt()
+  end)
+  ctx:queue()
+end
+
+-- Runs every job on a ctx of its own, so no state has it compiled yet
+local function uncached(name, code, nxt)
+  local done, start = 0, uv.hrtime()
+  local function queue()
+    uv.new_work(code, function ()
+      done = done + 1
+      if done < jobs then
+        return queue()
+      end
+      report(name, code, start)
+      nxt()
+    end):queue()
+  end
+  queue()
+end
+
+print(string.format("%d jobs, threadpool of %s", jobs, os.getenv("UV_THREADPOOL_SIZE") or "4"))
+cached("small, cached", small, function ()
+  cached("big, cached", big, function ()
+    uncached("big, compiled per job", big, function () end)
+  end)
+end)
+
+uv.run()
@@ -22,20 +22,100 @@ static uv_async_t* luv_check_async(lua_State* L, int index) {
   return handle;
 }
 
+typedef struct {
+  luv_mpsc_t queue;  // luv_thread_msg_t sent and not yet delivered
+  int batch;         // deliver all pending messages in one call
+} luv_async_t;
+
+// Calls the callback once per message, in the order they were sent.
+static void luv_async_deliver(lua_State* L, uv_async_t* handle, luv_async_t* async) {
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_mpsc_node_t* node;
+  // messages left after the handle is closed are dropped by luv_async_extra_gc
+  while (!uv_is_closing((uv_handle_t*)handle) && (node = luv_mpsc_pop(&async->queue))) {
+    luv_thread_msg_t* msg = (luv_thread_msg_t*)node;
+    int n = luv_thread_arg_push(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+    luv_call_callback(L, data, LUV_ASYNC, n);
+    luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+    luv_thread_msg_free(msg);
+  }
+}
+
+// Calls the callback once with an array of the pending messages, each one
+// an array of its values with their count in n.
+static void luv_async_deliver_batch(lua_State* L, uv_async_t* handle, luv_async_t* async) {
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_mpsc_node_t* first = NULL;
+  luv_mpsc_node_t* last = NULL;
+  luv_mpsc_node_t* node;
+  int count = 0;
+  int i;
+
+  lua_newtable(L);
+  while ((node = luv_mpsc_pop(&async->queue))) {
+    luv_thread_msg_t* msg = (luv_thread_msg_t*)node;
+    int n;
+    lua_createtable(L, msg->args.argc, 1);
+    n = luv_thread_arg_push(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+    for (i = n; i > 0; i--)
+      lua_rawseti(L, -(i + 1), i);
+    lua_pushinteger(L, n);
+    lua_setfield(L, -2, "n");
+    lua_rawseti(L, -2, ++count);
+    // popped nodes are only touched by this thread, keep them until the
+    // callback is done with the values
+    luv_atomic_ptr_store(&node->next, NULL);
+    if (last)
+      luv_atomic_ptr_store(&last->next, node);
+    else
+      first = node;
+    last = node;
+  }
+  if (count == 0) {
+    lua_pop(L, 1);
+    return;
+  }
+  luv_call_callback(L, data, LUV_ASYNC, 1);
+  while (first) {
+    luv_thread_msg_t* msg = (luv_thread_msg_t*)first;
+    first = (luv_mpsc_node_t*)luv_atomic_ptr_load(&first->next);
+    luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+    luv_thread_msg_free(msg);
+  }
+}
+
 static void luv_async_cb(uv_async_t* handle) {
   luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_async_t* async = (luv_async_t*)data->extra;
   lua_State* L = data->ctx->L;
-  int n = luv_thread_arg_push(L, (luv_thread_arg_t*)data->extra, LUVF_THREAD_SIDE_MAIN);
-  luv_call_callback(L, data, LUV_ASYNC, n);
-  luv_thread_arg_clear(L, (luv_thread_arg_t*)data->extra, LUVF_THREAD_SIDE_MAIN);
+  if (async->batch)
+    luv_async_deliver_batch(L, handle, async);
+  else
+    luv_async_deliver(L, handle, async);
+}
+
+static void luv_async_extra_gc(void* extra) {
+  luv_async_t* async = (luv_async_t*)extra;
+  luv_mpsc_node_t* node;
+  while ((node = luv_mpsc_pop(&async->queue)))
+    luv_thread_msg_drop((luv_thread_msg_t*)node);
+  free(async);
 }
 
 static int luv_new_async(lua_State* L) {
   uv_async_t* handle;
   luv_handle_t* data;
+  luv_async_t* async;
+  int batch = 0;
   int ret;
   luv_ctx_t* ctx = luv_context(L);
   luaL_checktype(L, 1, LUA_TFUNCTION);
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "batch");
+    batch = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
   handle = (uv_async_t*)luv_newuserdata(L, uv_handle_size(UV_ASYNC));
   ret = uv_async_init(ctx->loop, handle, luv_async_cb);
   if (ret < 0) {
@@ -43,26 +123,29 @@ static int luv_new_async(lua_State* L) {
     return luv_error(L, ret);
   }
   data = luv_setup_handle(L, ctx);
-  data->extra = (luv_thread_arg_t*)malloc(sizeof(luv_thread_arg_t));
-  if (!data->extra) {
+  async = (luv_async_t*)malloc(sizeof(luv_async_t));
+  if (!async) {
     handle->data = data;
     uv_close((uv_handle_t*)handle, luv_handle_free);
     return luaL_error(L, "Failed to allocate async args");
   }
-  data->extra_gc = free;
-  memset(data->extra, 0, sizeof(luv_thread_arg_t));
+  luv_mpsc_init(&async->queue);
+  async->batch = batch;
+  data->extra = async;
+  data->extra_gc = luv_async_extra_gc;
   handle->data = data;
   luv_check_callback(L, (luv_handle_t*)handle->data, LUV_ASYNC, 1);
   return 1;
 }
 
+// Can be called from any thread. Every send is queued and delivered, even
+// when libuv coalesces several sends into one wakeup.
 static int luv_async_send(lua_State* L) {
-  int ret;
   uv_async_t* handle = luv_check_async(L, 1);
-  luv_thread_arg_t* arg = (luv_thread_arg_t *)((luv_handle_t*) handle->data)->extra;
-
-  luv_thread_arg_set(L, arg, 2, lua_gettop(L), LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_CHILD);
-  ret = uv_async_send(handle);
-  luv_thread_arg_clear(L, arg, LUVF_THREAD_SIDE_CHILD);
-  return luv_result(L, ret);
+  luv_async_t* async = (luv_async_t*)((luv_handle_t*)handle->data)->extra;
+  luv_thread_msg_t* msg = luv_thread_msg_new(L, 2, lua_gettop(L));
+  if (!msg)
+    return luv_thread_arg_error(L);
+  luv_mpsc_push(&async->queue, &msg->node);
+  return luv_result(L, uv_async_send(handle));
 }
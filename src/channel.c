@@ -0,0 +1,337 @@
+/*
+*  Copyright 2014 The Luvit Authors. All Rights Reserved.
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+#include "private.h"
+
+#define LUV_CHANNEL_CAPACITY 64
+
+typedef struct luv_channel_recv_s luv_channel_recv_t;
+
+// A bounded queue of messages shared by reference between states, so any
+// thread can send or receive.
+typedef struct {
+  luv_shared_t shared;
+  uv_mutex_t mutex;
+  uv_cond_t not_empty;
+  uv_cond_t not_full;
+  luv_channel_recv_t* receiver;  // loop receiving with recv_start
+  int ready;                     // mutex and conditions are initialized
+  int closed;
+  size_t capacity;
+  size_t head;
+  size_t count;
+  luv_thread_msg_t* ring[1];     // capacity messages
+} luv_channel_t;
+
+// extra of the async handle that wakes a loop receiving from a channel
+struct luv_channel_recv_s {
+  luv_channel_t* channel;  // holds a reference
+  uv_async_t* handle;
+  luv_ctx_t* ctx;          // of the loop the handle belongs to
+};
+
+static void luv_channel_free(luv_shared_t* shared) {
+  luv_channel_t* channel = (luv_channel_t*)shared;
+  while (channel->count > 0) {
+    luv_thread_msg_drop(channel->ring[channel->head]);
+    channel->head = (channel->head + 1) % channel->capacity;
+    channel->count--;
+  }
+  if (channel->ready) {
+    uv_cond_destroy(&channel->not_full);
+    uv_cond_destroy(&channel->not_empty);
+    uv_mutex_destroy(&channel->mutex);
+  }
+  free(channel);
+}
+
+static luv_channel_t* luv_check_channel(lua_State* L, int index) {
+  return (luv_channel_t*)luv_shared_check(L, index, "luv_channel");
+}
+
+static int luv_new_channel(lua_State* L) {
+  luv_channel_t* channel;
+  lua_Integer capacity = LUV_CHANNEL_CAPACITY;
+  int ret;
+  if (!lua_isnoneornil(L, 1)) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_getfield(L, 1, "capacity");
+    if (!lua_isnil(L, -1))
+      capacity = luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+    luaL_argcheck(L, capacity > 0, 1, "capacity must be > 0");
+    // the slots are allocated with the channel, keep their size in range
+    luaL_argcheck(L, capacity <= INT_MAX &&
+      (size_t)capacity <= (SIZE_MAX - sizeof(*channel)) / sizeof(luv_thread_msg_t*),
+      1, "capacity is too large");
+  }
+  channel = (luv_channel_t*)luv_shared_new(L,
+    sizeof(*channel) + (size_t)(capacity - 1) * sizeof(luv_thread_msg_t*),
+    "luv_channel", luv_channel_free);
+  channel->capacity = (size_t)capacity;
+  ret = uv_mutex_init(&channel->mutex);
+  if (ret < 0) {
+    lua_pop(L, 1);
+    return luv_error(L, ret);
+  }
+  ret = uv_cond_init(&channel->not_empty);
+  if (ret == 0) {
+    ret = uv_cond_init(&channel->not_full);
+    if (ret < 0)
+      uv_cond_destroy(&channel->not_empty);
+  }
+  if (ret < 0) {
+    uv_mutex_destroy(&channel->mutex);
+    lua_pop(L, 1);
+    return luv_error(L, ret);
+  }
+  channel->ready = 1;
+  return 1;
+}
+
+// Takes the oldest message, called with the mutex held.
+static luv_thread_msg_t* luv_channel_shift(luv_channel_t* channel) {
+  luv_thread_msg_t* msg;
+  if (channel->count == 0)
+    return NULL;
+  msg = channel->ring[channel->head];
+  channel->head = (channel->head + 1) % channel->capacity;
+  channel->count--;
+  uv_cond_signal(&channel->not_full);
+  return msg;
+}
+
+static int luv_channel_put(lua_State* L, int wait) {
+  luv_channel_t* channel = luv_check_channel(L, 1);
+  // copy the values before taking the lock
+  luv_thread_msg_t* msg = luv_thread_msg_new(L, 2, lua_gettop(L));
+  if (!msg)
+    return luv_thread_arg_error(L);
+
+  uv_mutex_lock(&channel->mutex);
+  while (wait && channel->count == channel->capacity && !channel->closed)
+    uv_cond_wait(&channel->not_full, &channel->mutex);
+  if (channel->closed || channel->count == channel->capacity) {
+    int closed = channel->closed;
+    uv_mutex_unlock(&channel->mutex);
+    luv_thread_msg_drop(msg);
+    if (closed)
+      return luv_error(L, UV_EPIPE);
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+  channel->ring[(channel->head + channel->count) % channel->capacity] = msg;
+  channel->count++;
+  uv_cond_signal(&channel->not_empty);
+  if (channel->receiver)
+    uv_async_send(channel->receiver->handle);
+  uv_mutex_unlock(&channel->mutex);
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+static int luv_channel_send(lua_State* L) {
+  return luv_channel_put(L, 1);
+}
+
+static int luv_channel_try_send(lua_State* L) {
+  return luv_channel_put(L, 0);
+}
+
+static int luv_channel_recv(lua_State* L) {
+  luv_channel_t* channel = luv_check_channel(L, 1);
+  luv_thread_msg_t* msg;
+  int n;
+
+  uv_mutex_lock(&channel->mutex);
+  while (channel->count == 0 && !channel->closed)
+    uv_cond_wait(&channel->not_empty, &channel->mutex);
+  msg = luv_channel_shift(channel);
+  uv_mutex_unlock(&channel->mutex);
+  if (!msg)
+    return luv_error(L, UV_EOF);
+
+  n = luv_thread_arg_push(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+  luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+  luv_thread_msg_free(msg);
+  return n;
+}
+
+// Stops receiving in the loop, called from the loop thread.
+static void luv_channel_recv_close(luv_channel_recv_t* recv) {
+  luv_channel_t* channel = recv->channel;
+  uv_mutex_lock(&channel->mutex);
+  if (channel->receiver == recv)
+    channel->receiver = NULL;
+  uv_mutex_unlock(&channel->mutex);
+  if (!uv_is_closing((uv_handle_t*)recv->handle))
+    uv_close((uv_handle_t*)recv->handle, luv_close_cb);
+}
+
+static void luv_channel_recv_cb(uv_async_t* handle) {
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_channel_recv_t* recv = (luv_channel_recv_t*)data->extra;
+  luv_channel_t* channel = recv->channel;
+  lua_State* L = data->ctx->L;
+  size_t pending;
+  int done;
+
+  // only take what is queued now, later sends wake the loop again
+  uv_mutex_lock(&channel->mutex);
+  pending = channel->count;
+  uv_mutex_unlock(&channel->mutex);
+
+  while (pending-- > 0 && !uv_is_closing((uv_handle_t*)handle)) {
+    luv_thread_msg_t* msg;
+    int n;
+    uv_mutex_lock(&channel->mutex);
+    msg = luv_channel_shift(channel);
+    uv_mutex_unlock(&channel->mutex);
+    // a blocking recv in another thread may have taken it
+    if (!msg)
+      break;
+    n = luv_thread_arg_push(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+    luv_call_callback(L, data, LUV_ASYNC, n);
+    luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+    luv_thread_msg_free(msg);
+  }
+
+  // a closed channel stops its receiver once drained, so the loop can end
+  uv_mutex_lock(&channel->mutex);
+  done = channel->closed && channel->count == 0;
+  uv_mutex_unlock(&channel->mutex);
+  if (done)
+    luv_channel_recv_close(recv);
+}
+
+static void luv_channel_recv_gc(void* extra) {
+  luv_channel_recv_t* recv = (luv_channel_recv_t*)extra;
+  luv_channel_t* channel = recv->channel;
+  // the handle may have been closed without recv_stop, by uv.walk or loop_gc
+  uv_mutex_lock(&channel->mutex);
+  if (channel->receiver == recv)
+    channel->receiver = NULL;
+  uv_mutex_unlock(&channel->mutex);
+  luv_shared_release(&channel->shared);
+  free(recv);
+}
+
+static int luv_channel_recv_start(lua_State* L) {
+  luv_channel_t* channel = luv_check_channel(L, 1);
+  luv_ctx_t* ctx = luv_context(L);
+  luv_channel_recv_t* recv;
+  uv_async_t* handle;
+  luv_handle_t* data;
+  int ret;
+  luv_check_callable(L, 2);
+
+  recv = (luv_channel_recv_t*)malloc(sizeof(*recv));
+  if (!recv)
+    return luaL_error(L, "Failed to allocate channel receiver");
+  handle = (uv_async_t*)luv_newuserdata(L, uv_handle_size(UV_ASYNC));
+  ret = uv_async_init(ctx->loop, handle, luv_channel_recv_cb);
+  if (ret < 0) {
+    free(recv);
+    lua_pop(L, 1);
+    return luv_error(L, ret);
+  }
+  data = luv_setup_handle(L, ctx);
+  handle->data = data;
+  recv->channel = channel;
+  recv->handle = handle;
+  recv->ctx = ctx;
+
+  uv_mutex_lock(&channel->mutex);
+  if (channel->receiver) {
+    uv_mutex_unlock(&channel->mutex);
+    free(recv);
+    uv_close((uv_handle_t*)handle, luv_close_cb);
+    return luv_error(L, UV_EBUSY);
+  }
+  channel->receiver = recv;
+  // deliver what was sent before receiving started
+  if (channel->count > 0 || channel->closed)
+    uv_async_send(handle);
+  uv_mutex_unlock(&channel->mutex);
+
+  luv_shared_retain(&channel->shared);
+  data->extra = recv;
+  data->extra_gc = luv_channel_recv_gc;
+  luv_check_callback(L, data, LUV_ASYNC, 2);
+  lua_pop(L, 1);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+static int luv_channel_recv_stop(lua_State* L) {
+  luv_channel_t* channel = luv_check_channel(L, 1);
+  luv_channel_recv_t* recv;
+  luv_ctx_t* owner = NULL;
+  uv_mutex_lock(&channel->mutex);
+  recv = channel->receiver;
+  if (recv)
+    owner = recv->ctx;
+  uv_mutex_unlock(&channel->mutex);
+  if (!recv)
+    return 0;
+  // the handle can only be closed by the thread running its loop, which is
+  // also the only one that frees recv
+  if (owner != luv_context(L))
+    return luv_error(L, UV_EINVAL);
+  luv_channel_recv_close(recv);
+  return 0;
+}
+
+static int luv_channel_close(lua_State* L) {
+  luv_channel_t* channel = luv_check_channel(L, 1);
+  uv_mutex_lock(&channel->mutex);
+  channel->closed = 1;
+  uv_cond_broadcast(&channel->not_empty);
+  uv_cond_broadcast(&channel->not_full);
+  if (channel->receiver)
+    uv_async_send(channel->receiver->handle);
+  uv_mutex_unlock(&channel->mutex);
+  return 0;
+}
+
+static int luv_channel_count(lua_State* L) {
+  luv_channel_t* channel = luv_check_channel(L, 1);
+  size_t count;
+  uv_mutex_lock(&channel->mutex);
+  count = channel->count;
+  uv_mutex_unlock(&channel->mutex);
+  lua_pushinteger(L, count);
+  return 1;
+}
+
+static const luaL_Reg luv_channel_methods[] = {
+  {"send", luv_channel_send},
+  {"try_send", luv_channel_try_send},
+  {"recv", luv_channel_recv},
+  {"recv_start", luv_channel_recv_start},
+  {"recv_stop", luv_channel_recv_stop},
+  {"close", luv_channel_close},
+  {"count", luv_channel_count},
+  {NULL, NULL}
+};
+
+static void luv_channel_init(lua_State* L) {
+  luv_shared_newmetatable(L, "luv_channel", luv_channel_methods);
+  lua_pushcfunction(L, luv_channel_count);
+  lua_setfield(L, -2, "__len");
+  lua_pop(L, 1);
+}
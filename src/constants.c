@@ -41,6 +41,10 @@ static int luv_constants(lua_State* L) {
   lua_pushinteger(L, O_CREAT);
   lua_setfield(L, -2, "O_CREAT");
 #endif
+#if defined(UV_FS_O_DIRECT) && UV_FS_O_DIRECT != 0
+  lua_pushinteger(L, UV_FS_O_DIRECT);
+  lua_setfield(L, -2, "O_DIRECT");
+#endif
 #ifdef O_DSYNC
   lua_pushinteger(L, O_DSYNC);
   lua_setfield(L, -2, "O_DSYNC");
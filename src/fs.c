@@ -16,6 +16,11 @@
  */
 
 #include "private.h"
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #if LUV_UV_VERSION_GEQ(1, 28, 0)
 typedef struct {
@@ -145,16 +150,16 @@ static int luv_push_dirent(lua_State* L, const uv_dirent_t* ent, int table) {
   return table ? 1 : 2;
 }
 
-static int luv_check_flags(lua_State* L, int index) {
-  const char* string;
-  if (lua_isnumber(L, index)) {
-    return lua_tointeger(L, index);
-  }
-  else if (!lua_isstring(L, index)) {
-    return luaL_argerror(L, index, "Expected string or integer for file open mode");
-  }
-  string = lua_tostring(L, index);
+#if defined(UV_FS_O_DIRECT) && UV_FS_O_DIRECT != 0
+#define LUV_FS_O_DIRECT UV_FS_O_DIRECT
+#endif
+
+// Buffers used with O_DIRECT must be aligned to the logical block size of
+// the underlying device. 4096 covers every sector size in common use.
+#define LUV_FS_DIRECT_ALIGN 4096
+#define LUV_FS_DIRECT_BLOCK 512
 
+static int luv_parse_flags(const char* string) {
   if (strcmp(string, "r")   == 0) return O_RDONLY;
 #ifdef O_SYNC
   if (strcmp(string, "rs")  == 0 ||
@@ -178,7 +183,39 @@ static int luv_check_flags(lua_State* L, int index) {
   if (strcmp(string, "ax+") == 0 ||
       strcmp(string, "xa+") == 0) return O_APPEND | O_CREAT | O_RDWR   | O_EXCL;
 
-  return luaL_error(L, "Unknown file open flag '%s'", string);
+  return -1;
+}
+
+static int luv_check_flags(lua_State* L, int index) {
+  const char* string;
+  char mode[8];
+  size_t len;
+  int flags, direct = 0;
+  if (lua_isnumber(L, index)) {
+    return lua_tointeger(L, index);
+  }
+  else if (!lua_isstring(L, index)) {
+    return luaL_argerror(L, index, "Expected string or integer for file open mode");
+  }
+  string = lua_tolstring(L, index, &len);
+
+  // A trailing 'd' asks for direct I/O, for example "rd" or "w+d"
+  if (len > 1 && len < sizeof(mode) && string[len - 1] == 'd') {
+    memcpy(mode, string, len - 1);
+    mode[len - 1] = '\0';
+    direct = 1;
+  }
+  flags = luv_parse_flags(direct ? mode : string);
+  if (flags == -1)
+    return luaL_error(L, "Unknown file open flag '%s'", string);
+  if (direct) {
+#ifdef LUV_FS_O_DIRECT
+    flags |= LUV_FS_O_DIRECT;
+#else
+    return luaL_error(L, "Direct I/O is not supported on this platform");
+#endif
+  }
+  return flags;
 }
 
 static int luv_check_amode(lua_State* L, int index) {
@@ -249,6 +286,292 @@ static int fs_req_has_dest_path(uv_fs_t* req) {
   }
 }
 
+/* Descriptors opened for direct I/O, shared by every state in the process so
+   that a descriptor passed to a thread or work callback keeps its aligned
+   reads and writes. Only fs_read and fs_write on these descriptors pay for
+   alignment, every other call only loads the count. A descriptor closed
+   without fs_close stays listed, which costs its reuse an aligned buffer. */
+static uv_once_t luv_fs_direct_once = UV_ONCE_INIT;
+static uv_mutex_t luv_fs_direct_mutex;
+static luv_atomic_t luv_fs_direct_count;
+static uv_file* luv_fs_direct_fds;
+static size_t luv_fs_direct_cap;
+
+// Marks a request as direct I/O in its data_ref. An open adds its descriptor
+// to the list, a read has data->data over-allocated so it can be aligned.
+#define LUV_FS_DIRECT_REQ (-0x1235)
+
+static void luv_fs_direct_init_once(void) {
+  uv_mutex_init(&luv_fs_direct_mutex);
+}
+
+static void luv_fs_direct_add(uv_file file) {
+  size_t i, count;
+  uv_once(&luv_fs_direct_once, luv_fs_direct_init_once);
+  uv_mutex_lock(&luv_fs_direct_mutex);
+  count = (size_t)luv_atomic_load(&luv_fs_direct_count);
+  for (i = 0; i < count && luv_fs_direct_fds[i] != file; i++);
+  if (i == count) {
+    if (count == luv_fs_direct_cap) {
+      size_t cap = luv_fs_direct_cap ? luv_fs_direct_cap * 2 : 8;
+      uv_file* fds = (uv_file*)realloc(luv_fs_direct_fds, cap * sizeof(*fds));
+      // without an entry the descriptor gets EINVAL for unaligned buffers
+      if (!fds) {
+        uv_mutex_unlock(&luv_fs_direct_mutex);
+        return;
+      }
+      luv_fs_direct_fds = fds;
+      luv_fs_direct_cap = cap;
+    }
+    luv_fs_direct_fds[count] = file;
+    (void)luv_atomic_inc(&luv_fs_direct_count);
+  }
+  uv_mutex_unlock(&luv_fs_direct_mutex);
+}
+
+static void luv_fs_direct_remove(uv_file file) {
+  size_t i, count;
+  if (luv_atomic_load(&luv_fs_direct_count) == 0)
+    return;
+  uv_mutex_lock(&luv_fs_direct_mutex);
+  count = (size_t)luv_atomic_load(&luv_fs_direct_count);
+  for (i = 0; i < count; i++) {
+    if (luv_fs_direct_fds[i] == file) {
+      luv_fs_direct_fds[i] = luv_fs_direct_fds[count - 1];
+      (void)luv_atomic_dec(&luv_fs_direct_count);
+      break;
+    }
+  }
+  uv_mutex_unlock(&luv_fs_direct_mutex);
+}
+
+static int luv_fs_is_direct(uv_file file) {
+  size_t i, count;
+  int found = 0;
+  if (luv_atomic_load(&luv_fs_direct_count) == 0)
+    return 0;
+  uv_mutex_lock(&luv_fs_direct_mutex);
+  count = (size_t)luv_atomic_load(&luv_fs_direct_count);
+  for (i = 0; i < count && !found; i++)
+    found = luv_fs_direct_fds[i] == file;
+  uv_mutex_unlock(&luv_fs_direct_mutex);
+  return found;
+}
+
+/* Buffers for direct I/O are over-allocated by LUV_FS_DIRECT_ALIGN - 1 bytes
+   and used from the first aligned address, so the allocation itself can
+   still be released with free(). */
+static char* luv_fs_direct_align(void* base) {
+  uintptr_t start = (uintptr_t)base;
+  return (char*)base + (LUV_FS_DIRECT_ALIGN - start % LUV_FS_DIRECT_ALIGN) % LUV_FS_DIRECT_ALIGN;
+}
+
+static char* luv_fs_direct_alloc(size_t len, void** base) {
+  *base = malloc(len + LUV_FS_DIRECT_ALIGN - 1);
+  return *base ? luv_fs_direct_align(*base) : NULL;
+}
+
+/* Copies up to len bytes between two descriptors at explicit offsets without
+   moving either file position. Uses copy_file_range(2) where available and
+   falls back to a read/write loop. Returns the number of bytes copied, 0 at
+   the end of the input, or a negative libuv error code. Runs on the
+   threadpool with synchronous uv_fs_* calls. */
+#define LUV_FS_COPY_CHUNK (8 * 1024 * 1024)
+#define LUV_FS_COPY_BUFSIZE (256 * 1024)
+
+static int64_t luv_fs_copy_chunk(uv_loop_t* loop, uv_file in, int64_t in_offset,
+                                 uv_file out, int64_t out_offset, size_t len) {
+  uv_fs_t req;
+  uv_buf_t buf;
+  char* base;
+  int64_t nread, written;
+#if defined(__linux__) && defined(__NR_copy_file_range)
+  loff_t in_pos = in_offset, out_pos = out_offset;
+  ssize_t n = syscall(__NR_copy_file_range, in, &in_pos, out, &out_pos, len, 0);
+  if (n >= 0)
+    return n;
+  // Fall back to copying through userspace when the kernel or filesystem
+  // can't do it, e.g. across filesystems on older kernels.
+  if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+      errno != EOPNOTSUPP && errno != EPERM)
+    return -errno;
+#endif
+  if (len > LUV_FS_COPY_BUFSIZE)
+    len = LUV_FS_COPY_BUFSIZE;
+  base = (char*)malloc(len);
+  if (!base)
+    return UV_ENOMEM;
+  buf = uv_buf_init(base, len);
+  nread = uv_fs_read(loop, &req, in, &buf, 1, in_offset, NULL);
+  uv_fs_req_cleanup(&req);
+  for (written = 0; nread > 0 && written < nread; ) {
+    int64_t n;
+    buf = uv_buf_init(base + written, nread - written);
+    n = uv_fs_write(loop, &req, out, &buf, 1, out_offset + written, NULL);
+    uv_fs_req_cleanup(&req);
+    // a write that makes no progress would spin forever
+    if (n <= 0) {
+      nread = n < 0 ? n : UV_EIO;
+      break;
+    }
+    written += n;
+  }
+  free(base);
+  return nread;
+}
+
+/* Operations that libuv has no uv_fs_* function for. They run on the
+   threadpool as uv_work_t requests kept in the request userdata, and report
+   their result the same way as the uv_fs_* calls. */
+typedef enum {
+  LUV_FS_OP_FALLOCATE,
+  LUV_FS_OP_FADVISE,
+  LUV_FS_OP_COPY_RANGE
+} luv_fs_op_kind;
+
+typedef struct {
+  uv_work_t work;  // first, so the userdata is a uv_req_t
+  uv_loop_t* loop;
+  luv_fs_op_kind kind;
+  int64_t result;
+  uv_file file;
+  int64_t offset;
+  int64_t length;
+  int advice;
+  // copy_range only
+  uv_file out_file;
+  int64_t out_offset;
+  int64_t copied;
+  size_t chunk_size;
+} luv_fs_op_t;
+
+static void luv_fs_op_run(luv_fs_op_t* op) {
+  int64_t ret = UV_ENOSYS;
+  switch (op->kind) {
+    case LUV_FS_OP_FALLOCATE:
+#if defined(__linux__) || defined(__FreeBSD__)
+      ret = posix_fallocate(op->file, op->offset, op->length);
+      ret = ret ? -ret : 0;
+#endif
+      break;
+    case LUV_FS_OP_FADVISE:
+#ifdef POSIX_FADV_NORMAL
+      ret = posix_fadvise(op->file, op->offset, op->length, op->advice);
+      ret = ret ? -ret : 0;
+#endif
+      break;
+    case LUV_FS_OP_COPY_RANGE: {
+      // one chunk per run so a large copy doesn't hold a threadpool thread
+      size_t len = op->chunk_size;
+      if ((int64_t)len > op->length - op->copied)
+        len = op->length - op->copied;
+      ret = luv_fs_copy_chunk(op->loop, op->file, op->offset + op->copied,
+                              op->out_file, op->out_offset + op->copied, len);
+      break;
+    }
+  }
+  op->result = ret;
+}
+
+// Called on the loop thread after each run. Returns 1 if the op needs to run
+// again, otherwise leaves the final result in op->result.
+static int luv_fs_op_step(luv_fs_op_t* op) {
+  luv_req_t* data = (luv_req_t*)op->work.data;
+  lua_State* L = data->ctx->L;
+  if (op->kind != LUV_FS_OP_COPY_RANGE || op->result < 0)
+    return 0;
+  op->copied += op->result;
+  if (data->data_ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, data->data_ref);
+    lua_pushinteger(L, op->copied);
+    lua_pushinteger(L, op->length);
+    data->ctx->cb_pcall(L, 2, 0, 0);
+  }
+  if (op->result == 0 || op->copied >= op->length) {
+    op->result = op->copied;
+    return 0;
+  }
+  return 1;
+}
+
+// Pushes the value of a successful op.
+static void luv_fs_op_push_value(lua_State* L, luv_fs_op_t* op) {
+  if (op->kind == LUV_FS_OP_COPY_RANGE)
+    lua_pushinteger(L, op->result);
+  else
+    lua_pushboolean(L, 1);
+}
+
+static void luv_fs_op_work_cb(uv_work_t* work) {
+  luv_fs_op_run((luv_fs_op_t*)work);
+}
+
+static void luv_fs_op_after_work_cb(uv_work_t* work, int status) {
+  luv_fs_op_t* op = (luv_fs_op_t*)work;
+  luv_req_t* data = (luv_req_t*)work->data;
+  lua_State* L = data->ctx->L;
+  if (status == UV_ECANCELED)
+    op->result = status;
+  else if (luv_fs_op_step(op)) {
+    status = uv_queue_work(op->loop, &op->work, luv_fs_op_work_cb, luv_fs_op_after_work_cb);
+    if (status == 0)
+      return;
+    op->result = status;
+  }
+  if (op->result < 0) {
+    lua_pushfstring(L, "%s: %s", uv_err_name((int)op->result), uv_strerror((int)op->result));
+  }
+  else {
+    lua_pushnil(L);
+    luv_fs_op_push_value(L, op);
+  }
+  luv_fulfill_req(L, data, op->result < 0 ? 1 : 2);
+  luv_cleanup_req(L, data);
+}
+
+// Runs op right away without a callback at ref, otherwise queues it. Returns
+// what FS_CALL would. data_ref is released along with the request.
+static int luv_fs_op_call(lua_State* L, luv_fs_op_t* op, int ref, int data_ref) {
+  luv_req_t* data;
+  int ret;
+  op->loop = luv_loop(L);
+  op->work.data = data = luv_setup_req(L, luv_context(L), ref);
+  data->data_ref = data_ref;
+  if (ref == LUA_NOREF) {
+    do {
+      luv_fs_op_run(op);
+    } while (luv_fs_op_step(op));
+    ret = op->result < 0 ? (int)op->result : 0;
+    if (ret == 0)
+      luv_fs_op_push_value(L, op);
+    luv_cleanup_req(L, data);
+  }
+  else {
+    ret = uv_queue_work(op->loop, &op->work, luv_fs_op_work_cb, luv_fs_op_after_work_cb);
+    if (ret == 0) {
+      lua_rawgeti(L, LUA_REGISTRYINDEX, data->req_ref);
+    }
+    else {
+      luv_cleanup_req(L, data);
+    }
+  }
+  if (ret < 0) {
+    lua_pushnil(L);
+    lua_pushfstring(L, "%s: %s", uv_err_name(ret), uv_strerror(ret));
+    lua_pushstring(L, uv_err_name(ret));
+    return 3;
+  }
+  return 1;
+}
+
+// Pushes the request userdata holding a new op.
+static luv_fs_op_t* luv_fs_op_new(lua_State* L, luv_fs_op_kind kind) {
+  luv_fs_op_t* op = (luv_fs_op_t*)lua_newuserdata(L, sizeof(*op));
+  memset(op, 0, sizeof(*op));
+  op->kind = kind;
+  return op;
+}
+
 /* Processes a result and pushes the data onto the stack
    returns the number of items pushed */
 static int push_fs_result(lua_State* L, uv_fs_t* req) {
@@ -306,6 +629,11 @@ static int push_fs_result(lua_State* L, uv_fs_t* req) {
       return 1;
 
     case UV_FS_OPEN:
+      if (data->data_ref == LUV_FS_DIRECT_REQ)
+        luv_fs_direct_add((uv_file)req->result);
+      lua_pushinteger(L, req->result);
+      return 1;
+
     case UV_FS_SENDFILE:
     case UV_FS_WRITE:
       lua_pushinteger(L, req->result);
@@ -341,7 +669,13 @@ static int push_fs_result(lua_State* L, uv_fs_t* req) {
       return 1;
 
     case UV_FS_READ:
-      lua_pushlstring(L, (const char*)data->data, req->result);
+      // reads into a shared buffer have no data of their own
+      if (!data->data)
+        lua_pushinteger(L, req->result);
+      else if (data->data_ref == LUV_FS_DIRECT_REQ)
+        lua_pushlstring(L, luv_fs_direct_align(data->data), req->result);
+      else
+        lua_pushlstring(L, (const char*)data->data, req->result);
       return 1;
 
     case UV_FS_SCANDIR:
@@ -509,6 +843,7 @@ static int luv_fs_close(lua_State* L) {
   int ref = luv_check_continuation(L, 2);
   uv_fs_t* req = (uv_fs_t*)lua_newuserdata(L, uv_req_size(UV_FS));
   req->data = luv_setup_req(L, ctx, ref);
+  luv_fs_direct_remove(file);
   FS_CALL(uv_fs_close, req, file);
 }
 
@@ -520,17 +855,24 @@ static int luv_fs_open(lua_State* L) {
   int ref = luv_check_continuation(L, 4);
   uv_fs_t* req = (uv_fs_t*)lua_newuserdata(L, uv_req_size(UV_FS));
   req->data = luv_setup_req(L, ctx, ref);
+#ifdef LUV_FS_O_DIRECT
+  if (flags & LUV_FS_O_DIRECT)
+    ((luv_req_t*)req->data)->data_ref = LUV_FS_DIRECT_REQ;
+#endif
   FS_CALL(uv_fs_open, req, path, flags, mode);
 }
 
 static int luv_fs_read(lua_State* L) {
   luv_ctx_t* ctx = luv_context(L);
   uv_file file = luaL_checkinteger(L, 1);
-  int64_t len = luaL_checkinteger(L, 2);
+  uv_buf_t target;
+  int in_place = luv_shared_buffer_prep(L, 2, &target);
+  int64_t len = in_place ? 0 : luaL_checkinteger(L, 2);
   // -1 offset means "the current file offset is used and updated"
   int64_t offset = -1;
-  int ref;
+  int ref, direct;
   char* data;
+  void* base;
   // both offset and callback are optional
   if (luv_is_callable(L, 3) && lua_isnoneornil(L, 4)) {
     ref = luv_check_continuation(L, 3);
@@ -539,9 +881,21 @@ static int luv_fs_read(lua_State* L) {
     offset = luaL_optinteger(L, 3, offset);
     ref = luv_check_continuation(L, 4);
   }
+  if (in_place) {
+    // the request holds the shared buffer until it completes
+    uv_fs_t* req = (uv_fs_t*)lua_newuserdata(L, uv_req_size(UV_FS));
+    req->data = luv_setup_req(L, ctx, ref);
+    lua_pushvalue(L, 2);
+    ((luv_req_t*)req->data)->data_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    FS_CALL(uv_fs_read, req, file, &target, 1, offset);
+  }
   if (len < 0)
     return luaL_error(L, "Length must be non-negative");
-  data = (char*)malloc(len);
+  direct = len > 0 && len % LUV_FS_DIRECT_BLOCK == 0 && luv_fs_is_direct(file);
+  if (direct)
+    data = luv_fs_direct_alloc(len, &base);
+  else
+    base = data = (char*)malloc(len);
   if (!data) {
     luaL_unref(L, LUA_REGISTRYINDEX, ref);
     return luaL_error(L, "Failure to allocate buffer");
@@ -550,7 +904,9 @@ static int luv_fs_read(lua_State* L) {
   uv_fs_t* req = (uv_fs_t*)lua_newuserdata(L, uv_req_size(UV_FS));
   req->data = luv_setup_req(L, ctx, ref);
   // TODO: find out why we can't just use req->ptr for the base
-  ((luv_req_t*)req->data)->data = buf.base;
+  ((luv_req_t*)req->data)->data = base;
+  if (direct)
+    ((luv_req_t*)req->data)->data_ref = LUV_FS_DIRECT_REQ;
   FS_CALL(uv_fs_read, req, file, &buf, 1, offset);
 }
 
@@ -563,6 +919,58 @@ static int luv_fs_unlink(lua_State* L) {
   FS_CALL(uv_fs_unlink, req, path);
 }
 
+// Lua strings are never aligned, so a write that is otherwise valid for a
+// file opened for direct I/O is copied into an aligned buffer first.
+static int luv_fs_write_needs_bounce(uv_file file, const uv_buf_t* bufs, size_t count, int64_t offset) {
+#ifdef LUV_FS_O_DIRECT
+  size_t i, len = 0;
+  int misaligned = 0;
+  if (offset > 0 && offset % LUV_FS_DIRECT_BLOCK != 0)
+    return 0;
+  for (i = 0; i < count; i++) {
+    len += bufs[i].len;
+    if ((uintptr_t)bufs[i].base % LUV_FS_DIRECT_ALIGN != 0)
+      misaligned = 1;
+  }
+  if (!misaligned || len == 0 || len % LUV_FS_DIRECT_BLOCK != 0)
+    return 0;
+  return luv_fs_is_direct(file);
+#else
+  (void)file; (void)bufs; (void)count; (void)offset;
+  return 0;
+#endif
+}
+
+static void luv_fs_write_bounce(lua_State* L, luv_req_t* data, uv_buf_t* bufs, size_t* count) {
+  size_t i, len = 0;
+  void* base;
+  char* copy;
+  for (i = 0; i < *count; i++)
+    len += bufs[i].len;
+  copy = luv_fs_direct_alloc(len, &base);
+  if (!copy) {
+    free(bufs);
+    luaL_error(L, "Failure to allocate buffer");
+  }
+  len = 0;
+  for (i = 0; i < *count; i++) {
+    memcpy(copy + len, bufs[i].base, bufs[i].len);
+    len += bufs[i].len;
+  }
+  // the strings are no longer referenced by the request
+  if (data->data_ref == LUV_REQ_MULTIREF) {
+    for (i = 0; ((int*)(data->data))[i] != LUA_NOREF; i++)
+      luaL_unref(L, LUA_REGISTRYINDEX, ((int*)(data->data))[i]);
+    free(data->data);
+  }
+  else
+    luaL_unref(L, LUA_REGISTRYINDEX, data->data_ref);
+  data->data_ref = LUA_NOREF;
+  data->data = base;
+  bufs[0] = uv_buf_init(copy, len);
+  *count = 1;
+}
+
 static int luv_fs_write(lua_State* L) {
   luv_ctx_t* ctx = luv_context(L);
   uv_file file = luaL_checkinteger(L, 1);
@@ -582,6 +990,8 @@ static int luv_fs_write(lua_State* L) {
   size_t count;
   uv_buf_t* bufs = luv_check_bufs(L, 2, &count, (luv_req_t*)req->data);
   int nargs;
+  if (luv_fs_write_needs_bounce(file, bufs, count, offset))
+    luv_fs_write_bounce(L, (luv_req_t*)req->data, bufs, &count);
   FS_CALL_NORETURN(uv_fs_write, req, file, bufs, count, offset);
   free(bufs);
   return nargs;
@@ -739,6 +1149,54 @@ static int luv_fs_ftruncate(lua_State* L) {
   FS_CALL(uv_fs_ftruncate, req, file, offset);
 }
 
+static int luv_fs_fallocate(lua_State* L) {
+  uv_file file = luaL_checkinteger(L, 1);
+  int64_t offset = luaL_checkinteger(L, 2);
+  int64_t length = luaL_checkinteger(L, 3);
+  int ref = luv_check_continuation(L, 4);
+  luv_fs_op_t* op = luv_fs_op_new(L, LUV_FS_OP_FALLOCATE);
+  op->file = file;
+  op->offset = offset;
+  op->length = length;
+  return luv_fs_op_call(L, op, ref, LUA_NOREF);
+}
+
+static int luv_check_fadvise(lua_State* L, int index) {
+  static const char* const names[] = {
+    "normal", "sequential", "random", "willneed", "dontneed", "noreuse", NULL
+  };
+#ifdef POSIX_FADV_NORMAL
+  static const int values[] = {
+    POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM,
+    POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED, POSIX_FADV_NOREUSE
+  };
+#endif
+  int i;
+  if (lua_isnumber(L, index)) {
+    return lua_tointeger(L, index);
+  }
+  i = luaL_checkoption(L, index, NULL, names);
+#ifdef POSIX_FADV_NORMAL
+  return values[i];
+#else
+  return i;
+#endif
+}
+
+static int luv_fs_fadvise(lua_State* L) {
+  uv_file file = luaL_checkinteger(L, 1);
+  int64_t offset = luaL_checkinteger(L, 2);
+  int64_t length = luaL_checkinteger(L, 3);
+  int advice = luv_check_fadvise(L, 4);
+  int ref = luv_check_continuation(L, 5);
+  luv_fs_op_t* op = luv_fs_op_new(L, LUV_FS_OP_FADVISE);
+  op->file = file;
+  op->offset = offset;
+  op->length = length;
+  op->advice = advice;
+  return luv_fs_op_call(L, op, ref, LUA_NOREF);
+}
+
 static int luv_fs_sendfile(lua_State* L) {
   luv_ctx_t* ctx = luv_context(L);
   uv_file out_fd = luaL_checkinteger(L, 1);
@@ -932,6 +1390,590 @@ static int luv_fs_lchown(lua_State* L) {
 }
 #endif
 
+static int luv_fs_copy_range(lua_State* L) {
+  uv_file in_fd = luaL_checkinteger(L, 1);
+  uv_file out_fd = luaL_checkinteger(L, 2);
+  int64_t offset = luaL_checkinteger(L, 3);
+  int64_t length = luaL_checkinteger(L, 4);
+  int64_t out_offset = offset;
+  lua_Integer chunk_size = LUV_FS_COPY_CHUNK;
+  int progress_ref = LUA_NOREF, ref;
+  luv_fs_op_t* op;
+  luaL_argcheck(L, offset >= 0, 3, "offset must be non-negative");
+  luaL_argcheck(L, length >= 0, 4, "length must be non-negative");
+  // options can be omitted, callback can be the 5th parameter
+  if (luv_is_callable(L, 5) && lua_isnone(L, 6)) {
+    ref = luv_check_continuation(L, 5);
+  }
+  else {
+    if (lua_type(L, 5) == LUA_TTABLE) {
+      lua_getfield(L, 5, "out_offset");
+      out_offset = luaL_optinteger(L, -1, out_offset);
+      lua_pop(L, 1);
+      lua_getfield(L, 5, "chunk_size");
+      chunk_size = luaL_optinteger(L, -1, chunk_size);
+      lua_pop(L, 1);
+      luaL_argcheck(L, chunk_size > 0, 5, "chunk_size must be positive");
+      lua_getfield(L, 5, "on_progress");
+      if (!lua_isnil(L, -1))
+        luv_check_callable(L, -1);
+      lua_pop(L, 1);
+    }
+    else if (!lua_isnoneornil(L, 5)) {
+      return luv_arg_type_error(L, 5, "table or nil expected, got %s");
+    }
+    ref = luv_check_continuation(L, 6);
+    // the progress callback lives in data_ref so it is released with the req
+    if (lua_type(L, 5) == LUA_TTABLE) {
+      lua_getfield(L, 5, "on_progress");
+      if (lua_isnil(L, -1))
+        lua_pop(L, 1);
+      else
+        progress_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+  }
+  op = luv_fs_op_new(L, LUV_FS_OP_COPY_RANGE);
+  op->file = in_fd;
+  op->offset = offset;
+  op->length = length;
+  op->out_file = out_fd;
+  op->out_offset = out_offset;
+  op->chunk_size = chunk_size;
+  return luv_fs_op_call(L, op, ref, progress_ref);
+}
+
+/* fs_copy_tree first scans the source tree on the threadpool, creating the
+   directories and symlinks as it goes, then copies the regular files with at
+   most `concurrency` of them in flight. Every file is copied one chunk per
+   threadpool job so that a large tree doesn't monopolize the threadpool. */
+enum {
+  LUV_REFLINK_NEVER,
+  LUV_REFLINK_AUTO,
+  LUV_REFLINK_ALWAYS
+};
+
+typedef struct luv_copy_tree_s luv_copy_tree_t;
+
+typedef struct {
+  char* path;
+  int mode;
+} luv_copy_dir_t;
+
+typedef struct {
+  uv_work_t work;
+  luv_copy_tree_t* tree;
+  char* src;
+  char* dst;
+  int mode;
+  int64_t size;
+  int64_t copied;
+  int64_t delta; /* bytes copied by the last job */
+  uv_file in;
+  uv_file out;
+  int done;
+  int result;
+} luv_copy_file_t;
+
+struct luv_copy_tree_s {
+  uv_work_t work;
+  luv_ctx_t* ctx;
+  int cb_ref;
+  int progress_ref;
+  char* src;
+  char* dst;
+  int concurrency;
+  int reflink;
+  size_t chunk_size;
+  luv_copy_file_t** files;
+  size_t nfiles;
+  size_t capacity;
+  luv_copy_dir_t* dirs;  /* modes are set once their files are copied */
+  size_t ndirs;
+  size_t dir_capacity;
+  int dirs_done;
+  size_t next;
+  int active;
+  int64_t total;
+  int64_t copied;
+  int result;
+  char* error_path;
+};
+
+static char* luv_path_join(const char* dir, const char* name) {
+  size_t dlen = strlen(dir), nlen = strlen(name);
+  char* path = (char*)malloc(dlen + nlen + 2);
+  if (!path) return NULL;
+  memcpy(path, dir, dlen);
+  path[dlen] = '/';
+  memcpy(path + dlen + 1, name, nlen + 1);
+  return path;
+}
+
+static char* luv_strdup(const char* s) {
+  size_t len = strlen(s) + 1;
+  char* copy = (char*)malloc(len);
+  if (copy) memcpy(copy, s, len);
+  return copy;
+}
+
+static int luv_copy_tree_fail(luv_copy_tree_t* tree, int result, const char* path) {
+  if (tree->result == 0) {
+    tree->result = result;
+    tree->error_path = luv_strdup(path);
+  }
+  return result;
+}
+
+static int luv_copy_tree_add(luv_copy_tree_t* tree, const char* src, const char* dst, const uv_stat_t* s) {
+  luv_copy_file_t* file;
+  if (tree->nfiles == tree->capacity) {
+    size_t capacity = tree->capacity ? tree->capacity * 2 : 64;
+    luv_copy_file_t** files = (luv_copy_file_t**)realloc(tree->files, capacity * sizeof(*files));
+    if (!files) return luv_copy_tree_fail(tree, UV_ENOMEM, src);
+    tree->files = files;
+    tree->capacity = capacity;
+  }
+  file = (luv_copy_file_t*)calloc(1, sizeof(*file));
+  if (!file) return luv_copy_tree_fail(tree, UV_ENOMEM, src);
+  file->tree = tree;
+  file->src = luv_strdup(src);
+  file->dst = luv_strdup(dst);
+  file->mode = s->st_mode & 07777;
+  file->size = s->st_size;
+  file->in = -1;
+  file->out = -1;
+  tree->files[tree->nfiles++] = file;
+  tree->total += file->size;
+  if (!file->src || !file->dst) return luv_copy_tree_fail(tree, UV_ENOMEM, src);
+  return 0;
+}
+
+static int luv_copy_tree_add_dir(luv_copy_tree_t* tree, const char* dst, int mode) {
+  char* path;
+  if (tree->ndirs == tree->dir_capacity) {
+    size_t capacity = tree->dir_capacity ? tree->dir_capacity * 2 : 16;
+    luv_copy_dir_t* dirs = (luv_copy_dir_t*)realloc(tree->dirs, capacity * sizeof(*dirs));
+    if (!dirs) return luv_copy_tree_fail(tree, UV_ENOMEM, dst);
+    tree->dirs = dirs;
+    tree->dir_capacity = capacity;
+  }
+  path = luv_strdup(dst);
+  if (!path) return luv_copy_tree_fail(tree, UV_ENOMEM, dst);
+  tree->dirs[tree->ndirs].path = path;
+  tree->dirs[tree->ndirs].mode = mode;
+  tree->ndirs++;
+  return 0;
+}
+
+static int luv_is_path_sep(char c) {
+  return c == '/' || c == '\\';
+}
+
+// Returns the real path of path, or of its parent joined with its last
+// component when it doesn't exist yet. Returns NULL if that fails.
+static char* luv_copy_tree_realpath(uv_loop_t* loop, const char* path) {
+  uv_fs_t req;
+  char* dir;
+  char* name;
+  char* real = NULL;
+  char* joined = NULL;
+  size_t len;
+  if (uv_fs_realpath(loop, &req, path, NULL) == 0)
+    real = luv_strdup((const char*)req.ptr);
+  uv_fs_req_cleanup(&req);
+  if (real || !(dir = luv_strdup(path)))
+    return real;
+
+  len = strlen(dir);
+  while (len > 1 && luv_is_path_sep(dir[len - 1]))
+    dir[--len] = '\0';
+  name = dir + len;
+  while (name > dir && !luv_is_path_sep(name[-1]))
+    name--;
+  if (name == dir)
+    real = luv_copy_tree_realpath(loop, ".");
+  else if (name - 1 == dir)
+    real = luv_copy_tree_realpath(loop, "/");
+  else {
+    name[-1] = '\0';
+    real = luv_copy_tree_realpath(loop, dir);
+  }
+  if (real) {
+    len = strlen(real);
+    // a root already ends with a separator
+    if (len > 0 && luv_is_path_sep(real[len - 1]))
+      real[len - 1] = '\0';
+    joined = luv_path_join(real, name);
+    free(real);
+  }
+  free(dir);
+  return joined;
+}
+
+// Returns 1 if dst is src or inside it, which would copy the tree into
+// itself without end.
+static int luv_copy_tree_inside(uv_loop_t* loop, const char* src, const char* dst) {
+  char* real_src = luv_copy_tree_realpath(loop, src);
+  char* real_dst = luv_copy_tree_realpath(loop, dst);
+  int inside = 0;
+  if (real_src && real_dst) {
+    size_t len = strlen(real_src);
+    // a root source ends with its separator already
+    if (len > 0 && luv_is_path_sep(real_src[len - 1]))
+      len--;
+    inside = strncmp(real_dst, real_src, len) == 0 &&
+      (real_dst[len] == '\0' || luv_is_path_sep(real_dst[len]));
+  }
+  free(real_src);
+  free(real_dst);
+  return inside;
+}
+
+// Runs on the threadpool.
+static int luv_copy_tree_scan(luv_copy_tree_t* tree, uv_loop_t* loop, const char* src, const char* dst) {
+  uv_fs_t req;
+  uv_dirent_t ent;
+  uv_stat_t s;
+  int ret;
+
+  ret = uv_fs_lstat(loop, &req, src, NULL);
+  s = req.statbuf;
+  uv_fs_req_cleanup(&req);
+  if (ret < 0) return luv_copy_tree_fail(tree, ret, src);
+
+  if (S_ISREG(s.st_mode))
+    return luv_copy_tree_add(tree, src, dst, &s);
+
+  if (S_ISLNK(s.st_mode)) {
+    char* target;
+    ret = uv_fs_readlink(loop, &req, src, NULL);
+    target = ret < 0 ? NULL : luv_strdup((const char*)req.ptr);
+    uv_fs_req_cleanup(&req);
+    if (ret < 0) return luv_copy_tree_fail(tree, ret, src);
+    if (!target) return luv_copy_tree_fail(tree, UV_ENOMEM, src);
+    ret = uv_fs_symlink(loop, &req, target, dst, 0, NULL);
+    uv_fs_req_cleanup(&req);
+    free(target);
+    return ret < 0 ? luv_copy_tree_fail(tree, ret, dst) : 0;
+  }
+
+  // sockets, fifos and devices are skipped
+  if (!S_ISDIR(s.st_mode))
+    return 0;
+
+  // mkdir applies the umask, and a read-only mode would keep the files out,
+  // so the mode is set once the copy is done
+  ret = uv_fs_mkdir(loop, &req, dst, 0700, NULL);
+  uv_fs_req_cleanup(&req);
+  if (ret < 0 && ret != UV_EEXIST) return luv_copy_tree_fail(tree, ret, dst);
+  ret = luv_copy_tree_add_dir(tree, dst, s.st_mode & 07777);
+  if (ret < 0) return ret;
+
+  ret = uv_fs_scandir(loop, &req, src, 0, NULL);
+  if (ret < 0) {
+    uv_fs_req_cleanup(&req);
+    return luv_copy_tree_fail(tree, ret, src);
+  }
+  ret = 0;
+  while (ret == 0 && uv_fs_scandir_next(&req, &ent) != UV_EOF) {
+    char* child_src = luv_path_join(src, ent.name);
+    char* child_dst = luv_path_join(dst, ent.name);
+    if (child_src && child_dst)
+      ret = luv_copy_tree_scan(tree, loop, child_src, child_dst);
+    else
+      ret = luv_copy_tree_fail(tree, UV_ENOMEM, src);
+    free(child_src);
+    free(child_dst);
+  }
+  uv_fs_req_cleanup(&req);
+  return ret;
+}
+
+static void luv_copy_tree_scan_cb(uv_work_t* work) {
+  luv_copy_tree_t* tree = (luv_copy_tree_t*)work;
+  uv_loop_t* loop = tree->ctx->loop;
+  if (luv_copy_tree_inside(loop, tree->src, tree->dst)) {
+    luv_copy_tree_fail(tree, UV_EINVAL, tree->dst);
+    return;
+  }
+  luv_copy_tree_scan(tree, loop, tree->src, tree->dst);
+}
+
+// Runs on the threadpool, children first so a parent without search
+// permission doesn't hide them.
+static void luv_copy_tree_modes_cb(uv_work_t* work) {
+  luv_copy_tree_t* tree = (luv_copy_tree_t*)work;
+  uv_fs_t req;
+  size_t i = tree->ndirs;
+  while (i-- > 0) {
+    int ret = uv_fs_chmod(tree->ctx->loop, &req, tree->dirs[i].path, tree->dirs[i].mode, NULL);
+    uv_fs_req_cleanup(&req);
+    if (ret < 0) {
+      luv_copy_tree_fail(tree, ret, tree->dirs[i].path);
+      return;
+    }
+  }
+}
+
+static void luv_copy_file_close(luv_copy_file_t* file, uv_loop_t* loop) {
+  uv_fs_t req;
+  if (file->out >= 0) {
+    // open() applies the umask, so set the source mode explicitly
+    uv_fs_fchmod(loop, &req, file->out, file->mode, NULL);
+    uv_fs_req_cleanup(&req);
+    uv_fs_close(loop, &req, file->out, NULL);
+    uv_fs_req_cleanup(&req);
+    file->out = -1;
+  }
+  if (file->in >= 0) {
+    uv_fs_close(loop, &req, file->in, NULL);
+    uv_fs_req_cleanup(&req);
+    file->in = -1;
+  }
+}
+
+// Runs on the threadpool, opening the files on the first job and copying one
+// chunk per job.
+static void luv_copy_file_work_cb(uv_work_t* work) {
+  luv_copy_file_t* file = (luv_copy_file_t*)work;
+  luv_copy_tree_t* tree = file->tree;
+  uv_loop_t* loop = tree->ctx->loop;
+  uv_fs_t req;
+  int64_t n;
+  size_t len;
+
+  file->delta = 0;
+  if (file->in < 0) {
+#if LUV_UV_VERSION_GEQ(1, 20, 0)
+    if (tree->reflink != LUV_REFLINK_NEVER) {
+      n = uv_fs_copyfile(loop, &req, file->src, file->dst, UV_FS_COPYFILE_FICLONE_FORCE, NULL);
+      uv_fs_req_cleanup(&req);
+      if (n == 0) {
+        file->delta = file->copied = file->size;
+        file->done = 1;
+        return;
+      }
+      if (tree->reflink == LUV_REFLINK_ALWAYS) {
+        file->result = n;
+        return;
+      }
+    }
+#else
+    if (tree->reflink == LUV_REFLINK_ALWAYS) {
+      file->result = UV_ENOTSUP;
+      return;
+    }
+#endif
+    n = uv_fs_open(loop, &req, file->src, O_RDONLY, 0, NULL);
+    uv_fs_req_cleanup(&req);
+    if (n < 0) {
+      file->result = n;
+      return;
+    }
+    file->in = n;
+    n = uv_fs_open(loop, &req, file->dst, O_WRONLY | O_CREAT | O_TRUNC, file->mode, NULL);
+    uv_fs_req_cleanup(&req);
+    if (n < 0) {
+      file->result = n;
+      luv_copy_file_close(file, loop);
+      return;
+    }
+    file->out = n;
+  }
+
+  len = tree->chunk_size;
+  if ((int64_t)len > file->size - file->copied)
+    len = file->size - file->copied;
+  n = len ? luv_fs_copy_chunk(loop, file->in, file->copied, file->out, file->copied, len) : 0;
+  if (n < 0)
+    file->result = n;
+  else {
+    file->delta = n;
+    file->copied += n;
+    // a file that shrank during the copy ends early
+    file->done = n == 0 || file->copied >= file->size;
+  }
+  if (file->result < 0 || file->done)
+    luv_copy_file_close(file, loop);
+}
+
+static void luv_copy_tree_free(lua_State* L, luv_copy_tree_t* tree) {
+  size_t i;
+  for (i = 0; i < tree->nfiles; i++) {
+    free(tree->files[i]->src);
+    free(tree->files[i]->dst);
+    free(tree->files[i]);
+  }
+  for (i = 0; i < tree->ndirs; i++)
+    free(tree->dirs[i].path);
+  luaL_unref(L, LUA_REGISTRYINDEX, tree->cb_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, tree->progress_ref);
+  free(tree->files);
+  free(tree->dirs);
+  free(tree->src);
+  free(tree->dst);
+  free(tree->error_path);
+  free(tree);
+}
+
+static void luv_copy_tree_finish(luv_copy_tree_t* tree) {
+  luv_ctx_t* ctx = tree->ctx;
+  lua_State* L = ctx->L;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, tree->cb_ref);
+  if (tree->result < 0) {
+    lua_pushfstring(L, "%s: %s: %s", uv_err_name(tree->result), uv_strerror(tree->result),
+                    tree->error_path ? tree->error_path : tree->src);
+    lua_pushnil(L);
+  }
+  else {
+    lua_pushnil(L);
+    lua_createtable(L, 0, 2);
+    lua_pushinteger(L, tree->nfiles);
+    lua_setfield(L, -2, "files");
+    lua_pushinteger(L, tree->copied);
+    lua_setfield(L, -2, "bytes");
+  }
+  luv_copy_tree_free(L, tree);
+  ctx->cb_pcall(L, 2, 0, 0);
+}
+
+static void luv_copy_file_after_work_cb(uv_work_t* work, int status);
+
+static void luv_copy_tree_modes_after_cb(uv_work_t* work, int status) {
+  luv_copy_tree_t* tree = (luv_copy_tree_t*)work;
+  if (status == UV_ECANCELED)
+    luv_copy_tree_fail(tree, status, tree->dst);
+  luv_copy_tree_finish(tree);
+}
+
+static void luv_copy_tree_pump(luv_copy_tree_t* tree) {
+  while (tree->result == 0 && tree->active < tree->concurrency && tree->next < tree->nfiles) {
+    luv_copy_file_t* file = tree->files[tree->next++];
+    int ret = uv_queue_work(tree->ctx->loop, &file->work, luv_copy_file_work_cb, luv_copy_file_after_work_cb);
+    if (ret < 0) {
+      luv_copy_tree_fail(tree, ret, file->src);
+      break;
+    }
+    tree->active++;
+  }
+  if (tree->active > 0)
+    return;
+  if (tree->result == 0 && tree->ndirs > 0 && !tree->dirs_done) {
+    int ret;
+    tree->dirs_done = 1;
+    ret = uv_queue_work(tree->ctx->loop, &tree->work, luv_copy_tree_modes_cb, luv_copy_tree_modes_after_cb);
+    if (ret == 0)
+      return;
+    luv_copy_tree_fail(tree, ret, tree->dst);
+  }
+  luv_copy_tree_finish(tree);
+}
+
+static void luv_copy_file_after_work_cb(uv_work_t* work, int status) {
+  luv_copy_file_t* file = (luv_copy_file_t*)work;
+  luv_copy_tree_t* tree = file->tree;
+  lua_State* L = tree->ctx->L;
+
+  if (status == UV_ECANCELED)
+    file->result = status;
+  if (file->delta > 0) {
+    tree->copied += file->delta;
+    if (tree->progress_ref != LUA_NOREF) {
+      lua_rawgeti(L, LUA_REGISTRYINDEX, tree->progress_ref);
+      lua_pushinteger(L, tree->copied);
+      lua_pushinteger(L, tree->total);
+      tree->ctx->cb_pcall(L, 2, 0, 0);
+    }
+  }
+  if (file->result < 0)
+    luv_copy_tree_fail(tree, file->result, file->src);
+  if (!file->done && file->result == 0) {
+    if (tree->result == 0) {
+      status = uv_queue_work(tree->ctx->loop, &file->work, luv_copy_file_work_cb, luv_copy_file_after_work_cb);
+      if (status == 0)
+        return;
+      luv_copy_tree_fail(tree, status, file->src);
+    }
+    // another file failed, give up on this one
+    luv_copy_file_close(file, tree->ctx->loop);
+  }
+  tree->active--;
+  luv_copy_tree_pump(tree);
+}
+
+static void luv_copy_tree_scan_after_cb(uv_work_t* work, int status) {
+  luv_copy_tree_t* tree = (luv_copy_tree_t*)work;
+  if (status == UV_ECANCELED)
+    luv_copy_tree_fail(tree, status, tree->src);
+  luv_copy_tree_pump(tree);
+}
+
+static int luv_fs_copy_tree(lua_State* L) {
+  luv_ctx_t* ctx = luv_context(L);
+  const char* src = luaL_checkstring(L, 1);
+  const char* dst = luaL_checkstring(L, 2);
+  static const char* const reflink_modes[] = { "never", "auto", "always", NULL };
+  lua_Integer concurrency = 4, chunk_size = LUV_FS_COPY_CHUNK;
+  int reflink = LUV_REFLINK_AUTO, cb_index = 3, has_progress = 0, ret;
+  luv_copy_tree_t* tree;
+  if (lua_type(L, 3) == LUA_TTABLE) {
+    lua_getfield(L, 3, "concurrency");
+    concurrency = luaL_optinteger(L, -1, concurrency);
+    lua_pop(L, 1);
+    luaL_argcheck(L, concurrency > 0, 3, "concurrency must be positive");
+    lua_getfield(L, 3, "chunk_size");
+    chunk_size = luaL_optinteger(L, -1, chunk_size);
+    lua_pop(L, 1);
+    luaL_argcheck(L, chunk_size > 0, 3, "chunk_size must be positive");
+    lua_getfield(L, 3, "reflink");
+    if (lua_isboolean(L, -1))
+      reflink = lua_toboolean(L, -1) ? LUV_REFLINK_ALWAYS : LUV_REFLINK_NEVER;
+    else if (!lua_isnil(L, -1))
+      reflink = luaL_checkoption(L, -1, NULL, reflink_modes);
+    lua_pop(L, 1);
+    lua_getfield(L, 3, "on_progress");
+    if (!lua_isnil(L, -1)) {
+      luv_check_callable(L, -1);
+      has_progress = 1;
+    }
+    lua_pop(L, 1);
+    cb_index = 4;
+  }
+  else if (!lua_isnoneornil(L, 3) && !luv_is_callable(L, 3)) {
+    return luv_arg_type_error(L, 3, "table or nil expected, got %s");
+  }
+  else if (lua_isnil(L, 3)) {
+    cb_index = 4;
+  }
+  luv_check_callable(L, cb_index);
+
+  tree = (luv_copy_tree_t*)calloc(1, sizeof(*tree));
+  if (!tree) return luaL_error(L, "Failure to allocate copy state");
+  tree->ctx = ctx;
+  tree->concurrency = (int)concurrency;
+  tree->reflink = reflink;
+  tree->chunk_size = chunk_size;
+  tree->src = luv_strdup(src);
+  tree->dst = luv_strdup(dst);
+  lua_pushvalue(L, cb_index);
+  tree->cb_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  tree->progress_ref = LUA_NOREF;
+  if (has_progress) {
+    lua_getfield(L, 3, "on_progress");
+    tree->progress_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  if (!tree->src || !tree->dst)
+    ret = UV_ENOMEM;
+  else
+    ret = uv_queue_work(ctx->loop, &tree->work, luv_copy_tree_scan_cb, luv_copy_tree_scan_after_cb);
+  if (ret < 0) {
+    luv_copy_tree_free(L, tree);
+    return luv_error(L, ret);
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
 #if LUV_UV_VERSION_GEQ(1, 14, 0)
 static int luv_fs_copyfile(lua_State*L) {
   luv_ctx_t* ctx = luv_context(L);
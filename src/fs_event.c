@@ -35,17 +35,105 @@ static int luv_new_fs_event(lua_State* L) {
   return 1;
 }
 
-static void luv_fs_event_cb(uv_fs_event_t* handle, const char* filename, int events, int status) {
-  luv_handle_t* data = (luv_handle_t*)handle->data;
-  lua_State* L = data->ctx->L;
+/* When started with `debounce_ms` or `coalesce`, events are collected per
+   filename and delivered from an internal timer once per window instead of
+   once per event. */
+typedef struct {
+  char* filename;
+  int events;
+} luv_fs_event_entry_t;
 
-  // err
-  luv_status(L, status);
+#ifdef __linux__
+typedef struct luv_fs_event_inotify_s luv_fs_event_inotify_t;
+#endif
 
-  // filename
-  lua_pushstring(L, filename);
+/* Per handle state for the luv additions to fs_event, stored in the
+   luv_handle_t extra slot. */
+typedef struct {
+  uv_timer_t timer; /* must be first, data is left NULL */
+  uv_fs_event_t* handle;
+#ifdef __linux__
+  luv_fs_event_inotify_t* inotify;
+#endif
+  int enabled;
+  int coalesce;
+  uint64_t debounce;
+  luv_fs_event_entry_t* entries;
+  size_t count;
+  size_t capacity;
+  int* slots; /* open addressing index into entries, -1 if empty */
+  size_t nslots;
+} luv_fs_event_extra_t;
 
-  // events
+static size_t luv_fs_event_hash(const char* s) {
+  size_t h = 2166136261u;
+  for (; *s; s++)
+    h = (h ^ (unsigned char)*s) * 16777619u;
+  return h;
+}
+
+static void luv_fs_event_batch_clear(luv_fs_event_extra_t* batch) {
+  size_t i;
+  for (i = 0; i < batch->count; i++)
+    free(batch->entries[i].filename);
+  batch->count = 0;
+  for (i = 0; i < batch->nslots; i++)
+    batch->slots[i] = -1;
+}
+
+static int luv_fs_event_batch_grow(luv_fs_event_extra_t* batch) {
+  size_t i, capacity = batch->capacity ? batch->capacity * 2 : 16;
+  size_t nslots = capacity * 2;
+  luv_fs_event_entry_t* entries;
+  int* slots = (int*)malloc(nslots * sizeof(*slots));
+  if (!slots) return UV_ENOMEM;
+  entries = (luv_fs_event_entry_t*)realloc(batch->entries, capacity * sizeof(*entries));
+  if (!entries) {
+    free(slots);
+    return UV_ENOMEM;
+  }
+  for (i = 0; i < nslots; i++)
+    slots[i] = -1;
+  for (i = 0; i < batch->count; i++) {
+    size_t slot = luv_fs_event_hash(entries[i].filename) & (nslots - 1);
+    while (slots[slot] != -1)
+      slot = (slot + 1) & (nslots - 1);
+    slots[slot] = (int)i;
+  }
+  free(batch->slots);
+  batch->entries = entries;
+  batch->capacity = capacity;
+  batch->slots = slots;
+  batch->nslots = nslots;
+  return 0;
+}
+
+static int luv_fs_event_batch_add(luv_fs_event_extra_t* batch, const char* filename, int events) {
+  size_t slot;
+  luv_fs_event_entry_t* entry;
+  if (batch->count == batch->capacity) {
+    int ret = luv_fs_event_batch_grow(batch);
+    if (ret < 0) return ret;
+  }
+  slot = luv_fs_event_hash(filename) & (batch->nslots - 1);
+  while (batch->slots[slot] != -1) {
+    entry = &batch->entries[batch->slots[slot]];
+    if (strcmp(entry->filename, filename) == 0) {
+      entry->events |= events;
+      return 0;
+    }
+    slot = (slot + 1) & (batch->nslots - 1);
+  }
+  entry = &batch->entries[batch->count];
+  entry->filename = (char*)malloc(strlen(filename) + 1);
+  if (!entry->filename) return UV_ENOMEM;
+  strcpy(entry->filename, filename);
+  entry->events = events;
+  batch->slots[slot] = (int)batch->count++;
+  return 0;
+}
+
+static void luv_fs_event_push_events(lua_State* L, int events) {
   lua_newtable(L);
   if (events & UV_RENAME) {
     lua_pushboolean(L, 1);
@@ -55,10 +143,428 @@ static void luv_fs_event_cb(uv_fs_event_t* handle, const char* filename, int eve
     lua_pushboolean(L, 1);
     lua_setfield(L, -2, "change");
   }
+}
+
+static void luv_fs_event_flush(uv_timer_t* timer) {
+  luv_fs_event_extra_t* batch = (luv_fs_event_extra_t*)timer;
+  uv_fs_event_t* handle = batch->handle;
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  lua_State* L = data->ctx->L;
+  size_t i, count = batch->count;
+
+  // the callback may have been released along with a closing handle
+  if (uv_is_closing((uv_handle_t*)handle) || count == 0)
+    return;
+
+  if (batch->coalesce) {
+    lua_pushnil(L);
+    lua_createtable(L, 0, (int)count);
+    for (i = 0; i < count; i++) {
+      luv_fs_event_push_events(L, batch->entries[i].events);
+      lua_setfield(L, -2, batch->entries[i].filename);
+    }
+    luv_fs_event_batch_clear(batch);
+    luv_call_callback(L, data, LUV_FS_EVENT, 2);
+    return;
+  }
+
+  // detach the entries first, the callback may stop or restart the handle
+  {
+    luv_fs_event_entry_t* entries = batch->entries;
+    batch->entries = NULL;
+    batch->count = batch->capacity = 0;
+    free(batch->slots);
+    batch->slots = NULL;
+    batch->nslots = 0;
+    for (i = 0; i < count; i++) {
+      if (!uv_is_closing((uv_handle_t*)handle)) {
+        lua_pushnil(L);
+        lua_pushstring(L, entries[i].filename);
+        luv_fs_event_push_events(L, entries[i].events);
+        luv_call_callback(L, data, LUV_FS_EVENT, 3);
+      }
+      free(entries[i].filename);
+    }
+    free(entries);
+  }
+}
+
+static void luv_fs_event_extra_free(uv_handle_t* timer) {
+  luv_fs_event_extra_t* batch = (luv_fs_event_extra_t*)timer;
+  luv_fs_event_batch_clear(batch);
+  free(batch->entries);
+  free(batch->slots);
+  free(batch);
+}
+
+#ifdef __linux__
+static void luv_fs_event_inotify_stop(luv_fs_event_extra_t* extra);
+#endif
+
+static void luv_fs_event_extra_gc(void* ptr) {
+  luv_fs_event_extra_t* extra = (luv_fs_event_extra_t*)ptr;
+#ifdef __linux__
+  luv_fs_event_inotify_stop(extra);
+#endif
+  // at loop shutdown the timer is closed by loop_gc, leak it rather than
+  // freeing memory that libuv still holds
+  if (!uv_is_closing((uv_handle_t*)&extra->timer))
+    uv_close((uv_handle_t*)&extra->timer, luv_fs_event_extra_free);
+}
+
+// Releases the debounce timer and the recursive watches as soon as the
+// handle is closed instead of when it is collected.
+static void luv_fs_event_extra_close(void* ptr) {
+  luv_fs_event_extra_t* extra = (luv_fs_event_extra_t*)ptr;
+  luv_handle_t* data = (luv_handle_t*)extra->handle->data;
+  data->extra = NULL;
+  data->extra_gc = NULL;
+  data->extra_close = NULL;
+  luv_fs_event_extra_gc(extra);
+}
+
+static luv_fs_event_extra_t* luv_fs_event_extra(uv_fs_event_t* handle, int* err) {
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_fs_event_extra_t* extra = (luv_fs_event_extra_t*)data->extra;
+  if (extra) return extra;
+  extra = (luv_fs_event_extra_t*)calloc(1, sizeof(*extra));
+  if (!extra) {
+    *err = UV_ENOMEM;
+    return NULL;
+  }
+  *err = uv_timer_init(handle->loop, &extra->timer);
+  if (*err < 0) {
+    free(extra);
+    return NULL;
+  }
+  extra->timer.data = NULL;
+  extra->handle = handle;
+  data->extra = extra;
+  data->extra_gc = luv_fs_event_extra_gc;
+  data->extra_close = luv_fs_event_extra_close;
+  return extra;
+}
+
+static void luv_fs_event_cb(uv_fs_event_t* handle, const char* filename, int events, int status) {
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_fs_event_extra_t* batch = (luv_fs_event_extra_t*)data->extra;
+  lua_State* L = data->ctx->L;
+
+  if (batch && batch->enabled && status == 0) {
+    if (luv_fs_event_batch_add(batch, filename ? filename : "", events) == 0) {
+      if (!uv_is_active((uv_handle_t*)&batch->timer))
+        uv_timer_start(&batch->timer, luv_fs_event_flush, batch->debounce, 0);
+      return;
+    }
+    // out of memory, deliver the event on its own
+  }
+
+  // err
+  luv_status(L, status);
+
+  // filename
+  lua_pushstring(L, filename);
+
+  // events
+  luv_fs_event_push_events(L, events);
 
   luv_call_callback(L, (luv_handle_t*)handle->data, LUV_FS_EVENT, 3);
 }
 
+static int luv_fs_event_setup_batch(lua_State* L, uv_fs_event_t* handle, int index) {
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_fs_event_extra_t* batch = (luv_fs_event_extra_t*)data->extra;
+  lua_Integer debounce;
+  int coalesce, enabled, ret;
+
+  lua_getfield(L, index, "debounce_ms");
+  debounce = luaL_optinteger(L, -1, -1);
+  lua_pop(L, 1);
+  lua_getfield(L, index, "coalesce");
+  coalesce = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  enabled = debounce >= 0 || coalesce;
+
+  if (!enabled) {
+    if (batch) {
+      batch->enabled = 0;
+      uv_timer_stop(&batch->timer);
+      luv_fs_event_batch_clear(batch);
+    }
+    return 0;
+  }
+
+  batch = luv_fs_event_extra(handle, &ret);
+  if (!batch) return ret;
+  batch->enabled = 1;
+  batch->coalesce = coalesce;
+  batch->debounce = debounce > 0 ? (uint64_t)debounce : 0;
+  return 0;
+}
+
+#ifdef __linux__
+/* libuv only watches the top level directory on Linux when asked for a
+   recursive watch. Recursive watches are implemented here with a single
+   inotify descriptor polled on the loop, a watch per directory and a map from
+   watch descriptor to the directory path relative to the watched root. New
+   subdirectories are watched as they appear. */
+#include <dirent.h>
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define LUV_INOTIFY_MASK (IN_ATTRIB | IN_CREATE | IN_MODIFY | IN_DELETE | \
+  IN_DELETE_SELF | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | \
+  IN_ONLYDIR | IN_DONT_FOLLOW)
+
+struct luv_fs_event_inotify_s {
+  uv_poll_t poll; /* must be first, data is left NULL */
+  luv_fs_event_extra_t* extra;
+  int fd;
+  int stopped;
+  char* root;
+  char** dirs; /* relative directory path indexed by watch descriptor */
+  int ndirs;
+};
+
+static char* luv_fs_event_join(const char* dir, const char* name) {
+  size_t dlen = strlen(dir), nlen = strlen(name);
+  char* path = (char*)malloc(dlen + nlen + 2);
+  if (!path) return NULL;
+  if (dlen == 0) {
+    memcpy(path, name, nlen + 1);
+  }
+  else {
+    memcpy(path, dir, dlen);
+    path[dlen] = '/';
+    memcpy(path + dlen + 1, name, nlen + 1);
+  }
+  return path;
+}
+
+// Watches the directory at root/rel and every directory below it.
+static int luv_fs_event_inotify_add(luv_fs_event_inotify_t* w, const char* rel) {
+  char* path = rel[0] ? luv_fs_event_join(w->root, rel) : w->root;
+  DIR* dir;
+  struct dirent* ent;
+  int wd;
+  if (!path) return UV_ENOMEM;
+  wd = inotify_add_watch(w->fd, path, LUV_INOTIFY_MASK);
+  if (wd < 0) {
+    wd = -errno;
+    if (path != w->root) free(path);
+    return wd;
+  }
+  if (wd >= w->ndirs) {
+    int i, ndirs = wd * 2 + 16;
+    char** dirs = (char**)realloc(w->dirs, ndirs * sizeof(*dirs));
+    if (!dirs) {
+      if (path != w->root) free(path);
+      return UV_ENOMEM;
+    }
+    for (i = w->ndirs; i < ndirs; i++)
+      dirs[i] = NULL;
+    w->dirs = dirs;
+    w->ndirs = ndirs;
+  }
+  // a directory moved within the tree keeps its watch descriptor
+  free(w->dirs[wd]);
+  w->dirs[wd] = (char*)malloc(strlen(rel) + 1);
+  if (w->dirs[wd])
+    strcpy(w->dirs[wd], rel);
+
+  dir = opendir(path);
+  if (path != w->root) free(path);
+  if (!dir) return 0; // removed in the meantime
+  while ((ent = readdir(dir)) != NULL) {
+    char* child;
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+      continue;
+    if (ent->d_type != DT_DIR && ent->d_type != DT_UNKNOWN)
+      continue;
+    child = luv_fs_event_join(rel, ent->d_name);
+    if (!child) break;
+    // IN_ONLYDIR makes this fail with ENOTDIR for DT_UNKNOWN files
+    luv_fs_event_inotify_add(w, child);
+    free(child);
+  }
+  closedir(dir);
+  return 0;
+}
+
+static void luv_fs_event_inotify_free(uv_handle_t* poll) {
+  luv_fs_event_inotify_t* w = (luv_fs_event_inotify_t*)poll;
+  int i;
+  close(w->fd);
+  for (i = 0; i < w->ndirs; i++)
+    free(w->dirs[i]);
+  free(w->dirs);
+  free(w->root);
+  free(w);
+}
+
+static void luv_fs_event_inotify_stop(luv_fs_event_extra_t* extra) {
+  luv_fs_event_inotify_t* w = extra->inotify;
+  if (!w) return;
+  extra->inotify = NULL;
+  w->stopped = 1;
+  // as with the timer, leak rather than free if loop_gc is closing it
+  if (!uv_is_closing((uv_handle_t*)&w->poll))
+    uv_close((uv_handle_t*)&w->poll, luv_fs_event_inotify_free);
+}
+
+// Drops the watches on a directory moved out of its place and below it, the
+// watch descriptors would otherwise keep reporting under the old path.
+static void luv_fs_event_inotify_drop(luv_fs_event_inotify_t* w, const char* rel) {
+  size_t len = strlen(rel);
+  int i;
+  for (i = 0; i < w->ndirs; i++) {
+    const char* dir = w->dirs[i];
+    if (!dir || strncmp(dir, rel, len) != 0 || (dir[len] != '\0' && dir[len] != '/'))
+      continue;
+    inotify_rm_watch(w->fd, i);
+    free(w->dirs[i]);
+    w->dirs[i] = NULL;
+  }
+}
+
+static int luv_fs_event_inotify_done(luv_fs_event_inotify_t* w) {
+  return w->stopped || uv_is_closing((uv_handle_t*)w->extra->handle);
+}
+
+static void luv_fs_event_inotify_cb(uv_poll_t* poll, int status, int revents) {
+  luv_fs_event_inotify_t* w = (luv_fs_event_inotify_t*)poll;
+  uv_fs_event_t* handle = w->extra->handle;
+  char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+
+  (void)revents;
+  if (luv_fs_event_inotify_done(w)) return;
+  if (status < 0) {
+    luv_fs_event_cb(handle, NULL, 0, status);
+    return;
+  }
+
+  // the callback may stop or close the handle between two events
+  while (!luv_fs_event_inotify_done(w) && (n = read(w->fd, buf, sizeof(buf))) > 0) {
+    char* p;
+    for (p = buf; !luv_fs_event_inotify_done(w) && p < buf + n; ) {
+      const struct inotify_event* ev = (const struct inotify_event*)p;
+      const char* rel = ev->wd >= 0 && ev->wd < w->ndirs ? w->dirs[ev->wd] : NULL;
+      int events = 0;
+      p += sizeof(*ev) + ev->len;
+
+      if (ev->mask & IN_IGNORED) {
+        if (rel) {
+          free(w->dirs[ev->wd]);
+          w->dirs[ev->wd] = NULL;
+        }
+        continue;
+      }
+      if (!rel)
+        continue;
+      if (ev->mask & (IN_ATTRIB | IN_MODIFY))
+        events |= UV_CHANGE;
+      if (ev->mask & ~(IN_ATTRIB | IN_MODIFY))
+        events |= UV_RENAME;
+
+      if (ev->len > 0) {
+        char* filename = luv_fs_event_join(rel, ev->name);
+        if (!filename)
+          continue;
+        if ((ev->mask & IN_ISDIR) && (ev->mask & IN_MOVED_FROM))
+          luv_fs_event_inotify_drop(w, filename);
+        if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+          luv_fs_event_inotify_add(w, filename);
+        luv_fs_event_cb(handle, filename, events, 0);
+        free(filename);
+      }
+      else if (rel[0]) {
+        luv_fs_event_cb(handle, rel, events, 0);
+      }
+      else {
+        // event on the root itself, report its basename like libuv does
+        const char* base = strrchr(w->root, '/');
+        luv_fs_event_cb(handle, base ? base + 1 : w->root, events, 0);
+      }
+    }
+  }
+}
+
+// Events come from the poll, the handle watches the root only so that it
+// reports as active and its ref state decides whether it keeps the loop alive.
+static void luv_fs_event_inotify_root_cb(uv_fs_event_t* handle, const char* filename, int events, int status) {
+  (void)handle;
+  (void)filename;
+  (void)events;
+  (void)status;
+}
+
+static int luv_fs_event_inotify_start(uv_fs_event_t* handle, const char* path) {
+  luv_fs_event_extra_t* extra;
+  luv_fs_event_inotify_t* w;
+  int ret;
+
+  extra = luv_fs_event_extra(handle, &ret);
+  if (!extra) return ret;
+  if (extra->inotify) return UV_EBUSY;
+  ret = uv_fs_event_start(handle, luv_fs_event_inotify_root_cb, path, 0);
+  if (ret < 0) return ret;
+
+  w = (luv_fs_event_inotify_t*)calloc(1, sizeof(*w));
+  if (!w) {
+    uv_fs_event_stop(handle);
+    return UV_ENOMEM;
+  }
+  w->extra = extra;
+  w->root = (char*)malloc(strlen(path) + 1);
+  if (!w->root) {
+    free(w);
+    uv_fs_event_stop(handle);
+    return UV_ENOMEM;
+  }
+  strcpy(w->root, path);
+  w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (w->fd < 0) {
+    ret = -errno;
+    free(w->root);
+    free(w);
+    uv_fs_event_stop(handle);
+    return ret;
+  }
+  ret = luv_fs_event_inotify_add(w, "");
+  if (ret == 0)
+    ret = uv_poll_init(handle->loop, &w->poll, w->fd);
+  if (ret < 0) {
+    luv_fs_event_inotify_free((uv_handle_t*)&w->poll);
+    uv_fs_event_stop(handle);
+    return ret;
+  }
+  w->poll.data = NULL;
+  uv_unref((uv_handle_t*)&w->poll);
+  ret = uv_poll_start(&w->poll, UV_READABLE, luv_fs_event_inotify_cb);
+  extra->inotify = w;
+  if (ret < 0) {
+    luv_fs_event_inotify_stop(extra);
+    uv_fs_event_stop(handle);
+  }
+  return ret;
+}
+
+// Returns 1 if path is a directory that should be watched recursively here.
+static int luv_fs_event_use_inotify(const char* path, int flags) {
+  uv_stat_t s;
+  uv_fs_t req;
+  int ret;
+  if (!(flags & UV_FS_EVENT_RECURSIVE))
+    return 0;
+  ret = uv_fs_stat(NULL, &req, path, NULL);
+  s = req.statbuf;
+  uv_fs_req_cleanup(&req);
+  return ret == 0 && S_ISDIR(s.st_mode);
+}
+#endif
+
 static int luv_fs_event_start(lua_State* L) {
   uv_fs_event_t* handle = luv_check_fs_event(L, 1);
   const char* path = luaL_checkstring(L, 2);
@@ -74,13 +580,33 @@ static int luv_fs_event_start(lua_State* L) {
   if (lua_toboolean(L, -1)) flags |= UV_FS_EVENT_RECURSIVE;
   lua_pop(L, 1);
   luv_check_callback(L, (luv_handle_t*)handle->data, LUV_FS_EVENT, 4);
+  ret = luv_fs_event_setup_batch(L, handle, 3);
+  if (ret < 0) return luv_error(L, ret);
+#ifdef __linux__
+  if (luv_fs_event_use_inotify(path, flags)) {
+    ret = luv_fs_event_inotify_start(handle, path);
+    return luv_result(L, ret);
+  }
+#endif
   ret = uv_fs_event_start(handle, luv_fs_event_cb, path, flags);
   return luv_result(L, ret);
 }
 
+// Drops pending events and the recursive watches when the handle is stopped.
+static void luv_fs_event_release(uv_fs_event_t* handle) {
+  luv_fs_event_extra_t* batch = (luv_fs_event_extra_t*)((luv_handle_t*)handle->data)->extra;
+  if (!batch) return;
+  uv_timer_stop(&batch->timer);
+  luv_fs_event_batch_clear(batch);
+#ifdef __linux__
+  luv_fs_event_inotify_stop(batch);
+#endif
+}
+
 static int luv_fs_event_stop(lua_State* L) {
   uv_fs_event_t* handle = luv_check_fs_event(L, 1);
   int ret = uv_fs_event_stop(handle);
+  luv_fs_event_release(handle);
   return luv_result(L, ret);
 }
 
@@ -88,7 +614,8 @@ static int luv_fs_event_getpath(lua_State* L) {
   uv_fs_event_t* handle = luv_check_fs_event(L, 1);
   size_t len = 2*PATH_MAX;
   char buf[2*PATH_MAX];
-  int ret = uv_fs_event_getpath(handle, buf, &len);
+  int ret;
+  ret = uv_fs_event_getpath(handle, buf, &len);
   if (ret < 0) return luv_error(L, ret);
   lua_pushlstring(L, buf, len);
   return 1;
@@ -86,3 +86,366 @@ static int luv_fs_poll_getpath(lua_State* L) {
   lua_pushlstring(L, buf, len);
   return 1;
 }
+
+/* A fs_poll_set watches many paths with a single timer. Each round the paths
+   are split into batches that are stat'ed on the threadpool, and the paths
+   whose stat changed since the previous round are reported in one callback.
+   The userdata wraps the timer, so the generic handle methods apply. */
+
+#define LUV_FS_POLL_SET_BATCH 256
+
+typedef struct {
+  char* path;
+  int known; /* stat has completed at least once */
+  int status;
+  uv_stat_t stat;
+} luv_fs_poll_entry_t;
+
+typedef struct luv_fs_poll_round_s luv_fs_poll_round_t;
+
+typedef struct {
+  uv_timer_t timer; /* must be first, the handle of the userdata */
+  unsigned int interval;
+  luv_fs_poll_entry_t* entries; /* sorted by path */
+  size_t count;
+  size_t capacity;
+  luv_fs_poll_round_t* round; /* stats in flight, NULL if none */
+  int started;
+} luv_fs_poll_set_t;
+
+typedef struct {
+  uv_work_t work;
+  luv_fs_poll_round_t* round;
+  size_t first;
+  size_t count;
+} luv_fs_poll_job_t;
+
+struct luv_fs_poll_round_s {
+  luv_fs_poll_set_t* set; /* NULL once the set is closed */
+  uint64_t start;
+  size_t count;
+  size_t pending;
+  char** paths;
+  int* status;
+  uv_stat_t* stats;
+};
+
+static luv_fs_poll_set_t* luv_check_fs_poll_set(lua_State* L, int index) {
+  luv_fs_poll_set_t* set = (luv_fs_poll_set_t*)luv_checkudata(L, index, "uv_fs_poll_set");
+  luaL_argcheck(L, set->timer.type == UV_TIMER && set->timer.data, index, "Expected uv_fs_poll_set_t");
+  return set;
+}
+
+static void luv_fs_poll_round_free(luv_fs_poll_round_t* round) {
+  size_t i;
+  for (i = 0; i < round->count; i++)
+    free(round->paths[i]);
+  free(round->paths);
+  free(round->status);
+  free(round->stats);
+  free(round);
+}
+
+static void luv_fs_poll_set_gc(void* ptr) {
+  luv_fs_poll_set_t* set = (luv_fs_poll_set_t*)ptr;
+  size_t i;
+  // an unfinished round is freed by its last job
+  if (set->round)
+    set->round->set = NULL;
+  for (i = 0; i < set->count; i++)
+    free(set->entries[i].path);
+  free(set->entries);
+}
+
+static int luv_new_fs_poll_set(lua_State* L) {
+  luv_ctx_t* ctx = luv_context(L);
+  unsigned int interval = luaL_checkinteger(L, 1);
+  luv_fs_poll_set_t* set;
+  luv_handle_t* data;
+  int ret;
+  set = (luv_fs_poll_set_t*)luv_newuserdata(L, sizeof(*set));
+  memset(set, 0, sizeof(*set));
+  ret = uv_timer_init(ctx->loop, &set->timer);
+  if (ret < 0) {
+    lua_pop(L, 1);
+    return luv_error(L, ret);
+  }
+  set->interval = interval;
+  data = luv_setup_handle(L, ctx);
+  luaL_getmetatable(L, "uv_fs_poll_set");
+  lua_setmetatable(L, -2);
+  data->extra = set;
+  data->extra_gc = luv_fs_poll_set_gc;
+  set->timer.data = data;
+  return 1;
+}
+
+// Returns the index of path, or of the position it would be inserted at.
+static size_t luv_fs_poll_set_find(luv_fs_poll_set_t* set, const char* path, int* found) {
+  size_t lo = 0, hi = set->count;
+  *found = 0;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strcmp(set->entries[mid].path, path);
+    if (cmp == 0) {
+      *found = 1;
+      return mid;
+    }
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Two stats are the same file state if none of the fields uv_fs_poll compares
+// changed.
+static int luv_fs_poll_stat_eq(const uv_stat_t* a, const uv_stat_t* b) {
+  return a->st_ctim.tv_nsec == b->st_ctim.tv_nsec
+      && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec
+      && a->st_birthtim.tv_nsec == b->st_birthtim.tv_nsec
+      && a->st_ctim.tv_sec == b->st_ctim.tv_sec
+      && a->st_mtim.tv_sec == b->st_mtim.tv_sec
+      && a->st_birthtim.tv_sec == b->st_birthtim.tv_sec
+      && a->st_size == b->st_size
+      && a->st_mode == b->st_mode
+      && a->st_uid == b->st_uid
+      && a->st_gid == b->st_gid
+      && a->st_ino == b->st_ino
+      && a->st_dev == b->st_dev
+      && a->st_flags == b->st_flags
+      && a->st_gen == b->st_gen;
+}
+
+static void luv_fs_poll_set_round(luv_fs_poll_set_t* set);
+
+static void luv_fs_poll_set_timer_cb(uv_timer_t* timer) {
+  luv_fs_poll_set_round((luv_fs_poll_set_t*)timer);
+}
+
+static void luv_fs_poll_job_work_cb(uv_work_t* work) {
+  luv_fs_poll_job_t* job = (luv_fs_poll_job_t*)work;
+  luv_fs_poll_round_t* round = job->round;
+  size_t i;
+  for (i = job->first; i < job->first + job->count; i++) {
+    uv_fs_t req;
+    round->status[i] = uv_fs_stat(NULL, &req, round->paths[i], NULL);
+    if (round->status[i] == 0)
+      round->stats[i] = req.statbuf;
+    uv_fs_req_cleanup(&req);
+  }
+}
+
+// Compares the round's results with the previous ones and calls back with the
+// changed paths.
+static void luv_fs_poll_set_report(luv_fs_poll_set_t* set, luv_fs_poll_round_t* round) {
+  luv_handle_t* data = (luv_handle_t*)set->timer.data;
+  lua_State* L = data->ctx->L;
+  int changed = 0;
+  size_t i;
+
+  lua_newtable(L);
+  for (i = 0; i < round->count; i++) {
+    int found;
+    size_t index = luv_fs_poll_set_find(set, round->paths[i], &found);
+    luv_fs_poll_entry_t* entry;
+    int status = round->status[i];
+    if (!found || status > 0) continue; // removed while in flight, or skipped
+    entry = &set->entries[index];
+    if (!entry->known) {
+      // like uv_fs_poll, a first stat is only reported if it failed
+      entry->known = 1;
+      entry->status = status;
+      if (status == 0) {
+        entry->stat = round->stats[i];
+        continue;
+      }
+    }
+    else if (status == 0 && entry->status == 0) {
+      if (luv_fs_poll_stat_eq(&entry->stat, &round->stats[i]))
+        continue;
+    }
+    else if (status == entry->status) {
+      continue;
+    }
+
+    lua_createtable(L, 0, 4);
+    lua_pushstring(L, entry->path);
+    lua_setfield(L, -2, "path");
+    if (entry->status == 0 && entry->known) {
+      luv_push_stats_table(L, &entry->stat);
+      lua_setfield(L, -2, "prev");
+    }
+    if (status == 0) {
+      luv_push_stats_table(L, &round->stats[i]);
+      lua_setfield(L, -2, "curr");
+    }
+    else {
+      luv_status(L, status);
+      lua_setfield(L, -2, "err");
+    }
+    lua_rawseti(L, -2, ++changed);
+
+    entry->status = status;
+    if (status == 0)
+      entry->stat = round->stats[i];
+  }
+
+  if (changed > 0)
+    luv_call_callback(L, data, LUV_FS_POLL, 1);
+  else
+    lua_pop(L, 1);
+}
+
+static void luv_fs_poll_job_after_work_cb(uv_work_t* work, int status) {
+  luv_fs_poll_job_t* job = (luv_fs_poll_job_t*)work;
+  luv_fs_poll_round_t* round = job->round;
+  luv_fs_poll_set_t* set = round->set;
+  (void)status;
+  free(job);
+  if (--round->pending > 0) return;
+
+  if (set) {
+    uint64_t elapsed = uv_now(set->timer.loop) - round->start;
+    set->round = NULL;
+    if (set->started && !uv_is_closing((uv_handle_t*)&set->timer)) {
+      luv_fs_poll_set_report(set, round);
+      // the callback may have stopped or closed the set
+      if (set->started && !uv_is_closing((uv_handle_t*)&set->timer)) {
+        uint64_t timeout = elapsed < set->interval ? set->interval - elapsed : 1;
+        uv_timer_start(&set->timer, luv_fs_poll_set_timer_cb, timeout, 0);
+      }
+    }
+  }
+  luv_fs_poll_round_free(round);
+}
+
+// Snapshots the paths and queues a stat job per batch.
+static void luv_fs_poll_set_round(luv_fs_poll_set_t* set) {
+  uv_loop_t* loop = set->timer.loop;
+  luv_fs_poll_round_t* round;
+  size_t i;
+
+  if (set->count == 0) {
+    uv_timer_start(&set->timer, luv_fs_poll_set_timer_cb, set->interval, 0);
+    return;
+  }
+
+  round = (luv_fs_poll_round_t*)calloc(1, sizeof(*round));
+  if (!round) goto retry;
+  round->set = set;
+  round->start = uv_now(loop);
+  round->paths = (char**)calloc(set->count, sizeof(char*));
+  round->status = (int*)calloc(set->count, sizeof(int));
+  round->stats = (uv_stat_t*)malloc(set->count * sizeof(uv_stat_t));
+  if (!round->paths || !round->status || !round->stats) goto fail;
+  for (i = 0; i < set->count; i++) {
+    round->paths[i] = luv_strdup(set->entries[i].path);
+    if (!round->paths[i]) goto fail;
+    round->count++;
+  }
+
+  // one extra pending count while queueing so a quick job can't finish the round
+  round->pending = 1;
+  set->round = round;
+  for (i = 0; i < round->count; i += LUV_FS_POLL_SET_BATCH) {
+    luv_fs_poll_job_t* job = (luv_fs_poll_job_t*)malloc(sizeof(*job));
+    if (!job) break;
+    job->round = round;
+    job->first = i;
+    job->count = round->count - i < LUV_FS_POLL_SET_BATCH ? round->count - i : LUV_FS_POLL_SET_BATCH;
+    round->pending++;
+    if (uv_queue_work(loop, &job->work, luv_fs_poll_job_work_cb, luv_fs_poll_job_after_work_cb) < 0) {
+      round->pending--;
+      free(job);
+      break;
+    }
+  }
+  // paths of batches that failed to queue are skipped this round
+  for (; i < round->count; i++)
+    round->status[i] = 1;
+  if (--round->pending == 0) {
+    set->round = NULL;
+    luv_fs_poll_round_free(round);
+    goto retry;
+  }
+  return;
+
+fail:
+  luv_fs_poll_round_free(round);
+retry:
+  uv_timer_start(&set->timer, luv_fs_poll_set_timer_cb, set->interval, 0);
+}
+
+static int luv_fs_poll_set_add(lua_State* L) {
+  luv_fs_poll_set_t* set = luv_check_fs_poll_set(L, 1);
+  const char* path = luaL_checkstring(L, 2);
+  int found;
+  size_t index = luv_fs_poll_set_find(set, path, &found);
+  luv_fs_poll_entry_t* entry;
+  if (found) return luv_error(L, UV_EEXIST);
+  if (set->count == set->capacity) {
+    size_t capacity = set->capacity ? set->capacity * 2 : 16;
+    luv_fs_poll_entry_t* entries = (luv_fs_poll_entry_t*)realloc(set->entries, capacity * sizeof(*entries));
+    if (!entries) return luv_error(L, UV_ENOMEM);
+    set->entries = entries;
+    set->capacity = capacity;
+  }
+  memmove(&set->entries[index + 1], &set->entries[index], (set->count - index) * sizeof(*entry));
+  entry = &set->entries[index];
+  memset(entry, 0, sizeof(*entry));
+  entry->path = luv_strdup(path);
+  if (!entry->path) {
+    memmove(&set->entries[index], &set->entries[index + 1], (set->count - index) * sizeof(*entry));
+    return luv_error(L, UV_ENOMEM);
+  }
+  set->count++;
+  return luv_result(L, 0);
+}
+
+static int luv_fs_poll_set_remove(lua_State* L) {
+  luv_fs_poll_set_t* set = luv_check_fs_poll_set(L, 1);
+  const char* path = luaL_checkstring(L, 2);
+  int found;
+  size_t index = luv_fs_poll_set_find(set, path, &found);
+  if (!found) return luv_error(L, UV_ENOENT);
+  free(set->entries[index].path);
+  set->count--;
+  memmove(&set->entries[index], &set->entries[index + 1], (set->count - index) * sizeof(*set->entries));
+  return luv_result(L, 0);
+}
+
+static int luv_fs_poll_set_start(lua_State* L) {
+  luv_fs_poll_set_t* set = luv_check_fs_poll_set(L, 1);
+  luv_check_callback(L, (luv_handle_t*)set->timer.data, LUV_FS_POLL, 2);
+  if (set->started) return luv_result(L, 0);
+  set->started = 1;
+  // a round still in flight from before a stop will schedule the next one
+  if (!set->round)
+    luv_fs_poll_set_round(set);
+  return luv_result(L, 0);
+}
+
+static int luv_fs_poll_set_stop(lua_State* L) {
+  luv_fs_poll_set_t* set = luv_check_fs_poll_set(L, 1);
+  set->started = 0;
+  return luv_result(L, uv_timer_stop(&set->timer));
+}
+
+static int luv_fs_poll_set_getpaths(lua_State* L) {
+  luv_fs_poll_set_t* set = luv_check_fs_poll_set(L, 1);
+  size_t i;
+  lua_createtable(L, (int)set->count, 0);
+  for (i = 0; i < set->count; i++) {
+    lua_pushstring(L, set->entries[i].path);
+    lua_rawseti(L, -2, (int)i + 1);
+  }
+  return 1;
+}
+
+static int luv_fs_poll_set_tostring(lua_State* L) {
+  luv_fs_poll_set_t* set = luv_check_fs_poll_set(L, 1);
+  lua_pushfstring(L, "uv_fs_poll_set_t: %p", set);
+  return 1;
+}
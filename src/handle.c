@@ -108,12 +108,16 @@ static void luv_close_cb(uv_handle_t* handle) {
 
 static int luv_close(lua_State* L) {
   uv_handle_t* handle = luv_check_handle(L, 1);
+  luv_handle_t* data;
   if (uv_is_closing(handle)) {
     luaL_error(L, "handle %p is already closing", handle);
   }
   if (!lua_isnoneornil(L, 2)) {
     luv_check_callback(L, (luv_handle_t*)handle->data, LUV_CLOSED, 2);
   }
+  data = (luv_handle_t*)handle->data;
+  if (data->extra_close)
+    data->extra_close(data->extra);
   uv_close(handle, luv_close_cb);
   return 0;
 }
@@ -0,0 +1,109 @@
+/*
+*  Copyright 2014 The Luvit Authors. All Rights Reserved.
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+#ifndef LUV_LATOMIC_H
+#define LUV_LATOMIC_H
+
+// Atomic counters and pointers for objects shared between threads. C11
+// atomics are used where available, with the compiler builtins as fallback.
+// luv_atomic64_cas returns the value found, the swap happened if it equals
+// the expected one.
+#include <stdint.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+
+typedef volatile long luv_atomic_t;
+
+#define luv_atomic_init(p, v)   (*(p) = (v))
+#define luv_atomic_load(p)      _InterlockedOr((p), 0)
+#define luv_atomic_inc(p)       _InterlockedIncrement(p)
+#define luv_atomic_dec(p)       _InterlockedDecrement(p)
+#define luv_atomic_exchange(p, v) _InterlockedExchange((p), (v))
+
+typedef void* volatile luv_atomic_ptr_t;
+
+#define luv_atomic_ptr_init(p, v)     (*(p) = (v))
+#define luv_atomic_ptr_load(p)        _InterlockedCompareExchangePointer((p), NULL, NULL)
+#define luv_atomic_ptr_store(p, v)    ((void)_InterlockedExchangePointer((p), (v)))
+#define luv_atomic_ptr_exchange(p, v) _InterlockedExchangePointer((p), (v))
+
+typedef volatile __int64 luv_atomic64_t;
+
+#define luv_atomic64_init(p, v)      (*(p) = (v))
+#define luv_atomic64_load(p)         _InterlockedCompareExchange64((p), 0, 0)
+#define luv_atomic64_store(p, v)     ((void)_InterlockedExchange64((p), (v)))
+#define luv_atomic64_fetch_add(p, v) _InterlockedExchangeAdd64((p), (v))
+#define luv_atomic64_cas(p, e, d)    _InterlockedCompareExchange64((p), (d), (e))
+
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+
+typedef atomic_long luv_atomic_t;
+
+#define luv_atomic_init(p, v)   atomic_init((p), (v))
+#define luv_atomic_load(p)      atomic_load(p)
+#define luv_atomic_inc(p)       (atomic_fetch_add((p), 1) + 1)
+#define luv_atomic_dec(p)       (atomic_fetch_sub((p), 1) - 1)
+#define luv_atomic_exchange(p, v) atomic_exchange((p), (v))
+
+typedef _Atomic(void*) luv_atomic_ptr_t;
+
+#define luv_atomic_ptr_init(p, v)     atomic_init((p), (v))
+#define luv_atomic_ptr_load(p)        atomic_load(p)
+#define luv_atomic_ptr_store(p, v)    atomic_store((p), (v))
+#define luv_atomic_ptr_exchange(p, v) atomic_exchange((p), (v))
+
+typedef _Atomic(int64_t) luv_atomic64_t;
+
+#define luv_atomic64_init(p, v)      atomic_init((p), (v))
+#define luv_atomic64_load(p)         atomic_load(p)
+#define luv_atomic64_store(p, v)     atomic_store((p), (v))
+#define luv_atomic64_fetch_add(p, v) atomic_fetch_add((p), (v))
+
+static int64_t luv_atomic64_cas(luv_atomic64_t* p, int64_t expected, int64_t desired) {
+  atomic_compare_exchange_strong(p, &expected, desired);
+  return expected;
+}
+
+#else
+
+typedef long luv_atomic_t;
+
+#define luv_atomic_init(p, v)   (*(p) = (v))
+#define luv_atomic_load(p)      __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define luv_atomic_inc(p)       __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define luv_atomic_dec(p)       __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define luv_atomic_exchange(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+
+typedef void* luv_atomic_ptr_t;
+
+#define luv_atomic_ptr_init(p, v)     (*(p) = (v))
+#define luv_atomic_ptr_load(p)        __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define luv_atomic_ptr_store(p, v)    __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define luv_atomic_ptr_exchange(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+
+typedef int64_t luv_atomic64_t;
+
+#define luv_atomic64_init(p, v)      (*(p) = (v))
+#define luv_atomic64_load(p)         __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define luv_atomic64_store(p, v)     __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define luv_atomic64_fetch_add(p, v) __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+#define luv_atomic64_cas(p, e, d)    __sync_val_compare_and_swap((p), (e), (d))
+
+#endif
+
+#endif //LUV_LATOMIC_H
@@ -53,6 +53,7 @@ static luv_handle_t* luv_setup_handle(lua_State* L, luv_ctx_t* ctx) {
   data->ctx = ctx;
   data->extra = NULL;
   data->extra_gc = NULL;
+  data->extra_close = NULL;
 
   // record data in handle registry
   lua_getfield(L, LUA_REGISTRYINDEX, luv_handle_key);
@@ -48,6 +48,7 @@ typedef struct {
   luv_ctx_t* ctx;
   void* extra;
   luv_handle_extra_gc extra_gc;
+  luv_handle_extra_gc extra_close; /* called with extra when the handle is closed */
 } luv_handle_t;
 
 static void luv_handle_free(uv_handle_t* handle);
@@ -18,12 +18,27 @@
 #define LUV_LTHREADPOOL_H
 
 #include "luv.h"
+#include "latomic.h"
 
-#define LUV_THREAD_MAXNUM_ARG 9
+typedef struct luv_shared_s luv_shared_t;
+
+// Header of objects shared by reference between states, see shared.c
+struct luv_shared_s {
+  luv_atomic_t refs;
+  const char* metaname;               // metatable of its userdata
+  void (*free)(luv_shared_t* shared); // called when the last reference goes
+};
+
+// luv_val_t type of a luv_shared_t passed by reference
+#define LUV_THREAD_TSHARED 0x40  // above all basic Lua type tags
+
+// number of values stored without an extra allocation
+#define LUV_THREAD_INLINE_ARG 9
 
 typedef struct {
-  // support basic lua type LUA_TNIL, LUA_TBOOLEAN, LUA_TNUMBER, LUA_TSTRING
-  // and support uv_handle_t userdata
+  // support basic lua type LUA_TNIL, LUA_TBOOLEAN, LUA_TNUMBER, LUA_TSTRING,
+  // uv_handle_t userdata, LUA_TTABLE, which is serialized, and
+  // LUV_THREAD_TSHARED
   int type;
   union
   {
@@ -44,6 +59,11 @@ typedef struct {
       size_t size;
       const char* metaname;
     } udata;
+    struct {
+      char* data;      // serialized table, freed once it has been pushed
+      size_t len;
+    } table;
+    luv_shared_t* shared; // holds a reference until cleared
   } val;
   int ref[2];          // ref of string or userdata
 } luv_val_t;
@@ -52,9 +72,34 @@ typedef struct {
   int argc;
   int flags;          // control gc
 
-  luv_val_t argv[LUV_THREAD_MAXNUM_ARG];
+  // values live in inline_argv, or in argv once there are more than fit
+  int capacity;
+  luv_val_t* argv;
+  luv_val_t inline_argv[LUV_THREAD_INLINE_ARG];
 } luv_thread_arg_t;
 
+#define LUV_THREAD_ARGV(args) ((args)->argv ? (args)->argv : (args)->inline_argv)
+
+typedef struct luv_mpsc_node_s luv_mpsc_node_t;
+
+struct luv_mpsc_node_s {
+  luv_atomic_ptr_t next;
+};
+
+// Lock-free queue with many producer threads and a single consumer, see
+// luv_mpsc_push and luv_mpsc_pop in thread.c
+typedef struct {
+  luv_atomic_ptr_t head;  // last pushed node, updated by producers
+  luv_mpsc_node_t* tail;  // next node to pop, owned by the consumer
+  luv_mpsc_node_t stub;
+} luv_mpsc_t;
+
+// Args sent from any thread and queued until the receiver pushes them
+typedef struct {
+  luv_mpsc_node_t node;
+  luv_thread_arg_t args;
+} luv_thread_msg_t;
+
 //luajit miss LUA_OK
 #ifndef LUA_OK
 #define LUA_OK 0
@@ -64,7 +109,9 @@ typedef struct {
 #define LUVF_THREAD_SIDE_MAIN      0x00
 #define LUVF_THREAD_SIDE_CHILD     0x01
 #define LUVF_THREAD_MODE_ASYNC     0x02
+#define LUVF_THREAD_MODE_BORROW    0x04 // values are kept alive by the caller
 #define LUVF_THREAD_SIDE(i)        ((i)&0x01)
 #define LUVF_THREAD_ASYNC(i)       ((i)&0x02)
+#define LUVF_THREAD_BORROW(i)      ((i)&0x04)
 
 #endif //LUV_LTHREADPOOL_H
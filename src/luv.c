@@ -22,6 +22,7 @@
 #include "luv.h"
 
 #include "async.c"
+#include "channel.c"
 #include "check.c"
 #include "constants.c"
 #include "dns.c"
@@ -40,6 +41,8 @@
 #include "prepare.c"
 #include "process.c"
 #include "req.c"
+#include "shared.c"
+#include "shared_map.c"
 #include "signal.c"
 #include "stream.c"
 #include "tcp.c"
@@ -162,6 +165,13 @@ static const luaL_Reg luv_functions[] = {
   // tcp.c
   {"new_tcp", luv_new_tcp},
   {"tcp_open", luv_tcp_open},
+  {"tcp_detach", luv_tcp_detach},
+  {"tcp_adopt", luv_tcp_adopt},
+  {"tcp_listen_group", luv_tcp_listen_group},
+  {"listen_group_stop", luv_listen_group_stop},
+  {"listen_group_metrics", luv_listen_group_metrics},
+  {"listen_group_threads", luv_listen_group_threads},
+  {"listen_group_getsockname", luv_listen_group_getsockname},
   {"tcp_nodelay", luv_tcp_nodelay},
   {"tcp_keepalive", luv_tcp_keepalive},
   {"tcp_simultaneous_accepts", luv_tcp_simultaneous_accepts},
@@ -249,6 +259,12 @@ static const luaL_Reg luv_functions[] = {
   {"fs_poll_start", luv_fs_poll_start},
   {"fs_poll_stop", luv_fs_poll_stop},
   {"fs_poll_getpath", luv_fs_poll_getpath},
+  {"new_fs_poll_set", luv_new_fs_poll_set},
+  {"fs_poll_set_add", luv_fs_poll_set_add},
+  {"fs_poll_set_remove", luv_fs_poll_set_remove},
+  {"fs_poll_set_start", luv_fs_poll_set_start},
+  {"fs_poll_set_stop", luv_fs_poll_set_stop},
+  {"fs_poll_set_getpaths", luv_fs_poll_set_getpaths},
 
   // fs.c
   {"fs_close", luv_fs_close},
@@ -271,6 +287,8 @@ static const luaL_Reg luv_functions[] = {
   {"fs_fsync", luv_fs_fsync},
   {"fs_fdatasync", luv_fs_fdatasync},
   {"fs_ftruncate", luv_fs_ftruncate},
+  {"fs_fallocate", luv_fs_fallocate},
+  {"fs_fadvise", luv_fs_fadvise},
   {"fs_sendfile", luv_fs_sendfile},
   {"fs_access", luv_fs_access},
   {"fs_chmod", luv_fs_chmod},
@@ -294,6 +312,8 @@ static const luaL_Reg luv_functions[] = {
 #if LUV_UV_VERSION_GEQ(1, 14, 0)
   {"fs_copyfile", luv_fs_copyfile },
 #endif
+  {"fs_copy_range", luv_fs_copy_range},
+  {"fs_copy_tree", luv_fs_copy_tree},
 #if LUV_UV_VERSION_GEQ(1, 28, 0)
   {"fs_opendir", luv_fs_opendir},
   {"fs_readdir", luv_fs_readdir},
@@ -394,6 +414,13 @@ static const luaL_Reg luv_functions[] = {
   {"thread_equal", luv_thread_equal},
   {"thread_self", luv_thread_self},
   {"thread_join", luv_thread_join},
+  {"new_loop_thread", luv_new_loop_thread},
+  {"thread_post", luv_thread_post},
+  {"thread_stop", luv_thread_stop},
+  {"thread_vm_pool", luv_thread_vm_pool},
+  {"thread_vm_stats", luv_thread_vm_stats},
+  {"thread_vm_alloc", luv_thread_vm_alloc},
+  {"thread_vm_alloc_stats", luv_thread_vm_alloc_stats},
 #if LUV_UV_VERSION_GEQ(1, 45, 0)
   {"thread_getaffinity", luv_thread_getaffinity},
   {"thread_setaffinity", luv_thread_setaffinity},
@@ -414,6 +441,60 @@ static const luaL_Reg luv_functions[] = {
   {"sem_post", luv_sem_post},
   {"sem_wait", luv_sem_wait},
   {"sem_trywait", luv_sem_trywait},
+  {"new_atomic", luv_new_atomic},
+  {"atomic_load", luv_shared_atomic_load},
+  {"atomic_store", luv_shared_atomic_store},
+  {"atomic_add", luv_shared_atomic_add},
+  {"atomic_sub", luv_shared_atomic_sub},
+  {"atomic_cas", luv_shared_atomic_cas},
+  {"new_mutex", luv_new_mutex},
+  {"mutex_lock", luv_mutex_lock},
+  {"mutex_trylock", luv_mutex_trylock},
+  {"mutex_lock_async", luv_mutex_lock_async},
+  {"mutex_unlock", luv_mutex_unlock},
+  {"new_rwlock", luv_new_rwlock},
+  {"rwlock_rdlock", luv_rwlock_rdlock},
+  {"rwlock_tryrdlock", luv_rwlock_tryrdlock},
+  {"rwlock_rdlock_async", luv_rwlock_rdlock_async},
+  {"rwlock_rdunlock", luv_rwlock_rdunlock},
+  {"rwlock_wrlock", luv_rwlock_wrlock},
+  {"rwlock_trywrlock", luv_rwlock_trywrlock},
+  {"rwlock_wrlock_async", luv_rwlock_wrlock_async},
+  {"rwlock_wrunlock", luv_rwlock_wrunlock},
+  {"new_cond", luv_new_cond},
+  {"cond_wait", luv_cond_wait},
+  {"cond_wait_async", luv_cond_wait_async},
+  {"cond_signal", luv_cond_signal},
+  {"cond_broadcast", luv_cond_broadcast},
+  {"new_barrier", luv_new_barrier},
+  {"barrier_wait", luv_barrier_wait},
+  {"barrier_wait_async", luv_barrier_wait_async},
+
+  // shared.c
+  {"new_shared_buffer", luv_new_shared_buffer},
+  {"shared_buffer_size", luv_shared_buffer_size},
+  {"shared_buffer_read", luv_shared_buffer_read},
+  {"shared_buffer_write", luv_shared_buffer_write},
+  {"shared_buffer_slice", luv_shared_buffer_slice},
+
+  // shared_map.c
+  {"new_shared_map", luv_new_shared_map},
+  {"shared_map_get", luv_shared_map_get},
+  {"shared_map_set", luv_shared_map_set},
+  {"shared_map_version", luv_shared_map_version},
+  {"shared_map_count", luv_shared_map_count},
+  {"shared_map_snapshot", luv_shared_map_snapshot},
+  {"shared_map_pairs", luv_shared_map_pairs},
+
+  // channel.c
+  {"new_channel", luv_new_channel},
+  {"channel_send", luv_channel_send},
+  {"channel_try_send", luv_channel_try_send},
+  {"channel_recv", luv_channel_recv},
+  {"channel_recv_start", luv_channel_recv_start},
+  {"channel_recv_stop", luv_channel_recv_stop},
+  {"channel_close", luv_channel_close},
+  {"channel_count", luv_channel_count},
 
 #if LUV_UV_VERSION_GEQ(1, 49, 0)
   {"utf16_length_as_wtf8", luv_utf16_length_as_wtf8},
@@ -425,6 +506,16 @@ static const luaL_Reg luv_functions[] = {
   // work.c
   {"new_work", luv_new_work},
   {"queue_work", luv_queue_work},
+  {"queue_work_many", luv_queue_work_many},
+  {"cancel_work", luv_cancel_work},
+  {"work_report", luv_work_report},
+  {"work_metrics", luv_work_metrics},
+  {"parallel_map", luv_parallel_map},
+  {"parallel_reduce", luv_parallel_reduce},
+  {"new_work_pool", luv_new_work_pool},
+  {"work_pool_stats", luv_work_pool_stats},
+  {"set_work_init", luv_set_work_init},
+  {"warm_work_pool", luv_warm_work_pool},
 
   // util.c
 #if LUV_UV_VERSION_GEQ(1, 10, 0)
@@ -484,6 +575,15 @@ static const luaL_Reg luv_fs_poll_methods[] = {
   {NULL, NULL}
 };
 
+static const luaL_Reg luv_fs_poll_set_methods[] = {
+  {"add", luv_fs_poll_set_add},
+  {"remove", luv_fs_poll_set_remove},
+  {"start", luv_fs_poll_set_start},
+  {"stop", luv_fs_poll_set_stop},
+  {"getpaths", luv_fs_poll_set_getpaths},
+  {NULL, NULL}
+};
+
 static const luaL_Reg luv_idle_methods[] = {
   {"start", luv_idle_start},
   {"stop", luv_idle_stop},
@@ -554,6 +654,8 @@ static const luaL_Reg luv_process_methods[] = {
 
 static const luaL_Reg luv_tcp_methods[] = {
   {"open", luv_tcp_open},
+  {"detach", luv_tcp_detach},
+  {"adopt", luv_tcp_adopt},
   {"nodelay", luv_tcp_nodelay},
   {"keepalive", luv_tcp_keepalive},
   {"simultaneous_accepts", luv_tcp_simultaneous_accepts},
@@ -657,6 +759,19 @@ static void luv_handle_init(lua_State* L) {
 
   UV_HANDLE_TYPE_MAP(XX)
 #undef XX
+
+  // fs_poll_set wraps a timer but has its own methods
+  luaL_newmetatable(L, "uv_fs_poll_set");
+  lua_pushcfunction(L, luv_fs_poll_set_tostring);
+  lua_setfield(L, -2, "__tostring");
+  lua_pushcfunction(L, luv_handle_gc);
+  lua_setfield(L, -2, "__gc");
+  luaL_newlib(L, luv_fs_poll_set_methods);
+  luaL_setfuncs(L, luv_handle_methods, 0);
+  lua_setfield(L, -2, "__index");
+  lua_pushboolean(L, 1);
+  lua_rawset(L, -3);
+
   lua_setfield(L, LUA_REGISTRYINDEX, "uv_handle");
 
   lua_newtable(L);
@@ -934,6 +1049,10 @@ LUALIB_API int luaopen_luv (lua_State* L) {
 #endif
   luv_thread_init(L);
   luv_synch_init(L);
+  luv_shared_init(L);
+  luv_shared_map_init(L);
+  luv_channel_init(L);
+  luv_tcp_init(L);
   luv_work_init(L);
 
   luv_constants(L);
@@ -155,4 +155,19 @@ typedef lua_State* (*luv_acquire_vm)(void);
 typedef void (*luv_release_vm)(lua_State* L);
 LUALIB_API void luv_set_thread_cb(luv_acquire_vm acquire, luv_release_vm release);
 
+/* Keep up to max states of finished threads for the next uv.new_thread and
+   uv.new_loop_thread instead of releasing them, 0 (the default) disables it.
+   Reused states come from and go back to the luv_set_thread_cb callbacks, and
+   get back the globals and loaded modules they were created with.
+   Returns 0 or a negative libuv error.
+*/
+LUALIB_API int luv_set_thread_vm_pool(int max);
+
+/* Create the states of threads and work with a per-state allocator that
+   keeps freed small blocks for reuse, without locking, instead of sharing
+   malloc with every other thread. Only applies to states made by the default
+   luv_set_thread_cb callbacks after it is set. Returns the previous setting.
+*/
+LUALIB_API int luv_set_thread_vm_alloc(int enable);
+
 #endif
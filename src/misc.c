@@ -42,9 +42,18 @@ static int luv_version_string(lua_State* L) {
  return 1;
 }
 
-// requires the value at idx to be a string or number
+// Return true if the value at idx can be used as a buffer: a string, a
+// number or a shared buffer
+static int luv_is_buf(lua_State *L, int idx) {
+  return lua_isstring(L, idx) || luv_get_shared_buffer(L, idx) != NULL;
+}
+
+// requires luv_is_buf to be true for the value at idx
 static void luv_prep_buf(lua_State *L, int idx, uv_buf_t *pbuf) {
   size_t len;
+  // shared buffers are used in place, their userdata is kept alive by the refs
+  if (luv_shared_buffer_prep(L, idx, pbuf))
+    return;
   // note: if the value is a number, lua_tolstring converts the stack value to a string
   pbuf->base = (char*)lua_tolstring(L, idx, &len);
   pbuf->len = len;
@@ -76,7 +85,7 @@ static uv_buf_t* luv_prep_bufs(lua_State* L, int index, size_t *count, int **ref
   }
   for (i = 0; i < *count; ++i) {
     lua_rawgeti(L, index, i + 1);
-    if (!lua_isstring(L, -1)) {
+    if (!luv_is_buf(L, -1)) {
       /* free already-accumulated refs and heap allocations before throwing */
       if (refs_array) {
         size_t j;
@@ -116,7 +125,7 @@ static uv_buf_t* luv_check_bufs(lua_State* L, int index, size_t* count, luv_req_
     req_data->data = refs;
     req_data->data_ref = LUV_REQ_MULTIREF;
   }
-  else if (lua_isstring(L, index)) {
+  else if (luv_is_buf(L, index)) {
     *count = 1;
     bufs = (uv_buf_t*)malloc(sizeof(uv_buf_t));
     if (!bufs) luaL_error(L, "Failed to allocate buffer");
@@ -137,7 +146,7 @@ static uv_buf_t* luv_check_bufs_noref(lua_State* L, int index, size_t* count) {
   if (lua_istable(L, index)) {
     bufs = luv_prep_bufs(L, index, count, NULL);
   }
-  else if (lua_isstring(L, index)) {
+  else if (luv_is_buf(L, index)) {
     *count = 1;
     bufs = (uv_buf_t*)malloc(sizeof(uv_buf_t));
     if (!bufs) luaL_error(L, "Failed to allocate buffer");
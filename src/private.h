@@ -77,6 +77,7 @@ static void luv_cleanup_req(lua_State* L, luv_req_t* data);
 /* From handle.c */
 static void* luv_checkudata(lua_State* L, int ud, const char* tname);
 static void* luv_newuserdata(lua_State* L, size_t sz);
+static void luv_close_cb(uv_handle_t* handle);
 
 
 /* From misc.c */
@@ -85,8 +86,23 @@ static uv_buf_t* luv_prep_bufs(lua_State* L, int index, size_t *count, int **ref
 static uv_buf_t* luv_check_bufs(lua_State* L, int index, size_t *count, luv_req_t* req_data);
 static uv_buf_t* luv_check_bufs_noref(lua_State* L, int index, size_t *count);
 
+/* From shared.c */
+typedef struct luv_shared_buffer_s luv_shared_buffer_t;
+static luv_shared_t* luv_shared_retain(luv_shared_t* shared);
+static void luv_shared_release(luv_shared_t* shared);
+static void luv_shared_push(lua_State* L, luv_shared_t* shared);
+static luv_shared_t* luv_shared_get(lua_State* L, int index);
+static luv_shared_t* luv_shared_new(lua_State* L, size_t size, const char* metaname, void (*free_cb)(luv_shared_t*));
+static luv_shared_t* luv_shared_check(lua_State* L, int index, const char* metaname);
+static void luv_shared_newmetatable(lua_State* L, const char* metaname, const luaL_Reg* methods);
+static luv_shared_buffer_t* luv_check_shared_buffer(lua_State* L, int index);
+static luv_shared_buffer_t* luv_get_shared_buffer(lua_State* L, int index);
+static uv_buf_t luv_shared_buffer_buf(luv_shared_buffer_t* buffer);
+static int luv_shared_buffer_prep(lua_State* L, int index, uv_buf_t* buf);
+
 /* From tcp.c */
 static void parse_sockaddr(lua_State* L, struct sockaddr_storage* address);
+static int luv_tcp_bind_reuseport(uv_tcp_t* handle, const struct sockaddr* addr, unsigned int flags);
 static void luv_connect_cb(uv_connect_t* req, int status);
 
 /* From fs.c */
@@ -128,16 +144,26 @@ static int luv_optboolean(lua_State*L, int idx, int defaultval);
 
 /* From thread.c */
 static lua_State* luv_thread_acquire_vm(void);
+static void luv_mpsc_init(luv_mpsc_t* queue);
+static void luv_mpsc_push(luv_mpsc_t* queue, luv_mpsc_node_t* node);
+static luv_mpsc_node_t* luv_mpsc_pop(luv_mpsc_t* queue);
+static luv_thread_msg_t* luv_thread_msg_new(lua_State* L, int idx, int top);
+static void luv_thread_msg_free(luv_thread_msg_t* msg);
+static void luv_thread_msg_drop(luv_thread_msg_t* msg);
+static char* luv_serialize(lua_State* L, int idx, size_t* len);
+static void luv_deserialize(lua_State* L, const char* data);
 
 /* From process.c */
 static int luv_parse_signal(lua_State* L, int slot);
 
 /* From work.c */
 static int luv_thread_dumped(lua_State* L, int idx);
+static int luv_cancel_work(lua_State* L);
 static const char* luv_getmtname(lua_State *L, int idx);
 static int luv_thread_arg_set(lua_State* L, luv_thread_arg_t* args, int idx, int top, int flags);
 static int luv_thread_arg_push(lua_State* L, luv_thread_arg_t* args, int flags);
 static void luv_thread_arg_clear(lua_State* L, luv_thread_arg_t* args, int flags);
+static void luv_thread_arg_free(luv_thread_arg_t* args);
 static int luv_thread_arg_error(lua_State* L);
 
 static luv_acquire_vm acquire_vm_cb = NULL;
@@ -39,8 +39,12 @@ static int luv_req_tostring(lua_State* L) {
 
 // Metamethod to allow storing anything in the userdata's environment
 static int luv_cancel(lua_State* L) {
-  uv_req_t* req = (uv_req_t*)luv_check_req(L, 1);
-  int ret = uv_cancel(req);
+  uv_req_t* req;
+  int ret;
+  if (luaL_testudata(L, 1, "luv_work") != NULL)
+    return luv_cancel_work(L);
+  req = (uv_req_t*)luv_check_req(L, 1);
+  ret = uv_cancel(req);
   // Cleanup occurs when callbacks are ran with UV_ECANCELED status.
   return luv_result(L, ret);
 }
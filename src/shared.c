@@ -0,0 +1,236 @@
+/*
+*  Copyright 2014 The Luvit Authors. All Rights Reserved.
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+#include "private.h"
+
+/* Shared objects live outside of any Lua state. Their userdata only hold a
+   pointer to the object and a reference to it, so the same object can be
+   pushed into many states (through thread and work args) and is freed when
+   the last userdata is collected. */
+
+static luv_shared_t* luv_shared_retain(luv_shared_t* shared) {
+  (void)luv_atomic_inc(&shared->refs);
+  return shared;
+}
+
+static void luv_shared_release(luv_shared_t* shared) {
+  if (luv_atomic_dec(&shared->refs) == 0)
+    shared->free(shared);
+}
+
+static int luv_shared_gc(lua_State* L) {
+  luv_shared_t** udata = (luv_shared_t**)lua_touserdata(L, 1);
+  if (*udata) {
+    luv_shared_release(*udata);
+    *udata = NULL;
+  }
+  return 0;
+}
+
+// Pushes a new userdata for shared, taking a new reference to it.
+static void luv_shared_push(lua_State* L, luv_shared_t* shared) {
+  luv_shared_t** udata = (luv_shared_t**)lua_newuserdata(L, sizeof(*udata));
+  *udata = luv_shared_retain(shared);
+  luaL_getmetatable(L, shared->metaname);
+  lua_setmetatable(L, -2);
+}
+
+// Allocates a zeroed object of size bytes and pushes its userdata.
+static luv_shared_t* luv_shared_new(lua_State* L, size_t size, const char* metaname, void (*free_cb)(luv_shared_t*)) {
+  luv_shared_t** udata = (luv_shared_t**)lua_newuserdata(L, sizeof(*udata));
+  luv_shared_t* shared = (luv_shared_t*)calloc(1, size);
+  if (!shared) {
+    luaL_error(L, "Failed to allocate %s", metaname);
+    return NULL; // unreachable
+  }
+  luv_atomic_init(&shared->refs, 1);
+  shared->metaname = metaname;
+  shared->free = free_cb;
+  *udata = shared;
+  luaL_getmetatable(L, metaname);
+  lua_setmetatable(L, -2);
+  return shared;
+}
+
+static luv_shared_t* luv_shared_check(lua_State* L, int index, const char* metaname) {
+  luv_shared_t** udata = (luv_shared_t**)luaL_checkudata(L, index, metaname);
+  luaL_argcheck(L, *udata != NULL, index, "Expected a live shared object");
+  return *udata;
+}
+
+// Returns the shared object at index, or NULL if it isn't one.
+static luv_shared_t* luv_shared_get(lua_State* L, int index) {
+  luv_shared_t** udata = (luv_shared_t**)lua_touserdata(L, index);
+  lua_CFunction gc;
+  if (!udata || !lua_getmetatable(L, index))
+    return NULL;
+  lua_getfield(L, -1, "__gc");
+  gc = lua_tocfunction(L, -1);
+  lua_pop(L, 2);
+  return gc == luv_shared_gc ? *udata : NULL;
+}
+
+// Creates the metatable of a shared type and leaves it on the stack.
+static void luv_shared_newmetatable(lua_State* L, const char* metaname, const luaL_Reg* methods) {
+  luaL_newmetatable(L, metaname);
+  lua_pushcfunction(L, luv_shared_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_newtable(L);
+  luaL_setfuncs(L, methods, 0);
+  lua_setfield(L, -2, "__index");
+}
+
+struct luv_shared_buffer_s {
+  luv_shared_t shared;
+  luv_shared_buffer_t* parent;  // buffer a slice points into
+  char* base;
+  size_t len;
+};
+
+static void luv_shared_buffer_free(luv_shared_t* shared) {
+  luv_shared_buffer_t* buffer = (luv_shared_buffer_t*)shared;
+  if (buffer->parent)
+    luv_shared_release(&buffer->parent->shared);
+  free(buffer);
+}
+
+static luv_shared_buffer_t* luv_check_shared_buffer(lua_State* L, int index) {
+  return (luv_shared_buffer_t*)luv_shared_check(L, index, "luv_shared_buffer");
+}
+
+// Returns the shared buffer at index, or NULL if it isn't one.
+static luv_shared_buffer_t* luv_get_shared_buffer(lua_State* L, int index) {
+  luv_shared_t* shared = luv_shared_get(L, index);
+  if (shared && shared->free == luv_shared_buffer_free)
+    return (luv_shared_buffer_t*)shared;
+  return NULL;
+}
+
+static uv_buf_t luv_shared_buffer_buf(luv_shared_buffer_t* buffer) {
+  uv_buf_t buf;
+  buf.base = buffer->base;
+  buf.len = buffer->len;
+  return buf;
+}
+
+// Points buf at the shared buffer at index, returns 0 if it isn't one.
+static int luv_shared_buffer_prep(lua_State* L, int index, uv_buf_t* buf) {
+  luv_shared_buffer_t* buffer = luv_get_shared_buffer(L, index);
+  if (!buffer)
+    return 0;
+  *buf = luv_shared_buffer_buf(buffer);
+  return 1;
+}
+
+static int luv_new_shared_buffer(lua_State* L) {
+  luv_shared_buffer_t* buffer;
+  const char* data = NULL;
+  size_t len;
+  if (lua_type(L, 1) == LUA_TSTRING) {
+    data = lua_tolstring(L, 1, &len);
+  }
+  else {
+    lua_Integer size = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, size >= 0, 1, "size must be >= 0");
+    len = (size_t)size;
+  }
+  // the bytes follow the header in the same allocation
+  buffer = (luv_shared_buffer_t*)luv_shared_new(L, sizeof(*buffer) + len,
+    "luv_shared_buffer", luv_shared_buffer_free);
+  buffer->base = (char*)(buffer + 1);
+  buffer->len = len;
+  if (data)
+    memcpy(buffer->base, data, len);
+  return 1;
+}
+
+static int luv_shared_buffer_size(lua_State* L) {
+  luv_shared_buffer_t* buffer = luv_check_shared_buffer(L, 1);
+  lua_pushinteger(L, buffer->len);
+  return 1;
+}
+
+// Checks the 0-based offset at index and the length at index + 1, which
+// defaults to the rest of the buffer.
+static size_t luv_shared_buffer_range(lua_State* L, luv_shared_buffer_t* buffer, int index, size_t* len) {
+  lua_Integer offset = luaL_optinteger(L, index, 0);
+  lua_Integer length;
+  luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->len, index, "offset out of range");
+  length = luaL_optinteger(L, index + 1, (lua_Integer)(buffer->len - (size_t)offset));
+  luaL_argcheck(L, length >= 0 && (size_t)length <= buffer->len - (size_t)offset, index + 1, "length out of range");
+  *len = (size_t)length;
+  return (size_t)offset;
+}
+
+static int luv_shared_buffer_read(lua_State* L) {
+  luv_shared_buffer_t* buffer = luv_check_shared_buffer(L, 1);
+  size_t len;
+  size_t offset = luv_shared_buffer_range(L, buffer, 2, &len);
+  lua_pushlstring(L, buffer->base + offset, len);
+  return 1;
+}
+
+static int luv_shared_buffer_write(lua_State* L) {
+  luv_shared_buffer_t* buffer = luv_check_shared_buffer(L, 1);
+  luv_shared_buffer_t* source = luv_get_shared_buffer(L, 2);
+  const char* data;
+  size_t len;
+  lua_Integer offset;
+  if (source) {
+    data = source->base;
+    len = source->len;
+  }
+  else {
+    data = luaL_checklstring(L, 2, &len);
+  }
+  offset = luaL_optinteger(L, 3, 0);
+  luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->len, 3, "offset out of range");
+  luaL_argcheck(L, len <= buffer->len - (size_t)offset, 2, "data does not fit in the buffer");
+  // source may overlap with buffer when both are slices of the same buffer
+  memmove(buffer->base + offset, data, len);
+  lua_pushinteger(L, len);
+  return 1;
+}
+
+static int luv_shared_buffer_slice(lua_State* L) {
+  luv_shared_buffer_t* buffer = luv_check_shared_buffer(L, 1);
+  luv_shared_buffer_t* slice;
+  size_t len;
+  size_t offset = luv_shared_buffer_range(L, buffer, 2, &len);
+  slice = (luv_shared_buffer_t*)luv_shared_new(L, sizeof(*slice),
+    "luv_shared_buffer", luv_shared_buffer_free);
+  // slices of slices point into the root buffer
+  slice->parent = buffer->parent ? buffer->parent : buffer;
+  luv_shared_retain(&slice->parent->shared);
+  slice->base = buffer->base + offset;
+  slice->len = len;
+  return 1;
+}
+
+static const luaL_Reg luv_shared_buffer_methods[] = {
+  {"size", luv_shared_buffer_size},
+  {"read", luv_shared_buffer_read},
+  {"write", luv_shared_buffer_write},
+  {"slice", luv_shared_buffer_slice},
+  {NULL, NULL}
+};
+
+static void luv_shared_init(lua_State* L) {
+  luv_shared_newmetatable(L, "luv_shared_buffer", luv_shared_buffer_methods);
+  lua_pushcfunction(L, luv_shared_buffer_size);
+  lua_setfield(L, -2, "__len");
+  lua_pop(L, 1);
+}
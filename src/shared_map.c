@@ -0,0 +1,437 @@
+/*
+*  Copyright 2014 The Luvit Authors. All Rights Reserved.
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*/
+#include "private.h"
+
+// must be a power of two
+#define LUV_SHARED_MAP_STRIPES 16
+
+typedef struct luv_shared_map_entry_s {
+  struct luv_shared_map_entry_s* next;
+  size_t hash;
+  uint64_t version;
+  char* value;            // serialized like thread args
+  size_t len;
+  size_t keylen;
+  char key[1];            // keylen bytes
+} luv_shared_map_entry_t;
+
+// A part of the map with its own lock, so writers to different stripes
+// don't wait for each other.
+typedef struct {
+  uv_rwlock_t lock;
+  luv_shared_map_entry_t** buckets;
+  size_t nbuckets;        // power of two, 0 until the first set
+  size_t count;
+} luv_shared_map_stripe_t;
+
+// String keys to values stored in C memory, shared by reference between
+// states like a shared buffer.
+typedef struct {
+  luv_shared_t shared;
+  luv_atomic64_t clock;   // last version given to a value
+  int ready;              // stripes with an initialized lock
+  luv_shared_map_stripe_t stripes[LUV_SHARED_MAP_STRIPES];
+} luv_shared_map_t;
+
+// A copy of an entry, taken under the lock and pushed after.
+typedef struct {
+  char* key;
+  size_t keylen;
+  char* value;
+  uint64_t version;
+} luv_shared_map_item_t;
+
+static size_t luv_shared_map_hash(const char* key, size_t len) {
+  size_t h = 2166136261u;
+  size_t i;
+  for (i = 0; i < len; i++)
+    h = (h ^ (unsigned char)key[i]) * 16777619u;
+  return h;
+}
+
+static void luv_shared_map_free(luv_shared_t* shared) {
+  luv_shared_map_t* map = (luv_shared_map_t*)shared;
+  int i;
+  size_t j;
+  for (i = 0; i < map->ready; i++) {
+    luv_shared_map_stripe_t* stripe = &map->stripes[i];
+    for (j = 0; j < stripe->nbuckets; j++) {
+      luv_shared_map_entry_t* entry = stripe->buckets[j];
+      while (entry) {
+        luv_shared_map_entry_t* next = entry->next;
+        free(entry->value);
+        free(entry);
+        entry = next;
+      }
+    }
+    free(stripe->buckets);
+    uv_rwlock_destroy(&stripe->lock);
+  }
+  free(map);
+}
+
+static luv_shared_map_t* luv_check_shared_map(lua_State* L, int index) {
+  return (luv_shared_map_t*)luv_shared_check(L, index, "luv_shared_map");
+}
+
+static luv_shared_map_stripe_t* luv_shared_map_stripe(luv_shared_map_t* map, size_t hash) {
+  return &map->stripes[hash & (LUV_SHARED_MAP_STRIPES - 1)];
+}
+
+// Returns the link pointing to the entry for key, or to the end of its
+// bucket. Called with the stripe locked.
+static luv_shared_map_entry_t** luv_shared_map_find(luv_shared_map_stripe_t* stripe, const char* key, size_t keylen, size_t hash) {
+  luv_shared_map_entry_t** link;
+  if (stripe->nbuckets == 0)
+    return NULL;
+  // the low bits picked the stripe
+  link = &stripe->buckets[(hash / LUV_SHARED_MAP_STRIPES) & (stripe->nbuckets - 1)];
+  while (*link && !((*link)->hash == hash && (*link)->keylen == keylen &&
+                    memcmp((*link)->key, key, keylen) == 0))
+    link = &(*link)->next;
+  return link;
+}
+
+// Doubles the buckets of a stripe once it holds as many entries, called with
+// the stripe write locked. Keeps the old buckets when out of memory.
+static void luv_shared_map_grow(luv_shared_map_stripe_t* stripe) {
+  size_t nbuckets = stripe->nbuckets ? stripe->nbuckets * 2 : 8;
+  luv_shared_map_entry_t** buckets;
+  size_t i;
+  if (stripe->count < stripe->nbuckets)
+    return;
+  buckets = (luv_shared_map_entry_t**)calloc(nbuckets, sizeof(*buckets));
+  if (!buckets)
+    return;
+  for (i = 0; i < stripe->nbuckets; i++) {
+    luv_shared_map_entry_t* entry = stripe->buckets[i];
+    while (entry) {
+      luv_shared_map_entry_t* next = entry->next;
+      size_t slot = (entry->hash / LUV_SHARED_MAP_STRIPES) & (nbuckets - 1);
+      entry->next = buckets[slot];
+      buckets[slot] = entry;
+      entry = next;
+    }
+  }
+  free(stripe->buckets);
+  stripe->buckets = buckets;
+  stripe->nbuckets = nbuckets;
+}
+
+static int luv_new_shared_map(lua_State* L) {
+  luv_shared_map_t* map = (luv_shared_map_t*)luv_shared_new(L, sizeof(*map),
+    "luv_shared_map", luv_shared_map_free);
+  luv_atomic64_init(&map->clock, 0);
+  for (; map->ready < LUV_SHARED_MAP_STRIPES; map->ready++) {
+    int ret = uv_rwlock_init(&map->stripes[map->ready].lock);
+    if (ret < 0) {
+      lua_pop(L, 1);
+      return luv_error(L, ret);
+    }
+  }
+  return 1;
+}
+
+static int luv_shared_map_get(lua_State* L) {
+  luv_shared_map_t* map = luv_check_shared_map(L, 1);
+  size_t keylen;
+  const char* key = luaL_checklstring(L, 2, &keylen);
+  size_t hash = luv_shared_map_hash(key, keylen);
+  luv_shared_map_stripe_t* stripe = luv_shared_map_stripe(map, hash);
+  luv_shared_map_entry_t** link;
+  char* value = NULL;
+  uint64_t version = 0;
+  int found;
+
+  // copy the value out, pushing it allocates in Lua which can raise errors
+  uv_rwlock_rdlock(&stripe->lock);
+  link = luv_shared_map_find(stripe, key, keylen, hash);
+  found = link && *link;
+  if (found) {
+    value = (char*)malloc((*link)->len);
+    if (value)
+      memcpy(value, (*link)->value, (*link)->len);
+    version = (*link)->version;
+  }
+  uv_rwlock_rdunlock(&stripe->lock);
+  if (!found) {
+    lua_pushnil(L);
+    return 1;
+  }
+  if (!value)
+    return luaL_error(L, "Failed to allocate shared map value");
+
+  luv_deserialize(L, value);
+  free(value);
+  lua_pushinteger(L, (lua_Integer)version);
+  return 2;
+}
+
+static int luv_shared_map_version(lua_State* L) {
+  luv_shared_map_t* map = luv_check_shared_map(L, 1);
+  size_t keylen;
+  const char* key = luaL_checklstring(L, 2, &keylen);
+  size_t hash = luv_shared_map_hash(key, keylen);
+  luv_shared_map_stripe_t* stripe = luv_shared_map_stripe(map, hash);
+  luv_shared_map_entry_t** link;
+  uint64_t version = 0;
+  uv_rwlock_rdlock(&stripe->lock);
+  link = luv_shared_map_find(stripe, key, keylen, hash);
+  if (link && *link)
+    version = (*link)->version;
+  uv_rwlock_rdunlock(&stripe->lock);
+  lua_pushinteger(L, (lua_Integer)version);
+  return 1;
+}
+
+// Stores value, or removes the key when it is nil, if the version of the key
+// is expected (0 when absent) or expected isn't given.
+static int luv_shared_map_set(lua_State* L) {
+  luv_shared_map_t* map = luv_check_shared_map(L, 1);
+  size_t keylen;
+  const char* key = luaL_checklstring(L, 2, &keylen);
+  int remove = lua_isnoneornil(L, 3);
+  int check = !lua_isnoneornil(L, 4);
+  uint64_t expected = check ? (uint64_t)luaL_checkinteger(L, 4) : 0;
+  size_t hash = luv_shared_map_hash(key, keylen);
+  luv_shared_map_stripe_t* stripe = luv_shared_map_stripe(map, hash);
+  luv_shared_map_entry_t** link;
+  luv_shared_map_entry_t* entry = NULL;
+  luv_shared_map_entry_t* old = NULL;
+  char* value = NULL;
+  size_t len = 0;
+  uint64_t version = 0;
+
+  if (!remove) {
+    value = luv_serialize(L, 3, &len);
+    if (!value && lua_type(L, -1) == LUA_TSTRING)
+      return luaL_error(L, "Failed to serialize value: %s", lua_tostring(L, -1));
+    if (!value)
+      return luaL_argerror(L, 3, lua_pushfstring(L, "unsupported value type '%s'",
+        lua_typename(L, (int)lua_tointeger(L, -1))));
+    // allocate before locking, the entry is dropped if the key exists
+    entry = (luv_shared_map_entry_t*)malloc(sizeof(*entry) + keylen);
+    if (!entry) {
+      free(value);
+      return luaL_error(L, "Failed to allocate shared map entry");
+    }
+    memcpy(entry->key, key, keylen);
+    entry->keylen = keylen;
+    entry->hash = hash;
+  }
+
+  uv_rwlock_wrlock(&stripe->lock);
+  if (!remove)
+    luv_shared_map_grow(stripe);
+  link = luv_shared_map_find(stripe, key, keylen, hash);
+  version = link && *link ? (*link)->version : 0;
+  if (check && version != expected) {
+    uv_rwlock_wrunlock(&stripe->lock);
+    free(value);
+    free(entry);
+    lua_pushboolean(L, 0);
+    lua_pushinteger(L, (lua_Integer)version);
+    return 2;
+  }
+  if (remove) {
+    if (link && *link) {
+      old = *link;
+      *link = old->next;
+      stripe->count--;
+      value = old->value;
+      entry = old;
+    }
+    version = 0;
+  }
+  else {
+    version = (uint64_t)luv_atomic64_fetch_add(&map->clock, 1) + 1;
+    if (link && *link) {
+      // keep the entry, swap the value
+      char* previous;
+      old = *link;
+      previous = old->value;
+      old->value = value;
+      old->len = len;
+      old->version = version;
+      value = previous;
+    }
+    else if (link) {
+      entry->value = value;
+      entry->len = len;
+      entry->version = version;
+      entry->next = NULL;
+      *link = entry;
+      stripe->count++;
+      value = NULL;
+      entry = NULL;
+    }
+    else {
+      // the stripe could not get buckets
+      uv_rwlock_wrunlock(&stripe->lock);
+      free(value);
+      free(entry);
+      return luaL_error(L, "Failed to allocate shared map buckets");
+    }
+  }
+  uv_rwlock_wrunlock(&stripe->lock);
+  // what was replaced or removed
+  free(value);
+  free(entry);
+
+  lua_pushboolean(L, 1);
+  lua_pushinteger(L, (lua_Integer)version);
+  return 2;
+}
+
+static int luv_shared_map_count(lua_State* L) {
+  luv_shared_map_t* map = luv_check_shared_map(L, 1);
+  size_t count = 0;
+  int i;
+  for (i = 0; i < LUV_SHARED_MAP_STRIPES; i++) {
+    uv_rwlock_rdlock(&map->stripes[i].lock);
+    count += map->stripes[i].count;
+    uv_rwlock_rdunlock(&map->stripes[i].lock);
+  }
+  lua_pushinteger(L, count);
+  return 1;
+}
+
+static void luv_shared_map_items_free(luv_shared_map_item_t* items, size_t count) {
+  size_t i;
+  for (i = 0; i < count; i++) {
+    free(items[i].key);
+    free(items[i].value);
+  }
+  free(items);
+}
+
+// Copies every entry while all stripes are read locked, so the copy is a
+// consistent state of the map. Returns NULL when out of memory.
+static luv_shared_map_item_t* luv_shared_map_copy(luv_shared_map_t* map, size_t* count) {
+  luv_shared_map_item_t* items;
+  size_t n = 0, total = 0;
+  int i, failed = 0;
+
+  for (i = 0; i < LUV_SHARED_MAP_STRIPES; i++) {
+    uv_rwlock_rdlock(&map->stripes[i].lock);
+    total += map->stripes[i].count;
+  }
+  items = (luv_shared_map_item_t*)malloc((total ? total : 1) * sizeof(*items));
+  failed = !items;
+  for (i = 0; i < LUV_SHARED_MAP_STRIPES && !failed; i++) {
+    luv_shared_map_stripe_t* stripe = &map->stripes[i];
+    size_t j;
+    for (j = 0; j < stripe->nbuckets && !failed; j++) {
+      luv_shared_map_entry_t* entry;
+      for (entry = stripe->buckets[j]; entry && !failed; entry = entry->next) {
+        luv_shared_map_item_t* item = &items[n];
+        item->key = (char*)malloc(entry->keylen ? entry->keylen : 1);
+        item->value = (char*)malloc(entry->len);
+        if (!item->key || !item->value) {
+          free(item->key);
+          free(item->value);
+          failed = 1;
+          break;
+        }
+        memcpy(item->key, entry->key, entry->keylen);
+        memcpy(item->value, entry->value, entry->len);
+        item->keylen = entry->keylen;
+        item->version = entry->version;
+        n++;
+      }
+    }
+  }
+  for (i = LUV_SHARED_MAP_STRIPES - 1; i >= 0; i--)
+    uv_rwlock_rdunlock(&map->stripes[i].lock);
+
+  if (failed) {
+    if (items)
+      luv_shared_map_items_free(items, n);
+    return NULL;
+  }
+  *count = n;
+  return items;
+}
+
+// Pushes a table of the values by key, and one of the versions by key.
+static void luv_shared_map_push_items(lua_State* L, luv_shared_map_item_t* items, size_t count) {
+  size_t i;
+  lua_createtable(L, 0, (int)count);
+  lua_createtable(L, 0, (int)count);
+  for (i = 0; i < count; i++) {
+    lua_pushlstring(L, items[i].key, items[i].keylen);
+    luv_deserialize(L, items[i].value);
+    lua_rawset(L, -4);
+    lua_pushlstring(L, items[i].key, items[i].keylen);
+    lua_pushinteger(L, (lua_Integer)items[i].version);
+    lua_rawset(L, -3);
+  }
+}
+
+// Copies the map under the locks, then pushes the copy.
+static void luv_shared_map_snapshot_push(lua_State* L, luv_shared_map_t* map) {
+  size_t count = 0;
+  luv_shared_map_item_t* items = luv_shared_map_copy(map, &count);
+  if (!items) {
+    luaL_error(L, "Failed to allocate shared map snapshot");
+    return; // unreachable
+  }
+  luv_shared_map_push_items(L, items, count);
+  luv_shared_map_items_free(items, count);
+}
+
+static int luv_shared_map_snapshot(lua_State* L) {
+  luv_shared_map_t* map = luv_check_shared_map(L, 1);
+  luv_shared_map_snapshot_push(L, map);
+  return 2;
+}
+
+static int luv_shared_map_next(lua_State* L) {
+  // upvalues: values and versions of the snapshot
+  lua_settop(L, 2);
+  if (!lua_next(L, lua_upvalueindex(1)))
+    return 0;
+  lua_pushvalue(L, -2);
+  lua_rawget(L, lua_upvalueindex(2));
+  return 3;
+}
+
+static int luv_shared_map_pairs(lua_State* L) {
+  luv_shared_map_t* map = luv_check_shared_map(L, 1);
+  luv_shared_map_snapshot_push(L, map);
+  lua_pushcclosure(L, luv_shared_map_next, 2);
+  lua_pushnil(L);
+  lua_pushnil(L);
+  return 3;
+}
+
+static const luaL_Reg luv_shared_map_methods[] = {
+  {"get", luv_shared_map_get},
+  {"set", luv_shared_map_set},
+  {"version", luv_shared_map_version},
+  {"count", luv_shared_map_count},
+  {"snapshot", luv_shared_map_snapshot},
+  {"pairs", luv_shared_map_pairs},
+  {NULL, NULL}
+};
+
+static void luv_shared_map_init(lua_State* L) {
+  luv_shared_newmetatable(L, "luv_shared_map", luv_shared_map_methods);
+  lua_pushcfunction(L, luv_shared_map_count);
+  lua_setfield(L, -2, "__len");
+  lua_pop(L, 1);
+}
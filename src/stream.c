@@ -106,18 +106,44 @@ static void luv_alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* b
   buf->len = suggested_size;
 }
 
+/* A shared buffer given to read_start receives the data in place instead of
+   a new string per read. The handle extra holds a reference to it. */
+static void luv_read_target_gc(void* ptr) {
+  luv_shared_release((luv_shared_t*)ptr);
+}
+
+static luv_shared_buffer_t* luv_read_target(uv_stream_t* handle) {
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  if (data->extra_gc != luv_read_target_gc)
+    return NULL;
+  return (luv_shared_buffer_t*)data->extra;
+}
+
+static void luv_alloc_target_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
+  (void)suggested_size;
+  *buf = luv_shared_buffer_buf(luv_read_target((uv_stream_t*)handle));
+}
+
 static void luv_read_cb(uv_stream_t* handle, ssize_t nread, const uv_buf_t* buf) {
   luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_shared_buffer_t* target = luv_read_target(handle);
   lua_State* L = data->ctx->L;
   int nargs;
 
+  // reading may have been restarted with another buffer since the alloc
+  if (target && buf->base != luv_shared_buffer_buf(target).base)
+    target = NULL;
   if (nread > 0) {
     lua_pushnil(L);
-    lua_pushlstring(L, buf->base, nread);
+    if (target)
+      lua_pushinteger(L, nread);
+    else
+      lua_pushlstring(L, buf->base, nread);
     nargs = 2;
   }
 
-  free(buf->base);
+  if (!target)
+    free(buf->base);
   if (nread == 0) return;
 
   if (nread == UV_EOF) {
@@ -133,9 +159,28 @@ static void luv_read_cb(uv_stream_t* handle, ssize_t nread, const uv_buf_t* buf)
 
 static int luv_read_start(lua_State* L) {
   uv_stream_t* handle = luv_check_stream(L, 1);
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_shared_buffer_t* target = NULL;
   int ret;
-  luv_check_callback(L, (luv_handle_t*)handle->data, LUV_READ, 2);
-  ret = uv_read_start(handle, luv_alloc_cb, luv_read_cb);
+  luv_check_callback(L, data, LUV_READ, 2);
+  if (!lua_isnoneornil(L, 3)) {
+    target = luv_check_shared_buffer(L, 3);
+    luaL_argcheck(L, luv_shared_buffer_buf(target).len > 0, 3, "buffer must not be empty");
+    if (data->extra && data->extra_gc != luv_read_target_gc)
+      return luv_error(L, UV_EBUSY);
+  }
+  ret = uv_read_start(handle, target ? luv_alloc_target_cb : luv_alloc_cb, luv_read_cb);
+  if (ret < 0)
+    return luv_error(L, ret);
+  if (luv_read_target(handle)) {
+    luv_shared_release((luv_shared_t*)data->extra);
+    data->extra = NULL;
+    data->extra_gc = NULL;
+  }
+  if (target) {
+    data->extra = luv_shared_retain((luv_shared_t*)target);
+    data->extra_gc = luv_read_target_gc;
+  }
   return luv_result(L, ret);
 }
 
@@ -72,7 +72,743 @@ static const luaL_Reg luv_sem_methods[] = {
   {NULL, NULL}
 };
 
+// An integer shared by reference between states, updated without locks.
+typedef struct {
+  luv_shared_t shared;
+  luv_atomic64_t value;
+} luv_shared_atomic_t;
+
+static void luv_shared_atomic_free(luv_shared_t* shared) {
+  free(shared);
+}
+
+static luv_shared_atomic_t* luv_check_atomic(lua_State* L, int index) {
+  return (luv_shared_atomic_t*)luv_shared_check(L, index, "luv_atomic");
+}
+
+static int luv_new_atomic(lua_State* L) {
+  lua_Integer initial = luaL_optinteger(L, 1, 0);
+  luv_shared_atomic_t* atomic = (luv_shared_atomic_t*)luv_shared_new(L,
+    sizeof(*atomic), "luv_atomic", luv_shared_atomic_free);
+  luv_atomic64_init(&atomic->value, (int64_t)initial);
+  return 1;
+}
+
+static int luv_shared_atomic_load(lua_State* L) {
+  luv_shared_atomic_t* atomic = luv_check_atomic(L, 1);
+  lua_pushinteger(L, (lua_Integer)luv_atomic64_load(&atomic->value));
+  return 1;
+}
+
+static int luv_shared_atomic_store(lua_State* L) {
+  luv_shared_atomic_t* atomic = luv_check_atomic(L, 1);
+  lua_Integer value = luaL_checkinteger(L, 2);
+  luv_atomic64_store(&atomic->value, (int64_t)value);
+  return 0;
+}
+
+// Adds n, 1 by default, and returns the new value.
+static int luv_shared_atomic_add(lua_State* L) {
+  luv_shared_atomic_t* atomic = luv_check_atomic(L, 1);
+  int64_t n = (int64_t)luaL_optinteger(L, 2, 1);
+  lua_pushinteger(L, (lua_Integer)(luv_atomic64_fetch_add(&atomic->value, n) + n));
+  return 1;
+}
+
+static int luv_shared_atomic_sub(lua_State* L) {
+  luv_shared_atomic_t* atomic = luv_check_atomic(L, 1);
+  int64_t n = (int64_t)luaL_optinteger(L, 2, 1);
+  lua_pushinteger(L, (lua_Integer)(luv_atomic64_fetch_add(&atomic->value, -n) - n));
+  return 1;
+}
+
+// Stores desired if the value is expected, returns whether it did and the
+// value found.
+static int luv_shared_atomic_cas(lua_State* L) {
+  luv_shared_atomic_t* atomic = luv_check_atomic(L, 1);
+  int64_t expected = (int64_t)luaL_checkinteger(L, 2);
+  int64_t desired = (int64_t)luaL_checkinteger(L, 3);
+  int64_t found = luv_atomic64_cas(&atomic->value, expected, desired);
+  lua_pushboolean(L, found == expected);
+  lua_pushinteger(L, (lua_Integer)found);
+  return 2;
+}
+
+static const luaL_Reg luv_atomic_methods[] = {
+  {"load", luv_shared_atomic_load},
+  {"store", luv_shared_atomic_store},
+  {"add", luv_shared_atomic_add},
+  {"sub", luv_shared_atomic_sub},
+  {"cas", luv_shared_atomic_cas},
+  {NULL, NULL}
+};
+
+/* Locks, condition variables and barriers shared by reference between
+   states. A lock is not bound to the thread that took it, so it can be
+   taken in one loop callback and released in a later one. Besides the
+   blocking calls, a waiter can park on its loop instead: an async handle is
+   woken once it is granted, and its callback runs holding what it waited
+   for. Waiters are served in order, so a queued writer holds back readers
+   arriving after it. */
+
+enum {
+  LUV_WAIT_DONE,     // not queued: callback ran or the wait never started
+  LUV_WAIT_LOCK,     // queued on a lock
+  LUV_WAIT_COND,     // queued on a condition variable
+  LUV_WAIT_BARRIER,  // queued on a barrier
+  LUV_WAIT_GRANTED   // woken, owns what it waited for
+};
+
+typedef struct luv_waiter_s luv_waiter_t;
+struct luv_waiter_s {
+  luv_waiter_t* next;
+  int state;           // guarded by the mutex of the object it is queued on
+  int exclusive;       // wants the lock for writing
+  int serial;          // last to arrive at a barrier
+  uv_cond_t* cond;     // thread blocked in a wait, or NULL
+  uv_async_t* handle;  // loop parked in an async wait, or NULL
+};
+
+typedef struct {
+  luv_waiter_t* head;
+  luv_waiter_t* tail;
+} luv_waitq_t;
+
+static void luv_waitq_push(luv_waitq_t* queue, luv_waiter_t* w) {
+  w->next = NULL;
+  if (queue->tail)
+    queue->tail->next = w;
+  else
+    queue->head = w;
+  queue->tail = w;
+}
+
+static luv_waiter_t* luv_waitq_shift(luv_waitq_t* queue) {
+  luv_waiter_t* w = queue->head;
+  if (w) {
+    queue->head = w->next;
+    if (!queue->head)
+      queue->tail = NULL;
+  }
+  return w;
+}
+
+static void luv_waitq_remove(luv_waitq_t* queue, luv_waiter_t* w) {
+  luv_waiter_t* prev = NULL;
+  luv_waiter_t* cur = queue->head;
+  while (cur && cur != w) {
+    prev = cur;
+    cur = cur->next;
+  }
+  if (!cur)
+    return;
+  if (prev)
+    prev->next = w->next;
+  else
+    queue->head = w->next;
+  if (queue->tail == w)
+    queue->tail = prev;
+}
+
+// Grants w and wakes its thread or loop, called with the mutex guarding it
+// held.
+static void luv_waiter_wake(luv_waiter_t* w) {
+  w->state = LUV_WAIT_GRANTED;
+  if (w->cond)
+    uv_cond_signal(w->cond);
+  else
+    uv_async_send(w->handle);
+}
+
+// Queues the calling thread and blocks until it is granted, or timeout ms
+// pass when it is >= 0. Called with mutex held, which guards queue.
+static int luv_waiter_block(luv_waitq_t* queue, uv_mutex_t* mutex, int state, int exclusive, int64_t timeout) {
+  luv_waiter_t w;
+  uv_cond_t cond;
+  uint64_t deadline = 0;
+  int ret = uv_cond_init(&cond);
+  if (ret < 0)
+    return ret;
+  memset(&w, 0, sizeof(w));
+  w.state = state;
+  w.exclusive = exclusive;
+  w.cond = &cond;
+  luv_waitq_push(queue, &w);
+  if (timeout >= 0)
+    deadline = uv_hrtime() + (uint64_t)timeout * 1000000;
+  while (w.state == state) {
+    uint64_t now;
+    if (timeout < 0) {
+      uv_cond_wait(&cond, mutex);
+      continue;
+    }
+    now = uv_hrtime();
+    if (now < deadline && uv_cond_timedwait(&cond, mutex, deadline - now) == 0)
+      continue;
+    if (w.state == state) {
+      luv_waitq_remove(queue, &w);
+      ret = UV_ETIMEDOUT;
+    }
+    break;
+  }
+  uv_cond_destroy(&cond);
+  return ret;
+}
+
+// A mutex, or a read-write lock when taken shared.
+typedef struct {
+  luv_shared_t shared;
+  uv_mutex_t mutex;
+  int ready;          // mutex is initialized
+  int writer;         // held exclusively
+  int readers;        // holders sharing it
+  luv_waitq_t queue;
+} luv_lock_t;
+
+typedef struct {
+  luv_shared_t shared;
+  uv_mutex_t mutex;
+  int ready;
+  luv_waitq_t queue;
+} luv_condvar_t;
+
+typedef struct {
+  luv_shared_t shared;
+  uv_mutex_t mutex;
+  int ready;
+  unsigned int count;    // waiters that open the barrier
+  unsigned int arrived;
+  luv_waitq_t queue;
+} luv_barrier_t;
+
+enum {
+  LUV_SYNCH_LOCK,
+  LUV_SYNCH_COND,
+  LUV_SYNCH_BARRIER
+};
+
+// extra of the async handle parking a loop on a lock, condition variable or
+// barrier
+typedef struct {
+  luv_waiter_t waiter;   // first, signalling a condition casts it back
+  int kind;
+  luv_shared_t* object;  // waited on, holds a reference
+  luv_lock_t* lock;      // held when the callback runs, holds a reference
+} luv_synch_wait_t;
+
+static int luv_lock_available(luv_lock_t* lock, int exclusive) {
+  return exclusive ? !lock->writer && lock->readers == 0 : !lock->writer;
+}
+
+static void luv_lock_take(luv_lock_t* lock, int exclusive) {
+  if (exclusive)
+    lock->writer = 1;
+  else
+    lock->readers++;
+}
+
+// Hands the lock to the waiters at the head of the queue that can have it,
+// called with the mutex held.
+static void luv_lock_grant(luv_lock_t* lock) {
+  luv_waiter_t* w;
+  while ((w = lock->queue.head) && luv_lock_available(lock, w->exclusive)) {
+    luv_waitq_shift(&lock->queue);
+    luv_lock_take(lock, w->exclusive);
+    luv_waiter_wake(w);
+  }
+}
+
+static void luv_lock_drop(luv_lock_t* lock, int exclusive) {
+  if (exclusive)
+    lock->writer = 0;
+  else
+    lock->readers--;
+  luv_lock_grant(lock);
+}
+
+// Grants the lock to w or queues it, called with the mutex held.
+static void luv_lock_enqueue(luv_lock_t* lock, luv_waiter_t* w) {
+  if (!lock->queue.head && luv_lock_available(lock, w->exclusive)) {
+    luv_lock_take(lock, w->exclusive);
+    luv_waiter_wake(w);
+    return;
+  }
+  w->state = LUV_WAIT_LOCK;
+  luv_waitq_push(&lock->queue, w);
+}
+
+static int luv_lock_acquire(luv_lock_t* lock, int exclusive) {
+  int ret = 0;
+  uv_mutex_lock(&lock->mutex);
+  if (!lock->queue.head && luv_lock_available(lock, exclusive))
+    luv_lock_take(lock, exclusive);
+  else
+    ret = luv_waiter_block(&lock->queue, &lock->mutex, LUV_WAIT_LOCK, exclusive, -1);
+  uv_mutex_unlock(&lock->mutex);
+  return ret;
+}
+
+static void luv_synch_wait_cb(uv_async_t* handle) {
+  luv_handle_t* data = (luv_handle_t*)handle->data;
+  luv_synch_wait_t* wait = (luv_synch_wait_t*)data->extra;
+  lua_State* L = data->ctx->L;
+  int nargs = 0;
+  // only sent once granted, from here the callback owns the grant
+  wait->waiter.state = LUV_WAIT_DONE;
+  if (wait->kind == LUV_SYNCH_BARRIER) {
+    lua_pushboolean(L, wait->waiter.serial);
+    nargs = 1;
+  }
+  luv_call_callback(L, data, LUV_ASYNC, nargs);
+  if (!uv_is_closing((uv_handle_t*)handle))
+    uv_close((uv_handle_t*)handle, luv_close_cb);
+}
+
+static void luv_synch_wait_gc(void* extra) {
+  luv_synch_wait_t* wait = (luv_synch_wait_t*)extra;
+  luv_waiter_t* w = &wait->waiter;
+  // the handle may have been closed before its callback ran, by uv.walk or
+  // loop_gc: leave the queue, or pass on a lock it was already handed
+  if (wait->kind == LUV_SYNCH_BARRIER) {
+    luv_barrier_t* barrier = (luv_barrier_t*)wait->object;
+    uv_mutex_lock(&barrier->mutex);
+    if (w->state == LUV_WAIT_BARRIER) {
+      luv_waitq_remove(&barrier->queue, w);
+      barrier->arrived--;
+    }
+    uv_mutex_unlock(&barrier->mutex);
+  }
+  else {
+    luv_condvar_t* cond = NULL;
+    luv_lock_t* lock = wait->lock;
+    if (wait->kind == LUV_SYNCH_COND) {
+      cond = (luv_condvar_t*)wait->object;
+      uv_mutex_lock(&cond->mutex);
+    }
+    uv_mutex_lock(&lock->mutex);
+    if (w->state == LUV_WAIT_COND) {
+      luv_waitq_remove(&cond->queue, w);
+    }
+    else if (w->state == LUV_WAIT_LOCK) {
+      // it may have been holding back the waiters behind it
+      luv_waitq_remove(&lock->queue, w);
+      luv_lock_grant(lock);
+    }
+    else if (w->state == LUV_WAIT_GRANTED) {
+      luv_lock_drop(lock, w->exclusive);
+    }
+    uv_mutex_unlock(&lock->mutex);
+    if (cond)
+      uv_mutex_unlock(&cond->mutex);
+  }
+  luv_shared_release(wait->object);
+  if (wait->lock)
+    luv_shared_release(&wait->lock->shared);
+  free(wait);
+}
+
+// Creates the async handle parking the loop, with the callback at cbidx. The
+// caller queues the returned waiter. Returns NULL with the error in *err.
+static luv_synch_wait_t* luv_synch_wait_new(lua_State* L, int kind, luv_shared_t* object, luv_lock_t* lock, int exclusive, int cbidx, int* err) {
+  luv_ctx_t* ctx = luv_context(L);
+  luv_synch_wait_t* wait;
+  uv_async_t* handle;
+  luv_handle_t* data;
+  int ret;
+  luv_check_callable(L, cbidx);
+
+  wait = (luv_synch_wait_t*)calloc(1, sizeof(*wait));
+  if (!wait) {
+    luaL_error(L, "Failed to allocate waiter");
+    return NULL; // unreachable
+  }
+  handle = (uv_async_t*)luv_newuserdata(L, uv_handle_size(UV_ASYNC));
+  ret = uv_async_init(ctx->loop, handle, luv_synch_wait_cb);
+  if (ret < 0) {
+    free(wait);
+    lua_pop(L, 1);
+    *err = ret;
+    return NULL;
+  }
+  data = luv_setup_handle(L, ctx);
+  handle->data = data;
+  wait->waiter.exclusive = exclusive;
+  wait->waiter.handle = handle;
+  wait->kind = kind;
+  wait->object = luv_shared_retain(object);
+  if (lock)
+    wait->lock = (luv_lock_t*)luv_shared_retain(&lock->shared);
+  data->extra = wait;
+  data->extra_gc = luv_synch_wait_gc;
+  luv_check_callback(L, data, LUV_ASYNC, cbidx);
+  lua_pop(L, 1);
+  return wait;
+}
+
+static void luv_lock_free(luv_shared_t* shared) {
+  luv_lock_t* lock = (luv_lock_t*)shared;
+  if (lock->ready)
+    uv_mutex_destroy(&lock->mutex);
+  free(lock);
+}
+
+static luv_lock_t* luv_check_mutex(lua_State* L, int index) {
+  return (luv_lock_t*)luv_shared_check(L, index, "luv_mutex");
+}
+
+static luv_lock_t* luv_check_rwlock(lua_State* L, int index) {
+  return (luv_lock_t*)luv_shared_check(L, index, "luv_rwlock");
+}
+
+static int luv_lock_new(lua_State* L, const char* metaname) {
+  luv_lock_t* lock = (luv_lock_t*)luv_shared_new(L, sizeof(*lock), metaname, luv_lock_free);
+  int ret = uv_mutex_init(&lock->mutex);
+  if (ret < 0) {
+    lua_pop(L, 1);
+    return luv_error(L, ret);
+  }
+  lock->ready = 1;
+  return 1;
+}
+
+static int luv_lock_lock(lua_State* L, luv_lock_t* lock, int exclusive) {
+  int ret = luv_lock_acquire(lock, exclusive);
+  if (ret < 0)
+    return luv_error(L, ret);
+  return 0;
+}
+
+static int luv_lock_trylock(lua_State* L, luv_lock_t* lock, int exclusive) {
+  int ok;
+  uv_mutex_lock(&lock->mutex);
+  ok = !lock->queue.head && luv_lock_available(lock, exclusive);
+  if (ok)
+    luv_lock_take(lock, exclusive);
+  uv_mutex_unlock(&lock->mutex);
+  lua_pushboolean(L, ok);
+  return 1;
+}
+
+static int luv_lock_async(lua_State* L, luv_lock_t* lock, int exclusive) {
+  int ret;
+  luv_synch_wait_t* wait = luv_synch_wait_new(L, LUV_SYNCH_LOCK, &lock->shared, lock, exclusive, 2, &ret);
+  if (!wait)
+    return luv_error(L, ret);
+  uv_mutex_lock(&lock->mutex);
+  luv_lock_enqueue(lock, &wait->waiter);
+  uv_mutex_unlock(&lock->mutex);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+static int luv_lock_unlock(lua_State* L, luv_lock_t* lock, int exclusive) {
+  int held;
+  uv_mutex_lock(&lock->mutex);
+  held = exclusive ? lock->writer : lock->readers > 0;
+  if (held)
+    luv_lock_drop(lock, exclusive);
+  uv_mutex_unlock(&lock->mutex);
+  luaL_argcheck(L, held, 1, "not locked");
+  return 0;
+}
+
+static int luv_new_mutex(lua_State* L) {
+  return luv_lock_new(L, "luv_mutex");
+}
+
+static int luv_mutex_lock(lua_State* L) {
+  return luv_lock_lock(L, luv_check_mutex(L, 1), 1);
+}
+
+static int luv_mutex_trylock(lua_State* L) {
+  return luv_lock_trylock(L, luv_check_mutex(L, 1), 1);
+}
+
+static int luv_mutex_lock_async(lua_State* L) {
+  return luv_lock_async(L, luv_check_mutex(L, 1), 1);
+}
+
+static int luv_mutex_unlock(lua_State* L) {
+  return luv_lock_unlock(L, luv_check_mutex(L, 1), 1);
+}
+
+static const luaL_Reg luv_mutex_methods[] = {
+  {"lock", luv_mutex_lock},
+  {"trylock", luv_mutex_trylock},
+  {"lock_async", luv_mutex_lock_async},
+  {"unlock", luv_mutex_unlock},
+  {NULL, NULL}
+};
+
+static int luv_new_rwlock(lua_State* L) {
+  return luv_lock_new(L, "luv_rwlock");
+}
+
+static int luv_rwlock_rdlock(lua_State* L) {
+  return luv_lock_lock(L, luv_check_rwlock(L, 1), 0);
+}
+
+static int luv_rwlock_tryrdlock(lua_State* L) {
+  return luv_lock_trylock(L, luv_check_rwlock(L, 1), 0);
+}
+
+static int luv_rwlock_rdlock_async(lua_State* L) {
+  return luv_lock_async(L, luv_check_rwlock(L, 1), 0);
+}
+
+static int luv_rwlock_rdunlock(lua_State* L) {
+  return luv_lock_unlock(L, luv_check_rwlock(L, 1), 0);
+}
+
+static int luv_rwlock_wrlock(lua_State* L) {
+  return luv_lock_lock(L, luv_check_rwlock(L, 1), 1);
+}
+
+static int luv_rwlock_trywrlock(lua_State* L) {
+  return luv_lock_trylock(L, luv_check_rwlock(L, 1), 1);
+}
+
+static int luv_rwlock_wrlock_async(lua_State* L) {
+  return luv_lock_async(L, luv_check_rwlock(L, 1), 1);
+}
+
+static int luv_rwlock_wrunlock(lua_State* L) {
+  return luv_lock_unlock(L, luv_check_rwlock(L, 1), 1);
+}
+
+static const luaL_Reg luv_rwlock_methods[] = {
+  {"rdlock", luv_rwlock_rdlock},
+  {"tryrdlock", luv_rwlock_tryrdlock},
+  {"rdlock_async", luv_rwlock_rdlock_async},
+  {"rdunlock", luv_rwlock_rdunlock},
+  {"wrlock", luv_rwlock_wrlock},
+  {"trywrlock", luv_rwlock_trywrlock},
+  {"wrlock_async", luv_rwlock_wrlock_async},
+  {"wrunlock", luv_rwlock_wrunlock},
+  {NULL, NULL}
+};
+
+static void luv_condvar_free(luv_shared_t* shared) {
+  luv_condvar_t* cond = (luv_condvar_t*)shared;
+  if (cond->ready)
+    uv_mutex_destroy(&cond->mutex);
+  free(cond);
+}
+
+static luv_condvar_t* luv_check_cond(lua_State* L, int index) {
+  return (luv_condvar_t*)luv_shared_check(L, index, "luv_cond");
+}
+
+static int luv_new_cond(lua_State* L) {
+  luv_condvar_t* cond = (luv_condvar_t*)luv_shared_new(L, sizeof(*cond), "luv_cond", luv_condvar_free);
+  int ret = uv_mutex_init(&cond->mutex);
+  if (ret < 0) {
+    lua_pop(L, 1);
+    return luv_error(L, ret);
+  }
+  cond->ready = 1;
+  return 1;
+}
+
+// Releases lock for a waiter about to queue on cond, called with the mutex
+// of cond held so no signal can come in between. Returns 0 if it wasn't
+// held.
+static int luv_cond_unlock(luv_lock_t* lock) {
+  int held;
+  uv_mutex_lock(&lock->mutex);
+  held = lock->writer;
+  if (held)
+    luv_lock_drop(lock, 1);
+  uv_mutex_unlock(&lock->mutex);
+  return held;
+}
+
+static int luv_cond_wait(lua_State* L) {
+  luv_condvar_t* cond = luv_check_cond(L, 1);
+  luv_lock_t* lock = luv_check_mutex(L, 2);
+  lua_Integer timeout = luaL_optinteger(L, 3, -1);
+  int ret, relock;
+
+  uv_mutex_lock(&cond->mutex);
+  if (!luv_cond_unlock(lock)) {
+    uv_mutex_unlock(&cond->mutex);
+    return luaL_argerror(L, 2, "not locked");
+  }
+  ret = luv_waiter_block(&cond->queue, &cond->mutex, LUV_WAIT_COND, 1, (int64_t)timeout);
+  uv_mutex_unlock(&cond->mutex);
+
+  // the mutex is taken back even when the wait failed or timed out
+  relock = luv_lock_acquire(lock, 1);
+  if (relock < 0)
+    ret = relock;
+  if (ret < 0 && ret != UV_ETIMEDOUT)
+    return luv_error(L, ret);
+  lua_pushboolean(L, ret == 0);
+  return 1;
+}
+
+static int luv_cond_wait_async(lua_State* L) {
+  luv_condvar_t* cond = luv_check_cond(L, 1);
+  luv_lock_t* lock = luv_check_mutex(L, 2);
+  int ret, held;
+  luv_synch_wait_t* wait = luv_synch_wait_new(L, LUV_SYNCH_COND, &cond->shared, lock, 1, 3, &ret);
+  if (!wait)
+    return luv_error(L, ret);
+
+  uv_mutex_lock(&cond->mutex);
+  held = luv_cond_unlock(lock);
+  if (held) {
+    wait->waiter.state = LUV_WAIT_COND;
+    luv_waitq_push(&cond->queue, &wait->waiter);
+  }
+  uv_mutex_unlock(&cond->mutex);
+  if (!held) {
+    uv_close((uv_handle_t*)wait->waiter.handle, luv_close_cb);
+    return luaL_argerror(L, 2, "not locked");
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+// Wakes the first waiter, called with the mutex held.
+static int luv_cond_wake(luv_condvar_t* cond) {
+  luv_waiter_t* w = luv_waitq_shift(&cond->queue);
+  luv_lock_t* lock;
+  if (!w)
+    return 0;
+  // a blocked thread takes the mutex back itself
+  if (w->cond) {
+    luv_waiter_wake(w);
+    return 1;
+  }
+  // a parked loop queues for the mutex, its callback runs holding it
+  lock = ((luv_synch_wait_t*)w)->lock;
+  uv_mutex_lock(&lock->mutex);
+  luv_lock_enqueue(lock, w);
+  uv_mutex_unlock(&lock->mutex);
+  return 1;
+}
+
+static int luv_cond_signal(lua_State* L) {
+  luv_condvar_t* cond = luv_check_cond(L, 1);
+  uv_mutex_lock(&cond->mutex);
+  luv_cond_wake(cond);
+  uv_mutex_unlock(&cond->mutex);
+  return 0;
+}
+
+static int luv_cond_broadcast(lua_State* L) {
+  luv_condvar_t* cond = luv_check_cond(L, 1);
+  uv_mutex_lock(&cond->mutex);
+  while (luv_cond_wake(cond));
+  uv_mutex_unlock(&cond->mutex);
+  return 0;
+}
+
+static const luaL_Reg luv_cond_methods[] = {
+  {"wait", luv_cond_wait},
+  {"wait_async", luv_cond_wait_async},
+  {"signal", luv_cond_signal},
+  {"broadcast", luv_cond_broadcast},
+  {NULL, NULL}
+};
+
+static void luv_barrier_free(luv_shared_t* shared) {
+  luv_barrier_t* barrier = (luv_barrier_t*)shared;
+  if (barrier->ready)
+    uv_mutex_destroy(&barrier->mutex);
+  free(barrier);
+}
+
+static luv_barrier_t* luv_check_barrier(lua_State* L, int index) {
+  return (luv_barrier_t*)luv_shared_check(L, index, "luv_barrier");
+}
+
+static int luv_new_barrier(lua_State* L) {
+  lua_Integer count = luaL_checkinteger(L, 1);
+  luv_barrier_t* barrier;
+  int ret;
+  luaL_argcheck(L, count > 0 && (unsigned int)count == count, 1, "count must be > 0");
+  barrier = (luv_barrier_t*)luv_shared_new(L, sizeof(*barrier), "luv_barrier", luv_barrier_free);
+  barrier->count = (unsigned int)count;
+  ret = uv_mutex_init(&barrier->mutex);
+  if (ret < 0) {
+    lua_pop(L, 1);
+    return luv_error(L, ret);
+  }
+  barrier->ready = 1;
+  return 1;
+}
+
+// Lets everyone queued through, called with the mutex held by the last to
+// arrive.
+static void luv_barrier_open(luv_barrier_t* barrier) {
+  luv_waiter_t* w;
+  barrier->arrived = 0;
+  while ((w = luv_waitq_shift(&barrier->queue)))
+    luv_waiter_wake(w);
+}
+
+static int luv_barrier_wait(lua_State* L) {
+  luv_barrier_t* barrier = luv_check_barrier(L, 1);
+  int serial = 0;
+  int ret = 0;
+  uv_mutex_lock(&barrier->mutex);
+  if (++barrier->arrived == barrier->count) {
+    luv_barrier_open(barrier);
+    serial = 1;
+  }
+  else {
+    ret = luv_waiter_block(&barrier->queue, &barrier->mutex, LUV_WAIT_BARRIER, 0, -1);
+    if (ret < 0)
+      barrier->arrived--;
+  }
+  uv_mutex_unlock(&barrier->mutex);
+  if (ret < 0)
+    return luv_error(L, ret);
+  lua_pushboolean(L, serial);
+  return 1;
+}
+
+static int luv_barrier_wait_async(lua_State* L) {
+  luv_barrier_t* barrier = luv_check_barrier(L, 1);
+  int ret;
+  luv_synch_wait_t* wait = luv_synch_wait_new(L, LUV_SYNCH_BARRIER, &barrier->shared, NULL, 0, 2, &ret);
+  if (!wait)
+    return luv_error(L, ret);
+  uv_mutex_lock(&barrier->mutex);
+  if (++barrier->arrived == barrier->count) {
+    luv_barrier_open(barrier);
+    wait->waiter.serial = 1;
+    luv_waiter_wake(&wait->waiter);
+  }
+  else {
+    wait->waiter.state = LUV_WAIT_BARRIER;
+    luv_waitq_push(&barrier->queue, &wait->waiter);
+  }
+  uv_mutex_unlock(&barrier->mutex);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+static const luaL_Reg luv_barrier_methods[] = {
+  {"wait", luv_barrier_wait},
+  {"wait_async", luv_barrier_wait_async},
+  {NULL, NULL}
+};
+
 static void luv_synch_init(lua_State* L) {
+  luv_shared_newmetatable(L, "luv_atomic", luv_atomic_methods);
+  lua_pop(L, 1);
+  luv_shared_newmetatable(L, "luv_mutex", luv_mutex_methods);
+  lua_pop(L, 1);
+  luv_shared_newmetatable(L, "luv_rwlock", luv_rwlock_methods);
+  lua_pop(L, 1);
+  luv_shared_newmetatable(L, "luv_cond", luv_cond_methods);
+  lua_pop(L, 1);
+  luv_shared_newmetatable(L, "luv_barrier", luv_barrier_methods);
+  lua_pop(L, 1);
+
   luaL_newmetatable(L, "uv_sem");
   lua_pushcfunction(L, luv_sem_gc);
   lua_setfield(L, -2, "__gc");
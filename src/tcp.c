@@ -15,6 +15,10 @@
  *
  */
 #include "private.h"
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#endif
 
 static uv_tcp_t* luv_check_tcp(lua_State* L, int index) {
   uv_tcp_t* handle = (uv_tcp_t*)luv_checkudata(L, index, "uv_tcp");
@@ -67,6 +71,78 @@ static int luv_tcp_open(lua_State* L) {
   return luv_result(L, ret);
 }
 
+// A socket moved out of a tcp handle, so another loop can adopt it. It is
+// closed if nobody does.
+typedef struct {
+  luv_shared_t shared;
+  luv_atomic_t sock;  // -1 once adopted
+} luv_tcp_token_t;
+
+static void luv_tcp_token_free(luv_shared_t* shared) {
+  luv_tcp_token_t* token = (luv_tcp_token_t*)shared;
+  long sock = luv_atomic_load(&token->sock);
+  if (sock != -1) {
+#ifdef _WIN32
+    closesocket((SOCKET)sock);
+#else
+    close((int)sock);
+#endif
+  }
+  free(token);
+}
+
+static int luv_tcp_detach(lua_State* L) {
+  uv_tcp_t* handle = luv_check_tcp(L, 1);
+#ifdef _WIN32
+  return luv_error(L, UV_ENOTSUP);
+#else
+  luv_tcp_token_t* token;
+  uv_os_fd_t fd;
+  int sock;
+  int ret = uv_fileno((uv_handle_t*)handle, &fd);
+  if (ret < 0)
+    return luv_error(L, ret);
+  // closing the handle closes its descriptor, keep a duplicate of it
+#ifdef F_DUPFD_CLOEXEC
+  sock = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+#else
+  sock = dup(fd);
+#endif
+  if (sock < 0)
+    return luv_error(L, uv_translate_sys_error(errno));
+  token = (luv_tcp_token_t*)luv_shared_new(L, sizeof(*token), "luv_tcp_token", luv_tcp_token_free);
+  luv_atomic_init(&token->sock, sock);
+  uv_close((uv_handle_t*)handle, luv_close_cb);
+  return 1;
+#endif
+}
+
+static int luv_tcp_adopt(lua_State* L) {
+  uv_tcp_t* handle = luv_check_tcp(L, 1);
+  luv_tcp_token_t* token = (luv_tcp_token_t*)luv_shared_check(L, 2, "luv_tcp_token");
+  // tokens can be pushed to many states, only one of them gets the socket
+  long sock = luv_atomic_exchange(&token->sock, -1);
+  int ret;
+  if (sock == -1)
+    return luv_error(L, UV_EBADF);
+  ret = uv_tcp_open(handle, (uv_os_sock_t)sock);
+  if (ret < 0) {
+    (void)luv_atomic_exchange(&token->sock, sock);
+    return luv_error(L, ret);
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+static const luaL_Reg luv_tcp_token_methods[] = {
+  {NULL, NULL}
+};
+
+static void luv_tcp_init(lua_State* L) {
+  luv_shared_newmetatable(L, "luv_tcp_token", luv_tcp_token_methods);
+  lua_pop(L, 1);
+}
+
 static int luv_tcp_nodelay(lua_State* L) {
   uv_tcp_t* handle = luv_check_tcp(L, 1);
   int ret, enable;
@@ -109,11 +185,32 @@ static int luv_tcp_simultaneous_accepts(lua_State* L) {
   return luv_result(L, ret);
 }
 
+// Binds with SO_REUSEPORT so several handles, in any loop, can listen on
+// the same address. Before libuv 1.49 the option is set by hand, which needs
+// the socket created upfront with uv_tcp_init_ex.
+static int luv_tcp_bind_reuseport(uv_tcp_t* handle, const struct sockaddr* addr, unsigned int flags) {
+#if LUV_UV_VERSION_GEQ(1, 49, 0)
+  return uv_tcp_bind(handle, addr, flags | UV_TCP_REUSEPORT);
+#elif !defined(_WIN32) && defined(SO_REUSEPORT)
+  uv_os_fd_t fd;
+  int on = 1;
+  int ret = uv_fileno((uv_handle_t*)handle, &fd);
+  if (ret < 0)
+    return ret;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)))
+    return uv_translate_sys_error(errno);
+  return uv_tcp_bind(handle, addr, flags);
+#else
+  return UV_ENOTSUP;
+#endif
+}
+
 static int luv_tcp_bind(lua_State* L) {
   uv_tcp_t* handle = luv_check_tcp(L, 1);
   const char* host = luaL_checkstring(L, 2);
   int port = luaL_checkinteger(L, 3);
   unsigned int flags = 0;
+  int reuseport = 0;
   struct sockaddr_storage addr;
   int ret;
   if (uv_ip4_addr(host, port, (struct sockaddr_in*)&addr) &&
@@ -124,8 +221,14 @@ static int luv_tcp_bind(lua_State* L) {
     lua_getfield(L, 4, "ipv6only");
     if (lua_toboolean(L, -1)) flags |= UV_TCP_IPV6ONLY;
     lua_pop(L, 1);
+    lua_getfield(L, 4, "reuseport");
+    reuseport = lua_toboolean(L, -1);
+    lua_pop(L, 1);
   }
-  ret = uv_tcp_bind(handle, (struct sockaddr*)&addr, flags);
+  if (reuseport)
+    ret = luv_tcp_bind_reuseport(handle, (struct sockaddr*)&addr, flags);
+  else
+    ret = uv_tcp_bind(handle, (struct sockaddr*)&addr, flags);
   return luv_result(L, ret);
 }
 
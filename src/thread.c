@@ -16,21 +16,240 @@
 */
 #include "private.h"
 
+enum {
+  LUV_LOOP_THREAD_STARTING,
+  LUV_LOOP_THREAD_RUNNING,
+  LUV_LOOP_THREAD_STOPPING,  // posts are refused, the loop stops once drained
+  LUV_LOOP_THREAD_STOPPED
+};
+
+typedef struct luv_listen_shard_s luv_listen_shard_t;
+
+// State of a thread running its own loop, see luv_new_loop_thread
+typedef struct {
+  uv_async_t reply;       // in the owner loop, wakes it for replies
+  uv_async_t inbox;       // in the thread loop, wakes it for posts
+  uv_mutex_t mutex;       // guards state
+  int state;
+  luv_mpsc_t posts;       // luv_thread_msg_t {id, name, ...} for the thread
+  luv_mpsc_t replies;     // luv_thread_msg_t {id, ok, ...} for the owner
+  lua_State* L;           // owner state
+  lua_State* thread_L;    // state running in the thread
+  int callbacks;          // reply callbacks by id, in the owner state
+  lua_Integer next_id;
+  int handlers;           // table returned by init, in the thread state
+  int reply_closed;
+  int orphan;             // the thread userdata was collected
+  int graceful;           // stop by letting the loop run out of handles
+  uint64_t grace_timeout; // ms before a graceful stop is forced, 0 waits
+  uv_timer_t grace;       // in the thread loop, forces a graceful stop
+  int started;            // the inbox is initialized, guarded by mutex
+  int draining;           // in the thread, a graceful stop has begun
+  // listen group shard, see luv_tcp_listen_group
+  int (*setup)(lua_State* L, luv_listen_shard_t* shard);
+  void (*stopping)(luv_listen_shard_t* shard);
+  luv_listen_shard_t* shard;
+  luv_shared_t* shared;   // released by the thread once done
+} luv_loop_thread_t;
+
 typedef struct {
   uv_thread_t handle;
   char* code;
   int len;
   int argc;
   luv_thread_arg_t args;
+  luv_loop_thread_t* loop;  // NULL unless created by new_loop_thread
 
   // private fields, avoid thread be released before it done
   lua_State *L;
   int ref;
-  uv_async_t notify;
+  uv_async_t notify;  // data is left NULL, loop_gc may close it
 } luv_thread_t;
 
+static luv_thread_t* luv_thread_from_notify(uv_handle_t* handle) {
+  return (luv_thread_t*)((char*)handle - offsetof(luv_thread_t, notify));
+}
+
+/* An optional allocator for the states luv creates, see
+   luv_set_thread_vm_alloc. A state only runs on one thread at a time, so it
+   needs no locking: small blocks are carved from chunks and kept on a free
+   list per size class, larger ones go to malloc. The chunks go back to
+   malloc when the state is closed. */
+#define LUV_ALLOC_STEP 16
+#define LUV_ALLOC_CLASSES 16  // blocks up to 256 bytes
+#define LUV_ALLOC_CHUNK (64 * 1024)
+
+typedef struct luv_alloc_chunk_s {
+  struct luv_alloc_chunk_s* next;
+  size_t pad;  // keeps blocks 16-byte aligned on 64-bit
+} luv_alloc_chunk_t;
+
+typedef struct {
+  void* free[LUV_ALLOC_CLASSES];
+  luv_alloc_chunk_t* chunks;
+  char* next;       // unused part of the newest chunk
+  size_t left;
+  size_t bytes;     // in use by the state
+  size_t peak;
+  size_t reserved;  // held in chunks
+} luv_vm_alloc_t;
+
+static luv_atomic_t luv_vm_alloc_enabled;
+
+// Returns the size class of a block, LUV_ALLOC_CLASSES for malloc'd ones.
+static size_t luv_vm_alloc_class(size_t size) {
+  if (size > LUV_ALLOC_STEP * LUV_ALLOC_CLASSES)
+    return LUV_ALLOC_CLASSES;
+  return (size - 1) / LUV_ALLOC_STEP;
+}
+
+static void* luv_vm_alloc_block(luv_vm_alloc_t* a, size_t size) {
+  size_t c = luv_vm_alloc_class(size);
+  void* p;
+  if (c == LUV_ALLOC_CLASSES)
+    return malloc(size);
+  p = a->free[c];
+  if (p) {
+    a->free[c] = *(void**)p;
+    return p;
+  }
+  size = (c + 1) * LUV_ALLOC_STEP;
+  if (a->left < size) {
+    // what is left of the previous chunk is dropped
+    luv_alloc_chunk_t* chunk = (luv_alloc_chunk_t*)malloc(sizeof(*chunk) + LUV_ALLOC_CHUNK);
+    if (!chunk)
+      return NULL;
+    chunk->next = a->chunks;
+    a->chunks = chunk;
+    a->next = (char*)(chunk + 1);
+    a->left = LUV_ALLOC_CHUNK;
+    a->reserved += LUV_ALLOC_CHUNK;
+  }
+  p = a->next;
+  a->next += size;
+  a->left -= size;
+  return p;
+}
+
+static void luv_vm_alloc_release(luv_vm_alloc_t* a, void* p, size_t size) {
+  size_t c = luv_vm_alloc_class(size);
+  if (c == LUV_ALLOC_CLASSES) {
+    free(p);
+    return;
+  }
+  *(void**)p = a->free[c];
+  a->free[c] = p;
+}
+
+static void* luv_vm_alloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+  luv_vm_alloc_t* a = (luv_vm_alloc_t*)ud;
+  void* p;
+  // without a block osize is the type of the object being made
+  if (!ptr)
+    osize = 0;
+  if (nsize == 0) {
+    if (ptr)
+      luv_vm_alloc_release(a, ptr, osize);
+    a->bytes -= osize;
+    return NULL;
+  }
+  if (ptr && luv_vm_alloc_class(osize) == luv_vm_alloc_class(nsize)) {
+    p = ptr;
+    if (luv_vm_alloc_class(osize) == LUV_ALLOC_CLASSES) {
+      p = realloc(ptr, nsize);
+      if (!p)
+        return NULL;
+    }
+  }
+  else {
+    p = luv_vm_alloc_block(a, nsize);
+    if (!p)
+      return NULL;
+    if (ptr) {
+      memcpy(p, ptr, osize < nsize ? osize : nsize);
+      luv_vm_alloc_release(a, ptr, osize);
+    }
+  }
+  a->bytes += nsize - osize;
+  if (a->bytes > a->peak)
+    a->peak = a->bytes;
+  return p;
+}
+
+static int luv_vm_alloc_panic(lua_State* L) {
+  fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n",
+    lua_tostring(L, -1));
+  return 0;
+}
+
+static lua_State* luv_vm_newstate(void) {
+  luv_vm_alloc_t* a;
+  lua_State* L;
+  if (!luv_atomic_load(&luv_vm_alloc_enabled))
+    return luaL_newstate();
+  a = (luv_vm_alloc_t*)calloc(1, sizeof(*a));
+  if (a) {
+    L = lua_newstate(luv_vm_alloc, a);
+    if (L) {
+      lua_atpanic(L, luv_vm_alloc_panic);
+      return L;
+    }
+    // LuaJIT without GC64 refuses custom allocators on 64-bit
+    free(a);
+  }
+  return luaL_newstate();
+}
+
+static void luv_vm_close(lua_State* L) {
+  void* ud;
+  lua_Alloc alloc = lua_getallocf(L, &ud);
+  lua_close(L);
+  if (alloc == luv_vm_alloc) {
+    luv_vm_alloc_t* a = (luv_vm_alloc_t*)ud;
+    while (a->chunks) {
+      luv_alloc_chunk_t* chunk = a->chunks;
+      a->chunks = chunk->next;
+      free(chunk);
+    }
+    free(a);
+  }
+}
+
+LUALIB_API int luv_set_thread_vm_alloc(int enable) {
+  return (int)luv_atomic_exchange(&luv_vm_alloc_enabled, enable ? 1 : 0);
+}
+
+static int luv_thread_vm_alloc(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TBOOLEAN);
+  lua_pushboolean(L, luv_set_thread_vm_alloc(lua_toboolean(L, 1)));
+  return 1;
+}
+
+static int luv_thread_vm_alloc_stats(lua_State* L) {
+  void* ud;
+  luv_vm_alloc_t* a;
+  size_t bytes, peak, reserved;
+  if (lua_getallocf(L, &ud) != luv_vm_alloc) {
+    lua_pushnil(L);
+    return 1;
+  }
+  // read before the table below changes them
+  a = (luv_vm_alloc_t*)ud;
+  bytes = a->bytes;
+  peak = a->peak;
+  reserved = a->reserved;
+  lua_createtable(L, 0, 3);
+  lua_pushinteger(L, (lua_Integer)bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushinteger(L, (lua_Integer)peak);
+  lua_setfield(L, -2, "peak");
+  lua_pushinteger(L, (lua_Integer)reserved);
+  lua_setfield(L, -2, "reserved");
+  return 1;
+}
+
 static lua_State* luv_thread_acquire_vm(void) {
-  lua_State* L = luaL_newstate();
+  lua_State* L = luv_vm_newstate();
 
   // Add in the lua standard libraries
   luaL_openlibs(L);
@@ -49,7 +268,224 @@ static lua_State* luv_thread_acquire_vm(void) {
 }
 
 static void luv_thread_release_vm(lua_State* L) {
-  lua_close(L);
+  luv_vm_close(L);
+}
+
+/* Threads can reuse the states of finished threads through a pool in front
+   of acquire_vm_cb and release_vm_cb, see luv_set_thread_vm_pool. A reused
+   state gets back the globals and loaded modules it started with, changes
+   made inside them are kept. */
+static struct {
+  uv_mutex_t mutex;
+  lua_State** idle;
+  int count;
+  int size;          // of idle
+  int max;           // 0 disables the pool
+  lua_Integer created;
+  lua_Integer reused;
+} luv_vm_pool;
+static uv_once_t luv_vm_pool_once = UV_ONCE_INIT;
+static char luv_vm_globals_key; /* registry keys of the snapshots a pooled */
+static char luv_vm_loaded_key;  /* state is reset to */
+
+static void luv_vm_pool_init_once(void) {
+  if (uv_mutex_init(&luv_vm_pool.mutex))
+    abort();
+}
+
+// Copies the table on top into the registry at key and pops it.
+static void luv_vm_snapshot(lua_State* L, void* key) {
+  lua_newtable(L);
+  lua_pushnil(L);
+  while (lua_next(L, -3)) {
+    lua_pushvalue(L, -2);
+    lua_insert(L, -2);
+    lua_rawset(L, -4);
+  }
+  lua_rawsetp(L, LUA_REGISTRYINDEX, key);
+  lua_pop(L, 1);
+}
+
+// Makes the table on top match the snapshot at key again and pops it.
+static int luv_vm_restore(lua_State* L, void* key) {
+  lua_rawgetp(L, LUA_REGISTRYINDEX, key);
+  if (!lua_istable(L, -1) || !lua_istable(L, -2)) {
+    lua_pop(L, 2);
+    return 0;
+  }
+  // clearing fields during a traversal is allowed
+  lua_pushnil(L);
+  while (lua_next(L, -3)) {
+    lua_pop(L, 1);
+    lua_pushvalue(L, -1);
+    lua_rawget(L, -3);
+    if (lua_isnil(L, -1)) {
+      lua_pop(L, 1);
+      lua_pushvalue(L, -1);
+      lua_pushnil(L);
+      lua_rawset(L, -5);
+    }
+    else {
+      lua_pop(L, 1);
+    }
+  }
+  lua_pushnil(L);
+  while (lua_next(L, -2)) {
+    lua_pushvalue(L, -2);
+    lua_insert(L, -2);
+    lua_rawset(L, -5);
+  }
+  lua_pushnil(L);
+  lua_setmetatable(L, -3);
+  lua_pop(L, 2);
+  return 1;
+}
+
+static void luv_vm_count_handle(uv_handle_t* handle, void* arg) {
+  (void)handle;
+  (*(int*)arg)++;
+}
+
+// Resets a state for the next thread, returns 0 if it can't be reused.
+static int luv_vm_reset(lua_State* L) {
+  luv_ctx_t* ctx = luv_context(L);
+  int handles = 0;
+  lua_settop(L, 0);
+  // handles left in the loop may point into memory of the finished thread
+  uv_walk(ctx->loop, luv_vm_count_handle, &handles);
+  if (handles > 0 || uv_loop_alive(ctx->loop))
+    return 0;
+  lua_pushglobaltable(L);
+  if (!luv_vm_restore(L, &luv_vm_globals_key))
+    return 0;
+  lua_getglobal(L, "package");
+  if (!lua_istable(L, -1)) {
+    lua_pop(L, 1);
+    return 0;
+  }
+  lua_getfield(L, -1, "loaded");
+  lua_remove(L, -2);
+  if (!luv_vm_restore(L, &luv_vm_loaded_key))
+    return 0;
+  lua_gc(L, LUA_GCCOLLECT, 0);
+  return 1;
+}
+
+static lua_State* luv_thread_vm_acquire(void) {
+  lua_State* L = NULL;
+  int pooled;
+  uv_once(&luv_vm_pool_once, luv_vm_pool_init_once);
+  uv_mutex_lock(&luv_vm_pool.mutex);
+  if (luv_vm_pool.count > 0) {
+    L = luv_vm_pool.idle[--luv_vm_pool.count];
+    luv_vm_pool.reused++;
+  }
+  else {
+    luv_vm_pool.created++;
+  }
+  pooled = luv_vm_pool.max > 0;
+  uv_mutex_unlock(&luv_vm_pool.mutex);
+  if (L)
+    return L;
+
+  L = acquire_vm_cb();
+  if (pooled) {
+    lua_pushglobaltable(L);
+    luv_vm_snapshot(L, &luv_vm_globals_key);
+    lua_getglobal(L, "package");
+    if (lua_istable(L, -1)) {
+      lua_getfield(L, -1, "loaded");
+      lua_remove(L, -2);
+    }
+    if (lua_istable(L, -1))
+      luv_vm_snapshot(L, &luv_vm_loaded_key);
+    else
+      lua_pop(L, 1);
+  }
+  return L;
+}
+
+static void luv_thread_vm_release(lua_State* L) {
+  int kept = 0;
+  uv_mutex_lock(&luv_vm_pool.mutex);
+  kept = luv_vm_pool.count < luv_vm_pool.max;
+  uv_mutex_unlock(&luv_vm_pool.mutex);
+  if (kept && luv_vm_reset(L)) {
+    uv_mutex_lock(&luv_vm_pool.mutex);
+    // the pool may have shrunk or filled up meanwhile
+    kept = luv_vm_pool.count < luv_vm_pool.max;
+    if (kept)
+      luv_vm_pool.idle[luv_vm_pool.count++] = L;
+    uv_mutex_unlock(&luv_vm_pool.mutex);
+  }
+  else {
+    kept = 0;
+  }
+  if (!kept)
+    release_vm_cb(L);
+}
+
+LUALIB_API int luv_set_thread_vm_pool(int max) {
+  lua_State** extra = NULL;
+  int i, n = 0;
+  if (max < 0)
+    max = 0;
+  uv_once(&luv_vm_pool_once, luv_vm_pool_init_once);
+  uv_mutex_lock(&luv_vm_pool.mutex);
+  if (max > luv_vm_pool.size) {
+    lua_State** idle = (lua_State**)realloc(luv_vm_pool.idle, max * sizeof(*idle));
+    if (!idle) {
+      uv_mutex_unlock(&luv_vm_pool.mutex);
+      return UV_ENOMEM;
+    }
+    luv_vm_pool.idle = idle;
+    luv_vm_pool.size = max;
+  }
+  if (luv_vm_pool.count > max) {
+    n = luv_vm_pool.count - max;
+    extra = (lua_State**)malloc(n * sizeof(*extra));
+    if (!extra) {
+      uv_mutex_unlock(&luv_vm_pool.mutex);
+      return UV_ENOMEM;
+    }
+    memcpy(extra, luv_vm_pool.idle + max, n * sizeof(*extra));
+    luv_vm_pool.count = max;
+  }
+  luv_vm_pool.max = max;
+  uv_mutex_unlock(&luv_vm_pool.mutex);
+
+  for (i = 0; i < n; i++)
+    release_vm_cb(extra[i]);
+  free(extra);
+  return 0;
+}
+
+static int luv_thread_vm_pool(lua_State* L) {
+  lua_Integer max = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, max >= 0 && (int)max == max, 1, "max out of range");
+  return luv_result(L, luv_set_thread_vm_pool((int)max));
+}
+
+static int luv_thread_vm_stats(lua_State* L) {
+  lua_Integer created, reused;
+  int idle, max;
+  uv_once(&luv_vm_pool_once, luv_vm_pool_init_once);
+  uv_mutex_lock(&luv_vm_pool.mutex);
+  created = luv_vm_pool.created;
+  reused = luv_vm_pool.reused;
+  idle = luv_vm_pool.count;
+  max = luv_vm_pool.max;
+  uv_mutex_unlock(&luv_vm_pool.mutex);
+  lua_createtable(L, 0, 4);
+  lua_pushinteger(L, created);
+  lua_setfield(L, -2, "created");
+  lua_pushinteger(L, reused);
+  lua_setfield(L, -2, "reused");
+  lua_pushinteger(L, idle);
+  lua_setfield(L, -2, "idle");
+  lua_pushinteger(L, max);
+  lua_setfield(L, -2, "max");
+  return 1;
 }
 
 static const char* luv_getmtname(lua_State *L, int idx) {
@@ -62,17 +498,311 @@ static const char* luv_getmtname(lua_State *L, int idx) {
   return name;
 }
 
+/* Tables are passed between states serialized into one buffer. Every value
+   starts with a tag byte. Tables are numbered in the order they are first
+   written, and a table seen again (shared or cyclic) is written as a reference
+   to its number. Tables whose keys are exactly 1..n are written as arrays
+   without keys. Metatables are not kept. */
+enum {
+  LUV_SER_NIL,
+  LUV_SER_FALSE,
+  LUV_SER_TRUE,
+  LUV_SER_INTEGER,
+  LUV_SER_NUMBER,
+  LUV_SER_STRING,
+  LUV_SER_ARRAY,
+  LUV_SER_TABLE,
+  LUV_SER_REF
+};
+
+#define LUV_SER_MAXDEPTH 128
+
+typedef struct {
+  char* data;
+  size_t len;
+  size_t cap;
+  int seen;           // stack index of the table -> number map
+  lua_Integer ntables;
+  int depth;
+  int badtype;        // type that can't be serialized, LUA_TNONE otherwise
+  const char* error;  // set for other failures
+} luv_ser_t;
+
+static int luv_ser_write(luv_ser_t* ser, const void* p, size_t n) {
+  if (ser->len + n > ser->cap) {
+    size_t cap = ser->cap ? ser->cap * 2 : 256;
+    char* data;
+    while (cap < ser->len + n)
+      cap *= 2;
+    data = (char*)realloc(ser->data, cap);
+    if (!data) {
+      ser->error = "out of memory";
+      return -1;
+    }
+    ser->data = data;
+    ser->cap = cap;
+  }
+  memcpy(ser->data + ser->len, p, n);
+  ser->len += n;
+  return 0;
+}
+
+static int luv_ser_tag(luv_ser_t* ser, char tag) {
+  return luv_ser_write(ser, &tag, 1);
+}
+
+static int luv_ser_value(lua_State* L, luv_ser_t* ser, int idx);
+
+static int luv_ser_table(lua_State* L, luv_ser_t* ser, int idx) {
+  lua_Integer n, i, count = 0;
+  int array = 1;
+
+  lua_pushvalue(L, idx);
+  lua_rawget(L, ser->seen);
+  if (!lua_isnil(L, -1)) {
+    lua_Integer ref = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if (luv_ser_tag(ser, LUV_SER_REF) < 0) return -1;
+    return luv_ser_write(ser, &ref, sizeof(ref));
+  }
+  lua_pop(L, 1);
+
+  if (ser->depth >= LUV_SER_MAXDEPTH) {
+    ser->error = "tables nested too deep";
+    return -1;
+  }
+  if (!lua_checkstack(L, 4)) {
+    ser->error = "stack overflow";
+    return -1;
+  }
+  lua_pushvalue(L, idx);
+  lua_pushinteger(L, ++ser->ntables);
+  lua_rawset(L, ser->seen);
+
+  // the keys are exactly 1..n if there are n of them and all are in 1..n
+  n = (lua_Integer)lua_rawlen(L, idx);
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    count++;
+    if (array && !(lua_isinteger(L, -2) && lua_tointeger(L, -2) >= 1 && lua_tointeger(L, -2) <= n))
+      array = 0;
+    lua_pop(L, 1);
+  }
+
+  ser->depth++;
+  if (array && count == n) {
+    if (luv_ser_tag(ser, LUV_SER_ARRAY) < 0) return -1;
+    if (luv_ser_write(ser, &n, sizeof(n)) < 0) return -1;
+    for (i = 1; i <= n; i++) {
+      lua_rawgeti(L, idx, i);
+      if (luv_ser_value(L, ser, -1) < 0) return -1;
+      lua_pop(L, 1);
+    }
+  }
+  else {
+    if (luv_ser_tag(ser, LUV_SER_TABLE) < 0) return -1;
+    if (luv_ser_write(ser, &count, sizeof(count)) < 0) return -1;
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+      if (luv_ser_value(L, ser, -2) < 0) return -1;
+      if (luv_ser_value(L, ser, -1) < 0) return -1;
+      lua_pop(L, 1);
+    }
+  }
+  ser->depth--;
+  return 0;
+}
+
+// On failure the stack is left unbalanced, callers reset it.
+static int luv_ser_value(lua_State* L, luv_ser_t* ser, int idx) {
+  idx = lua_absindex(L, idx);
+  switch (lua_type(L, idx)) {
+  case LUA_TNIL:
+    return luv_ser_tag(ser, LUV_SER_NIL);
+  case LUA_TBOOLEAN:
+    return luv_ser_tag(ser, lua_toboolean(L, idx) ? LUV_SER_TRUE : LUV_SER_FALSE);
+  case LUA_TNUMBER:
+    if (lua_isinteger(L, idx)) {
+      lua_Integer v = lua_tointeger(L, idx);
+      if (luv_ser_tag(ser, LUV_SER_INTEGER) < 0) return -1;
+      return luv_ser_write(ser, &v, sizeof(v));
+    }
+    else {
+      lua_Number v = lua_tonumber(L, idx);
+      if (luv_ser_tag(ser, LUV_SER_NUMBER) < 0) return -1;
+      return luv_ser_write(ser, &v, sizeof(v));
+    }
+  case LUA_TSTRING: {
+    size_t len;
+    const char* str = lua_tolstring(L, idx, &len);
+    if (luv_ser_tag(ser, LUV_SER_STRING) < 0) return -1;
+    if (luv_ser_write(ser, &len, sizeof(len)) < 0) return -1;
+    return luv_ser_write(ser, str, len);
+  }
+  case LUA_TTABLE:
+    return luv_ser_table(L, ser, idx);
+  default:
+    ser->badtype = lua_type(L, idx);
+    return -1;
+  }
+}
+
+// Pushes the value read from *p. refs is the stack index of the number ->
+// table map.
+static void luv_deser_value(lua_State* L, const char** p, int refs) {
+  char tag = *(*p)++;
+  switch (tag) {
+  case LUV_SER_FALSE:
+  case LUV_SER_TRUE:
+    lua_pushboolean(L, tag == LUV_SER_TRUE);
+    break;
+  case LUV_SER_INTEGER: {
+    lua_Integer v;
+    memcpy(&v, *p, sizeof(v));
+    *p += sizeof(v);
+    lua_pushinteger(L, v);
+    break;
+  }
+  case LUV_SER_NUMBER: {
+    lua_Number v;
+    memcpy(&v, *p, sizeof(v));
+    *p += sizeof(v);
+    lua_pushnumber(L, v);
+    break;
+  }
+  case LUV_SER_STRING: {
+    size_t len;
+    memcpy(&len, *p, sizeof(len));
+    *p += sizeof(len);
+    lua_pushlstring(L, *p, len);
+    *p += len;
+    break;
+  }
+  case LUV_SER_ARRAY:
+  case LUV_SER_TABLE: {
+    lua_Integer n, i;
+    memcpy(&n, *p, sizeof(n));
+    *p += sizeof(n);
+    luaL_checkstack(L, 4, "serialized table nested too deep");
+    if (tag == LUV_SER_ARRAY)
+      lua_createtable(L, (int)n, 0);
+    else
+      lua_createtable(L, 0, (int)n);
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, refs, (lua_Integer)lua_rawlen(L, refs) + 1);
+    for (i = 1; i <= n; i++) {
+      if (tag == LUV_SER_ARRAY) {
+        luv_deser_value(L, p, refs);
+        lua_rawseti(L, -2, i);
+      }
+      else {
+        luv_deser_value(L, p, refs);
+        luv_deser_value(L, p, refs);
+        lua_rawset(L, -3);
+      }
+    }
+    break;
+  }
+  case LUV_SER_REF: {
+    lua_Integer ref;
+    memcpy(&ref, *p, sizeof(ref));
+    *p += sizeof(ref);
+    lua_rawgeti(L, refs, ref);
+    break;
+  }
+  case LUV_SER_NIL:
+  default:
+    lua_pushnil(L);
+    break;
+  }
+}
+
+// Serializes the value at idx into a new buffer of *len bytes. Returns NULL
+// with the type that can't be serialized pushed as an integer, or with the
+// reason it failed pushed as a string.
+static char* luv_serialize(lua_State* L, int idx, size_t* len) {
+  luv_ser_t ser;
+  int top = lua_gettop(L);
+  int ret;
+
+  idx = lua_absindex(L, idx);
+  memset(&ser, 0, sizeof(ser));
+  ser.badtype = LUA_TNONE;
+  lua_newtable(L);
+  ser.seen = lua_gettop(L);
+  ret = luv_ser_value(L, &ser, idx);
+  lua_settop(L, top);
+  if (ret < 0) {
+    free(ser.data);
+    if (ser.badtype == LUA_TNONE)
+      lua_pushstring(L, ser.error);
+    else
+      lua_pushinteger(L, ser.badtype);
+    return NULL;
+  }
+  *len = ser.len;
+  return ser.data;
+}
+
+// Pushes a value serialized by luv_serialize.
+static void luv_deserialize(lua_State* L, const char* data) {
+  int refs;
+  lua_newtable(L);
+  refs = lua_gettop(L);
+  luv_deser_value(L, &data, refs);
+  lua_remove(L, refs);
+}
+
+// Frees the copies made for the first n args when setting fails half way.
+static void luv_thread_arg_unset(luv_thread_arg_t* args, int n) {
+  luv_val_t* argv = LUV_THREAD_ARGV(args);
+  int j;
+  for (j = 0; j < n; j++) {
+    luv_val_t* arg = argv + j;
+    if (arg->type == LUA_TSTRING && LUVF_THREAD_ASYNC(args->flags)) {
+      free((void*)arg->val.str.base);
+    } else if (arg->type == LUA_TTABLE) {
+      free(arg->val.table.data);
+    } else if (arg->type == LUV_THREAD_TSHARED) {
+      luv_shared_release(arg->val.shared);
+    }
+  }
+  args->argc = 0;
+}
+
+// Copies the values from idx to top into args and returns how many there
+// are. On failure returns -1 with the unsupported type or the reason, then
+// the position of the argument pushed, and leaves the args copied so far in
+// args->argc for the caller to clear. Never raises for a value it can't copy,
+// so callers can free what they allocated before raising.
 static int luv_thread_arg_set(lua_State* L, luv_thread_arg_t* args, int idx, int top, int flags) {
-  int i;
+  int i, n;
   int side = LUVF_THREAD_SIDE(flags);
   int async = LUVF_THREAD_ASYNC(flags);
+  int borrow = LUVF_THREAD_BORROW(flags);
+  luv_val_t* argv;
 
   idx = idx > 0 ? idx : 1;
+  n = top >= idx ? top - idx + 1 : 0;
+  if (n > LUV_THREAD_INLINE_ARG && n > args->capacity) {
+    argv = (luv_val_t*)realloc(args->argv, n * sizeof(luv_val_t));
+    if (!argv) {
+      args->argc = 0;
+      lua_pushliteral(L, "out of memory");
+      lua_pushinteger(L, LUV_THREAD_INLINE_ARG + 1);
+      return -1;
+    }
+    args->argv = argv;
+    args->capacity = n;
+  }
+  argv = LUV_THREAD_ARGV(args);
+
   i = idx;
+  args->argc = 0;
   args->flags = flags;
-  while (i <= top && i < LUV_THREAD_MAXNUM_ARG + idx)
+  while (i <= top)
   {
-    luv_val_t *arg = args->argv + (i - idx);
+    luv_val_t *arg = argv + (i - idx);
     arg->type = lua_type(L, i);
     arg->ref[0] = arg->ref[1] = LUA_NOREF;
     switch (arg->type)
@@ -96,32 +826,45 @@ static int luv_thread_arg_set(lua_State* L, luv_thread_arg_t* args, int idx, int
         const char* p = lua_tolstring(L, i, &arg->val.str.len);
         arg->val.str.base = malloc(arg->val.str.len);
         if (!arg->val.str.base) {
-          for (int j = 0; j < i - idx; j++) {
-            luv_val_t* arg = args->argv + j;
-            if (arg->type == LUA_TSTRING && arg->ref[side] == LUA_NOREF) {
-              free((void*)arg->val.str.base);
-            }
-          }
-
-          return luaL_error(L, "Failed to allocate thread arg string");
+          args->argc = i - idx;
+          lua_pushliteral(L, "out of memory");
+          lua_pushinteger(L, i - idx + 1);
+          return -1;
         }
         memcpy((void*)arg->val.str.base, p, arg->val.str.len);
       } else {
         arg->val.str.base = lua_tolstring(L, i, &arg->val.str.len);
-        lua_pushvalue(L, i);
-        arg->ref[side] = luaL_ref(L, LUA_REGISTRYINDEX);
+        if (!borrow) {
+          lua_pushvalue(L, i);
+          arg->ref[side] = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
       }
       break;
     case LUA_TUSERDATA:
+      // shared objects are passed by reference instead of copied
+      arg->val.shared = luv_shared_get(L, i);
+      if (arg->val.shared) {
+        arg->type = LUV_THREAD_TSHARED;
+        luv_shared_retain(arg->val.shared);
+        break;
+      }
       arg->val.udata.data = lua_topointer(L, i);
       arg->val.udata.size = lua_rawlen(L, i);
       arg->val.udata.metaname = luv_getmtname(L, i);
 
-      if (arg->val.udata.size) {
+      if (arg->val.udata.size && !borrow) {
         lua_pushvalue(L, i);
         arg->ref[side] = luaL_ref(L, LUA_REGISTRYINDEX);
       }
       break;
+    case LUA_TTABLE:
+      arg->val.table.data = luv_serialize(L, i, &arg->val.table.len);
+      if (!arg->val.table.data) {
+        args->argc = i - idx;
+        lua_pushinteger(L, i - idx + 1);
+        return -1;
+      }
+      break;
     default:
       args->argc = i - idx;
       lua_pushinteger(L, arg->type);
@@ -139,12 +882,13 @@ static void luv_thread_arg_clear(lua_State* L, luv_thread_arg_t* args, int flags
   int side = LUVF_THREAD_SIDE(flags);
   int set = LUVF_THREAD_SIDE(args->flags);
   int async = LUVF_THREAD_ASYNC(args->flags);
+  luv_val_t* argv = LUV_THREAD_ARGV(args);
 
   if (args->argc == 0)
     return;
 
   for (i = 0; i < args->argc; i++) {
-    luv_val_t* arg = args->argv + i;
+    luv_val_t* arg = argv + i;
     switch (arg->type) {
     case LUA_TSTRING:
       if (arg->ref[side] != LUA_NOREF)
@@ -175,19 +919,120 @@ static void luv_thread_arg_clear(lua_State* L, luv_thread_arg_t* args, int flags
         arg->ref[side] = LUA_NOREF;
       }
       break;
+    case LUA_TTABLE:
+      // in async mode the setting side clears before the other side pushes
+      if (!async || set != side)
+      {
+        free(arg->val.table.data);
+        arg->val.table.data = NULL;
+        arg->val.table.len = 0;
+      }
+      break;
+    case LUV_THREAD_TSHARED:
+      // the reference is released once, like table data
+      if ((!async || set != side) && arg->val.shared)
+      {
+        luv_shared_release(arg->val.shared);
+        arg->val.shared = NULL;
+      }
+      break;
     default:
       break;
     }
   }
 }
 
+// Releases the storage of args that are no longer used, after both sides
+// have cleared them.
+static void luv_thread_arg_free(luv_thread_arg_t* args) {
+  free(args->argv);
+  args->argv = NULL;
+  args->capacity = 0;
+  args->argc = 0;
+}
+
+// Intrusive multi-producer single-consumer queue (Dmitry Vyukov's design).
+// Pushing is a single atomic exchange, so any thread can send without a lock.
+static void luv_mpsc_init(luv_mpsc_t* queue) {
+  luv_atomic_ptr_init(&queue->stub.next, NULL);
+  luv_atomic_ptr_init(&queue->head, &queue->stub);
+  queue->tail = &queue->stub;
+}
+
+static void luv_mpsc_push(luv_mpsc_t* queue, luv_mpsc_node_t* node) {
+  luv_mpsc_node_t* prev;
+  luv_atomic_ptr_store(&node->next, NULL);
+  prev = (luv_mpsc_node_t*)luv_atomic_ptr_exchange(&queue->head, node);
+  luv_atomic_ptr_store(&prev->next, node);
+}
+
+// Returns the oldest node, or NULL when the queue is empty or a producer is
+// still linking its node. That producer wakes the consumer again afterwards.
+static luv_mpsc_node_t* luv_mpsc_pop(luv_mpsc_t* queue) {
+  luv_mpsc_node_t* tail = queue->tail;
+  luv_mpsc_node_t* next = (luv_mpsc_node_t*)luv_atomic_ptr_load(&tail->next);
+  if (tail == &queue->stub) {
+    if (!next)
+      return NULL;
+    queue->tail = tail = next;
+    next = (luv_mpsc_node_t*)luv_atomic_ptr_load(&tail->next);
+  }
+  if (next) {
+    queue->tail = next;
+    return tail;
+  }
+  if (tail != luv_atomic_ptr_load(&queue->head))
+    return NULL;
+  // tail is the last node, put the stub behind it so it can be taken
+  luv_mpsc_push(queue, &queue->stub);
+  next = (luv_mpsc_node_t*)luv_atomic_ptr_load(&tail->next);
+  if (next) {
+    queue->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+// Copies the values from idx to top into a new message. Returns NULL with
+// the error left by luv_thread_arg_set on the stack, see
+// luv_thread_arg_error.
+static luv_thread_msg_t* luv_thread_msg_new(lua_State* L, int idx, int top) {
+  luv_thread_msg_t* msg = (luv_thread_msg_t*)calloc(1, sizeof(*msg));
+  if (!msg) {
+    luaL_error(L, "Failed to allocate thread message");
+    return NULL; // unreachable
+  }
+  if (luv_thread_arg_set(L, &msg->args, idx, top, LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_CHILD) < 0) {
+    luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_CHILD);
+    luv_thread_msg_drop(msg);
+    return NULL;
+  }
+  // the copies no longer depend on the sending state
+  luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_CHILD);
+  return msg;
+}
+
+// Frees a message once the receiver has pushed and cleared its args.
+static void luv_thread_msg_free(luv_thread_msg_t* msg) {
+  luv_thread_arg_free(&msg->args);
+  free(msg);
+}
+
+// Frees a message that was never received, with the copies it holds.
+static void luv_thread_msg_drop(luv_thread_msg_t* msg) {
+  luv_thread_arg_unset(&msg->args, msg->args.argc);
+  luv_thread_msg_free(msg);
+}
+
 // called only in thread
 static int luv_thread_arg_push(lua_State* L, luv_thread_arg_t* args, int flags) {
   int i = 0;
   int side = LUVF_THREAD_SIDE(flags);
+  luv_val_t* argv = LUV_THREAD_ARGV(args);
 
+  luaL_checkstack(L, args->argc, "too many thread args");
   while (i < args->argc) {
-    luv_val_t* arg = args->argv + i;
+    luv_val_t* arg = argv + i;
     switch (arg->type) {
     case LUA_TNIL:
       lua_pushnil(L);
@@ -221,6 +1066,23 @@ static int luv_thread_arg_push(lua_State* L, luv_thread_arg_t* args, int flags)
         lua_pushlightuserdata(L, (void*)arg->val.udata.data);
       }
       break;
+    case LUA_TTABLE:
+      if (arg->val.table.data)
+      {
+        const char* p = arg->val.table.data;
+        lua_newtable(L);
+        luv_deser_value(L, &p, lua_gettop(L));
+        lua_remove(L, -2);
+      } else {
+        lua_pushnil(L);
+      }
+      break;
+    case LUV_THREAD_TSHARED:
+      if (arg->val.shared)
+        luv_shared_push(L, arg->val.shared);
+      else
+        lua_pushnil(L);
+      break;
     default:
       fprintf(stderr, "Error: thread arg not support type %s at %d",
         lua_typename(L, arg->type), i + 1);
@@ -230,12 +1092,24 @@ static int luv_thread_arg_push(lua_State* L, luv_thread_arg_t* args, int flags)
   return i;
 }
 
+// Replaces the error left by a failed luv_thread_arg_set, the unsupported
+// type or the reason the copy failed and then the position, with a message.
+// offset is subtracted from the position.
+static const char* luv_thread_arg_errmsg(lua_State* L, int offset) {
+  int pos = (int)lua_tointeger(L, -1) - offset;
+  if (lua_type(L, -2) == LUA_TSTRING)
+    lua_pushfstring(L, "Error: failed to copy thread arg at %d: %s",
+      pos, lua_tostring(L, -2));
+  else
+    lua_pushfstring(L, "Error: thread arg not support type '%s' at %d",
+      lua_typename(L, (int)lua_tointeger(L, -2)), pos);
+  lua_replace(L, -3);
+  lua_pop(L, 1);
+  return lua_tostring(L, -1);
+}
+
 static int luv_thread_arg_error(lua_State *L) {
-  int type = lua_tointeger(L, -2);
-  int pos = lua_tointeger(L, -1);
-  lua_pop(L, 2);
-  return luaL_error(L, "Error: thread arg not support type '%s' at %d",
-    lua_typename(L, type), pos);
+  return luaL_error(L, "%s", luv_thread_arg_errmsg(L, 0));
 }
 
 // Based on code from lstrlib.c in Lua 5.5
@@ -339,10 +1213,142 @@ static luv_thread_t* luv_check_thread(lua_State* L, int index) {
   return thread;
 }
 
+static void luv_loop_thread_free(luv_loop_thread_t* lt) {
+  uv_mutex_destroy(&lt->mutex);
+  free(lt);
+}
+
+static void luv_loop_thread_reply_close_cb(uv_handle_t* handle) {
+  luv_loop_thread_t* lt = (luv_loop_thread_t*)handle;
+  lt->reply_closed = 1;
+  if (lt->orphan)
+    luv_loop_thread_free(lt);
+}
+
+// Called from any thread, the posts queued before still run. A graceful stop
+// only unrefs the inbox and lets the loop end on its own, forcing it after
+// timeout ms when not 0. A forced stop also cuts short a graceful one.
+static void luv_loop_thread_stop(luv_loop_thread_t* lt, int graceful, uint64_t timeout) {
+  uv_mutex_lock(&lt->mutex);
+  if (lt->state == LUV_LOOP_THREAD_RUNNING)
+    uv_async_send(&lt->inbox);
+  if (lt->state < LUV_LOOP_THREAD_STOPPING) {
+    lt->state = LUV_LOOP_THREAD_STOPPING;
+    lt->graceful = graceful;
+    lt->grace_timeout = timeout;
+  }
+  else if (lt->state == LUV_LOOP_THREAD_STOPPING && lt->graceful && !graceful) {
+    lt->graceful = 0;
+    if (lt->started)
+      uv_async_send(&lt->inbox);
+  }
+  uv_mutex_unlock(&lt->mutex);
+}
+
+static void luv_loop_thread_drop(luv_mpsc_t* queue) {
+  luv_mpsc_node_t* node;
+  while ((node = luv_mpsc_pop(queue)))
+    luv_thread_msg_drop((luv_thread_msg_t*)node);
+}
+
+// Calls the callback of a reply {id, ok, ...} as callback(nil, ...) or
+// callback(err).
+static void luv_loop_thread_deliver(luv_loop_thread_t* lt, luv_thread_msg_t* msg) {
+  lua_State* L = lt->L;
+  luv_ctx_t* ctx = luv_context(L);
+  int top = lua_gettop(L);
+  int n = luv_thread_arg_push(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+  lua_Integer id = lua_tointeger(L, top + 1);
+  int ok = lua_toboolean(L, top + 2);
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, lt->callbacks);
+  lua_rawgeti(L, -1, id);
+  lua_pushnil(L);
+  lua_rawseti(L, -3, id);
+  lua_remove(L, -2);
+  lua_replace(L, top + 1);
+  if (ok) {
+    lua_pushnil(L);
+    lua_replace(L, top + 2);
+    n--;
+  }
+  else {
+    lua_remove(L, top + 2);
+    n -= 2;
+  }
+  if (lua_isnil(L, top + 1))
+    lua_settop(L, top);
+  else
+    ctx->cb_pcall(L, n, 0, 0);
+  luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+  luv_thread_msg_free(msg);
+}
+
+// Removes the callback of a post that was not sent.
+static void luv_loop_thread_forget(lua_State* L, luv_loop_thread_t* lt, lua_Integer id) {
+  lua_rawgeti(L, LUA_REGISTRYINDEX, lt->callbacks);
+  lua_pushnil(L);
+  lua_rawseti(L, -2, id);
+  lua_pop(L, 1);
+}
+
+static void luv_loop_thread_reply_cb(uv_async_t* handle) {
+  luv_loop_thread_t* lt = (luv_loop_thread_t*)handle;
+  luv_mpsc_node_t* node;
+  while ((node = luv_mpsc_pop(&lt->replies)))
+    luv_loop_thread_deliver(lt, (luv_thread_msg_t*)node);
+}
+
+// Called in the owner loop once the thread is done: delivers the last
+// replies and cancels the posts that will never get one.
+static void luv_loop_thread_exited(luv_loop_thread_t* lt) {
+  lua_State* L = lt->L;
+  luv_ctx_t* ctx = luv_context(L);
+  int callbacks = lt->callbacks;
+
+  luv_loop_thread_reply_cb(&lt->reply);
+  // later posts fail before adding a callback
+  lt->callbacks = LUA_NOREF;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, callbacks);
+  luaL_unref(L, LUA_REGISTRYINDEX, callbacks);
+  lua_pushnil(L);
+  while (lua_next(L, -2)) {
+    lua_pushfstring(L, "%s: %s", uv_err_name(UV_ECANCELED), uv_strerror(UV_ECANCELED));
+    ctx->cb_pcall(L, 1, 0, 0);
+  }
+  lua_pop(L, 1);
+  if (!uv_is_closing((uv_handle_t*)&lt->reply))
+    uv_close((uv_handle_t*)&lt->reply, luv_loop_thread_reply_close_cb);
+}
+
+// Releases the owner side, the thread must be done.
+static void luv_loop_thread_release(luv_loop_thread_t* lt) {
+  luv_loop_thread_drop(&lt->posts);
+  luv_loop_thread_drop(&lt->replies);
+  lt->orphan = 1;
+  if (lt->reply_closed)
+    luv_loop_thread_free(lt);
+  // at loop shutdown the handle may already be closed by loop_gc, leak it
+  // rather than freeing memory that libuv still holds
+  else if (!uv_is_closing((uv_handle_t*)&lt->reply))
+    uv_close((uv_handle_t*)&lt->reply, luv_loop_thread_reply_close_cb);
+}
+
 static int luv_thread_gc(lua_State* L) {
   luv_thread_t* tid = luv_check_thread(L, 1);
+  if (tid->loop) {
+    // the state is closing with the thread still running its loop
+    if (tid->ref != LUA_NOREF && tid->handle != 0) {
+      luv_loop_thread_stop(tid->loop, 0, 0);
+      uv_thread_join(&tid->handle);
+      tid->handle = 0;
+    }
+    luv_loop_thread_release(tid->loop);
+    tid->loop = NULL;
+  }
   free(tid->code);
   luv_thread_arg_clear(L, &tid->args, LUVF_THREAD_SIDE_MAIN);
+  luv_thread_arg_free(&tid->args);
   return 0;
 }
 
@@ -356,7 +1362,7 @@ static int luv_thread_tostring(lua_State* L)
 static void luv_thread_cb(void* varg) {
   //acquire vm and get top
   luv_thread_t* thd = (luv_thread_t*)varg;
-  lua_State* L = acquire_vm_cb();
+  lua_State* L = luv_thread_vm_acquire();
   luv_ctx_t *ctx = luv_context(L);
 
   lua_pushboolean(L, 1);
@@ -376,11 +1382,11 @@ static void luv_thread_cb(void* varg) {
   }
 
   uv_async_send(&thd->notify);
-  release_vm_cb(L);
+  luv_thread_vm_release(L);
 }
 
 static void luv_thread_notify_close_cb(uv_handle_t *handle) {
-  luv_thread_t *thread = handle->data;
+  luv_thread_t *thread = luv_thread_from_notify(handle);
   if (thread->handle != 0)
     uv_thread_join(&thread->handle);
 
@@ -390,17 +1396,69 @@ static void luv_thread_notify_close_cb(uv_handle_t *handle) {
 }
 
 static void luv_thread_exit_cb(uv_async_t* handle) {
+  luv_thread_t* thread = luv_thread_from_notify((uv_handle_t*)handle);
+  if (thread->loop)
+    luv_loop_thread_exited(thread->loop);
   uv_close((uv_handle_t*)handle, luv_thread_notify_close_cb);
 }
 
-static int luv_new_thread(lua_State* L) {
+// Starts entry in a new thread for the code on top of the stack, with the
+// values from argidx as arguments, and replaces the code with the thread.
+static int luv_thread_start(lua_State* L, int argidx, const void* options, uv_thread_cb entry, luv_loop_thread_t* loop) {
   int ret;
   size_t len;
   char* code;
   luv_thread_t* thread;
-  int cbidx = 1;
   luv_ctx_t* ctx = luv_context(L);
 
+  len = lua_rawlen(L, -1);
+  code = malloc(len);
+  if (!code) return luaL_error(L, "Failed to allocate thread code buffer");
+  memcpy(code, lua_tostring(L, -1), len);
+
+  thread = (luv_thread_t*)lua_newuserdata(L, sizeof(*thread));
+  memset(thread, 0, sizeof(*thread));
+  luaL_getmetatable(L, "uv_thread");
+  lua_setmetatable(L, -2);
+
+  thread->len = len;
+  thread->code = code;
+  thread->loop = loop;
+  lua_remove(L, -2);
+  //clear in luv_thread_gc or in child threads
+  thread->argc = luv_thread_arg_set(L, &thread->args, argidx, lua_gettop(L) - 1, LUVF_THREAD_SIDE_MAIN);
+  if (thread->argc < 0) {
+    return luv_thread_arg_error(L);
+  }
+
+  thread->ref = LUA_NOREF;
+  thread->L = L;
+  ret = uv_async_init(ctx->loop, &thread->notify, luv_thread_exit_cb);
+  if (ret < 0)
+    return luv_error(L, ret);
+  thread->notify.data = NULL;
+
+  lua_pushvalue(L, -1);
+  thread->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+#if LUV_UV_VERSION_GEQ(1, 26, 0)
+  if (options)
+    ret = uv_thread_create_ex(&thread->handle, (const uv_thread_options_t*)options, entry, thread);
+  else
+#endif
+  ret = uv_thread_create(&thread->handle, entry, thread);
+  if (ret < 0) {
+    uv_close((uv_handle_t*)&thread->notify, luv_thread_notify_close_cb);
+    return luv_error(L, ret);
+  }
+
+  return 1;
+}
+
+static int luv_new_thread(lua_State* L) {
+  int cbidx = 1;
+  const void* thread_options = NULL;
+
 #if LUV_UV_VERSION_GEQ(1, 26, 0)
   uv_thread_options_t options;
   options.flags = UV_THREAD_NO_FLAGS;
@@ -421,51 +1479,650 @@ static int luv_new_thread(lua_State* L) {
     }
     lua_pop(L, 1);
   }
+  thread_options = &options;
 #endif
 
   luv_thread_dumped(L, cbidx);
-  len = lua_rawlen(L, -1);
-  code = malloc(len);
-  if (!code) return luaL_error(L, "Failed to allocate thread code buffer");
-  memcpy(code, lua_tostring(L, -1), len);
+  return luv_thread_start(L, cbidx + 1, thread_options, luv_thread_cb, NULL);
+}
 
-  thread = (luv_thread_t*)lua_newuserdata(L, sizeof(*thread));
-  memset(thread, 0, sizeof(*thread));
-  luaL_getmetatable(L, "uv_thread");
-  lua_setmetatable(L, -2);
+// Runs a post {id, name, ...} in the thread loop and sends back the reply
+// when id isn't 0.
+static void luv_loop_thread_run(lua_State* L, luv_loop_thread_t* lt, luv_thread_msg_t* msg) {
+  luv_ctx_t* ctx = luv_context(L);
+  int top = lua_gettop(L);
+  int n = luv_thread_arg_push(L, &msg->args, LUVF_THREAD_SIDE_MAIN) - 2;
+  lua_Integer id = lua_tointeger(L, top + 1);
+  const char* name = lua_tostring(L, top + 2);
+  luv_thread_msg_t* reply;
+  int ret;
 
-  thread->len = len;
-  thread->code = code;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, lt->handlers);
+  lua_getfield(L, -1, name);
   lua_remove(L, -2);
-  //clear in luv_thread_gc or in child threads
-  thread->argc = luv_thread_arg_set(L, &thread->args, cbidx+1, lua_gettop(L) - 1, LUVF_THREAD_SIDE_MAIN);
-  if (thread->argc < 0) {
-    return luv_thread_arg_error(L);
+  if (!luv_is_callable(L, -1)) {
+    lua_settop(L, top);
+    if (id == 0)
+      fprintf(stderr, "Uncaught Error in loop thread: no handler named '%s'\n", name);
+    else
+      lua_pushfstring(L, "no handler named '%s'", name);
+    ret = -1;
+  }
+  else {
+    // the handler replaces the id and name
+    lua_replace(L, top + 1);
+    lua_remove(L, top + 2);
+    if (id == 0) {
+      ctx->cb_pcall(L, n, 0, 0);
+      ret = -1;
+    }
+    else {
+      lua_pushcfunction(L, luv_traceback);
+      lua_insert(L, top + 1);
+      ret = lua_pcall(L, n, LUA_MULTRET, top + 1);
+      lua_remove(L, top + 1);
+    }
   }
 
-  thread->notify.data = thread;
-  thread->ref = LUA_NOREF;
-  thread->L = L;
-  ret = uv_async_init(ctx->loop, &thread->notify, luv_thread_exit_cb);
-  if (ret < 0)
-    return luv_error(L, ret);
+  if (id != 0) {
+    lua_pushinteger(L, id);
+    lua_insert(L, top + 1);
+    lua_pushboolean(L, ret == 0);
+    lua_insert(L, top + 2);
+    reply = luv_thread_msg_new(L, top + 1, lua_gettop(L));
+    if (!reply) {
+      luv_thread_arg_errmsg(L, 2);
+      lua_insert(L, top + 3);
+      lua_settop(L, top + 3);
+      lua_pushboolean(L, 0);
+      lua_replace(L, top + 2);
+      reply = luv_thread_msg_new(L, top + 1, top + 3);
+    }
+    if (reply) {
+      luv_mpsc_push(&lt->replies, &reply->node);
+      uv_async_send(&lt->reply);
+    }
+  }
+  lua_settop(L, top);
+  luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+  luv_thread_msg_free(msg);
+}
 
-  lua_pushvalue(L, -1);
-  thread->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+static void luv_loop_thread_grace_cb(uv_timer_t* handle) {
+  uv_stop(handle->loop);
+}
 
-#if LUV_UV_VERSION_GEQ(1, 26, 0)
-  ret = uv_thread_create_ex(&thread->handle, &options, luv_thread_cb, thread);
+static void luv_loop_thread_inbox_cb(uv_async_t* handle) {
+  luv_loop_thread_t* lt = (luv_loop_thread_t*)((char*)handle - offsetof(luv_loop_thread_t, inbox));
+  lua_State* L = lt->thread_L;
+  luv_mpsc_node_t* node;
+  int stopping, graceful;
+  uint64_t timeout;
+  while ((node = luv_mpsc_pop(&lt->posts)))
+    luv_loop_thread_run(L, lt, (luv_thread_msg_t*)node);
+  uv_mutex_lock(&lt->mutex);
+  stopping = lt->state == LUV_LOOP_THREAD_STOPPING;
+  graceful = lt->graceful;
+  timeout = lt->grace_timeout;
+  uv_mutex_unlock(&lt->mutex);
+  if (!stopping)
+    return;
+  if (!graceful) {
+    uv_stop(handle->loop);
+    return;
+  }
+  if (lt->draining)
+    return;
+  lt->draining = 1;
+  // nothing is posted once stopping, the inbox only waits for a forced stop
+  uv_unref((uv_handle_t*)handle);
+  if (lt->stopping)
+    lt->stopping(lt->shard);
+  if (timeout > 0 && uv_timer_init(handle->loop, &lt->grace) == 0) {
+    uv_timer_start(&lt->grace, luv_loop_thread_grace_cb, timeout, 0);
+    // the loop may still end before
+    uv_unref((uv_handle_t*)&lt->grace);
+  }
+}
+
+static void luv_loop_thread_cb(void* varg) {
+  luv_thread_t* thd = (luv_thread_t*)varg;
+  luv_loop_thread_t* lt = thd->loop;
+  lua_State* L = luv_thread_vm_acquire();
+  luv_ctx_t *ctx = luv_context(L);
+  int running = 0;
+
+  lua_pushboolean(L, 1);
+  lua_setglobal(L, "_THREAD");
+  lt->thread_L = L;
+
+  if (luaL_loadbuffer(L, thd->code, thd->len, "=thread") == 0) {
+    int i = luv_thread_arg_push(L, &thd->args, LUVF_THREAD_SIDE_CHILD);
+    if (ctx->thrd_pcall(L, i, 1, 0) >= 0 &&
+        (!lt->setup || lt->setup(L, lt->shard) == 0)) {
+      // posts call the fields of the returned table, or globals
+      if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_pushglobaltable(L);
+      }
+      lt->handlers = luaL_ref(L, LUA_REGISTRYINDEX);
+      running = uv_async_init(ctx->loop, &lt->inbox, luv_loop_thread_inbox_cb) == 0;
+    }
+    luv_thread_arg_clear(L, &thd->args, LUVF_THREAD_SIDE_CHILD);
+  } else {
+    fprintf(stderr, "Uncaught Error in thread: %s\n", lua_tostring(L, -1));
+    //pop errmsg
+    lua_pop(L, 1);
+  }
+
+  uv_mutex_lock(&lt->mutex);
+  if (!running)
+    lt->state = LUV_LOOP_THREAD_STOPPED;
+  else {
+    lt->started = 1;
+    if (lt->state == LUV_LOOP_THREAD_STARTING)
+      lt->state = LUV_LOOP_THREAD_RUNNING;
+    // run what was posted before the loop was ready
+    uv_async_send(&lt->inbox);
+  }
+  uv_mutex_unlock(&lt->mutex);
+
+  if (running) {
+    ctx->mode = UV_RUN_DEFAULT;
+    uv_run(ctx->loop, UV_RUN_DEFAULT);
+    ctx->mode = -1;
+    uv_mutex_lock(&lt->mutex);
+    lt->state = LUV_LOOP_THREAD_STOPPED;
+    uv_mutex_unlock(&lt->mutex);
+  }
+  luv_loop_thread_drop(&lt->posts);
+
+  // closing the state closes the handles left in the loop
+  luv_thread_vm_release(L);
+  if (lt->shared)
+    luv_shared_release(lt->shared);
+  uv_async_send(&thd->notify);
+}
+
+// Restricts thread to the 1-based cpu, as thread:setaffinity() does.
+static int luv_thread_pin(uv_thread_t* thread, lua_Integer cpu) {
+#if LUV_UV_VERSION_GEQ(1, 45, 0)
+  int ret;
+  char* cpumask;
+  int mask_size = uv_cpumask_size();
+  if (mask_size < 0)
+    return mask_size;
+  if (cpu < 1 || cpu > mask_size)
+    return UV_EINVAL;
+  cpumask = (char*)calloc(mask_size, 1);
+  if (!cpumask)
+    return UV_ENOMEM;
+  cpumask[cpu - 1] = 1;
+  ret = uv_thread_setaffinity(thread, cpumask, NULL, mask_size);
+  free(cpumask);
+  return ret;
 #else
-  ret = uv_thread_create(&thread->handle, luv_thread_cb, thread);
+  (void)thread;
+  (void)cpu;
+  return UV_ENOTSUP;
 #endif
+}
+
+// Allocates the owner side of a loop thread, returns NULL with err set when
+// it fails.
+static luv_loop_thread_t* luv_loop_thread_new(lua_State* L, int* err) {
+  luv_ctx_t* ctx = luv_context(L);
+  luv_loop_thread_t* lt = (luv_loop_thread_t*)calloc(1, sizeof(*lt));
+  int ret;
+  if (!lt) {
+    luaL_error(L, "Failed to allocate loop thread");
+    return NULL; // unreachable
+  }
+  ret = uv_mutex_init(&lt->mutex);
+  if (ret == 0) {
+    ret = uv_async_init(ctx->loop, &lt->reply, luv_loop_thread_reply_cb);
+    if (ret < 0)
+      uv_mutex_destroy(&lt->mutex);
+  }
   if (ret < 0) {
-    uv_close((uv_handle_t*)&thread->notify, luv_thread_notify_close_cb);
+    free(lt);
+    *err = ret;
+    return NULL;
+  }
+  // the running thread keeps the loop alive
+  uv_unref((uv_handle_t*)&lt->reply);
+  luv_mpsc_init(&lt->posts);
+  luv_mpsc_init(&lt->replies);
+  lt->L = L;
+  lt->handlers = LUA_NOREF;
+  lua_newtable(L);
+  lt->callbacks = luaL_ref(L, LUA_REGISTRYINDEX);
+  return lt;
+}
+
+static int luv_new_loop_thread(lua_State* L) {
+  luv_loop_thread_t* lt;
+  luv_thread_t* thread;
+  lua_Integer cpu = 0;
+  int ret;
+
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "cpu");
+    if (!lua_isnil(L, -1))
+      cpu = luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+  }
+  luv_thread_dumped(L, 1);
+
+  lt = luv_loop_thread_new(L, &ret);
+  if (!lt)
+    return luv_error(L, ret);
+
+  // from here the thread userdata owns lt
+  ret = luv_thread_start(L, 3, NULL, luv_loop_thread_cb, lt);
+  if (ret != 1 || cpu == 0)
+    return ret;
+  thread = (luv_thread_t*)lua_touserdata(L, -1);
+  ret = luv_thread_pin(&thread->handle, cpu);
+  if (ret < 0) {
+    luv_loop_thread_stop(lt, 0, 0);
+    return luv_error(L, ret);
+  }
+  return 1;
+}
+
+static luv_loop_thread_t* luv_check_loop_thread(lua_State* L, int index) {
+  luv_thread_t* thread = luv_check_thread(L, index);
+  luaL_argcheck(L, thread->loop != NULL, index, "Expected a thread from new_loop_thread");
+  return thread->loop;
+}
+
+static int luv_thread_post(lua_State* L) {
+  luv_loop_thread_t* lt = luv_check_loop_thread(L, 1);
+  int top = lua_gettop(L);
+  lua_Integer id = 0;
+  luv_thread_msg_t* msg;
+  luaL_checkstring(L, 2);
+
+  // a function at the end is called with the reply
+  if (top > 2 && lua_type(L, top) == LUA_TFUNCTION) {
+    if (lt->callbacks == LUA_NOREF)
+      return luv_error(L, UV_EPIPE);
+    id = ++lt->next_id;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lt->callbacks);
+    lua_pushvalue(L, top);
+    lua_rawseti(L, -2, id);
+    lua_pop(L, 1);
+    top--;
+  }
+  lua_pushinteger(L, id);
+  lua_replace(L, 1);
+  msg = luv_thread_msg_new(L, 1, top);
+  if (!msg) {
+    if (id)
+      luv_loop_thread_forget(L, lt, id);
+    return luv_thread_arg_error(L);
+  }
+
+  uv_mutex_lock(&lt->mutex);
+  if (lt->state >= LUV_LOOP_THREAD_STOPPING) {
+    uv_mutex_unlock(&lt->mutex);
+    luv_thread_msg_drop(msg);
+    if (id)
+      luv_loop_thread_forget(L, lt, id);
+    return luv_error(L, UV_EPIPE);
+  }
+  luv_mpsc_push(&lt->posts, &msg->node);
+  if (lt->state == LUV_LOOP_THREAD_RUNNING)
+    uv_async_send(&lt->inbox);
+  uv_mutex_unlock(&lt->mutex);
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+static int luv_thread_stop(lua_State* L) {
+  luv_loop_thread_t* lt = luv_check_loop_thread(L, 1);
+  luv_loop_thread_stop(lt, 0, 0);
+  return 0;
+}
+
+// ms a stopping listen group waits for its connections before forcing
+#define LUV_LISTEN_GROUP_GRACE 5000
+
+// A listener in one thread of a listen group.
+struct luv_listen_shard_s {
+  struct luv_listen_group_s* group;
+  luv_atomic_t accepted;
+  luv_atomic_t errors;    // failed accepts
+  luv_atomic_t listening;
+  uv_tcp_t* server;       // in the shard loop
+  int handler;            // connection callback, in the shard state
+};
+
+// Loop threads that each listen with SO_REUSEPORT on the same address, so the
+// kernel spreads the connections between them.
+typedef struct luv_listen_group_s {
+  luv_shared_t shared;    // held by the group userdata and each running shard
+  struct sockaddr_storage addr;
+  int backlog;
+  int count;
+  luv_listen_shard_t shards[1];  // count shards
+} luv_listen_group_t;
+
+typedef struct {
+  luv_listen_group_t* group;
+  uv_tcp_t* reserve;      // holds the address in the owner loop until stopped
+  int threads;            // table of the shard threads, in the owner state
+} luv_listen_group_ref_t;
+
+static void luv_listen_group_free(luv_shared_t* shared) {
+  free(shared);
+}
+
+static void luv_listen_group_connection_cb(uv_stream_t* server, int status) {
+  luv_handle_t* data = (luv_handle_t*)server->data;
+  luv_listen_shard_t* shard = (luv_listen_shard_t*)data->extra;
+  lua_State* L = data->ctx->L;
+  uv_tcp_t* client;
+  int ret;
+  if (status < 0) {
+    (void)luv_atomic_inc(&shard->errors);
+    return;
+  }
+  client = (uv_tcp_t*)luv_newuserdata(L, uv_handle_size(UV_TCP));
+  ret = uv_tcp_init(server->loop, client);
+  if (ret == 0) {
+    client->data = luv_setup_handle(L, data->ctx);
+    ret = uv_accept(server, (uv_stream_t*)client);
+    if (ret < 0)
+      uv_close((uv_handle_t*)client, luv_close_cb);
+  }
+  if (ret < 0) {
+    lua_pop(L, 1);
+    (void)luv_atomic_inc(&shard->errors);
+    return;
+  }
+  (void)luv_atomic_inc(&shard->accepted);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, shard->handler);
+  lua_insert(L, -2);
+  data->ctx->cb_pcall(L, 1, 0, 0);
+}
+
+// Runs in the shard thread with the value returned by init on top, the
+// connection callback. Replaces it with the handlers of posts and listens.
+static int luv_listen_group_setup(lua_State* L, luv_listen_shard_t* shard) {
+  luv_listen_group_t* group = shard->group;
+  luv_ctx_t* ctx = luv_context(L);
+  uv_tcp_t* server;
+  int ret;
+  if (!luv_is_callable(L, -1)) {
+    lua_pop(L, 1);
+    fprintf(stderr, "Uncaught Error in listen group: init must return a connection callback\n");
+    return -1;
+  }
+  shard->handler = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  server = (uv_tcp_t*)luv_newuserdata(L, uv_handle_size(UV_TCP));
+  ret = uv_tcp_init_ex(ctx->loop, server, group->addr.ss_family);
+  if (ret == 0) {
+    luv_handle_t* data = luv_setup_handle(L, ctx);
+    data->extra = shard;
+    server->data = data;
+    ret = luv_tcp_bind_reuseport(server, (struct sockaddr*)&group->addr, 0);
+    if (ret == 0)
+      ret = uv_listen((uv_stream_t*)server, group->backlog, luv_listen_group_connection_cb);
+    if (ret < 0)
+      uv_close((uv_handle_t*)server, luv_close_cb);
+  }
+  lua_pop(L, 1);
+  if (ret < 0) {
+    fprintf(stderr, "Uncaught Error in listen group: %s: %s\n", uv_err_name(ret), uv_strerror(ret));
+    return -1;
+  }
+  shard->server = server;
+  (void)luv_atomic_exchange(&shard->listening, 1);
+  // posts call globals
+  lua_pushnil(L);
+  return 0;
+}
+
+// Runs in the shard thread when a graceful stop begins, the loop then ends
+// once the accepted connections are closed.
+static void luv_listen_group_stopping(luv_listen_shard_t* shard) {
+  if (shard->server && !uv_is_closing((uv_handle_t*)shard->server))
+    uv_close((uv_handle_t*)shard->server, luv_close_cb);
+  shard->server = NULL;
+  (void)luv_atomic_exchange(&shard->listening, 0);
+}
+
+static luv_listen_group_ref_t* luv_check_listen_group(lua_State* L, int index) {
+  return (luv_listen_group_ref_t*)luaL_checkudata(L, index, "luv_listen_group");
+}
+
+// Stops the shards still running and gives up the address.
+static void luv_listen_group_stop_all(lua_State* L, luv_listen_group_ref_t* ref, int graceful, uint64_t timeout) {
+  int i;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, ref->threads);
+  for (i = 1; i <= ref->group->count; i++) {
+    luv_thread_t* thread;
+    lua_rawgeti(L, -1, i);
+    thread = (luv_thread_t*)lua_touserdata(L, -1);
+    if (thread && thread->loop)
+      luv_loop_thread_stop(thread->loop, graceful, timeout);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+  if (ref->reserve) {
+    if (!uv_is_closing((uv_handle_t*)ref->reserve))
+      uv_close((uv_handle_t*)ref->reserve, luv_close_cb);
+    ref->reserve = NULL;
+  }
+}
+
+static int luv_tcp_listen_group(lua_State* L) {
+  luv_ctx_t* ctx = luv_context(L);
+  const char* host = luaL_checkstring(L, 1);
+  int port = luaL_checkinteger(L, 2);
+  lua_Integer count = luaL_checkinteger(L, 3);
+  lua_Integer backlog = 128;
+  struct sockaddr_storage addr;
+  int addrlen = sizeof(addr);
+  luv_listen_group_t* group;
+  luv_listen_group_ref_t* ref;
+  uv_tcp_t* reserve;
+  int code, i, ret;
+
+  luaL_argcheck(L, count > 0, 3, "count must be > 0");
+  if (!lua_isnoneornil(L, 5)) {
+    luaL_checktype(L, 5, LUA_TTABLE);
+    lua_getfield(L, 5, "backlog");
+    if (!lua_isnil(L, -1))
+      backlog = luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+  }
+  lua_settop(L, 4);
+  luv_thread_dumped(L, 4);
+  code = lua_gettop(L);
+  if (uv_ip4_addr(host, port, (struct sockaddr_in*)&addr) &&
+      uv_ip6_addr(host, port, (struct sockaddr_in6*)&addr)) {
+    return luaL_error(L, "Invalid IP address or port [%s:%d]", host, port);
+  }
+
+  // bind here first, which resolves port 0 for the shards and keeps the
+  // address while they start
+  reserve = (uv_tcp_t*)luv_newuserdata(L, uv_handle_size(UV_TCP));
+  ret = uv_tcp_init_ex(ctx->loop, reserve, addr.ss_family);
+  if (ret < 0) {
+    lua_pop(L, 1);
+    return luv_error(L, ret);
+  }
+  reserve->data = luv_setup_handle(L, ctx);
+  lua_pop(L, 1);
+  ret = luv_tcp_bind_reuseport(reserve, (struct sockaddr*)&addr, 0);
+  if (ret == 0)
+    ret = uv_tcp_getsockname(reserve, (struct sockaddr*)&addr, &addrlen);
+  if (ret < 0) {
+    uv_close((uv_handle_t*)reserve, luv_close_cb);
     return luv_error(L, ret);
   }
 
+  group = (luv_listen_group_t*)calloc(1, sizeof(*group) + (size_t)(count - 1) * sizeof(luv_listen_shard_t));
+  if (!group) {
+    uv_close((uv_handle_t*)reserve, luv_close_cb);
+    return luaL_error(L, "Failed to allocate listen group");
+  }
+  luv_atomic_init(&group->shared.refs, 1);
+  group->shared.free = luv_listen_group_free;
+  group->addr = addr;
+  group->backlog = (int)backlog;
+  group->count = (int)count;
+  for (i = 0; i < count; i++) {
+    group->shards[i].group = group;
+    luv_atomic_init(&group->shards[i].accepted, 0);
+    luv_atomic_init(&group->shards[i].errors, 0);
+    luv_atomic_init(&group->shards[i].listening, 0);
+    group->shards[i].handler = LUA_NOREF;
+  }
+
+  ref = (luv_listen_group_ref_t*)lua_newuserdata(L, sizeof(*ref));
+  ref->group = group;
+  ref->reserve = reserve;
+  ref->threads = LUA_NOREF;
+  luaL_getmetatable(L, "luv_listen_group");
+  lua_setmetatable(L, -2);
+  lua_newtable(L);
+  lua_pushvalue(L, -1);
+  ref->threads = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  for (i = 1; i <= count; i++) {
+    luv_loop_thread_t* lt = luv_loop_thread_new(L, &ret);
+    if (!lt) {
+      luv_listen_group_stop_all(L, ref, 0, 0);
+      return luv_error(L, ret);
+    }
+    lt->setup = luv_listen_group_setup;
+    lt->stopping = luv_listen_group_stopping;
+    lt->shard = &group->shards[i - 1];
+    lt->shared = luv_shared_retain(&group->shared);
+    // init gets the 1-based index of its shard
+    lua_pushinteger(L, i);
+    lua_pushvalue(L, code);
+    ret = luv_thread_start(L, lua_gettop(L) - 1, NULL, luv_loop_thread_cb, lt);
+    if (ret != 1) {
+      // the thread never ran to release it
+      lt->shared = NULL;
+      luv_shared_release(&group->shared);
+      luv_listen_group_stop_all(L, ref, 0, 0);
+      return ret;
+    }
+    lua_rawseti(L, -3, i);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+  return 1;
+}
+
+static int luv_listen_group_stop(lua_State* L) {
+  luv_listen_group_ref_t* ref = luv_check_listen_group(L, 1);
+  lua_Integer timeout = luaL_optinteger(L, 2, LUV_LISTEN_GROUP_GRACE);
+  luaL_argcheck(L, timeout >= 0, 2, "timeout must be >= 0");
+  luv_listen_group_stop_all(L, ref, 1, (uint64_t)timeout);
+  return 0;
+}
+
+static void luv_listen_group_push_metrics(lua_State* L, lua_Integer accepted, lua_Integer errors, int listening, int running) {
+  lua_pushinteger(L, accepted);
+  lua_setfield(L, -2, "accepted");
+  lua_pushinteger(L, errors);
+  lua_setfield(L, -2, "errors");
+  lua_pushinteger(L, listening);
+  lua_setfield(L, -2, "listening");
+  lua_pushinteger(L, running);
+  lua_setfield(L, -2, "running");
+}
+
+static int luv_listen_group_metrics(lua_State* L) {
+  luv_listen_group_ref_t* ref = luv_check_listen_group(L, 1);
+  luv_listen_group_t* group = ref->group;
+  lua_Integer accepted = 0, errors = 0;
+  int listening = 0, running = 0;
+  int i;
+
+  lua_newtable(L);
+  lua_createtable(L, group->count, 0);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, ref->threads);
+  for (i = 0; i < group->count; i++) {
+    luv_listen_shard_t* shard = &group->shards[i];
+    lua_Integer shard_accepted = luv_atomic_load(&shard->accepted);
+    lua_Integer shard_errors = luv_atomic_load(&shard->errors);
+    luv_thread_t* thread;
+    int alive = 0, listens;
+    lua_rawgeti(L, -1, i + 1);
+    thread = (luv_thread_t*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (thread && thread->loop) {
+      uv_mutex_lock(&thread->loop->mutex);
+      alive = thread->loop->state < LUV_LOOP_THREAD_STOPPED;
+      uv_mutex_unlock(&thread->loop->mutex);
+    }
+    // a forced stop leaves the flag set
+    listens = alive && luv_atomic_load(&shard->listening);
+    accepted += shard_accepted;
+    errors += shard_errors;
+    listening += listens;
+    running += alive;
+    lua_createtable(L, 0, 4);
+    luv_listen_group_push_metrics(L, shard_accepted, shard_errors, listens, alive);
+    lua_rawseti(L, -3, i + 1);
+  }
+  lua_pop(L, 1);
+  lua_setfield(L, -2, "shards");
+  luv_listen_group_push_metrics(L, accepted, errors, listening, running);
+  return 1;
+}
+
+static int luv_listen_group_threads(lua_State* L) {
+  luv_listen_group_ref_t* ref = luv_check_listen_group(L, 1);
+  int i;
+  lua_createtable(L, ref->group->count, 0);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, ref->threads);
+  for (i = 1; i <= ref->group->count; i++) {
+    lua_rawgeti(L, -1, i);
+    lua_rawseti(L, -3, i);
+  }
+  lua_pop(L, 1);
+  return 1;
+}
+
+static int luv_listen_group_getsockname(lua_State* L) {
+  luv_listen_group_ref_t* ref = luv_check_listen_group(L, 1);
+  parse_sockaddr(L, &ref->group->addr);
   return 1;
 }
 
+static int luv_listen_group_gc(lua_State* L) {
+  luv_listen_group_ref_t* ref = luv_check_listen_group(L, 1);
+  if (!ref->group)
+    return 0;
+  // let the shards finish the connections they have for a while, idle
+  // keep-alive connections would hold them forever
+  luv_listen_group_stop_all(L, ref, 1, LUV_LISTEN_GROUP_GRACE);
+  luaL_unref(L, LUA_REGISTRYINDEX, ref->threads);
+  luv_shared_release(&ref->group->shared);
+  ref->group = NULL;
+  return 0;
+}
+
+static const luaL_Reg luv_listen_group_methods[] = {
+  {"stop", luv_listen_group_stop},
+  {"metrics", luv_listen_group_metrics},
+  {"threads", luv_listen_group_threads},
+  {"getsockname", luv_listen_group_getsockname},
+  {NULL, NULL}
+};
+
 #if LUV_UV_VERSION_GEQ(1, 45, 0)
 static int luv_thread_getaffinity(lua_State* L) {
   luv_thread_t* tid = luv_check_thread(L, 1);
@@ -625,6 +2282,8 @@ static int luv_thread_equal(lua_State* L) {
 static const luaL_Reg luv_thread_methods[] = {
   {"equal", luv_thread_equal},
   {"join", luv_thread_join},
+  {"post", luv_thread_post},
+  {"stop", luv_thread_stop},
 #if LUV_UV_VERSION_GEQ(1, 45, 0)
   {"getaffinity", luv_thread_getaffinity},
   {"setaffinity", luv_thread_setaffinity},
@@ -654,6 +2313,14 @@ static void luv_thread_init(lua_State* L) {
   lua_setfield(L, -2, "__index");
   lua_pop(L, 1);
 
+  luaL_newmetatable(L, "luv_listen_group");
+  lua_pushcfunction(L, luv_listen_group_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_newtable(L);
+  luaL_setfuncs(L, luv_listen_group_methods, 0);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
   if (acquire_vm_cb == NULL) acquire_vm_cb = luv_thread_acquire_vm;
   if (release_vm_cb == NULL) release_vm_cb = luv_thread_release_vm;
 }
@@ -16,33 +16,177 @@
 */
 #include "private.h"
 
+#define LUV_WORK_EVICT_RING 64
+/* log2 buckets of microseconds, the last one is open ended */
+#define LUV_WORK_HIST_BUCKETS 24
+
 typedef struct {
   lua_State** vms;
   unsigned int nvms;
   unsigned int idx_vms;
   uv_mutex_t vm_mutex;
+
+  /* set with uv.set_work_init, protected by vm_mutex */
+  char* init_code;
+  size_t init_len;
+  unsigned int init_gen; /* bumped on every change, states rerun init */
+
+  /* ids of collected work ctxs, protected by vm_mutex. States drop them from
+     their function cache before the next job, or clear the whole cache if
+     they fell more than LUV_WORK_EVICT_RING ids behind. */
+  lua_Integer evicted[LUV_WORK_EVICT_RING];
+  unsigned int evict_seq;
+
+  /* Lua heap of each state after its last job, protected by vm_mutex */
+  size_t* heaps;
+
+  /* owners, the Lua state and each of its work pools, protected by
+     work_mutex. Released with the last one, as pool threads use it. */
+  unsigned int refs;
 } luv_work_vms_t;
 
+/* Job counters, protected by work_mutex. Kept per ctx and for the process. */
+typedef struct {
+  int64_t queued;
+  int64_t running;
+  uint64_t completed;
+  uint64_t errors;
+  uint64_t cancelled;
+  uint64_t wait_total;  /* ns */
+  uint64_t run_total;   /* ns */
+  uint64_t wait_hist[LUV_WORK_HIST_BUCKETS];
+  uint64_t run_hist[LUV_WORK_HIST_BUCKETS];
+} luv_work_metrics_t;
+
+typedef struct luv_work_warm_s luv_work_warm_t;
+typedef struct luv_work_batch_s luv_work_batch_t;
+
+typedef struct luv_work_pool_s luv_work_pool_t;
+typedef struct luv_work_progress_s luv_work_progress_t;
+
 typedef struct {
   lua_State* L;       /* vm in main */
   char* code;         /* thread entry code */
   size_t len;
+  lua_Integer id;     /* key of the compiled code in the worker states */
 
   int after_work_cb;  /* ref, run in main ,call after work cb*/
   luv_work_vms_t* vms; /* userdata owned by L, so parent thread can clean up old states */
+  luv_work_pool_t* pool; /* NULL to run in the libuv threadpool */
+  int pool_ref;       /* ref to the pool userdata, keeps it alive */
+  int progress_cb;    /* ref to on_progress */
+  luv_work_progress_t* progress; /* NULL without on_progress */
+  luv_work_metrics_t metrics;
+  int map;            /* jobs map the function over a chunk, for parallel_map */
 } luv_work_ctx_t;
 
-typedef struct {
+typedef struct luv_work_s {
   uv_work_t work;
   luv_work_ctx_t* ctx;
 
   luv_thread_arg_t args;
   luv_thread_arg_t rets;
   int ref;            /* ref to luv_work_ctx_t, which create a new uv_work_t*/
+
+  struct luv_work_s* next; /* link in a work pool queue */
+  uint64_t queued;    /* hrtime when queued in a work pool */
+  luv_work_warm_t* warm; /* set instead of ctx for warm up jobs */
+  luv_work_batch_t* batch; /* set for jobs from queue_many */
+  lua_Integer index;  /* position in the batch */
+  struct luv_work_s** handle; /* userdata returned by queue, NULL once collected */
+  int status;         /* UV_ECANCELED once cancelled in a work pool */
+  int failed;         /* work_callback raised an error */
 } luv_work_t;
 
+/* Jobs queued together with work_ctx:queue_many share one allocation and one
+   set of refs. The arguments are borrowed from a private copy of args_list. */
+struct luv_work_batch_s {
+  lua_State* L;
+  luv_work_t* items;
+  size_t remaining;
+  int ctx_ref;
+  int args_ref;
+  int results_ref;    /* results array, only when there is an on_done */
+  int each_ref;
+  int done_ref;
+  int aborted;        /* queueing failed, the jobs are released silently */
+};
+
+/* A work pool runs jobs on its own threads instead of the libuv threadpool,
+   each thread with a Lua state that lives as long as the pool. Jobs are handed
+   over through a mutex protected queue, and completed jobs go back to the loop
+   through the async handle. */
+struct luv_work_pool_s {
+  uv_async_t async;   /* must be first, data is left NULL */
+  uv_mutex_t mutex;
+  uv_cond_t cond;
+  uv_thread_t* threads;
+  unsigned int nthreads;
+  char* name;
+  int priority;
+  int has_priority;
+  int stopping;
+  int warming;
+  luv_work_vms_t vms;
+  luv_work_vms_t* init_vms; /* global vms of the owning state, holds the init code */
+
+  /* protected by mutex */
+  luv_work_t* head;   /* queued jobs */
+  luv_work_t* tail;
+  luv_work_t* done_head; /* completed jobs, waiting for the loop */
+  luv_work_t* done_tail;
+  unsigned int depth;
+  unsigned int running;
+  uint64_t completed;
+  uint64_t wait_total;
+  uint64_t wait_max;
+  uint64_t run_total;
+  uint64_t run_max;
+
+  unsigned int pending; /* loop thread only, jobs not yet delivered */
+};
+
+/* Values from uv.work_report() travel to the loop in a mutex protected queue
+   and wake it through the async handle. after_work flushes the queue of its
+   ctx first, so they arrive in order and before the result of their job. */
+typedef struct luv_work_msg_s {
+  struct luv_work_msg_s* next;
+  luv_thread_arg_t args;
+} luv_work_msg_t;
+
+struct luv_work_progress_s {
+  uv_async_t async;   /* must be first, data is left NULL */
+  uv_mutex_t mutex;
+  luv_work_msg_t* head;
+  luv_work_msg_t* tail;
+  luv_work_ctx_t* ctx;
+};
+
+/* Warm up jobs, one per thread. The barrier holds every job until all of them
+   have started, so each lands on a different thread. */
+struct luv_work_warm_s {
+  uv_barrier_t barrier;
+  luv_work_vms_t* vms; /* holds the init code */
+  luv_work_pool_t* pool; /* NULL for the libuv threadpool */
+  unsigned int remaining;
+  lua_State* L;
+  int cb_ref;
+  int pool_ref;
+};
+
 static uv_once_t once_vmkey = UV_ONCE_INIT;
 static uv_key_t tls_vmkey;  /* thread local storage key for Lua state */
+/* process wide work state, shared by all Lua states. The libuv threadpool is
+   shared too, so only one warm up may hold its threads at a time. */
+static uv_mutex_t work_mutex;
+static int warming;
+static lua_Integer last_ctx_id;
+static char luv_work_cache_key; /* registry key of the per state function cache */
+static char luv_work_report_key; /* registry key of the job running in a state */
+static char luv_work_owner_key; /* registry keys of the vms a state belongs to, */
+static char luv_work_index_key; /* and of its position there */
+static luv_work_metrics_t work_metrics; /* protected by work_mutex */
+static unsigned int threadpool_size; /* set once, with tls_vmkey */
 
 #if LUV_UV_VERSION_GEQ(1, 30, 0)
 #define MAX_THREADPOOL_SIZE 1024
@@ -50,15 +194,126 @@ static uv_key_t tls_vmkey;  /* thread local storage key for Lua state */
 #define MAX_THREADPOOL_SIZE 128
 #endif
 
+/* ref to https://github.com/libuv/libuv/blob/v1.x/src/threadpool.c init_threads */
+static unsigned int luv_work_threadpool_env(void) {
+  const char* val;
+  unsigned int size = 4;
+  val = getenv("UV_THREADPOOL_SIZE");
+  if (val != NULL)
+    size = atoi(val);
+  if (size == 0)
+    size = 1;
+  if (size > MAX_THREADPOOL_SIZE)
+    size = MAX_THREADPOOL_SIZE;
+  return size;
+}
+
+/* libuv reads the environment once, when the threadpool is first used. The
+   size is recorded when luv is first opened, before it queues anything, so
+   later changes to UV_THREADPOOL_SIZE can't make warm ups wait for threads
+   that don't exist. */
+static unsigned int luv_work_threadpool_size(void) {
+  return threadpool_size;
+}
+
 static luv_work_ctx_t* luv_check_work_ctx(lua_State* L, int index) {
   luv_work_ctx_t* ctx = (luv_work_ctx_t*)luaL_checkudata(L, index, "luv_work_ctx");
   return ctx;
 }
 
+static void luv_work_progress_free(uv_handle_t* handle) {
+  luv_work_progress_t* progress = (luv_work_progress_t*)handle;
+  uv_mutex_destroy(&progress->mutex);
+  free(progress);
+}
+
+// Delivers the queued messages of ctx to on_progress.
+static void luv_work_progress_flush(luv_work_ctx_t* ctx) {
+  luv_work_progress_t* progress = ctx->progress;
+  lua_State* L = ctx->L;
+  luv_ctx_t* lctx = luv_context(L);
+  luv_work_msg_t* msg;
+
+  uv_mutex_lock(&progress->mutex);
+  msg = progress->head;
+  progress->head = progress->tail = NULL;
+  uv_mutex_unlock(&progress->mutex);
+
+  while (msg) {
+    luv_work_msg_t* next = msg->next;
+    int i;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->progress_cb);
+    i = luv_thread_arg_push(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+    lctx->cb_pcall(L, i, 0, 0);
+    luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+    luv_thread_arg_free(&msg->args);
+    free(msg);
+    msg = next;
+  }
+}
+
+static void luv_work_progress_async_cb(uv_async_t* handle) {
+  luv_work_progress_t* progress = (luv_work_progress_t*)handle;
+  luv_work_progress_flush(progress->ctx);
+}
+
+// Runs in a worker, sends its arguments to on_progress of the running job.
+static int luv_work_report(lua_State* L) {
+  luv_work_t* work;
+  luv_work_progress_t* progress;
+  luv_work_msg_t* msg;
+  int ret;
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_report_key);
+  work = (luv_work_t*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (!work)
+    return luaL_error(L, "work_report must be called from a work callback");
+  progress = work->ctx->progress;
+  if (!progress)
+    return 0;
+
+  msg = (luv_work_msg_t*)calloc(1, sizeof(*msg));
+  if (!msg)
+    return luaL_error(L, "Failed to allocate work report");
+  ret = luv_thread_arg_set(L, &msg->args, 1, lua_gettop(L),
+      LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_CHILD);
+  // the loop side frees copies that were made in async mode
+  luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_CHILD);
+  if (ret < 0) {
+    luv_thread_arg_clear(L, &msg->args, LUVF_THREAD_SIDE_MAIN);
+    luv_thread_arg_free(&msg->args);
+    free(msg);
+    return luv_thread_arg_error(L);
+  }
+
+  uv_mutex_lock(&progress->mutex);
+  if (progress->tail)
+    progress->tail->next = msg;
+  else
+    progress->head = msg;
+  progress->tail = msg;
+  uv_mutex_unlock(&progress->mutex);
+  uv_async_send(&progress->async);
+  return 0;
+}
+
 static int luv_work_ctx_gc(lua_State *L) {
   luv_work_ctx_t* ctx = luv_check_work_ctx(L, 1);
+  luv_work_vms_t* vms = ctx->vms;
+  uv_mutex_lock(&vms->vm_mutex);
+  vms->evicted[vms->evict_seq % LUV_WORK_EVICT_RING] = ctx->id;
+  vms->evict_seq++;
+  uv_mutex_unlock(&vms->vm_mutex);
+
   free(ctx->code);
   luaL_unref(L, LUA_REGISTRYINDEX, ctx->after_work_cb);
+  luaL_unref(L, LUA_REGISTRYINDEX, ctx->pool_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, ctx->progress_cb);
+  // every job flushed its messages, and at loop shutdown the handle may
+  // already be closed by loop_gc
+  if (ctx->progress && !uv_is_closing((uv_handle_t*)&ctx->progress->async))
+    uv_close((uv_handle_t*)&ctx->progress->async, luv_work_progress_free);
 
   return 0;
 }
@@ -69,6 +324,50 @@ static int luv_work_ctx_tostring(lua_State* L) {
   return 1;
 }
 
+static void luv_work_push_cache(lua_State* L) {
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_cache_key);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &luv_work_cache_key);
+  }
+}
+
+static int luv_work_map_loop(lua_State* L) {
+  lua_Integer i, n = (lua_Integer)lua_rawlen(L, 2);
+  lua_createtable(L, (int)n, 0);
+  for (i = 1; i <= n; i++) {
+    lua_pushvalue(L, 1);
+    lua_rawgeti(L, 2, i);
+    lua_call(L, 1, 1);
+    lua_rawseti(L, 3, i);
+  }
+  return 1;
+}
+
+// Calls fn on each item of a chunk from uv.parallel_map. Returns the array of
+// results, or on error marks the job failed and returns the error message so
+// the loop side can report it.
+static int luv_work_map_chunk(lua_State* L) {
+  luv_work_t* work;
+  lua_pushcfunction(L, luv_work_map_loop);
+  lua_insert(L, 1);
+  lua_settop(L, 3);
+  if (lua_pcall(L, 2, 1, 0) == 0)
+    return 1;
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_report_key);
+  work = (luv_work_t*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (work)
+    work->failed = 1;
+  if (!lua_isstring(L, -1)) {
+    lua_pop(L, 1);
+    lua_pushliteral(L, "error object is not a string");
+  }
+  return 1;
+}
+
 static int luv_work_cb(lua_State* L) {
   uv_work_t* req = lua_touserdata(L, 1);
   luv_work_t* work = (luv_work_t*)req->data;
@@ -78,31 +377,39 @@ static int luv_work_cb(lua_State* L) {
 
   int top = lua_gettop(L);
 
-  /* push lua function */
-  lua_pushlstring(L, ctx->code, ctx->len);
-  lua_rawget(L, LUA_REGISTRYINDEX);
+  /* push lua function, compiled once per state and cached by ctx id */
+  luv_work_push_cache(L);
+  lua_rawgeti(L, -1, ctx->id);
   if (lua_isnil(L, -1)) {
     lua_pop(L, 1);
 
-    lua_pushlstring(L, ctx->code, ctx->len);
     if (luaL_loadbuffer(L, ctx->code, ctx->len, "=pool") != 0)
     {
       fprintf(stderr, "Uncaught Error in work callback: %s\n", lua_tostring(L, -1));
-      lua_pop(L, 2);
+      lua_pop(L, 1);
 
       lua_pushnil(L);
     } else {
       lua_pushvalue(L, -1);
-      lua_insert(L, lua_gettop(L) - 2);
-      lua_rawset(L, LUA_REGISTRYINDEX);
+      lua_rawseti(L, -3, ctx->id);
     }
   }
+  lua_remove(L, -2);
 
   if (lua_isfunction(L, -1)) {
-    int i = luv_thread_arg_push(L, &work->args, LUVF_THREAD_SIDE_CHILD);
+    int i;
+    if (ctx->map) {
+      lua_pushcfunction(L, luv_work_map_chunk);
+      lua_insert(L, -2);
+    }
+    i = luv_thread_arg_push(L, &work->args, LUVF_THREAD_SIDE_CHILD);
+    if (ctx->map)
+      i++;  // the function is the first argument of luv_work_map_chunk
     // If exit is called on a thread in the thread pool, abort is called in
     // uv__threadpool_cleanup, so exit is not called in luv_cfpcall.
     i = lctx->thrd_pcall(L, i, LUA_MULTRET, LUVF_CALLBACK_NOEXIT);
+    if (i < 0)
+      work->failed = 1;
     if ( i>=0 ) {
       //clear in main threads, luv_after_work_cb
       i = luv_thread_arg_set(L, &work->rets, top + 1, lua_gettop(L),
@@ -125,84 +432,402 @@ static int luv_work_cb(lua_State* L) {
   return LUA_OK;
 }
 
-static lua_State* luv_work_acquire_vm(luv_work_vms_t* vms)
-{
-  lua_State* L = uv_key_get(&tls_vmkey);
-  if (L == NULL)
-  {
-    L = acquire_vm_cb();
-    uv_key_set(&tls_vmkey, L);
-    lua_pushboolean(L, 1);
-    lua_setglobal(L, "_THREAD");
-
-    uv_mutex_lock(&vms->vm_mutex);
-    if (vms->idx_vms >= vms->nvms) {
-      unsigned int new_nvms = vms->nvms * 2;
+static int luv_work_vms_init(luv_work_vms_t* vms, unsigned int nvms) {
+  int status = uv_mutex_init(&vms->vm_mutex);
+  if (status != 0)
+    return status;
+  vms->init_code = NULL;
+  vms->init_len = 0;
+  vms->init_gen = 0;
+  vms->evict_seq = 0;
+  vms->vms = (lua_State**)calloc(nvms, sizeof(lua_State*));
+  vms->heaps = (size_t*)calloc(nvms, sizeof(size_t));
+  if (!vms->vms || !vms->heaps) {
+    free(vms->vms);
+    free(vms->heaps);
+    uv_mutex_destroy(&vms->vm_mutex);
+    return UV_ENOMEM;
+  }
+  vms->nvms = nvms;
+  vms->idx_vms = 0;
+  vms->refs = 1;
+  return 0;
+}
 
-      lua_State **new_vms= realloc(vms->vms, sizeof(lua_State*) * new_nvms);
-      if (!new_vms) {
-        uv_mutex_unlock(&vms->vm_mutex);
-        return L; // we failed to realloc, so we will leak this vm, but we have no choice at this point
-      }
-      vms->vms = new_vms;
-      vms->nvms = new_nvms;
+// Records a newly created worker state so the owner can release it later.
+static void luv_work_vms_add(luv_work_vms_t* vms, lua_State* L) {
+  uv_mutex_lock(&vms->vm_mutex);
+  if (vms->idx_vms >= vms->nvms) {
+    unsigned int new_nvms = vms->nvms * 2;
 
-      for (unsigned int i = vms->idx_vms; i < vms->nvms; i++) {
-        vms->vms[i] = NULL;
-      }
+    lua_State **new_vms= realloc(vms->vms, sizeof(lua_State*) * new_nvms);
+    size_t* new_heaps;
+    if (!new_vms) {
+      uv_mutex_unlock(&vms->vm_mutex);
+      return; // we failed to realloc, so we will leak this vm, but we have no choice at this point
     }
+    vms->vms = new_vms;
+    new_heaps = realloc(vms->heaps, sizeof(size_t) * new_nvms);
+    if (!new_heaps) {
+      uv_mutex_unlock(&vms->vm_mutex);
+      return;
+    }
+    vms->heaps = new_heaps;
+    vms->nvms = new_nvms;
 
-    vms->vms[vms->idx_vms] = L;
-    vms->idx_vms += 1;
-    
-    uv_mutex_unlock(&vms->vm_mutex);
+    for (unsigned int i = vms->idx_vms; i < vms->nvms; i++) {
+      vms->vms[i] = NULL;
+      vms->heaps[i] = 0;
+    }
   }
-  return L;
+
+  // the state reports its heap size to its slot after each job
+  lua_pushlightuserdata(L, vms);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &luv_work_owner_key);
+  lua_pushinteger(L, vms->idx_vms);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &luv_work_index_key);
+
+  vms->vms[vms->idx_vms] = L;
+  vms->idx_vms += 1;
+
+  uv_mutex_unlock(&vms->vm_mutex);
 }
 
-static int luv_work_cleanup(lua_State *L)
-{
+static void luv_work_vms_release(luv_work_vms_t* vms) {
   unsigned int i;
-  luv_work_vms_t *vms = (luv_work_vms_t*)lua_touserdata(L, 1);
-  
-  if (!vms || vms->nvms == 0)
-    return 0;
+
+  if (vms->nvms == 0)
+    return;
 
   for (i = 0; i < vms->nvms && vms->vms[i]; i++)
     release_vm_cb(vms->vms[i]);
 
   free(vms->vms);
+  free(vms->heaps);
+  free(vms->init_code);
 
   uv_mutex_destroy(&vms->vm_mutex);
   vms->nvms = 0;
+}
+
+static void luv_work_vms_unref(luv_work_vms_t* vms) {
+  unsigned int refs;
+  uv_mutex_lock(&work_mutex);
+  refs = --vms->refs;
+  uv_mutex_unlock(&work_mutex);
+  if (refs == 0)
+    luv_work_vms_release(vms);
+}
+
+// Brings a worker state up to date with its owner before a job: drops the
+// compiled functions of collected ctxs and runs the init function set with
+// uv.set_work_init if this state has not run the current one yet.
+static void luv_work_vm_sync(lua_State* L, luv_work_vms_t* vms) {
+  lua_Integer evicted[LUV_WORK_EVICT_RING];
+  unsigned int gen, seq, nevicted = 0, i;
+  int clear = 0;
+  int ret = -1;
+
+  // the last seen init gen and evict seq are kept in the state's registry
+  lua_rawgetp(L, LUA_REGISTRYINDEX, vms);
+  gen = (unsigned int)lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &vms->evict_seq);
+  seq = (unsigned int)lua_tointeger(L, -1);
+  lua_pop(L, 1);
+
+  uv_mutex_lock(&vms->vm_mutex);
+  if (gen == vms->init_gen && seq == vms->evict_seq) {
+    uv_mutex_unlock(&vms->vm_mutex);
+    return;
+  }
+  if (vms->evict_seq - seq > LUV_WORK_EVICT_RING) {
+    clear = 1;
+  }
+  else {
+    for (; seq != vms->evict_seq; seq++)
+      evicted[nevicted++] = vms->evicted[seq % LUV_WORK_EVICT_RING];
+  }
+  seq = vms->evict_seq;
+  if (gen != vms->init_gen) {
+    gen = vms->init_gen;
+    if (vms->init_code)
+      ret = luaL_loadbuffer(L, vms->init_code, vms->init_len, "=init");
+  }
+  uv_mutex_unlock(&vms->vm_mutex);
+
+  lua_pushinteger(L, gen);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, vms);
+  lua_pushinteger(L, seq);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &vms->evict_seq);
+
+  if (clear) {
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &luv_work_cache_key);
+  }
+  else if (nevicted > 0) {
+    luv_work_push_cache(L);
+    for (i = 0; i < nevicted; i++) {
+      lua_pushnil(L);
+      lua_rawseti(L, -2, evicted[i]);
+    }
+    lua_pop(L, 1);
+  }
+
+  if (ret < 0)
+    return;
+  if (ret != 0) {
+    fprintf(stderr, "Uncaught Error in work init: %s\n", lua_tostring(L, -1));
+    lua_pop(L, 1);
+    return;
+  }
+  luv_context(L)->thrd_pcall(L, 0, 0, LUVF_CALLBACK_NOEXIT);
+}
+
+static lua_State* luv_work_new_vm(luv_work_vms_t* vms) {
+  lua_State* L = acquire_vm_cb();
+  lua_pushboolean(L, 1);
+  lua_setglobal(L, "_THREAD");
+  luv_work_vms_add(vms, L);
+  return L;
+}
+
+static lua_State* luv_work_acquire_vm(luv_work_vms_t* vms)
+{
+  lua_State* L = uv_key_get(&tls_vmkey);
+  if (L == NULL)
+  {
+    L = luv_work_new_vm(vms);
+    uv_key_set(&tls_vmkey, L);
+  }
+  return L;
+}
+
+static int luv_work_cleanup(lua_State *L)
+{
+  luv_work_vms_t *vms = (luv_work_vms_t*)lua_touserdata(L, 1);
+
+  // pools collected after this still hold it
+  if (vms)
+    luv_work_vms_unref(vms);
   return 0;
 }
 
-static void luv_work_cb_wrapper(uv_work_t* req) {
-  luv_work_t* work =  (luv_work_t*)req->data;
-  lua_State *L = luv_work_acquire_vm(work->ctx->vms);
+static unsigned int luv_work_hist_bucket(uint64_t ns) {
+  uint64_t us = ns / 1000;
+  unsigned int bucket = 0;
+  while (us && bucket < LUV_WORK_HIST_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+// Counts n jobs of ctx as queued, or un-queues them with a negative n.
+static void luv_work_metrics_queue(luv_work_ctx_t* ctx, int n) {
+  uv_mutex_lock(&work_mutex);
+  ctx->metrics.queued += n;
+  work_metrics.queued += n;
+  uv_mutex_unlock(&work_mutex);
+}
+
+static void luv_work_metrics_start(luv_work_ctx_t* ctx, uint64_t wait) {
+  luv_work_metrics_t* all[2];
+  int i;
+  all[0] = &ctx->metrics;
+  all[1] = &work_metrics;
+  uv_mutex_lock(&work_mutex);
+  for (i = 0; i < 2; i++) {
+    all[i]->queued--;
+    all[i]->running++;
+    all[i]->wait_total += wait;
+    all[i]->wait_hist[luv_work_hist_bucket(wait)]++;
+  }
+  uv_mutex_unlock(&work_mutex);
+}
+
+static void luv_work_metrics_end(luv_work_ctx_t* ctx, uint64_t run, int failed) {
+  luv_work_metrics_t* all[2];
+  int i;
+  all[0] = &ctx->metrics;
+  all[1] = &work_metrics;
+  uv_mutex_lock(&work_mutex);
+  for (i = 0; i < 2; i++) {
+    all[i]->running--;
+    if (failed)
+      all[i]->errors++;
+    else
+      all[i]->completed++;
+    all[i]->run_total += run;
+    all[i]->run_hist[luv_work_hist_bucket(run)]++;
+  }
+  uv_mutex_unlock(&work_mutex);
+}
+
+static void luv_work_metrics_cancel(luv_work_ctx_t* ctx) {
+  uv_mutex_lock(&work_mutex);
+  ctx->metrics.queued--;
+  ctx->metrics.cancelled++;
+  work_metrics.queued--;
+  work_metrics.cancelled++;
+  uv_mutex_unlock(&work_mutex);
+}
+
+// Stores the heap size of a worker state in the vms it belongs to.
+static void luv_work_record_heap(lua_State* L) {
+  luv_work_vms_t* vms;
+  lua_Integer idx;
+  size_t heap;
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_owner_key);
+  vms = (luv_work_vms_t*)lua_touserdata(L, -1);
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_index_key);
+  idx = lua_tointeger(L, -1);
+  lua_pop(L, 2);
+  if (!vms)
+    return;
+
+  heap = (size_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + (size_t)lua_gc(L, LUA_GCCOUNTB, 0);
+  uv_mutex_lock(&vms->vm_mutex);
+  if (idx >= 0 && (unsigned int)idx < vms->idx_vms)
+    vms->heaps[idx] = heap;
+  uv_mutex_unlock(&vms->vm_mutex);
+}
+
+static void luv_work_run(lua_State* L, luv_work_t* work) {
   luv_ctx_t* lctx = luv_context(L);
+  uint64_t start;
 
+  if (work->warm) {
+    luv_work_vm_sync(L, work->warm->vms);
+    uv_barrier_wait(&work->warm->barrier);
+    return;
+  }
+  luv_work_vm_sync(L, work->ctx->vms);
+  start = uv_hrtime();
+  luv_work_metrics_start(work->ctx, start - work->queued);
+
+  // uv.work_report() finds the job here
+  lua_pushlightuserdata(L, work);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &luv_work_report_key);
   // If exit is called on a thread in the thread pool, abort is called in
   // uv__threadpool_cleanup, so exit is not called in luv_cfpcall.
-  int i = lctx->thrd_cpcall(L, luv_work_cb, (void*)req, LUVF_CALLBACK_NOEXIT);
+  int i = lctx->thrd_cpcall(L, luv_work_cb, (void*)&work->work, LUVF_CALLBACK_NOEXIT);
+  lua_pushnil(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &luv_work_report_key);
   if (i != LUA_OK) {
+    work->failed = 1;
     luv_thread_arg_clear(L, &work->rets, LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_CHILD);
     luv_thread_arg_clear(L, &work->args, LUVF_THREAD_SIDE_CHILD);
   }
+  luv_work_metrics_end(work->ctx, uv_hrtime() - start, work->failed);
+  luv_work_record_heap(L);
+}
+
+static void luv_work_cb_wrapper(uv_work_t* req) {
+  luv_work_t* work =  (luv_work_t*)req->data;
+  lua_State *L = luv_work_acquire_vm(work->warm ? work->warm->vms : work->ctx->vms);
+  luv_work_run(L, work);
+}
+
+static void luv_work_warm_done(luv_work_t* work);
+
+static void luv_work_batch_free(lua_State* L, luv_work_batch_t* batch) {
+  luaL_unref(L, LUA_REGISTRYINDEX, batch->ctx_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, batch->args_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, batch->results_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, batch->each_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, batch->done_ref);
+  free(batch->items);
+  free(batch);
+}
+
+static void luv_work_batch_done(luv_work_t* work, int status) {
+  luv_work_batch_t* batch = work->batch;
+  lua_State* L = batch->L;
+  luv_ctx_t* lctx = luv_context(L);
+  int top = lua_gettop(L);
+  int i;
+
+  if (status == UV_ECANCELED)
+    luv_work_metrics_cancel(work->ctx);
+  if (batch->aborted) {
+    luv_thread_arg_clear(L, &work->args, LUVF_THREAD_SIDE_MAIN);
+    luv_thread_arg_clear(L, &work->rets, LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_MAIN);
+    luv_thread_arg_free(&work->rets);
+    if (--batch->remaining == 0)
+      luv_work_batch_free(L, batch);
+    return;
+  }
+
+  i = luv_thread_arg_push(L, &work->rets, LUVF_THREAD_SIDE_MAIN);
+  if (batch->results_ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, batch->results_ref);
+    if (i > 0)
+      lua_pushvalue(L, top + 1);
+    else
+      lua_pushnil(L);
+    lua_rawseti(L, -2, work->index);
+    lua_pop(L, 1);
+  }
+  if (batch->each_ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, batch->each_ref);
+    lua_insert(L, top + 1);
+    lua_pushinteger(L, work->index);
+    lua_insert(L, top + 2);
+    lctx->cb_pcall(L, i + 1, 0, 0);
+  }
+  else {
+    lua_settop(L, top);
+  }
+  luv_thread_arg_clear(L, &work->args, LUVF_THREAD_SIDE_MAIN);
+  luv_thread_arg_clear(L, &work->rets, LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_MAIN);
+  luv_thread_arg_free(&work->rets);
+
+  if (--batch->remaining > 0)
+    return;
+  if (batch->done_ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, batch->done_ref);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, batch->results_ref);
+    luv_work_batch_free(L, batch);
+    lctx->cb_pcall(L, 1, 0, 0);
+  }
+  else {
+    luv_work_batch_free(L, batch);
+  }
 }
 
 static void luv_after_work_cb(uv_work_t* req, int status) {
   luv_work_t* work = (luv_work_t*)req->data;
   luv_work_ctx_t* ctx = work->ctx;
-  lua_State* L = ctx->L;
-  luv_ctx_t *lctx = luv_context(L);
+  lua_State* L;
+  luv_ctx_t *lctx;
   int i;
 
-  (void)status;
+  if (work->warm) {
+    luv_work_warm_done(work);
+    return;
+  }
+  if (ctx->progress)
+    luv_work_progress_flush(ctx);
+  if (work->batch) {
+    luv_work_batch_done(work, status);
+    return;
+  }
+  L = ctx->L;
+  lctx = luv_context(L);
+  if (work->handle)
+    *work->handle = NULL;
 
   lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->after_work_cb);
-  i = luv_thread_arg_push(L, &work->rets, LUVF_THREAD_SIDE_MAIN);
+  if (status == UV_ECANCELED) {
+    // the job never ran, so its arguments were only set on this side
+    luv_work_metrics_cancel(ctx);
+    i = luv_error(L, status);
+  }
+  else {
+    i = luv_thread_arg_push(L, &work->rets, LUVF_THREAD_SIDE_MAIN);
+  }
   lctx->cb_pcall(L, i, 0, 0);
 
   //ref down to ctx, up in luv_queue_work()
@@ -211,13 +836,480 @@ static void luv_after_work_cb(uv_work_t* req, int status) {
 
   luv_thread_arg_clear(L, &work->args, LUVF_THREAD_SIDE_MAIN);
   luv_thread_arg_clear(L, &work->rets, LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_MAIN);
+  luv_thread_arg_free(&work->args);
+  luv_thread_arg_free(&work->rets);
   free(work);
 }
 
+static luv_work_pool_t* luv_check_work_pool(lua_State* L, int index) {
+  luv_work_pool_t** udata = (luv_work_pool_t**)luaL_checkudata(L, index, "luv_work_pool");
+  luaL_argcheck(L, *udata != NULL, index, "Expected luv_work_pool_t");
+  return *udata;
+}
+
+static void luv_work_pool_thread(void* arg) {
+  luv_work_pool_t* pool = (luv_work_pool_t*)arg;
+  lua_State* L = luv_work_new_vm(&pool->vms);
+  luv_work_vm_sync(L, pool->init_vms);
+
+#if LUV_UV_VERSION_GEQ(1, 48, 0)
+  if (pool->has_priority)
+    uv_thread_setpriority(uv_thread_self(), pool->priority);
+#endif
+#if LUV_UV_VERSION_GEQ(1, 50, 0)
+  if (pool->name)
+    uv_thread_setname(pool->name);
+#endif
+
+  uv_mutex_lock(&pool->mutex);
+  for (;;) {
+    luv_work_t* work;
+    uint64_t start, wait, run;
+
+    while (!pool->head && !pool->stopping)
+      uv_cond_wait(&pool->cond, &pool->mutex);
+    // only warm up jobs are left when stopping, one may be waiting for the
+    // other threads
+    if (!pool->head)
+      break;
+
+    work = pool->head;
+    pool->head = work->next;
+    if (!pool->head)
+      pool->tail = NULL;
+    pool->depth--;
+    pool->running++;
+    uv_mutex_unlock(&pool->mutex);
+
+    start = uv_hrtime();
+    luv_work_run(L, work);
+    run = uv_hrtime() - start;
+    wait = start - work->queued;
+
+    uv_mutex_lock(&pool->mutex);
+    pool->running--;
+    pool->completed++;
+    pool->wait_total += wait;
+    if (wait > pool->wait_max)
+      pool->wait_max = wait;
+    pool->run_total += run;
+    if (run > pool->run_max)
+      pool->run_max = run;
+    work->next = NULL;
+    if (pool->done_tail)
+      pool->done_tail->next = work;
+    else
+      pool->done_head = work;
+    pool->done_tail = work;
+    uv_async_send(&pool->async);
+  }
+  uv_mutex_unlock(&pool->mutex);
+}
+
+static void luv_work_pool_async_cb(uv_async_t* handle) {
+  luv_work_pool_t* pool = (luv_work_pool_t*)handle;
+  luv_work_t* work;
+
+  uv_mutex_lock(&pool->mutex);
+  work = pool->done_head;
+  pool->done_head = pool->done_tail = NULL;
+  uv_mutex_unlock(&pool->mutex);
+
+  // every job holds its ctx which holds the pool, so the pool outlives this loop
+  while (work) {
+    luv_work_t* next = work->next;
+    if (--pool->pending == 0)
+      uv_unref((uv_handle_t*)&pool->async);
+    luv_after_work_cb(&work->work, work->status);
+    work = next;
+  }
+}
+
+static int luv_work_pool_queue(luv_work_pool_t* pool, luv_work_t* work) {
+  work->next = NULL;
+  work->queued = uv_hrtime();
+
+  uv_mutex_lock(&pool->mutex);
+  if (pool->tail)
+    pool->tail->next = work;
+  else
+    pool->head = work;
+  pool->tail = work;
+  pool->depth++;
+  uv_cond_signal(&pool->cond);
+  uv_mutex_unlock(&pool->mutex);
+
+  // the pool keeps the loop alive only while it has jobs
+  if (pool->pending++ == 0)
+    uv_ref((uv_handle_t*)&pool->async);
+  return 0;
+}
+
+// Moves a job that hasn't started yet to the completed jobs, so it is
+// delivered as cancelled. Returns UV_EBUSY if it already started.
+static int luv_work_pool_cancel(luv_work_pool_t* pool, luv_work_t* work) {
+  luv_work_t** link;
+  luv_work_t* prev = NULL;
+  int ret = UV_EBUSY;
+
+  uv_mutex_lock(&pool->mutex);
+  for (link = &pool->head; *link; prev = *link, link = &(*link)->next) {
+    if (*link != work)
+      continue;
+    *link = work->next;
+    if (pool->tail == work)
+      pool->tail = prev;
+    pool->depth--;
+    work->status = UV_ECANCELED;
+    work->next = NULL;
+    if (pool->done_tail)
+      pool->done_tail->next = work;
+    else
+      pool->done_head = work;
+    pool->done_tail = work;
+    uv_async_send(&pool->async);
+    ret = 0;
+    break;
+  }
+  uv_mutex_unlock(&pool->mutex);
+  return ret;
+}
+
+// Joins the threads, which finish the running jobs first. Jobs that haven't
+// started are moved to the completed ones as cancelled, except for warm up
+// jobs that the threads still have to pass through.
+static void luv_work_pool_stop(luv_work_pool_t* pool, unsigned int nthreads) {
+  luv_work_t** link;
+  luv_work_t* prev = NULL;
+  unsigned int i;
+  uv_mutex_lock(&pool->mutex);
+  pool->stopping = 1;
+  link = &pool->head;
+  while (*link) {
+    luv_work_t* work = *link;
+    if (work->warm) {
+      prev = work;
+      link = &work->next;
+      continue;
+    }
+    *link = work->next;
+    pool->depth--;
+    luv_work_metrics_cancel(work->ctx);
+    work->status = UV_ECANCELED;
+    work->next = NULL;
+    if (pool->done_tail)
+      pool->done_tail->next = work;
+    else
+      pool->done_head = work;
+    pool->done_tail = work;
+  }
+  pool->tail = prev;
+  uv_cond_broadcast(&pool->cond);
+  uv_mutex_unlock(&pool->mutex);
+  for (i = 0; i < nthreads; i++)
+    uv_thread_join(&pool->threads[i]);
+}
+
+static void luv_work_pool_free(uv_handle_t* handle) {
+  luv_work_pool_t* pool = (luv_work_pool_t*)handle;
+  uv_mutex_destroy(&pool->mutex);
+  uv_cond_destroy(&pool->cond);
+  free(pool->threads);
+  free(pool->name);
+  free(pool);
+}
+
+// Releases a job that will not be delivered.
+static void luv_work_drop(lua_State* L, luv_work_t* work) {
+  if (work->warm) {
+    // no callback while the state is closing
+    luaL_unref(L, LUA_REGISTRYINDEX, work->warm->cb_ref);
+    work->warm->cb_ref = LUA_NOREF;
+    luv_work_warm_done(work);
+    return;
+  }
+  if (work->batch) {
+    luv_thread_arg_clear(L, &work->args, LUVF_THREAD_SIDE_MAIN);
+    luv_thread_arg_clear(L, &work->rets, LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_MAIN);
+    luv_thread_arg_free(&work->rets);
+    if (--work->batch->remaining == 0)
+      luv_work_batch_free(L, work->batch);
+    return;
+  }
+  if (work->handle)
+    *work->handle = NULL;
+  luaL_unref(L, LUA_REGISTRYINDEX, work->ref);
+  luv_thread_arg_clear(L, &work->args, LUVF_THREAD_SIDE_MAIN);
+  luv_thread_arg_clear(L, &work->rets, LUVF_THREAD_MODE_ASYNC|LUVF_THREAD_SIDE_MAIN);
+  luv_thread_arg_free(&work->args);
+  luv_thread_arg_free(&work->rets);
+  free(work);
+}
+
+static int luv_work_pool_gc(lua_State* L) {
+  luv_work_pool_t** udata = (luv_work_pool_t**)luaL_checkudata(L, 1, "luv_work_pool");
+  luv_work_pool_t* pool = *udata;
+  luv_work_t* work;
+  if (!pool) return 0;
+  *udata = NULL;
+
+  luv_work_pool_stop(pool, pool->nthreads);
+  luv_work_vms_release(&pool->vms);
+  luv_work_vms_unref(pool->init_vms);
+
+  // jobs are only left over when the whole state is closing, they are
+  // dropped without running
+  while ((work = pool->done_head) != NULL) {
+    pool->done_head = work->next;
+    luv_work_drop(L, work);
+  }
+
+  // at loop shutdown the handle may already be closed by loop_gc, leak it
+  // rather than freeing memory that libuv still holds
+  if (!uv_is_closing((uv_handle_t*)&pool->async))
+    uv_close((uv_handle_t*)&pool->async, luv_work_pool_free);
+  return 0;
+}
+
+static int luv_work_pool_tostring(lua_State* L) {
+  luv_work_pool_t* pool = luv_check_work_pool(L, 1);
+  if (pool->name)
+    lua_pushfstring(L, "luv_work_pool_t: %p (%s)", pool, pool->name);
+  else
+    lua_pushfstring(L, "luv_work_pool_t: %p", pool);
+  return 1;
+}
+
+static int luv_new_work_pool(lua_State* L) {
+  luv_ctx_t* ctx = luv_context(L);
+  luv_work_pool_t* pool;
+  luv_work_pool_t** udata;
+  unsigned int nthreads = 4;
+  unsigned int i;
+  int ret;
+
+  pool = (luv_work_pool_t*)calloc(1, sizeof(*pool));
+  if (!pool) return luaL_error(L, "Failed to allocate work pool");
+
+#if LUV_UV_VERSION_GEQ(1, 44, 0)
+  nthreads = uv_available_parallelism();
+  if (nthreads > MAX_THREADPOOL_SIZE)
+    nthreads = MAX_THREADPOOL_SIZE;
+#endif
+  if (!lua_isnoneornil(L, 1)) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    lua_getfield(L, 1, "threads");
+    if (!lua_isnil(L, -1)) {
+      lua_Integer n = lua_tointeger(L, -1);
+      if (n <= 0 || n > MAX_THREADPOOL_SIZE) {
+        free(pool);
+        return luaL_argerror(L, 1, "threads must be between 1 and the maximum threadpool size");
+      }
+      nthreads = (unsigned int)n;
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, 1, "name");
+    if (lua_isstring(L, -1)) {
+      size_t len;
+      const char* name = lua_tolstring(L, -1, &len);
+      pool->name = (char*)malloc(len + 1);
+      if (pool->name)
+        memcpy(pool->name, name, len + 1);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, 1, "priority");
+    if (!lua_isnil(L, -1)) {
+      pool->priority = (int)lua_tointeger(L, -1);
+      pool->has_priority = 1;
+    }
+    lua_pop(L, 1);
+  }
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_cleanup);
+  pool->init_vms = (luv_work_vms_t*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  pool->nthreads = nthreads;
+  pool->threads = (uv_thread_t*)calloc(nthreads, sizeof(uv_thread_t));
+  if (!pool->threads) {
+    free(pool->name);
+    free(pool);
+    return luaL_error(L, "Failed to allocate work pool");
+  }
+  ret = uv_mutex_init(&pool->mutex);
+  if (ret == 0) {
+    ret = uv_cond_init(&pool->cond);
+    if (ret < 0) uv_mutex_destroy(&pool->mutex);
+  }
+  if (ret == 0) {
+    ret = luv_work_vms_init(&pool->vms, nthreads);
+    if (ret < 0) {
+      uv_cond_destroy(&pool->cond);
+      uv_mutex_destroy(&pool->mutex);
+    }
+  }
+  if (ret == 0) {
+    ret = uv_async_init(ctx->loop, &pool->async, luv_work_pool_async_cb);
+    if (ret < 0) {
+      luv_work_vms_release(&pool->vms);
+      uv_cond_destroy(&pool->cond);
+      uv_mutex_destroy(&pool->mutex);
+    }
+  }
+  if (ret < 0) {
+    free(pool->threads);
+    free(pool->name);
+    free(pool);
+    return luv_error(L, ret);
+  }
+  pool->async.data = NULL;
+  uv_unref((uv_handle_t*)&pool->async);
+  uv_mutex_lock(&work_mutex);
+  pool->init_vms->refs++;
+  uv_mutex_unlock(&work_mutex);
+
+  for (i = 0; i < nthreads; i++) {
+    ret = uv_thread_create(&pool->threads[i], luv_work_pool_thread, pool);
+    if (ret < 0) {
+      luv_work_pool_stop(pool, i);
+      luv_work_vms_release(&pool->vms);
+      luv_work_vms_unref(pool->init_vms);
+      uv_close((uv_handle_t*)&pool->async, luv_work_pool_free);
+      return luv_error(L, ret);
+    }
+  }
+
+  udata = (luv_work_pool_t**)lua_newuserdata(L, sizeof(*udata));
+  *udata = pool;
+  luaL_getmetatable(L, "luv_work_pool");
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+static int luv_work_pool_stats(lua_State* L) {
+  luv_work_pool_t* pool = luv_check_work_pool(L, 1);
+  unsigned int depth, running;
+  uint64_t completed, wait_total, wait_max, run_total, run_max;
+
+  uv_mutex_lock(&pool->mutex);
+  depth = pool->depth;
+  running = pool->running;
+  completed = pool->completed;
+  wait_total = pool->wait_total;
+  wait_max = pool->wait_max;
+  run_total = pool->run_total;
+  run_max = pool->run_max;
+  uv_mutex_unlock(&pool->mutex);
+
+  lua_createtable(L, 0, 8);
+  lua_pushinteger(L, pool->nthreads);
+  lua_setfield(L, -2, "threads");
+  lua_pushinteger(L, depth);
+  lua_setfield(L, -2, "queued");
+  lua_pushinteger(L, running);
+  lua_setfield(L, -2, "running");
+  lua_pushinteger(L, completed);
+  lua_setfield(L, -2, "completed");
+  // latencies in milliseconds
+  lua_pushnumber(L, completed ? wait_total / 1e6 / completed : 0);
+  lua_setfield(L, -2, "wait_avg");
+  lua_pushnumber(L, wait_max / 1e6);
+  lua_setfield(L, -2, "wait_max");
+  lua_pushnumber(L, completed ? run_total / 1e6 / completed : 0);
+  lua_setfield(L, -2, "run_avg");
+  lua_pushnumber(L, run_max / 1e6);
+  lua_setfield(L, -2, "run_max");
+  return 1;
+}
+
+static void luv_work_push_hist(lua_State* L, const uint64_t* hist) {
+  int i;
+  lua_createtable(L, LUV_WORK_HIST_BUCKETS, 0);
+  for (i = 0; i < LUV_WORK_HIST_BUCKETS; i++) {
+    lua_pushinteger(L, (lua_Integer)hist[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+}
+
+// Sets the number of states in vms and their heap sizes in the table on top.
+static void luv_work_push_vms(lua_State* L, luv_work_vms_t* vms) {
+  unsigned int i, n;
+  size_t total = 0;
+
+  uv_mutex_lock(&vms->vm_mutex);
+  n = vms->idx_vms;
+  uv_mutex_unlock(&vms->vm_mutex);
+
+  // preallocated, so filling it can't raise an error with the mutex held
+  lua_createtable(L, (int)n, 0);
+  uv_mutex_lock(&vms->vm_mutex);
+  for (i = 0; i < n; i++) {
+    total += vms->heaps[i];
+    lua_pushinteger(L, (lua_Integer)vms->heaps[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  uv_mutex_unlock(&vms->vm_mutex);
+  lua_setfield(L, -2, "heaps");
+  lua_pushinteger(L, n);
+  lua_setfield(L, -2, "vms");
+  lua_pushinteger(L, (lua_Integer)total);
+  lua_setfield(L, -2, "heap");
+}
+
+static int luv_work_metrics(lua_State* L) {
+  luv_work_metrics_t metrics;
+  luv_work_vms_t* vms;
+
+  if (lua_isnoneornil(L, 1)) {
+    uv_mutex_lock(&work_mutex);
+    metrics = work_metrics;
+    uv_mutex_unlock(&work_mutex);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_cleanup);
+    vms = (luv_work_vms_t*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+  }
+  else {
+    luv_work_ctx_t* ctx = luv_check_work_ctx(L, 1);
+    uv_mutex_lock(&work_mutex);
+    metrics = ctx->metrics;
+    uv_mutex_unlock(&work_mutex);
+    vms = ctx->pool ? &ctx->pool->vms : ctx->vms;
+  }
+
+  lua_createtable(L, 0, 12);
+  lua_pushinteger(L, (lua_Integer)metrics.queued);
+  lua_setfield(L, -2, "queued");
+  lua_pushinteger(L, (lua_Integer)metrics.running);
+  lua_setfield(L, -2, "running");
+  lua_pushinteger(L, (lua_Integer)metrics.completed);
+  lua_setfield(L, -2, "completed");
+  lua_pushinteger(L, (lua_Integer)metrics.errors);
+  lua_setfield(L, -2, "errors");
+  lua_pushinteger(L, (lua_Integer)metrics.cancelled);
+  lua_setfield(L, -2, "cancelled");
+  // totals in milliseconds
+  lua_pushnumber(L, metrics.wait_total / 1e6);
+  lua_setfield(L, -2, "wait_total");
+  lua_pushnumber(L, metrics.run_total / 1e6);
+  lua_setfield(L, -2, "run_total");
+  luv_work_push_hist(L, metrics.wait_hist);
+  lua_setfield(L, -2, "wait_hist");
+  luv_work_push_hist(L, metrics.run_hist);
+  lua_setfield(L, -2, "run_hist");
+  luv_work_push_vms(L, vms);
+  return 1;
+}
+
 static int luv_new_work(lua_State* L) {
   size_t len;
   char* code;
   luv_work_ctx_t* ctx;
+  luv_work_pool_t* pool = NULL;
+  luv_work_progress_t* progress = NULL;
+  int has_progress = 0;
 
   luv_thread_dumped(L, 1);
   len = lua_rawlen(L, -1);
@@ -228,8 +1320,61 @@ static int luv_new_work(lua_State* L) {
 
   luaL_checktype(L, 2, LUA_TFUNCTION);
 
+  if (!lua_isnoneornil(L, 3)) {
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_getfield(L, 3, "pool");
+    if (!lua_isnil(L, -1)) {
+      pool = luv_check_work_pool(L, -1);
+      if (pool->async.loop != luv_loop(L)) {
+        free(code);
+        return luaL_argerror(L, 3, "work pool belongs to a different loop");
+      }
+    }
+    lua_pop(L, 1);
+    lua_getfield(L, 3, "on_progress");
+    if (!lua_isnil(L, -1)) {
+      if (!luv_is_callable(L, -1)) {
+        free(code);
+        return luaL_argerror(L, 3, "on_progress must be callable");
+      }
+      has_progress = 1;
+    }
+    lua_pop(L, 1);
+  }
+
+  if (has_progress) {
+    int ret;
+    progress = (luv_work_progress_t*)calloc(1, sizeof(*progress));
+    if (!progress) {
+      free(code);
+      return luaL_error(L, "Failed to allocate work progress");
+    }
+    ret = uv_async_init(luv_loop(L), &progress->async, luv_work_progress_async_cb);
+    if (ret < 0) {
+      free(progress);
+      free(code);
+      return luv_error(L, ret);
+    }
+    uv_mutex_init(&progress->mutex);
+    // the running jobs keep the loop alive
+    uv_unref((uv_handle_t*)&progress->async);
+  }
+
   ctx = (luv_work_ctx_t*)lua_newuserdata(L, sizeof(*ctx));
   memset(ctx, 0, sizeof(*ctx));
+  ctx->pool_ref = LUA_NOREF;
+  ctx->progress_cb = LUA_NOREF;
+  if (pool) {
+    lua_getfield(L, 3, "pool");
+    ctx->pool = pool;
+    ctx->pool_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  if (progress) {
+    progress->ctx = ctx;
+    ctx->progress = progress;
+    lua_getfield(L, 3, "on_progress");
+    ctx->progress_cb = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
 
   lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_cleanup);
   ctx->vms = (luv_work_vms_t*)lua_touserdata(L, -1);
@@ -237,6 +1382,9 @@ static int luv_new_work(lua_State* L) {
 
   ctx->len = len;
   ctx->code = code;
+  uv_mutex_lock(&work_mutex);
+  ctx->id = ++last_ctx_id;
+  uv_mutex_unlock(&work_mutex);
 
   lua_pushvalue(L, 2);
   ctx->after_work_cb = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -251,21 +1399,40 @@ static int luv_new_work(lua_State* L) {
 static int luv_queue_work(lua_State* L) {
   int top = lua_gettop(L);
   luv_work_ctx_t* ctx = luv_check_work_ctx(L, 1);
-  luv_work_t* work = (luv_work_t*)malloc(sizeof(*work));
+  luv_work_t* work;
+  luv_work_t** udata;
   int ret;
 
+  // created first, failing after the job is queued would lose it
+  udata = (luv_work_t**)lua_newuserdata(L, sizeof(*udata));
+  *udata = NULL;
+  luaL_getmetatable(L, "luv_work");
+  lua_setmetatable(L, -2);
+
+  work = (luv_work_t*)malloc(sizeof(*work));
+  if (!work)
+    return luaL_error(L, "Failed to allocate work request");
   memset(work, 0, sizeof(*work));
   ret = luv_thread_arg_set(L, &work->args, 2, top, LUVF_THREAD_SIDE_MAIN); //clear in sub threads,luv_work_cb
   if (ret < 0) {
     luv_thread_arg_clear(L, &work->args, LUVF_THREAD_SIDE_MAIN);
+    luv_thread_arg_free(&work->args);
     free(work);
     return luv_thread_arg_error(L);
   }
   work->ctx = ctx;
   work->work.data = work;
-  ret = uv_queue_work(luv_loop(L), &work->work, luv_work_cb_wrapper, luv_after_work_cb);
+  work->queued = uv_hrtime();
+  // counted first, the job may start before queueing returns
+  luv_work_metrics_queue(ctx, 1);
+  if (ctx->pool)
+    ret = luv_work_pool_queue(ctx->pool, work);
+  else
+    ret = uv_queue_work(luv_loop(L), &work->work, luv_work_cb_wrapper, luv_after_work_cb);
   if (ret < 0) {
+    luv_work_metrics_queue(ctx, -1);
     luv_thread_arg_clear(L, &work->args, LUVF_THREAD_SIDE_MAIN);
+    luv_thread_arg_free(&work->args);
     free(work);
     return luv_error(L, ret);
   }
@@ -274,12 +1441,430 @@ static int luv_queue_work(lua_State* L) {
   lua_pushvalue(L, 1);
   work->ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
+  *udata = work;
+  work->handle = udata;
+  lua_pushvalue(L, top + 1);
+  return 1;
+}
+
+static int luv_work_gc(lua_State* L) {
+  luv_work_t** udata = (luv_work_t**)luaL_checkudata(L, 1, "luv_work");
+  if (*udata)
+    (*udata)->handle = NULL;
+  return 0;
+}
+
+static int luv_work_tostring(lua_State* L) {
+  luv_work_t** udata = (luv_work_t**)luaL_checkudata(L, 1, "luv_work");
+  lua_pushfstring(L, "luv_work_t: %p", udata);
+  return 1;
+}
+
+static int luv_cancel_work(lua_State* L) {
+  luv_work_t** udata = (luv_work_t**)luaL_checkudata(L, 1, "luv_work");
+  luv_work_t* work = *udata;
+  int ret;
+  // already completed, or delivered as cancelled
+  if (!work || work->status == UV_ECANCELED)
+    return luv_error(L, UV_EBUSY);
+  if (work->ctx->pool)
+    ret = luv_work_pool_cancel(work->ctx->pool, work);
+  else
+    ret = uv_cancel((uv_req_t*)&work->work);
+  // cleanup happens when after_work_callback is called with ECANCELED
+  return luv_result(L, ret);
+}
+
+static int luv_set_work_init(lua_State* L) {
+  luv_work_vms_t* vms;
+  char* code = NULL;
+  size_t len = 0;
+
+  if (!lua_isnoneornil(L, 1)) {
+    luv_thread_dumped(L, 1);
+    len = lua_rawlen(L, -1);
+    code = malloc(len);
+    if (!code) return luaL_error(L, "Failed to allocate work init code buffer");
+    memcpy(code, lua_tostring(L, -1), len);
+    lua_pop(L, 1);
+  }
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_cleanup);
+  vms = (luv_work_vms_t*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  uv_mutex_lock(&vms->vm_mutex);
+  free(vms->init_code);
+  vms->init_code = code;
+  vms->init_len = len;
+  vms->init_gen++;
+  uv_mutex_unlock(&vms->vm_mutex);
+  return luv_result(L, 0);
+}
+
+static void luv_work_warm_done(luv_work_t* work) {
+  luv_work_warm_t* warm = work->warm;
+  lua_State* L = warm->L;
+  free(work);
+  if (--warm->remaining > 0)
+    return;
+
+  uv_barrier_destroy(&warm->barrier);
+  if (warm->pool) {
+    warm->pool->warming = 0;
+    luaL_unref(L, LUA_REGISTRYINDEX, warm->pool_ref);
+  }
+  else {
+    uv_mutex_lock(&work_mutex);
+    warming = 0;
+    uv_mutex_unlock(&work_mutex);
+  }
+  if (warm->cb_ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, warm->cb_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, warm->cb_ref);
+    luv_context(L)->cb_pcall(L, 0, 0, 0);
+  }
+  free(warm);
+}
+
+static int luv_warm_work_pool(lua_State* L) {
+  luv_work_pool_t* pool = NULL;
+  luv_work_warm_t* warm;
+  luv_work_t** jobs;
+  unsigned int i, nthreads;
+  int cbidx = 1;
+  int ret;
+
+  if (lua_isuserdata(L, 1)) {
+    pool = luv_check_work_pool(L, 1);
+    cbidx = 2;
+  }
+  if (!lua_isnoneornil(L, cbidx))
+    luv_check_callable(L, cbidx);
+
+  if (pool) {
+    if (pool->warming)
+      return luv_error(L, UV_EBUSY);
+    nthreads = pool->nthreads;
+  }
+  else {
+    uv_mutex_lock(&work_mutex);
+    ret = warming;
+    warming = 1;
+    uv_mutex_unlock(&work_mutex);
+    if (ret)
+      return luv_error(L, UV_EBUSY);
+    nthreads = luv_work_threadpool_size();
+  }
+
+  // every job is allocated up front, once one is queued the others must
+  // follow or the barrier would never open
+  warm = (luv_work_warm_t*)calloc(1, sizeof(*warm));
+  jobs = (luv_work_t**)calloc(nthreads, sizeof(*jobs));
+  ret = warm && jobs ? 0 : UV_ENOMEM;
+  for (i = 0; ret == 0 && i < nthreads; i++) {
+    jobs[i] = (luv_work_t*)calloc(1, sizeof(**jobs));
+    if (!jobs[i])
+      ret = UV_ENOMEM;
+  }
+  if (ret == 0)
+    ret = uv_barrier_init(&warm->barrier, nthreads);
+  if (ret < 0) {
+    for (i = 0; jobs && i < nthreads; i++)
+      free(jobs[i]);
+    free(jobs);
+    free(warm);
+    if (!pool) {
+      uv_mutex_lock(&work_mutex);
+      warming = 0;
+      uv_mutex_unlock(&work_mutex);
+    }
+    return luv_error(L, ret);
+  }
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &luv_work_cleanup);
+  warm->vms = (luv_work_vms_t*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  warm->L = luv_state(L);
+  warm->pool = pool;
+  warm->remaining = nthreads;
+  warm->cb_ref = LUA_NOREF;
+  warm->pool_ref = LUA_NOREF;
+  if (!lua_isnoneornil(L, cbidx)) {
+    lua_pushvalue(L, cbidx);
+    warm->cb_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  if (pool) {
+    pool->warming = 1;
+    lua_pushvalue(L, 1);
+    warm->pool_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    luv_work_t* work = jobs[i];
+    work->warm = warm;
+    work->work.data = work;
+    if (pool)
+      luv_work_pool_queue(pool, work);
+    else
+      uv_queue_work(luv_loop(L), &work->work, luv_work_cb_wrapper, luv_after_work_cb);
+  }
+  free(jobs);
+  return luv_result(L, 0);
+}
+
+static int luv_queue_work_many(lua_State* L) {
+  luv_work_ctx_t* ctx = luv_check_work_ctx(L, 1);
+  luv_work_batch_t* batch;
+  size_t n, i, j;
+  int ret;
+
+  luaL_checktype(L, 2, LUA_TTABLE);
+  n = lua_rawlen(L, 2);
+  luaL_argcheck(L, n > 0, 2, "args_list must not be empty");
+  if (!lua_isnoneornil(L, 3))
+    luv_check_callable(L, 3);
+  if (!lua_isnoneornil(L, 4))
+    luv_check_callable(L, 4);
+
+  batch = (luv_work_batch_t*)malloc(sizeof(*batch));
+  if (!batch) return luaL_error(L, "Failed to allocate work batch");
+  batch->items = (luv_work_t*)calloc(n, sizeof(luv_work_t));
+  if (!batch->items) {
+    free(batch);
+    return luaL_error(L, "Failed to allocate work batch");
+  }
+  batch->L = luv_state(L);
+  batch->remaining = n;
+  batch->ctx_ref = batch->args_ref = batch->results_ref = LUA_NOREF;
+  batch->each_ref = batch->done_ref = LUA_NOREF;
+  batch->aborted = 0;
+
+  // a private copy keeps the borrowed arguments alive even if the caller
+  // changes args_list
+  lua_createtable(L, (int)n, 0);
+  for (i = 0; i < n; i++) {
+    luv_work_t* work = &batch->items[i];
+    int top;
+    lua_rawgeti(L, 2, (lua_Integer)i + 1);
+    top = lua_gettop(L);
+    ret = luv_thread_arg_set(L, &work->args, top, top, LUVF_THREAD_SIDE_MAIN|LUVF_THREAD_MODE_BORROW);
+    if (ret < 0) {
+      // report the position in args_list instead of the argument position
+      lua_pop(L, 1);
+      lua_pushinteger(L, (lua_Integer)i + 1);
+      while (i-- > 0)
+        luv_thread_arg_clear(L, &batch->items[i].args, LUVF_THREAD_SIDE_MAIN);
+      free(batch->items);
+      free(batch);
+      return luv_thread_arg_error(L);
+    }
+    lua_rawseti(L, -2, (lua_Integer)i + 1);
+    work->ctx = ctx;
+    work->ref = LUA_NOREF;
+    work->batch = batch;
+    work->index = (lua_Integer)i + 1;
+    work->work.data = work;
+  }
+  batch->args_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_pushvalue(L, 1);
+  batch->ctx_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  if (!lua_isnoneornil(L, 3)) {
+    lua_pushvalue(L, 3);
+    batch->each_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  if (!lua_isnoneornil(L, 4)) {
+    lua_pushvalue(L, 4);
+    batch->done_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_createtable(L, (int)n, 0);
+    batch->results_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  luv_work_metrics_queue(ctx, (int)n);
+  for (i = 0; i < n; i++) {
+    luv_work_t* work = &batch->items[i];
+    work->queued = uv_hrtime();
+    if (ctx->pool)
+      ret = luv_work_pool_queue(ctx->pool, work);
+    else
+      ret = uv_queue_work(luv_loop(L), &work->work, luv_work_cb_wrapper, luv_after_work_cb);
+    if (ret < 0)
+      break;
+  }
+  if (i < n) {
+    // the whole batch fails: the queued jobs are cancelled if they haven't
+    // started, and release the batch with the last one without any callback
+    batch->aborted = 1;
+    batch->remaining -= n - i;
+    luv_work_metrics_queue(ctx, -(int)(n - i));
+    for (j = i; j < n; j++)
+      luv_thread_arg_clear(L, &batch->items[j].args, LUVF_THREAD_SIDE_MAIN);
+    if (i == 0)
+      luv_work_batch_free(L, batch);
+    for (j = 0; j < i; j++) {
+      if (ctx->pool)
+        luv_work_pool_cancel(ctx->pool, &batch->items[j]);
+      else
+        uv_cancel((uv_req_t*)&batch->items[j].work);
+    }
+    return luv_error(L, ret);
+  }
+
   lua_pushboolean(L, 1);
   return 1;
 }
 
+static int luv_work_noop(lua_State* L) {
+  (void)L;
+  return 0;
+}
+
+// on_done of the chunks of uv.parallel_map and uv.parallel_reduce: merges their
+// results in order, reduces them if there is a reduce function, and calls the
+// callback. Upvalues: callback, reduce function or nil, item count, chunk size
+// and chunk count.
+static int luv_parallel_done(lua_State* L) {
+  lua_Integer n = lua_tointeger(L, lua_upvalueindex(3));
+  lua_Integer chunk = lua_tointeger(L, lua_upvalueindex(4));
+  lua_Integer nchunks = lua_tointeger(L, lua_upvalueindex(5));
+  lua_Integer k, j, pos = 0;
+
+  lua_settop(L, 1);
+  lua_createtable(L, (int)n, 0);
+  for (k = 1; k <= nchunks; k++) {
+    lua_Integer m = n - pos < chunk ? n - pos : chunk;
+    lua_rawgeti(L, 1, k);
+    if (lua_type(L, -1) != LUA_TTABLE) {
+      // the error of the chunk, or nil if its results could not be sent back
+      if (lua_type(L, -1) != LUA_TSTRING) {
+        lua_pop(L, 1);
+        lua_pushfstring(L, "chunk %d of parallel map failed", (int)k);
+      }
+      lua_pushvalue(L, lua_upvalueindex(1));
+      lua_insert(L, -2);
+      lua_call(L, 1, 0);
+      return 0;
+    }
+    for (j = 1; j <= m; j++) {
+      lua_rawgeti(L, -1, j);
+      lua_rawseti(L, 2, ++pos);
+    }
+    lua_pop(L, 1);
+  }
+
+  lua_pushvalue(L, lua_upvalueindex(1));
+  lua_pushnil(L);
+  if (lua_isnil(L, lua_upvalueindex(2))) {
+    lua_pushvalue(L, 2);
+  }
+  else {
+    lua_rawgeti(L, 2, 1);
+    for (j = 2; j <= n; j++) {
+      lua_pushvalue(L, lua_upvalueindex(2));
+      lua_insert(L, -2);
+      lua_rawgeti(L, 2, j);
+      lua_call(L, 2, 1);
+    }
+  }
+  lua_call(L, 2, 0);
+  return 0;
+}
+
+// Splits items into chunks and maps fn over them with queue_many.
+static int luv_parallel_run(lua_State* L, int fn, int reduce, int items, int opts, int cb) {
+  lua_Integer n, chunk, nchunks, k, j;
+  luv_work_ctx_t* ctx;
+  unsigned int threads;
+  int base;
+
+  luaL_checktype(L, items, LUA_TTABLE);
+  n = (lua_Integer)lua_rawlen(L, items);
+  luaL_argcheck(L, n > 0, items, "items must not be empty");
+  if (reduce)
+    luv_check_callable(L, reduce);
+  if (opts)
+    luaL_checktype(L, opts, LUA_TTABLE);
+  luv_check_callable(L, cb);
+
+  lua_pushcfunction(L, luv_new_work);
+  lua_pushvalue(L, fn);
+  lua_pushcfunction(L, luv_work_noop);
+  if (opts)
+    lua_pushvalue(L, opts);
+  else
+    lua_pushnil(L);
+  lua_call(L, 3, 1);
+  ctx = (luv_work_ctx_t*)lua_touserdata(L, -1);
+  ctx->map = 1;
+  base = lua_gettop(L);
+
+  // a few chunks per thread balance uneven items without paying per item
+  threads = ctx->pool ? ctx->pool->nthreads : luv_work_threadpool_size();
+  chunk = (n + threads * 4 - 1) / (threads * 4);
+  if (opts) {
+    lua_getfield(L, opts, "chunk");
+    if (!lua_isnil(L, -1)) {
+      chunk = luaL_checkinteger(L, -1);
+      luaL_argcheck(L, chunk > 0, opts, "chunk must be > 0");
+    }
+    lua_pop(L, 1);
+  }
+  if (chunk < 1)
+    chunk = 1;
+  nchunks = (n + chunk - 1) / chunk;
+
+  lua_createtable(L, (int)nchunks, 0);
+  for (k = 0; k < nchunks; k++) {
+    lua_Integer m = n - k * chunk < chunk ? n - k * chunk : chunk;
+    lua_createtable(L, (int)m, 0);
+    for (j = 1; j <= m; j++) {
+      lua_rawgeti(L, items, k * chunk + j);
+      lua_rawseti(L, -2, j);
+    }
+    lua_rawseti(L, -2, k + 1);
+  }
+
+  lua_pushcfunction(L, luv_queue_work_many);
+  lua_pushvalue(L, base);
+  lua_pushvalue(L, base + 1);
+  lua_pushnil(L);
+  lua_pushvalue(L, cb);
+  if (reduce)
+    lua_pushvalue(L, reduce);
+  else
+    lua_pushnil(L);
+  lua_pushinteger(L, n);
+  lua_pushinteger(L, chunk);
+  lua_pushinteger(L, nchunks);
+  lua_pushcclosure(L, luv_parallel_done, 5);
+  lua_call(L, 4, LUA_MULTRET);
+  return lua_gettop(L) - base - 1;
+}
+
+static int luv_parallel_map(lua_State* L) {
+  // options may be left out
+  int cb = lua_gettop(L) >= 4 ? 4 : 3;
+  return luv_parallel_run(L, 1, 0, 2, cb == 4 ? 3 : 0, cb);
+}
+
+static int luv_parallel_reduce(lua_State* L) {
+  int cb = lua_gettop(L) >= 5 ? 5 : 4;
+  return luv_parallel_run(L, 1, 2, 3, cb == 5 ? 4 : 0, cb);
+}
+
 static const luaL_Reg luv_work_ctx_methods[] = {
   {"queue", luv_queue_work},
+  {"queue_many", luv_queue_work_many},
+  {NULL, NULL}
+};
+
+static const luaL_Reg luv_work_methods[] = {
+  {"cancel", luv_cancel_work},
+  {NULL, NULL}
+};
+
+static const luaL_Reg luv_work_pool_methods[] = {
+  {"stats", luv_work_pool_stats},
+  {"warm", luv_warm_work_pool},
   {NULL, NULL}
 };
 
@@ -293,6 +1878,15 @@ static void luv_key_init_once(void)
       uv_err_name(status), uv_strerror(status));
     abort();
   }
+  status = uv_mutex_init(&work_mutex);
+  if (status != 0)
+  {
+    fprintf(stderr, "*** threadpool not works\n");
+    fprintf(stderr, "Error to uv_mutex_init with %s: %s\n",
+      uv_err_name(status), uv_strerror(status));
+    abort();
+  }
+  threadpool_size = luv_work_threadpool_env();
 }
 
 static void luv_work_init(lua_State* L) {
@@ -305,46 +1899,45 @@ static void luv_work_init(lua_State* L) {
   lua_setfield(L, -2, "__index");
   lua_pop(L, 1);
 
+  luaL_newmetatable(L, "luv_work");
+  lua_pushcfunction(L, luv_work_tostring);
+  lua_setfield(L, -2, "__tostring");
+  lua_pushcfunction(L, luv_work_gc);
+  lua_setfield(L, -2, "__gc");
+  luaL_newlib(L, luv_work_methods);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  luaL_newmetatable(L, "luv_work_pool");
+  lua_pushcfunction(L, luv_work_pool_tostring);
+  lua_setfield(L, -2, "__tostring");
+  lua_pushcfunction(L, luv_work_pool_gc);
+  lua_setfield(L, -2, "__gc");
+  luaL_newlib(L, luv_work_pool_methods);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
   luaL_newmetatable(L, "luv_work_vms");
   lua_pushcfunction(L, luv_work_cleanup);
   lua_setfield(L, -2, "__gc");
   lua_pop(L, 1);
-  
-  /* ref to https://github.com/libuv/libuv/blob/v1.x/src/threadpool.c init_threads */
-  const char* val;
-  unsigned int nvms = 4;
-  val = getenv("UV_THREADPOOL_SIZE");
-  if (val != NULL)
-    nvms = atoi(val);
-  if (nvms == 0)
-    nvms = 1;
-  if (nvms > MAX_THREADPOOL_SIZE)
-    nvms = MAX_THREADPOOL_SIZE;
+
+  uv_once(&once_vmkey, luv_key_init_once);
+  unsigned int nvms = luv_work_threadpool_size();
 
   luv_work_vms_t* vms = (luv_work_vms_t*)lua_newuserdata(L, sizeof(luv_work_vms_t));
-  int status = uv_mutex_init(&vms->vm_mutex);
+  int status = luv_work_vms_init(vms, nvms);
   if (status != 0)
   {
     fprintf(stderr, "*** threadpool not works\n");
-    fprintf(stderr, "Error to uv_mutex_init with %s: %s\n",
+    fprintf(stderr, "Error to initialize thread pool vms with %s: %s\n",
       uv_err_name(status), uv_strerror(status));
     abort();
   }
 
-  vms->vms = (lua_State**)calloc(nvms, sizeof(lua_State*));
-  if (!vms->vms) {
-    fprintf(stderr, "*** threadpool not works\n");
-    fprintf(stderr, "Error to allocate thread pool vm array\n");
-    abort();
-  }
-  vms->nvms = nvms;
-  vms->idx_vms = 0;
-
   luaL_getmetatable(L, "luv_work_vms");
   lua_setmetatable(L, -2);
 
   // store the luv_work_vms_t in registry
   lua_rawsetp(L, LUA_REGISTRYINDEX, &luv_work_cleanup);
-
-  uv_once(&once_vmkey, luv_key_init_once);
 }
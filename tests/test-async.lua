@@ -27,4 +27,48 @@ return require('lib/tap')(function (test)
     assert(elapsed >= 1000, "elapsed should be at least delay ")
   end)
 
+  test("test async_send delivers every message", function(p, p, expect, uv)
+    local received = {}
+    local count = 0
+    local done = expect(function() end)
+    local async
+    async = uv.new_async(function (id, i)
+      received[id] = received[id] or {}
+      -- messages from the same thread arrive in order
+      assert(#received[id] == i - 1)
+      received[id][i] = true
+      count = count + 1
+      if count == 400 then
+        uv.close(async)
+        done()
+      end
+    end)
+    local threads = {}
+    for id = 1, 4 do
+      threads[id] = uv.new_thread(function(asy, id)
+        local uv = require'luv'
+        for i = 1, 100 do
+          assert(uv.async_send(asy, id, i) == 0)
+        end
+      end, async, id)
+    end
+    -- every send happens before the loop wakes up
+    for _, thread in ipairs(threads) do
+      thread:join()
+    end
+  end)
+
+  test("test async batch delivery", function(p, p, expect, uv)
+    local async
+    async = uv.new_async(expect(function (batch)
+      assert(#batch == 3)
+      assert(batch[1].n == 2 and batch[1][1] == 'a' and batch[1][2] == 1)
+      assert(batch[2].n == 0)
+      assert(batch[3].n == 2 and batch[3][1] == nil and batch[3][2] == true)
+      uv.close(async)
+    end), { batch = true })
+    async:send('a', 1)
+    async:send()
+    async:send(nil, true)
+  end)
 end)
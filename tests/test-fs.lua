@@ -577,4 +577,240 @@ return require('lib/tap')(function (test)
       assert(uv.fs_unlink(path))
     end)
   end, "1.36.0")
+
+  test("fs.fallocate and fs.fadvise", function(print, p, expect, uv)
+    local path = "_test_"
+    local fd = assert(uv.fs_open(path, "w+", 438))
+
+    local ok, err, errname = uv.fs_fallocate(fd, 0, 8192)
+    if ok then
+      assert(uv.fs_fstat(fd).size == 8192)
+    else
+      print("fallocate unsupported, got", err)
+      assert(errname == "ENOSYS" or errname == "EOPNOTSUPP" or errname == "ENOTSUP")
+    end
+
+    ok, err, errname = uv.fs_fadvise(fd, 0, 0, "sequential")
+    assert(ok or errname == "ENOSYS", err)
+
+    assert(uv.fs_fadvise(fd, 0, 0, "dontneed", expect(function(err, ok)
+      assert(ok or err:match("^ENOSYS"), err)
+      assert(uv.fs_close(fd))
+      assert(uv.fs_unlink(path))
+    end)))
+  end)
+
+  test("fs.open with direct I/O", function(print, p, expect, uv)
+    if not uv.constants.O_DIRECT then
+      print("O_DIRECT unsupported, skipping")
+      return
+    end
+    local path = "_test_"
+    local fd, err = uv.fs_open(path, "w+d", 438)
+    if not fd then
+      -- tmpfs and some other filesystems reject O_DIRECT
+      print("O_DIRECT rejected, skipping", err)
+      uv.fs_unlink(path)
+      return
+    end
+    local block = string.rep("x", 4096)
+    assert(uv.fs_write(fd, { block, block }, 0) == 8192)
+    local chunk = assert(uv.fs_read(fd, 4096, 4096))
+    assert(chunk == block)
+    assert(uv.fs_close(fd))
+    -- descriptors opened asynchronously get aligned buffers too
+    assert(uv.fs_open(path, "rd", 438, expect(function(err, fd)
+      assert(not err, err)
+      assert(uv.fs_read(fd, 4096, 0) == block)
+      assert(uv.fs_close(fd))
+      assert(uv.fs_unlink(path))
+    end)))
+  end)
+
+  test("fs.copy_range", function(print, p, expect, uv)
+    local src, dst = "_test_", "_test2_"
+    local data = string.rep("0123456789", 1000)
+    local fd = assert(uv.fs_open(src, "w+", 438))
+    assert(uv.fs_write(fd, data) == #data)
+    local out = assert(uv.fs_open(dst, "w+", 438))
+
+    assert(uv.fs_copy_range(fd, out, 0, 100) == 100)
+    assert(uv.fs_read(out, 100, 0) == data:sub(1, 100))
+
+    local reports = 0
+    assert(uv.fs_copy_range(fd, out, 0, #data + 100, {
+      chunk_size = 4096,
+      on_progress = function(copied, total)
+        reports = reports + 1
+        assert(total == #data + 100)
+      end,
+    }, expect(function(err, bytes)
+      assert(not err, err)
+      -- stops at the end of the input
+      assert(bytes == #data)
+      assert(reports >= 3)
+      assert(uv.fs_read(out, #data, 0) == data)
+      assert(uv.fs_close(fd))
+      assert(uv.fs_close(out))
+      assert(uv.fs_unlink(src))
+      assert(uv.fs_unlink(dst))
+    end)))
+  end)
+
+  test("fs.copy_range within one file", function(print, p, expect, uv)
+    -- copy_file_range(2) refuses overlapping ranges in the same file, so
+    -- this goes through the read/write fallback
+    local path = "_test_"
+    local data = string.rep("0123456789", 100)
+    local fd = assert(uv.fs_open(path, "w+", 438))
+    assert(uv.fs_write(fd, data) == #data)
+    assert(uv.fs_copy_range(fd, fd, 0, 500, { out_offset = 250 }) == 500)
+    assert(uv.fs_read(fd, #data, 0) == data:sub(1, 250) .. data:sub(1, 500) .. data:sub(751))
+    assert(uv.fs_close(fd))
+    assert(uv.fs_unlink(path))
+  end)
+
+  test("fs.copy_tree", function(print, p, expect, uv)
+    local src, dst = "_test_tree_", "_test_tree_copy_"
+    local function write(path, data)
+      local fd = assert(uv.fs_open(path, "w", 438))
+      assert(uv.fs_write(fd, data) == #data)
+      assert(uv.fs_close(fd))
+    end
+    assert(uv.fs_mkdir(src, 493))
+    assert(uv.fs_mkdir(src .. "/sub", 493))
+    -- 0770, which a 022 umask would turn into 0750
+    assert(uv.fs_chmod(src .. "/sub", 504))
+    write(src .. "/a", "hello")
+    write(src .. "/sub/b", string.rep("x", 10000))
+
+    local progress = 0
+    assert(uv.fs_copy_tree(src, dst, { concurrency = 2, chunk_size = 4096,
+      on_progress = function(copied, total)
+        assert(total == 10005)
+        progress = copied
+      end,
+    }, expect(function(err, result)
+      assert(not err, err)
+      assert(result.files == 2 and result.bytes == 10005)
+      assert(progress == 10005)
+      local stat = uv.fs_stat(dst .. "/sub")
+      assert(stat.type == "directory")
+      if not isWindows then
+        assert(stat.mode % 512 == 504)
+      end
+      local fd = assert(uv.fs_open(dst .. "/sub/b", "r", 0))
+      assert(uv.fs_read(fd, 20000, 0) == string.rep("x", 10000))
+      assert(uv.fs_close(fd))
+
+      -- a destination inside the source is refused before anything is made
+      assert(uv.fs_copy_tree(src, src .. "/sub/copy", expect(function(err)
+        assert(err and err:match("^EINVAL"), err)
+        assert(not uv.fs_stat(src .. "/sub/copy"))
+        for _, dir in ipairs({ src, dst }) do
+          assert(uv.fs_unlink(dir .. "/sub/b"))
+          assert(uv.fs_rmdir(dir .. "/sub"))
+          assert(uv.fs_unlink(dir .. "/a"))
+          assert(uv.fs_rmdir(dir))
+        end
+      end)))
+    end)))
+  end)
+
+  test("fs_event coalesced batches", function(print, p, expect, uv)
+    local dir = "_test_watch_"
+    assert(uv.fs_mkdir(dir, 493))
+    local watcher = uv.new_fs_event()
+    local onbatch = expect(function(err, batch)
+      assert(not err, err)
+      assert(type(batch) == "table")
+      assert(batch.a and (batch.a.change or batch.a.rename))
+      watcher:close()
+      for _, name in ipairs({ "a", "b" }) do
+        uv.fs_unlink(dir .. "/" .. name)
+      end
+      assert(uv.fs_rmdir(dir))
+    end)
+    assert(watcher:start(dir, { debounce_ms = 50, coalesce = true }, onbatch))
+    for i = 1, 10 do
+      local fd = assert(uv.fs_open(dir .. "/a", "a", 438))
+      assert(uv.fs_write(fd, tostring(i)))
+      assert(uv.fs_close(fd))
+    end
+    local fd = assert(uv.fs_open(dir .. "/b", "w", 438))
+    assert(uv.fs_close(fd))
+  end)
+
+  test("fs_event recursive watch", function(print, p, expect, uv)
+    local dir = "_test_watch_r_"
+    local sub = dir .. "/sub"
+    assert(uv.fs_mkdir(dir, 493))
+    assert(uv.fs_mkdir(sub, 493))
+    local watcher = uv.new_fs_event()
+    local seen = expect(function()
+      watcher:close()
+      uv.fs_unlink(sub .. "/deep/file")
+      assert(uv.fs_rmdir(sub .. "/deep"))
+      assert(uv.fs_rmdir(sub))
+      assert(uv.fs_rmdir(dir))
+    end)
+    local ok = watcher:start(dir, { recursive = true }, function(err, filename)
+      assert(not err, err)
+      assert(not watcher:is_closing())
+      if filename ~= "sub/deep/file" and filename ~= "sub\\deep\\file" then return end
+      seen()
+    end)
+    if not ok then
+      print("recursive fs_event not supported, skipping")
+      watcher:close()
+      assert(uv.fs_rmdir(sub))
+      return assert(uv.fs_rmdir(dir))
+    end
+    assert(watcher:getpath() == dir)
+    assert(watcher:is_active())
+    -- the new directory is watched before the file is created in it
+    assert(uv.fs_mkdir(sub .. "/deep", 493))
+    local timer = uv.new_timer()
+    timer:start(50, 0, function()
+      timer:close()
+      local fd = assert(uv.fs_open(sub .. "/deep/file", "w", 438))
+      assert(uv.fs_close(fd))
+    end)
+  end)
+
+  test("fs_poll_set reports changed paths together", function(print, p, expect, uv)
+    local names = { "_test_poll_a_", "_test_poll_b_", "_test_poll_c_" }
+    local set = assert(uv.new_fs_poll_set(20))
+    for _, name in ipairs(names) do
+      local fd = assert(uv.fs_open(name, "w", 438))
+      assert(uv.fs_close(fd))
+      assert(set:add(name))
+    end
+    assert(not set:add(names[1]))
+    assert(set:remove(names[3]))
+    assert(#set:getpaths() == 2)
+    local timer = uv.new_timer()
+    assert(set:start(expect(function(changes)
+      p(changes)
+      local seen = {}
+      for _, change in ipairs(changes) do
+        assert(change.prev and change.curr)
+        seen[change.path] = true
+      end
+      assert(seen[names[1]] and seen[names[2]])
+      set:close()
+      for _, name in ipairs(names) do
+        assert(uv.fs_unlink(name))
+      end
+    end)))
+    -- change both files once the first round has recorded them
+    timer:start(100, 0, function()
+      timer:close()
+      for i = 1, 2 do
+        local fd = assert(uv.fs_open(names[i], "a", 438))
+        assert(uv.fs_write(fd, "changed"))
+        assert(uv.fs_close(fd))
+      end
+    end)
+  end)
 end)
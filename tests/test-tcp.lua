@@ -353,4 +353,148 @@ return require('lib/tap')(function (test)
       end))
     end))
   end, "1.41.0")
+
+  test("tcp detach and adopt in a loop thread", function (print, p, expect, uv)
+    if uv.os_uname().sysname:find("Windows") then
+      print("skipped, detach is not supported on Windows")
+      return
+    end
+    local thread = uv.new_loop_thread(function()
+      local uv = require('luv')
+      return {
+        serve = function(token)
+          local tcp = uv.new_tcp()
+          assert(tcp:adopt(token) == tcp)
+          -- a token is adopted once
+          local ok, _, name = uv.new_tcp():adopt(token)
+          assert(ok == nil and name == "EBADF")
+          tcp:write("hello from thread", function()
+            tcp:close()
+          end)
+        end,
+      }
+    end)
+
+    local server = uv.new_tcp()
+    assert(server:bind("127.0.0.1", 0))
+    assert(server:listen(128, expect(function (err)
+      assert(not err, err)
+      local conn = uv.new_tcp()
+      assert(server:accept(conn))
+      local token = assert(conn:detach())
+      assert(conn:is_closing())
+      assert(thread:post("serve", token))
+      server:close()
+    end)))
+
+    local client = uv.new_tcp()
+    local chunks = {}
+    assert(client:connect("127.0.0.1", server:getsockname().port, expect(function (err)
+      assert(not err, err)
+      local done = expect(function () end)
+      client:read_start(function (err, data)
+        assert(not err, err)
+        if data then
+          chunks[#chunks + 1] = data
+          return
+        end
+        assert(table.concat(chunks) == "hello from thread")
+        client:close()
+        thread:stop()
+        done()
+      end)
+    end)))
+  end)
+
+  test("tcp listen group spreads connections over loop threads", function (print, p, expect, uv)
+    local group = assert(uv.tcp_listen_group("127.0.0.1", 0, 2, function (index)
+      return function (client)
+        client:write("shard " .. index, function ()
+          client:close()
+        end)
+      end
+    end))
+    local port = group:getsockname().port
+    local pending = 4
+    local done = expect(function () end)
+
+    local function connect()
+      local client = uv.new_tcp()
+      assert(client:connect("127.0.0.1", port, expect(function (err)
+        assert(not err, err)
+        client:read_start(function (err, data)
+          assert(not err, err)
+          if data then
+            assert(data:match("^shard %d$"), data)
+            return
+          end
+          client:close()
+          pending = pending - 1
+          if pending > 0 then return end
+          local metrics = group:metrics()
+          p(metrics)
+          assert(metrics.accepted == 4 and metrics.errors == 0)
+          assert(#metrics.shards == 2)
+          group:stop(1000)
+          done()
+        end)
+      end)))
+    end
+
+    -- the shards start listening in their own threads
+    local timer = uv.new_timer()
+    timer:start(10, 10, function ()
+      local metrics = group:metrics()
+      assert(metrics.running == 2, "a shard failed to start")
+      if metrics.listening < 2 then return end
+      timer:close()
+      for _ = 1, pending do
+        connect()
+      end
+    end)
+  end)
+
+  test("tcp listen group forced stop cuts short a graceful one", function (print, p, expect, uv)
+    local group = assert(uv.tcp_listen_group("127.0.0.1", 0, 1, function ()
+      local idle = {}
+      return function (client)
+        -- an idle keep-alive connection, never closed by the shard
+        idle[#idle + 1] = client
+        client:read_start(function () end)
+      end
+    end))
+    local port = group:getsockname().port
+    local client = uv.new_tcp()
+    local done = expect(function ()
+      client:close()
+    end)
+    local timer = uv.new_timer()
+    local stopped
+    timer:start(10, 10, function ()
+      local metrics = group:metrics()
+      if metrics.listening == 1 and not client:is_active() and metrics.accepted == 0 then
+        client:connect("127.0.0.1", port, function (err)
+          assert(not err, err)
+        end)
+        return
+      end
+      if metrics.accepted == 0 then return end
+      if not stopped then
+        -- waits for the connection however long it stays open
+        group:stop(0)
+        stopped = uv.now()
+        return
+      end
+      if uv.now() - stopped < 50 then
+        assert(metrics.running == 1)
+        return
+      end
+      if metrics.running == 1 then
+        group:threads()[1]:stop()
+        return
+      end
+      timer:close()
+      done()
+    end)
+  end)
 end)
@@ -85,8 +85,9 @@ return require('lib/tap')(function (test)
 
   test("test thread arguments limit", function(print, p, expect, uv)
     local args = {}
-    args[1] = uv.new_async(expect(function (n)
-      assert(n==9)
+    args[1] = uv.new_async(expect(function (n, last)
+      assert(n==10)
+      assert(last==10)
       args[1]:close()
     end))
     for i=2, 10 do
@@ -95,8 +96,8 @@ return require('lib/tap')(function (test)
     local unpack = unpack or table.unpack
     uv.new_thread(function(...)
       local arg = {...}
-      assert(#arg == 9)
-      arg[1]:send(#arg)
+      assert(#arg == 10)
+      arg[1]:send(#arg, arg[10])
     end, unpack(args)):join()
     assert(#args==10)
   end)
@@ -204,4 +205,311 @@ return require('lib/tap')(function (test)
     end, 'hello', 'world')
     thread:detach()
   end, "1.50.0")
+
+  test("channel between threads and the loop", function(print, p, expect, uv)
+    local jobs = uv.new_channel({ capacity = 4 })
+    local results = uv.new_channel()
+
+    -- workers block in recv until the channel is closed and drained
+    local workers = {}
+    for i = 1, 2 do
+      workers[i] = uv.new_thread(function(jobs, results)
+        while true do
+          local n, err, name = jobs:recv()
+          if n == nil then
+            assert(name == "EOF", err)
+            break
+          end
+          assert(results:send(n, n * n))
+        end
+      end, jobs, results)
+    end
+
+    local sum = 0
+    local count = 0
+    local done = expect(function() end)
+    assert(results:recv_start(function(n, square)
+      assert(square == n * n)
+      sum = sum + square
+      count = count + 1
+      if count == 20 then
+        assert(sum == 2870)
+        done()
+      end
+    end))
+    local ok, err, name = results:recv_start(function() end)
+    assert(not ok and name == "EBUSY", err)
+
+    -- send blocks while the workers catch up
+    for n = 1, 20 do
+      assert(jobs:send(n))
+    end
+    jobs:close()
+    local sent, _, errname = jobs:send(21)
+    assert(sent == nil and errname == "EPIPE")
+    for i = 1, 2 do
+      workers[i]:join()
+    end
+    -- the receiver stops by itself once the closed channel is drained
+    results:close()
+  end)
+
+  test("channel try_send", function(print, p, expect, uv)
+    local channel = uv.new_channel({ capacity = 2 })
+    assert(channel:try_send("a", { 1, 2 }) == true)
+    assert(channel:try_send() == true)
+    assert(channel:try_send("c") == false)
+    assert(#channel == 2)
+    assert(not pcall(uv.new_channel, { capacity = math.maxinteger or 2^53 }))
+    local a, t = channel:recv()
+    assert(a == "a" and t[2] == 2)
+    assert(select("#", channel:recv()) == 0)
+    assert(channel:count() == 0)
+  end)
+
+  test("loop thread post and reply", function(print, p, expect, uv)
+    local thread = uv.new_loop_thread(function(base)
+      local count = 0
+      return {
+        count = function()
+          count = count + 1
+        end,
+        total = function()
+          return count
+        end,
+        add = function(a, b)
+          return base + a + b
+        end,
+        fail = function()
+          error("boom")
+        end,
+      }
+    end, nil, 100)
+
+    assert(thread:post("count"))
+    assert(thread:post("count"))
+    assert(thread:post("add", 1, 2, expect(function(err, sum)
+      assert(not err, err)
+      assert(sum == 103)
+    end)))
+    -- posts run in order
+    assert(thread:post("total", expect(function(err, n)
+      assert(not err, err)
+      assert(n == 2)
+    end)))
+    assert(thread:post("fail", expect(function(err)
+      assert(err:find("boom"))
+    end)))
+    assert(thread:post("missing", expect(function(err)
+      assert(err:find("no handler named 'missing'"))
+    end)))
+
+    -- the posts already queued still run
+    thread:stop()
+    local ok, _, name = thread:post("count")
+    assert(ok == nil and name == "EPIPE")
+  end)
+
+  test("loop thread pinned to a cpu", function(print, p, expect, uv)
+    local thread = assert(uv.new_loop_thread(function()
+      return {
+        cpu = function()
+          return require('luv').thread_getcpu()
+        end,
+      }
+    end, { cpu = 1 }))
+    assert(thread:getaffinity()[1] == true)
+    assert(thread:post("cpu", expect(function(err, cpu)
+      assert(not err, err)
+      assert(cpu == 1)
+    end)))
+    thread:stop()
+  end, "1.45.0")
+
+  test("thread vm pool reuses states", function(print, p, expect, uv)
+    assert(uv.thread_vm_pool(2))
+    local before = uv.thread_vm_stats()
+    for _ = 1, 3 do
+      uv.new_thread(function()
+        assert(leaked == nil, "globals are reset between threads")
+        leaked = true
+      end):join()
+    end
+    local stats = uv.thread_vm_stats()
+    p(before, stats)
+    assert(stats.created - before.created == 1)
+    assert(stats.reused - before.reused == 2)
+    assert(stats.idle == 1 and stats.max == 2)
+
+    assert(uv.thread_vm_pool(0))
+    assert(uv.thread_vm_stats().idle == 0)
+  end)
+
+  test("atomic shared between threads", function(print, p, expect, uv)
+    local counter = uv.new_atomic()
+    local threads = {}
+    for i = 1, 4 do
+      threads[i] = uv.new_thread(function(counter)
+        for _ = 1, 1000 do
+          counter:add()
+        end
+        counter:sub(10)
+      end, counter)
+    end
+    for i = 1, 4 do
+      threads[i]:join()
+    end
+    assert(counter:load() == 4 * 990)
+
+    local swapped, found = counter:cas(0, 1)
+    assert(not swapped and found == 4 * 990)
+    assert(counter:cas(found, 7))
+    counter:store(-1)
+    assert(counter:add(2) == 1)
+  end)
+
+  test("shared map between threads", function(print, p, expect, uv)
+    local map = uv.new_shared_map()
+    assert(map:get("missing") == nil)
+    assert(map:version("missing") == 0)
+
+    local ok, v1 = map:set("routes", { "/a", "/b", nested = { on = true } })
+    assert(ok and v1 > 0)
+    local routes, version = map:get("routes")
+    assert(routes[2] == "/b" and routes.nested.on == true and version == v1)
+
+    -- writers in threads, on keys spread over the stripes
+    local threads = {}
+    for i = 1, 4 do
+      threads[i] = uv.new_thread(function(map, i)
+        for j = 1, 100 do
+          assert(map:set("key" .. i .. ":" .. j, j))
+        end
+        -- only one update wins per version
+        while true do
+          local n, version = map:get("total")
+          if map:set("total", (n or 0) + 1, version or 0) then break end
+        end
+      end, map, i)
+    end
+    for i = 1, 4 do
+      threads[i]:join()
+    end
+    assert(#map == 4 * 100 + 2)
+    assert(map:get("total") == 4)
+    assert(map:get("key3:50") == 50)
+
+    local ok2, current = map:set("routes", "stale", v1 - 1)
+    assert(ok2 == false and current == v1)
+    assert(map:set("routes", nil, v1))
+    assert(map:get("routes") == nil)
+
+    local values, versions = map:snapshot()
+    assert(values["key1:1"] == 1 and versions["key1:1"] > 0)
+    local count = 0
+    for key, value, v in map:pairs() do
+      assert(values[key] == value and versions[key] == v)
+      count = count + 1
+    end
+    assert(count == 4 * 100 + 1)
+  end)
+
+  test("locks shared between threads, waited on from the loop", function(print, p, expect, uv)
+    local unlocked = uv.new_atomic()
+    local mutex = uv.new_mutex()
+    assert(mutex:trylock())
+    assert(not mutex:trylock())
+
+    -- the loop waits for the mutex without blocking, it isn't bound to the
+    -- thread that locked it
+    mutex:lock_async(expect(function()
+      assert(unlocked:load() == 1)
+      mutex:unlock()
+    end))
+    local thread = uv.new_thread(function(mutex, unlocked)
+      unlocked:add()
+      mutex:unlock()
+    end, mutex, unlocked)
+    thread:join()
+
+    -- a queued writer holds back the readers after it
+    local rwlock = uv.new_rwlock()
+    assert(rwlock:tryrdlock() and rwlock:tryrdlock())
+    assert(not rwlock:trywrlock())
+    rwlock:wrlock_async(expect(function()
+      assert(not rwlock:tryrdlock())
+      rwlock:wrunlock()
+      assert(rwlock:tryrdlock())
+      rwlock:rdunlock()
+    end))
+    assert(not rwlock:tryrdlock())
+    rwlock:rdunlock()
+    rwlock:rdunlock()
+
+    -- signalled by a thread, the callback runs with the mutex locked again
+    local lock = uv.new_mutex()
+    local cond = uv.new_cond()
+    local signalled = uv.new_atomic()
+    lock:lock()
+    cond:wait_async(lock, expect(function()
+      assert(signalled:load() == 1)
+      lock:unlock()
+    end))
+    thread = uv.new_thread(function(lock, cond, signalled)
+      lock:lock()
+      signalled:add()
+      cond:signal()
+      lock:unlock()
+    end, lock, cond, signalled)
+    thread:join()
+
+    local other = uv.new_mutex()
+    other:lock()
+    assert(cond:wait(other, 10) == false)
+    assert(not other:trylock())
+    other:unlock()
+
+    local serials = uv.new_atomic()
+    local barrier = uv.new_barrier(3)
+    barrier:wait_async(expect(function(serial)
+      assert(serial == false)
+    end))
+    local threads = {}
+    for i = 1, 2 do
+      threads[i] = uv.new_thread(function(barrier, serials)
+        if barrier:wait() then
+          serials:add()
+        end
+      end, barrier, serials)
+    end
+    for i = 1, 2 do
+      threads[i]:join()
+    end
+    assert(serials:load() == 1)
+  end)
+
+  test("thread vm allocator", function(print, p, expect, uv)
+    local previous = uv.thread_vm_alloc(true)
+    local thread = uv.new_thread(function()
+      local uv = require('luv')
+      local stats = uv.thread_vm_alloc_stats()
+      -- LuaJIT may not take a custom allocator
+      if not stats then
+        return
+      end
+      assert(stats.bytes > 0 and stats.peak >= stats.bytes)
+      local t = {}
+      for i = 1, 10000 do
+        t[i] = { i, tostring(i) }
+      end
+      local grown = uv.thread_vm_alloc_stats()
+      assert(grown.bytes > stats.bytes and grown.reserved > 0)
+      t = nil
+      collectgarbage()
+      assert(uv.thread_vm_alloc_stats().bytes < grown.bytes)
+      assert(uv.thread_vm_alloc_stats().peak >= grown.bytes)
+    end)
+    thread:join()
+    uv.thread_vm_alloc(previous)
+  end)
 end)
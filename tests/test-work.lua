@@ -118,17 +118,334 @@ return require('lib/tap')(function (test)
     local after_work_fn = function() end
     local work_ctx = _uv.new_work(work_fn, after_work_fn)
 
-   local ok,msg = pcall(work_ctx.queue, work_ctx, {})
+   local ok,msg = pcall(work_ctx.queue, work_ctx, function() end)
    assert(ok==false)
-   assert(msg=="Error: thread arg not support type 'table' at 1")
+   assert(msg=="Error: thread arg not support type 'function' at 1")
+
+   ok,msg = pcall(work_ctx.queue, work_ctx, 1, { a = { coroutine.create(print) } })
+   assert(ok==false)
+   assert(msg=="Error: thread arg not support type 'thread' at 2")
   end)
 
   test("test threadpool with invalid return value", function(print,p,expect,_uv)
-    local work_fn = function() return {} end
+    local work_fn = function() return function() end end
     local after_work_fn = function() end
     local work_ctx = _uv.new_work(work_fn, after_work_fn)
 
     assert(work_ctx:queue())
     assert(not _uv.run())
   end)
+
+  test("test work pool", function(print,p,expect,_uv)
+    local pool = assert(_uv.new_work_pool({ threads = 2, name = "test-pool" }))
+    local count, done = 20, 0
+    local ctx = _uv.new_work(function(n)
+      -- globals persist because each pool thread keeps its Lua state
+      calls = (calls or 0) + 1
+      return n * 2, calls
+    end, function(r, calls)
+      assert(r % 2 == 0)
+      assert(calls >= 1)
+      done = done + 1
+      if done == count then
+        local stats = pool:stats()
+        p(stats)
+        assert(stats.threads == 2)
+        assert(stats.completed == count)
+        assert(stats.queued == 0)
+      end
+    end, { pool = pool })
+    for i = 1, count do
+      assert(ctx:queue(i))
+    end
+  end)
+
+  test("test work init and warm up", function(print,p,expect,_uv)
+    assert(_uv.set_work_init(function()
+      init_count = (init_count or 0) + 1
+      lookup = { answer = 42 }
+    end))
+    local pool = assert(_uv.new_work_pool({ threads = 2 }))
+    local ctx = _uv.new_work(function()
+      return lookup and lookup.answer, init_count
+    end, expect(function(answer, count)
+      assert(answer == 42)
+      -- the init function ran once in this state
+      assert(count == 1)
+      assert(_uv.set_work_init(nil))
+    end), { pool = pool })
+    assert(pool:warm(expect(function()
+      assert(ctx:queue())
+    end)))
+    assert(not pool:warm())
+  end)
+
+  test("test threadpool compiles large functions once per state", function(print,p,expect,_uv)
+    -- Compiled work functions are cached per worker state by ctx, so a 50 KB
+    -- function is loaded once by each thread rather than once per job. The
+    -- function reports whether its state already ran this very closure.
+    local big = string.dump(load("local s = '" .. string.rep("x", 50 * 1024) .. "' " .. [[
+      local fn = debug.getinfo(1, "f").func
+      local seen = _G.big_fn == fn
+      _G.big_fn = fn
+      return seen, #s
+    ]]))
+    local jobs, done, loads = 200, 0, 0
+    local threads = tonumber(os.getenv("UV_THREADPOOL_SIZE")) or 4
+    local finish = expect(function()
+      p{jobs = jobs, loads = loads}
+      assert(loads <= threads)
+    end)
+    local ctx
+    ctx = _uv.new_work(big, function(seen, len)
+      assert(len == 50 * 1024)
+      if not seen then loads = loads + 1 end
+      done = done + 1
+      if done < jobs then
+        return ctx:queue()
+      end
+      finish()
+    end)
+    ctx:queue()
+  end)
+
+  test("test threadpool queue_many", function(print,p,expect,_uv)
+    local ctx = _uv.new_work(function(s)
+      return #s, s
+    end, function()
+      error("after_work_callback is not used by queue_many")
+    end)
+    local args, seen = {}, 0
+    for i = 1, 100 do
+      args[i] = string.rep("x", i)
+    end
+    assert(ctx:queue_many(args, function(i, len, s)
+      assert(len == i and s == string.rep("x", i))
+      seen = seen + 1
+    end, expect(function(results)
+      assert(seen == 100)
+      for i = 1, 100 do
+        assert(results[i] == i)
+      end
+    end)))
+    -- the arguments were copied when queued
+    args[1] = nil
+
+    local ok, msg = pcall(ctx.queue_many, ctx, { 1, function() end })
+    assert(not ok)
+    assert(msg == "Error: thread arg not support type 'function' at 2")
+  end)
+
+  test("test threadpool with table arguments", function(print,p,expect,_uv)
+    local ctx = _uv.new_work(function(t, list, ...)
+      assert(t.self == t and t.nested.parent == t)
+      -- each argument is copied on its own
+      assert(t.nested.list ~= list and t.nested.list[2] == list[2])
+      assert(#list == 3 and list[2] == "two" and list[3] == 3.5)
+      assert(t[true] == false and t[1.5] == "x")
+      return t, select("#", ...), select(20, ...)
+    end, expect(function(t, n, last)
+      assert(t.self == t and t.nested.parent == t)
+      assert(t.nested.list[1] == 1)
+      assert(n == 20 and last == 20)
+    end))
+    local list = { 1, "two", 3.5 }
+    local t = { [true] = false, [1.5] = "x", nested = { list = list } }
+    t.self = t
+    t.nested.parent = t
+    local extra = {}
+    for i = 1, 20 do extra[i] = i end
+    assert(ctx:queue(t, list, (table.unpack or unpack)(extra)))
+
+    -- a table that can't be copied raises without queueing anything
+    local deep = {}
+    for _ = 1, 200 do deep = { deep } end
+    local ok, msg = pcall(ctx.queue, ctx, "x", deep)
+    assert(not ok and msg:find("failed to copy thread arg at 2: tables nested too deep", 1, true), msg)
+    ok, msg = pcall(ctx.queue_many, ctx, { { 1 }, deep })
+    assert(not ok and msg:find("failed to copy thread arg at 2: tables nested too deep", 1, true), msg)
+  end)
+
+  test("test threadpool with shared buffers", function(print,p,expect,_uv)
+    local buf = _uv.new_shared_buffer(8)
+    assert(#buf == 8 and buf:read() == string.rep("\0", 8))
+    local ctx = _uv.new_work(function(b, slice)
+      -- the worker writes to the same memory, not to a copy
+      slice:write("abcd")
+      b:write("!", 7)
+      return slice
+    end, expect(function(slice)
+      assert(buf:read() == "\0\0abcd\0!")
+      assert(slice:size() == 4 and slice:read(1, 2) == "bc")
+
+      -- slices are written out without copying them to a string first
+      local path = "shared_buffer.tmp"
+      local fd = assert(_uv.fs_open(path, "w", 438))
+      assert(_uv.fs_write(fd, { slice, "!" }) == 5)
+      assert(_uv.fs_close(fd))
+      fd = assert(_uv.fs_open(path, "r", 438))
+      assert(_uv.fs_read(fd, 16) == "abcd!")
+      assert(_uv.fs_close(fd))
+      assert(_uv.fs_unlink(path))
+    end))
+    assert(ctx:queue(buf, buf:slice(2, 4)))
+
+    local ok = pcall(buf.write, buf, "too long", 4)
+    assert(not ok)
+  end)
+
+  test("test reading into shared buffers", function(print,p,expect,_uv)
+    local buf = _uv.new_shared_buffer(8)
+    local path = "shared_buffer_read.tmp"
+    local fd = assert(_uv.fs_open(path, "w+", 438))
+    assert(_uv.fs_write(fd, "hello world", 0) == 11)
+    -- a read fills the slice in place and returns the byte count
+    assert(_uv.fs_read(fd, buf:slice(2, 4), 6) == 4)
+    assert(buf:read() == "\0\0worl\0\0")
+    assert(_uv.fs_read(fd, buf:slice(4), 0, expect(function(err, n)
+      assert(not err, err)
+      assert(n == 4 and buf:read() == "\0\0wohell")
+      assert(_uv.fs_close(fd))
+      assert(_uv.fs_unlink(path))
+    end)))
+
+    local fds = assert(_uv.pipe())
+    local reader = assert(_uv.new_pipe())
+    local writer = assert(_uv.new_pipe())
+    assert(reader:open(fds.read))
+    assert(writer:open(fds.write))
+    local target = _uv.new_shared_buffer(4)
+    local got = {}
+    assert(reader:read_start(function(err, n)
+      assert(not err, err)
+      if n then
+        -- the data is only valid until the next read
+        got[#got + 1] = target:read(0, n)
+        return
+      end
+      assert(table.concat(got) == "abcdefghij")
+      reader:close()
+    end, target))
+    writer:write("abcdefghij", expect(function()
+      writer:close()
+    end))
+  end)
+
+  test("test threadpool cancel", function(print,p,expect,_uv)
+    local pool = assert(_uv.new_work_pool({ threads = 1 }))
+    local busy, req
+    local ctx = _uv.new_work(function(ms)
+      require('luv').sleep(ms)
+      return ms
+    end, expect(function(ms, err, name)
+      if ms then
+        -- completed requests can't be cancelled anymore
+        local ok, _, ename = busy:cancel()
+        assert(not ok and ename == "EBUSY")
+      else
+        assert(err:match("^ECANCELED") and name == "ECANCELED")
+      end
+    end, 2), { pool = pool })
+
+    -- the single thread is busy, so the second request is still queued
+    busy = assert(ctx:queue(100))
+    req = assert(ctx:queue(0, "args", { "are", "released" }))
+    assert(_uv.cancel(req))
+    local ok, _, name = req:cancel()
+    assert(not ok and name == "EBUSY")
+  end)
+
+  test("test threadpool progress", function(print,p,expect,_uv)
+    local seen = {}
+    local ctx = _uv.new_work(function(n)
+      local uv = require('luv')
+      for i = 1, n do
+        uv.work_report(i, { step = i })
+      end
+      return n
+    end, expect(function(n)
+      -- every report arrived in order, before the result
+      assert(#seen == n)
+      for i = 1, n do
+        assert(seen[i] == i)
+      end
+    end), { on_progress = function(i, t)
+      assert(t.step == i)
+      seen[#seen + 1] = i
+    end })
+    assert(ctx:queue(100))
+
+    -- only work callbacks can report
+    assert(not pcall(_uv.work_report, 1))
+  end)
+
+  test("test threadpool metrics", function(print,p,expect,_uv)
+    local before = _uv.work_metrics()
+    local calls = 0
+    local ctx
+    ctx = _uv.new_work(function(fail)
+      if fail then
+        error("failing on purpose")
+      end
+      return true
+    end, expect(function()
+      calls = calls + 1
+      if calls < 3 then return end
+      local m = _uv.work_metrics(ctx)
+      p(m)
+      assert(m.queued == 0 and m.running == 0)
+      assert(m.completed == 2 and m.errors == 1)
+      local waits, runs = 0, 0
+      for i = 1, #m.wait_hist do
+        waits = waits + m.wait_hist[i]
+        runs = runs + m.run_hist[i]
+      end
+      assert(waits == 3 and runs == 3)
+      assert(m.vms >= 1 and #m.heaps == m.vms and m.heap > 0)
+
+      local all = _uv.work_metrics()
+      assert(all.completed >= before.completed + 2)
+      assert(all.errors >= before.errors + 1)
+    end, 3))
+    assert(ctx:queue(false))
+    assert(ctx:queue(false))
+    assert(ctx:queue(true))
+  end)
+
+  test("test parallel map and reduce", function(print,p,expect,_uv)
+    local items = {}
+    for i = 1, 1000 do
+      items[i] = i
+    end
+    assert(_uv.parallel_map(function(x)
+      return x * x
+    end, items, { chunk = 64 }, expect(function(err, squares)
+      assert(not err, err)
+      assert(#squares == 1000)
+      for i = 1, 1000 do
+        assert(squares[i] == i * i)
+      end
+    end)))
+
+    assert(_uv.parallel_reduce(function(x)
+      return x * 2
+    end, function(a, b)
+      return a + b
+    end, items, expect(function(err, sum)
+      assert(not err, err)
+      assert(sum == 1000 * 1001)
+    end)))
+
+    -- the failing chunk counts as an error, not as a completed job
+    local errors = _uv.work_metrics().errors
+    assert(_uv.parallel_map(function(x)
+      if x == 500 then
+        error("bad item")
+      end
+      return x
+    end, items, expect(function(err, results)
+      assert(err:find("bad item") and results == nil)
+      assert(_uv.work_metrics().errors == errors + 1)
+    end)))
+  end)
 end)